@@ -13,6 +13,9 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/secondary_cache.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/write_batch.h"
 #include "port/port.h"
 #include "util/crc32c.h"
@@ -102,6 +105,24 @@ static int FLAGS_block_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// If true, use NewClockCache() instead of NewLRUCache() for --cache_size.
+static bool FLAGS_clock_cache = false;
+
+// If true, readrandom reads values into a PinnableSlice instead of a
+// std::string.
+static bool FLAGS_pin_values = false;
+
+// Number of bytes to use as a cache of compressed blocks, or negative for
+// none.
+static int FLAGS_compressed_cache_size = -1;
+
+// Number of bytes to use as a secondary block cache, or negative for none.
+static int FLAGS_secondary_cache_size = -1;
+
+// If set, keep the secondary block cache in files in this directory
+// instead of in memory.
+static const char* FLAGS_secondary_cache_dir = nullptr;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -109,9 +130,31 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = -1;
 
+// If true, use NewBlockedBloomFilterPolicy() for --bloom_bits.
+static bool FLAGS_blocked_bloom = false;
+
+// If true, use NewXorFilterPolicy() for --bloom_bits.
+static bool FLAGS_xor_filter = false;
+
+// If true, build one filter per table instead of one per 2KB of data.
+static bool FLAGS_full_filter = false;
+
+// If true, partition the index and filter blocks of new tables.
+static bool FLAGS_partition_index_and_filters = false;
+
+// If true, hold index and filter blocks in the block cache.
+static bool FLAGS_cache_index_and_filter_blocks = false;
+
+// If true, append a hash index to data blocks of new tables.
+static bool FLAGS_data_block_hash_index = false;
+
 // Common key prefix length.
 static int FLAGS_key_prefix = 0;
 
+// Length of the key prefixes recorded in filters, or zero for none.
+// seekrandom only yields keys with the prefix of its target if set.
+static int FLAGS_prefix_size = 0;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -123,6 +166,44 @@ static bool FLAGS_reuse_logs = false;
 // If true, use compression.
 static bool FLAGS_compression = true;
 
+// If true, overlap memtable inserts of one write group with logging of the
+// next one.
+static bool FLAGS_enable_pipelined_write = false;
+
+// If true, let every writer of a write group insert its own batch into the
+// memtable in parallel.
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
+// Maximum number of compactions to run at the same time.
+static int FLAGS_max_background_compactions = 1;
+
+// Maximum number of threads a single compaction may be split into.
+static int FLAGS_max_subcompactions = 1;
+
+// If true, derive the level size targets from the size of the largest level.
+static bool FLAGS_level_compaction_dynamic_level_bytes = false;
+
+// Number of levels in the database.
+static int FLAGS_num_levels = leveldb::Options().num_levels;
+
+// Number of level-0 files at which compactions, write slowdowns and write
+// stops are triggered.
+static int FLAGS_level0_file_num_compaction_trigger =
+    leveldb::Options().level0_file_num_compaction_trigger;
+static int FLAGS_level0_slowdown_writes_trigger =
+    leveldb::Options().level0_slowdown_writes_trigger;
+static int FLAGS_level0_stop_writes_trigger =
+    leveldb::Options().level0_stop_writes_trigger;
+
+// Bytes per second that writes are throttled to while compactions are
+// falling behind.
+static int FLAGS_delayed_write_rate =
+    static_cast<int>(leveldb::Options().delayed_write_rate);
+
+// Bytes per second that flushes and compactions may write, or zero for no
+// limit.
+static int FLAGS_rate_limiter_bytes_per_sec = 0;
+
 // Use the db with the following name.
 static const char* FLAGS_db = nullptr;
 
@@ -428,7 +509,11 @@ void Uncompress(
 class Benchmark {
  private:
   Cache* cache_;
+  Cache* compressed_cache_;
+  SecondaryCache* secondary_cache_;
   const FilterPolicy* filter_policy_;
+  const SliceTransform* prefix_extractor_;
+  RateLimiter* rate_limiter_;
   DB* db_;
   int num_;
   int value_size_;
@@ -519,10 +604,25 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
-        filter_policy_(FLAGS_bloom_bits >= 0
-                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                           : nullptr),
+      : cache_(FLAGS_cache_size < 0 ? nullptr
+               : FLAGS_clock_cache   ? NewClockCache(FLAGS_cache_size)
+                                     : NewLRUCache(FLAGS_cache_size)),
+        compressed_cache_(FLAGS_compressed_cache_size >= 0
+                              ? NewLRUCache(FLAGS_compressed_cache_size)
+                              : nullptr),
+        secondary_cache_(nullptr),
+        filter_policy_(FLAGS_bloom_bits < 0 ? nullptr
+                       : FLAGS_xor_filter ? NewXorFilterPolicy(FLAGS_bloom_bits)
+                       : FLAGS_blocked_bloom
+                           ? NewBlockedBloomFilterPolicy(FLAGS_bloom_bits)
+                           : NewBloomFilterPolicy(FLAGS_bloom_bits)),
+        prefix_extractor_(FLAGS_prefix_size > 0
+                              ? NewFixedPrefixTransform(FLAGS_prefix_size)
+                              : nullptr),
+        rate_limiter_(FLAGS_rate_limiter_bytes_per_sec > 0
+                          ? NewGenericRateLimiter(
+                                FLAGS_rate_limiter_bytes_per_sec)
+                          : nullptr),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
@@ -541,12 +641,29 @@ class Benchmark {
     if (!FLAGS_use_existing_db) {
       DestroyDB(FLAGS_db, Options());
     }
+    if (FLAGS_secondary_cache_size >= 0 &&
+        FLAGS_secondary_cache_dir == nullptr) {
+      secondary_cache_ = NewMemorySecondaryCache(FLAGS_secondary_cache_size);
+    } else if (FLAGS_secondary_cache_size >= 0) {
+      Status s = NewFileSecondaryCache(g_env, FLAGS_secondary_cache_dir,
+                                       FLAGS_secondary_cache_size,
+                                       &secondary_cache_);
+      if (!s.ok()) {
+        std::fprintf(stderr, "secondary cache error: %s\n",
+                     s.ToString().c_str());
+        std::exit(1);
+      }
+    }
   }
 
   ~Benchmark() {
     delete db_;
     delete cache_;
+    delete compressed_cache_;
+    delete secondary_cache_;
     delete filter_policy_;
+    delete prefix_extractor_;
+    delete rate_limiter_;
   }
 
   void Run() {
@@ -805,6 +922,8 @@ class Benchmark {
     options.env = g_env;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.block_cache_compressed = compressed_cache_;
+    options.secondary_cache = secondary_cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
     options.block_size = FLAGS_block_size;
@@ -813,7 +932,28 @@ class Benchmark {
     }
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
+    options.full_filter = FLAGS_full_filter;
+    options.partition_index_and_filters = FLAGS_partition_index_and_filters;
+    options.cache_index_and_filter_blocks =
+        FLAGS_cache_index_and_filter_blocks;
+    options.data_block_hash_index = FLAGS_data_block_hash_index;
+    options.prefix_extractor = prefix_extractor_;
+    options.rate_limiter = rate_limiter_;
     options.reuse_logs = FLAGS_reuse_logs;
+    options.enable_pipelined_write = FLAGS_enable_pipelined_write;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.max_subcompactions = FLAGS_max_subcompactions;
+    options.level_compaction_dynamic_level_bytes =
+        FLAGS_level_compaction_dynamic_level_bytes;
+    options.num_levels = FLAGS_num_levels;
+    options.level0_file_num_compaction_trigger =
+        FLAGS_level0_file_num_compaction_trigger;
+    options.level0_slowdown_writes_trigger =
+        FLAGS_level0_slowdown_writes_trigger;
+    options.level0_stop_writes_trigger = FLAGS_level0_stop_writes_trigger;
+    options.delayed_write_rate = FLAGS_delayed_write_rate;
     options.compression =
         FLAGS_compression ? kSnappyCompression : kNoCompression;
     Status s = DB::Open(options, FLAGS_db, &db_);
@@ -894,12 +1034,15 @@ class Benchmark {
   void ReadRandom(ThreadState* thread) {
     ReadOptions options;
     std::string value;
+    PinnableSlice pinned;
     int found = 0;
     KeyBuffer key;
     for (int i = 0; i < reads_; i++) {
       const int k = thread->rand.Uniform(FLAGS_num);
       key.Set(k);
-      if (db_->Get(options, key.slice(), &value).ok()) {
+      Status s = FLAGS_pin_values ? db_->Get(options, key.slice(), &pinned)
+                                  : db_->Get(options, key.slice(), &value);
+      if (s.ok()) {
         found++;
       }
       thread->stats.FinishedSingleOp();
@@ -937,6 +1080,7 @@ class Benchmark {
 
   void SeekRandom(ThreadState* thread) {
     ReadOptions options;
+    options.prefix_same_as_start = (prefix_extractor_ != nullptr);
     int found = 0;
     KeyBuffer key;
     for (int i = 0; i < reads_; i++) {
@@ -1093,6 +1237,39 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--compression=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_compression = n;
+    } else if (sscanf(argv[i], "--enable_pipelined_write=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_enable_pipelined_write = n;
+    } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_max_background_compactions = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
+    } else if (sscanf(argv[i], "--level_compaction_dynamic_level_bytes=%d%c",
+                      &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_level_compaction_dynamic_level_bytes = n;
+    } else if (sscanf(argv[i], "--num_levels=%d%c", &n, &junk) == 1) {
+      FLAGS_num_levels = n;
+    } else if (sscanf(argv[i], "--level0_file_num_compaction_trigger=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_level0_file_num_compaction_trigger = n;
+    } else if (sscanf(argv[i], "--level0_slowdown_writes_trigger=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_level0_slowdown_writes_trigger = n;
+    } else if (sscanf(argv[i], "--level0_stop_writes_trigger=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_level0_stop_writes_trigger = n;
+    } else if (sscanf(argv[i], "--delayed_write_rate=%d%c", &n, &junk) == 1) {
+      FLAGS_delayed_write_rate = n;
+    } else if (sscanf(argv[i], "--rate_limiter_bytes_per_sec=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_rate_limiter_bytes_per_sec = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -1111,8 +1288,45 @@ int main(int argc, char** argv) {
       FLAGS_key_prefix = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--clock_cache=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_clock_cache = n;
+    } else if (sscanf(argv[i], "--pin_values=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_pin_values = n;
+    } else if (sscanf(argv[i], "--compressed_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_compressed_cache_size = n;
+    } else if (sscanf(argv[i], "--secondary_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_secondary_cache_size = n;
+    } else if (strncmp(argv[i], "--secondary_cache_dir=", 22) == 0) {
+      FLAGS_secondary_cache_dir = argv[i] + 22;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (sscanf(argv[i], "--blocked_bloom=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_blocked_bloom = n;
+    } else if (sscanf(argv[i], "--xor_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_xor_filter = n;
+    } else if (sscanf(argv[i], "--full_filter=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_full_filter = n;
+    } else if (sscanf(argv[i], "--partition_index_and_filters=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_partition_index_and_filters = n;
+    } else if (sscanf(argv[i], "--cache_index_and_filter_blocks=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_cache_index_and_filter_blocks = n;
+    } else if (sscanf(argv[i], "--data_block_hash_index=%d%c", &n, &junk) ==
+                   1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_data_block_hash_index = n;
+    } else if (sscanf(argv[i], "--prefix_size=%d%c", &n, &junk) == 1) {
+      FLAGS_prefix_size = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
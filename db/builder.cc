@@ -6,11 +6,13 @@
 
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
+#include "util/rate_limiter.h"
 
 namespace leveldb {
 /**
@@ -21,26 +23,37 @@ namespace leveldb {
  * option: 表示一些配置选项
  * table_cache: 配置缓存
  * iter: 一些迭代器
+ * range_del_iter: 范围删除的迭代器, 可以为空
  * meta: 元数据信息 
  * 
  */
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta) {
   Status s;
   meta->file_size = 0;
+  meta->has_range_tombstones = false;
   iter->SeekToFirst();
+  if (range_del_iter != nullptr) {
+    range_del_iter->SeekToFirst();
+  }
 
 /**
  * 返回一个表名称对象
  */
   std::string fname = TableFileName(dbname, meta->number);
   
-  if (iter->Valid()) {
+  if (iter->Valid() ||
+      (range_del_iter != nullptr && range_del_iter->Valid())) {
     WritableFile* file;
     s = env->NewWritableFile(fname, &file);
     if (!s.ok()) {
       return s;
     }
+    if (options.rate_limiter != nullptr) {
+      file = NewRateLimitedWritableFile(file, options.rate_limiter,
+                                        RateLimiter::kHighPriority);
+    }
     /**
      * 创建一个表构建的类
      * 1.
@@ -49,7 +62,10 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
     /**
      * 输入 iter->key, 对这个数值进行编码 存入 smallest中
      */
-    meta->smallest.DecodeFrom(iter->key());
+    const bool empty = !iter->Valid();
+    if (!empty) {
+      meta->smallest.DecodeFrom(iter->key());
+    }
     Slice key;
     for (; iter->Valid(); iter->Next()) {
       key = iter->key();
@@ -59,6 +75,21 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
       meta->largest.DecodeFrom(key);
     }
 
+    // The range tombstones widen the key range of the table.
+    if (range_del_iter != nullptr) {
+      const InternalKeyComparator* icmp =
+          static_cast<const InternalKeyComparator*>(options.comparator);
+      for (; range_del_iter->Valid(); range_del_iter->Next()) {
+        builder->AddRangeTombstone(range_del_iter->key(),
+                                   range_del_iter->value());
+        ExtendRangeForTombstone(*icmp, range_del_iter->key(),
+                                range_del_iter->value(),
+                                empty && !meta->has_range_tombstones,
+                                &meta->smallest, &meta->largest);
+        meta->has_range_tombstones = true;
+      }
+    }
+
     s = builder->Finish();// 判断表是不是正常结束
     if (s.ok()) {
       meta->file_size = builder->FileSize();
@@ -90,6 +121,9 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
   if (!iter->status().ok()) {
     s = iter->status();
   }
+  if (range_del_iter != nullptr && !range_del_iter->status().ok()) {
+    s = range_del_iter->status();
+  }
 
   // 如果状态正常且文件大小大于 0，保留文件
   if (s.ok() && meta->file_size > 0) {
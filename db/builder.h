@@ -27,8 +27,13 @@ class VersionEdit;
 // 成功时，meta的其余部分将填充生成的表的元数据。
 // 如果*iter中没有数据，meta->file_size将被设置为零，并且不会生成表文件。
 // 通过 Status 来判断 这个建表的操作
+//
+// If range_del_iter is non-null, the range tombstones it yields (see
+// db/range_tombstone.h) are stored in the table too, and the table is
+// built even if *iter is empty.
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta);
+                  TableCache* table_cache, Iterator* iter,
+                  Iterator* range_del_iter, FileMetaData* meta);
 
 }  // namespace leveldb
 
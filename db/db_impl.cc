@@ -8,8 +8,10 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <memory>
 #include <set>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "db/builder.h"
@@ -19,11 +21,16 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_context.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
+#include "db/ttl.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/merge_operator.h"
 #include "leveldb/status.h"
 #include "leveldb/table.h"
 #include "leveldb/table_builder.h"
@@ -34,31 +41,59 @@
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
+#include "util/rate_limiter.h"
 
 namespace leveldb {
 
 // 非表缓存文件的数量
 const int kNumNonTableCacheFiles = 10;
 
+// Longest sleep of a delayed write between checks for errors and shutdown
+const uint64_t kMaxDelaySliceMicros = 100000;
+
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   //explicit: 用来防止隐式转换s
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        done(false),
+        memtable(nullptr),
+        leader(nullptr),
+        pending_inserts(0),
+        cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+
+  // Set by the leader of this writer's group when the writer should apply
+  // its own batch to *memtable.  See ParallelInsertIntoMemTable().
+  MemTable* memtable;
+  Writer* leader;
+  int pending_inserts;  // Leader only: followers that are still inserting
+
   port::CondVar cv;
 };
 
+// A group of writes whose log record has been written and that is waiting
+// for its turn to be applied to the memtable.  Used by pipelined writes.
+struct DBImpl::MemTableWriteGroup {
+  Status status;
+  WriteBatch* batch;
+  WriteBatch merged;               // Combined batch, if the group needs one
+  SequenceNumber last_sequence;    // Last sequence number used by the group
+  std::vector<Writer*> followers;  // Writers to wake up once applied
+};
+
 struct DBImpl::CompactionState {
   // Files produced by compaction
   struct Output {
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    bool has_range_tombstones;
   };
 
   Output* current_output() { return &outputs[outputs.size() - 1]; }
@@ -66,6 +101,10 @@ struct DBImpl::CompactionState {
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(0),
+        newest_snapshot(0),
+        range_tombstones(nullptr),
+        next_fragment(0),
+        has_tombstone_lower(false),
         outfile(nullptr),
         builder(nullptr),
         total_bytes(0) {}
@@ -78,6 +117,19 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Entries with larger sequence numbers are not visible to any snapshot,
+  // so the compaction filter may change them.  Zero if there are no
+  // snapshots.
+  SequenceNumber newest_snapshot;
+
+  // Range tombstones of the input files, or null if they have none.  Not
+  // owned.  The parts of the fragments before next_fragment, and before
+  // tombstone_lower if has_tombstone_lower, have been written already.
+  const RangeTombstoneList* range_tombstones;
+  size_t next_fragment;
+  bool has_tombstone_lower;
+  std::string tombstone_lower;
+
   std::vector<Output> outputs;
 
   // State kept for output being generated
@@ -87,6 +139,17 @@ struct DBImpl::CompactionState {
   uint64_t total_bytes;
 };
 
+struct DBImpl::Subcompaction {
+  DBImpl* db;
+  CompactionState* state;
+  Iterator* input;
+  const Slice* begin;
+  const Slice* end;
+  Status status;
+  bool done;
+  port::CondVar* done_signal;
+};
+
 // Fix user-supplied options to be reasonable
 template <class T, class V>
 static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
@@ -96,14 +159,43 @@ static void ClipToRange(T* ptr, V minvalue, V maxvalue) {
 Options SanitizeOptions(const std::string& dbname,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* iprefix,
+                        const TtlCompactionFilter* ttl_filter,
+                        const TtlMergeOperator* ttl_merge_operator,
                         const Options& src) {
   Options result = src;
   result.comparator = icmp;
   result.filter_policy = (src.filter_policy != nullptr) ? ipolicy : nullptr;
+  result.prefix_extractor =
+      (src.prefix_extractor != nullptr) ? iprefix : nullptr;
+  if (src.ttl > 0 && ttl_filter != nullptr) {
+    result.compaction_filter = ttl_filter;
+  }
+  if (src.ttl > 0 && src.merge_operator != nullptr &&
+      ttl_merge_operator != nullptr) {
+    result.merge_operator = ttl_merge_operator;
+  }
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.metadata_block_size, 1 << 10, 4 << 20);
+  ClipToRange(&result.max_background_compactions, 1, 64);
+  ClipToRange(&result.max_subcompactions, 1, 64);
+  ClipToRange(&result.num_levels, 2, config::kMaxNumLevels);
+  ClipToRange(&result.max_mem_compaction_level, 0, result.num_levels - 1);
+  // Writes must not stop before level-0 compactions are triggered.
+  ClipToRange(&result.level0_file_num_compaction_trigger, 1, 1 << 20);
+  ClipToRange(&result.level0_slowdown_writes_trigger,
+              result.level0_file_num_compaction_trigger, 1 << 20);
+  ClipToRange(&result.level0_stop_writes_trigger,
+              result.level0_slowdown_writes_trigger, 1 << 20);
+  if (result.hard_pending_compaction_bytes_limit > 0 &&
+      result.soft_pending_compaction_bytes_limit >
+          result.hard_pending_compaction_bytes_limit) {
+    result.soft_pending_compaction_bytes_limit =
+        result.hard_pending_compaction_bytes_limit;
+  }
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -129,8 +221,16 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
+      internal_prefix_extractor_(raw_options.prefix_extractor),
+      ttl_compaction_filter_(raw_options.compaction_filter, raw_options.ttl,
+                             raw_options.env),
+      ttl_merge_operator_(raw_options.merge_operator, raw_options.ttl,
+                          raw_options.env),
       options_(SanitizeOptions(dbname, &internal_comparator_,
-                               &internal_filter_policy_, raw_options)),
+                               &internal_filter_policy_,
+                               &internal_prefix_extractor_,
+                               &ttl_compaction_filter_, &ttl_merge_operator_,
+                               raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
       owns_cache_(options_.block_cache != raw_options.block_cache),
       dbname_(dbname),
@@ -146,16 +246,26 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       log_(nullptr),
       seed_(0),
       tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      memtable_write_signal_(&mutex_),
+      background_compactions_scheduled_(0),
+      background_flush_scheduled_(false),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
-                               &internal_comparator_)) {}
+                               &internal_comparator_)),
+      stats_(options_.num_levels),
+      write_controller_(options_.delayed_write_rate) {
+  if (parallel_compactions()) {
+    // One thread for memtable compactions, plus one per table compaction.
+    env_->IncBackgroundThreadsIfNeeded(options_.max_background_compactions +
+                                       1);
+  }
+}
 
 DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 || background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
@@ -215,6 +325,10 @@ Status DBImpl::NewDB() {
   return s;
 }
 
+uint64_t DBImpl::NewFileCreationTime() const {
+  return (options_.ttl > 0) ? TtlNow(env_) : 0;
+}
+
 void DBImpl::MaybeIgnoreError(Status* s) const {
   if (s->ok() || options_.paranoid_checks) {
     // No change needed
@@ -457,7 +571,11 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t file_number;
+      status = WriteLevel0Table(mem, edit, nullptr, &file_number);
+      // No compaction runs during recovery, so the table needs no
+      // protection until *edit is applied.
+      pending_outputs_.erase(file_number);
       mem->Unref();
       mem = nullptr;
       if (!status.ok()) {
@@ -496,7 +614,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t file_number;
+      status = WriteLevel0Table(mem, edit, nullptr, &file_number);
+      pending_outputs_.erase(file_number);
     }
     mem->Unref();
   }
@@ -505,20 +625,23 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 }
 
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base, uint64_t* file_number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
+  *file_number = meta.number;
   Iterator* iter = mem->NewIterator();
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
 
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, range_del_iter,
+                   &meta);
     mutex_.Lock();
   }
 
@@ -526,7 +649,7 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
+  delete range_del_iter;
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -534,11 +657,14 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   if (s.ok() && meta.file_size > 0) {
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
-    if (base != nullptr) {
+    // With parallel compactions, a running compaction may be about to
+    // add files overlapping this one to the levels below level-0.
+    if (base != nullptr && !parallel_compactions()) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
     }
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
-                  meta.largest);
+                  meta.largest, meta.has_range_tombstones,
+                  NewFileCreationTime());
   }
 
   CompactionStats stats;
@@ -556,7 +682,8 @@ void DBImpl::CompactMemTable() {
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  uint64_t file_number;
+  Status s = WriteLevel0Table(imm_, &edit, base, &file_number);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -569,6 +696,7 @@ void DBImpl::CompactMemTable() {
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
     s = versions_->LogAndApply(&edit, &mutex_);
   }
+  pending_outputs_.erase(file_number);
 
   if (s.ok()) {
     // Commit to the new state
@@ -586,7 +714,7 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   {
     MutexLock l(&mutex_);
     Version* base = versions_->current();
-    for (int level = 1; level < config::kNumLevels; level++) {
+    for (int level = 1; level < options_.num_levels; level++) {
       if (base->OverlapInLevel(level, begin, end)) {
         max_level_with_files = level;
       }
@@ -598,16 +726,57 @@ void DBImpl::CompactRange(const Slice* begin, const Slice* end) {
   }
 }
 
+Status DBImpl::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+  MutexLock l(&mutex_);
+  if (!bg_error_.ok()) {
+    return bg_error_;
+  }
+
+  Version* base = versions_->current();
+  base->Ref();
+  VersionEdit edit;
+  std::vector<FileMetaData*> deleted;
+  for (int level = 0; level < options_.num_levels; level++) {
+    std::vector<FileMetaData*> files;
+    base->GetFilesInRange(level, begin, end, &files);
+    for (FileMetaData* f : files) {
+      edit.RemoveFile(level, f->number);
+      // Keep compactions from picking the file while the edit is logged
+      f->being_compacted = true;
+      deleted.push_back(f);
+    }
+  }
+
+  Status s;
+  if (!deleted.empty()) {
+    s = versions_->LogAndApply(&edit, &mutex_);
+    for (FileMetaData* f : deleted) {
+      f->being_compacted = false;
+    }
+  }
+  base->Unref();  // Otherwise the deleted files would still be live
+
+  if (deleted.empty()) {
+    // Nothing to do
+  } else if (s.ok()) {
+    RemoveObsoleteFiles();
+  } else {
+    RecordBackgroundError(s);
+  }
+  return s;
+}
+
 void DBImpl::TEST_CompactRange(int level, const Slice* begin,
                                const Slice* end) {
   assert(level >= 0);
-  assert(level + 1 < config::kNumLevels);
+  assert(level + 1 < options_.num_levels);
 
   InternalKey begin_storage, end_storage;
 
   ManualCompaction manual;
   manual.level = level;
   manual.done = false;
+  manual.in_progress = false;
   if (begin == nullptr) {
     manual.begin = nullptr;
   } else {
@@ -633,7 +802,7 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
   }
   // Finish current background compaction in the case where
   // `background_work_finished_signal_` was signalled due to an error.
-  while (background_compaction_scheduled_) {
+  while (background_compactions_scheduled_ > 0 || background_flush_scheduled_) {
     background_work_finished_signal_.Wait();
   }
   if (manual_compaction_ == &manual) {
@@ -658,6 +827,13 @@ Status DBImpl::TEST_CompactMemTable() {
   return s;
 }
 
+void DBImpl::TEST_WaitForCompactions() {
+  MutexLock l(&mutex_);
+  while (background_compactions_scheduled_ > 0 || background_flush_scheduled_) {
+    background_work_finished_signal_.Wait();
+  }
+}
+
 void DBImpl::RecordBackgroundError(const Status& s) {
   mutex_.AssertHeld();
   if (bg_error_.ok()) {
@@ -668,17 +844,30 @@ void DBImpl::RecordBackgroundError(const Status& s) {
 
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
+    return;
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
+    return;
+  }
+
+  if (parallel_compactions() && imm_ != nullptr &&
+      !background_flush_scheduled_) {
+    background_flush_scheduled_ = true;
+    env_->Schedule(&DBImpl::BGFlushWork, this);
+  }
+
+  if (background_compactions_scheduled_ >=
+      options_.max_background_compactions) {
+    // Already scheduled
+  } else if ((parallel_compactions() || imm_ == nullptr) &&
+             (manual_compaction_ == nullptr ||
+              manual_compaction_->in_progress) &&
              !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
+    background_compactions_scheduled_++;
     env_->Schedule(&DBImpl::BGWork, this);
   }
 }
@@ -687,39 +876,73 @@ void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
+void DBImpl::BGFlushWork(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool ran = true;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    ran = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
+  // so reschedule another compaction if needed.  If no compaction could
+  // run because the candidates overlap running compactions, those will
+  // reschedule when they finish.
+  if (ran) {
+    MaybeScheduleCompaction();
+  }
+  background_work_finished_signal_.SignalAll();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != nullptr) {
+    CompactMemTable();
+  }
+
+  background_flush_scheduled_ = false;
+
+  // The new level-0 file may call for a compaction.
   MaybeScheduleCompaction();
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
+  if (!parallel_compactions() && imm_ != nullptr) {
     CompactMemTable();
-    return;
+    return true;
   }
 
   Compaction* c;
-  bool is_manual = (manual_compaction_ != nullptr);
+  bool is_manual =
+      (manual_compaction_ != nullptr && !manual_compaction_->in_progress);
   InternalKey manual_end;
   if (is_manual) {
     ManualCompaction* m = manual_compaction_;
     c = versions_->CompactRange(m->level, m->begin, m->end);
+    if (c != nullptr && !c->AcquireInputs()) {
+      // Retry once the compaction that holds the inputs is done.
+      delete c;
+      return false;
+    }
+    m->in_progress = true;
     m->done = (c == nullptr);
     if (c != nullptr) {
       manual_end = c->input(0, c->num_input_files(0) - 1)->largest;
@@ -731,8 +954,16 @@ void DBImpl::BackgroundCompaction() {
         (m->done ? "(end)" : manual_end.DebugString().c_str()));
   } else {
     c = versions_->PickCompaction();
+    if (c == nullptr) {
+      // Nothing to do, or everything that needs compacting is already
+      // being compacted.
+      return false;
+    }
   }
 
+  // Let another thread pick up work that does not overlap this one.
+  MaybeScheduleCompaction();
+
   Status status;
   if (c == nullptr) {
     // Nothing to do
@@ -741,15 +972,16 @@ void DBImpl::BackgroundCompaction() {
     assert(c->num_input_files(0) == 1);
     FileMetaData* f = c->input(0, 0);
     c->edit()->RemoveFile(c->level(), f->number);
-    c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
-                       f->largest);
+    c->edit()->AddFile(c->output_level(), f->number, f->file_size,
+                       f->smallest, f->largest, f->has_range_tombstones,
+                       f->creation_time);
     status = versions_->LogAndApply(c->edit(), &mutex_);
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
     VersionSet::LevelSummaryStorage tmp;
     Log(options_.info_log, "Moved #%lld to level-%d %lld bytes %s: %s\n",
-        static_cast<unsigned long long>(f->number), c->level() + 1,
+        static_cast<unsigned long long>(f->number), c->output_level(),
         static_cast<unsigned long long>(f->file_size),
         status.ToString().c_str(), versions_->LevelSummary(&tmp));
   } else {
@@ -783,8 +1015,10 @@ void DBImpl::BackgroundCompaction() {
       m->tmp_storage = manual_end;
       m->begin = &m->tmp_storage;
     }
+    m->in_progress = false;
     manual_compaction_ = nullptr;
   }
+  return true;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -816,6 +1050,7 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
     out.number = file_number;
     out.smallest.Clear();
     out.largest.Clear();
+    out.has_range_tombstones = false;
     compact->outputs.push_back(out);
     mutex_.Unlock();
   }
@@ -824,11 +1059,80 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
+    if (options_.rate_limiter != nullptr) {
+      compact->outfile = NewRateLimitedWritableFile(
+          compact->outfile, options_.rate_limiter, RateLimiter::kLowPriority);
+    }
     compact->builder = new TableBuilder(options_, compact->outfile);
   }
   return s;
 }
 
+Status DBImpl::AddCompactionRangeTombstones(CompactionState* compact,
+                                            const Slice* upper) {
+  const RangeTombstoneList* list = compact->range_tombstones;
+  const Comparator* ucmp = user_comparator();
+  Status s;
+  while (compact->next_fragment < list->NumFragments()) {
+    const RangeTombstoneList::Fragment f =
+        list->fragment(compact->next_fragment);
+    if (upper != nullptr && ucmp->Compare(f.start, *upper) >= 0) {
+      break;
+    }
+    // Clip the fragment to [tombstone_lower, *upper)
+    Slice start = f.start;
+    if (compact->has_tombstone_lower &&
+        ucmp->Compare(start, compact->tombstone_lower) < 0) {
+      start = compact->tombstone_lower;
+    }
+    const bool ends_before_upper =
+        upper == nullptr || ucmp->Compare(f.end, *upper) <= 0;
+    const Slice end = ends_before_upper ? f.end : *upper;
+
+    if (ucmp->Compare(start, end) < 0) {
+      // The tombstones newer than smallest_snapshot are needed by some
+      // snapshot.  Of the others, only the newest one is, and only if
+      // there may be older entries in the range below the output level.
+      int n = 0;
+      while (n < f.num_sequences &&
+             f.sequences[n] > compact->smallest_snapshot) {
+        n++;
+      }
+      if (n < f.num_sequences &&
+          !compact->compaction->IsBaseLevelForRange(start, end)) {
+        n++;
+      }
+      if (n > 0 && compact->builder == nullptr) {
+        s = OpenCompactionOutputFile(compact);
+        if (!s.ok()) {
+          return s;
+        }
+      }
+      CompactionState::Output* out =
+          n > 0 ? compact->current_output() : nullptr;
+      for (int i = 0; i < n; i++) {
+        InternalKey key(start, f.sequences[i], kTypeRangeDeletion);
+        compact->builder->AddRangeTombstone(key.Encode(), end);
+        ExtendRangeForTombstone(
+            internal_comparator_, key.Encode(), end,
+            compact->builder->NumEntries() == 0 && !out->has_range_tombstones,
+            &out->smallest, &out->largest);
+        out->has_range_tombstones = true;
+      }
+    }
+
+    if (!ends_before_upper) {
+      break;
+    }
+    compact->next_fragment++;
+  }
+  if (upper != nullptr) {
+    compact->has_tombstone_lower = true;
+    compact->tombstone_lower.assign(upper->data(), upper->size());
+  }
+  return s;
+}
+
 Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
                                           Iterator* input) {
   assert(compact != nullptr);
@@ -836,6 +1140,8 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   assert(compact->builder != nullptr);
 
   const uint64_t output_number = compact->current_output()->number;
+  const bool has_range_tombstones =
+      compact->current_output()->has_range_tombstones;
   assert(output_number != 0);
 
   // Check for iterator errors
@@ -862,7 +1168,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   delete compact->outfile;
   compact->outfile = nullptr;
 
-  if (s.ok() && current_entries > 0) {
+  if (s.ok() && (current_entries > 0 || has_range_tombstones)) {
     // Verify that the table is usable
     Iterator* iter =
         table_cache_->NewIterator(ReadOptions(), output_number, current_bytes);
@@ -882,16 +1188,20 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
   mutex_.AssertHeld();
   Log(options_.info_log, "Compacted %d@%d + %d@%d files => %lld bytes",
       compact->compaction->num_input_files(0), compact->compaction->level(),
-      compact->compaction->num_input_files(1), compact->compaction->level() + 1,
+      compact->compaction->num_input_files(1),
+      compact->compaction->output_level(),
       static_cast<long long>(compact->total_bytes));
 
   // Add compaction outputs
   compact->compaction->AddInputDeletions(compact->compaction->edit());
-  const int level = compact->compaction->level();
+  const int level = compact->compaction->output_level();
+  const uint64_t creation_time = NewFileCreationTime();
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
-                                         out.smallest, out.largest);
+    compact->compaction->edit()->AddFile(level, out.number, out.file_size,
+                                         out.smallest, out.largest,
+                                         out.has_range_tombstones,
+                                         creation_time);
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
 }
@@ -903,15 +1213,42 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
       compact->compaction->num_input_files(1),
-      compact->compaction->level() + 1);
+      compact->compaction->output_level());
 
   assert(versions_->NumLevelFiles(compact->compaction->level()) > 0);
   assert(compact->builder == nullptr);
   assert(compact->outfile == nullptr);
   if (snapshots_.empty()) {
     compact->smallest_snapshot = versions_->LastSequence();
+    compact->newest_snapshot = 0;
   } else {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
+    compact->newest_snapshot = snapshots_.newest()->sequence_number();
+  }
+
+  // Split the key range so that its parts can be compacted in parallel.
+  // The first part is compacted by this thread, into *compact.
+  std::vector<std::string> boundaries;
+  compact->compaction->GetSubcompactionBoundaries(options_.max_subcompactions,
+                                                  &boundaries);
+  std::vector<Slice> keys(boundaries.begin(), boundaries.end());
+  port::CondVar subcompactions_done(&mutex_);
+  std::vector<Subcompaction> subs(boundaries.size());
+  for (size_t i = 0; i < subs.size(); i++) {
+    Subcompaction* sub = &subs[i];
+    sub->db = this;
+    sub->state = new CompactionState(compact->compaction->NewSubcompaction());
+    sub->state->smallest_snapshot = compact->smallest_snapshot;
+    sub->state->newest_snapshot = compact->newest_snapshot;
+    sub->input = versions_->MakeInputIterator(sub->state->compaction);
+    sub->begin = &keys[i];
+    sub->end = (i + 1 < keys.size()) ? &keys[i + 1] : nullptr;
+    sub->done = false;
+    sub->done_signal = &subcompactions_done;
+  }
+  if (!subs.empty()) {
+    Log(options_.info_log, "Compacting in %d subcompactions",
+        static_cast<int>(subs.size()) + 1);
   }
 
   Iterator* input = versions_->MakeInputIterator(compact->compaction);
@@ -919,15 +1256,239 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  input->SeekToFirst();
+  // Gather the range tombstones of the inputs, shared by all the parts.
+  Status status;
+  RangeTombstoneList* range_tombstones = nullptr;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      const FileMetaData* f = compact->compaction->input(which, i);
+      if (f->has_range_tombstones && status.ok()) {
+        if (range_tombstones == nullptr) {
+          range_tombstones = new RangeTombstoneList(user_comparator());
+        }
+        status = table_cache_->AddRangeTombstones(f->number, f->file_size,
+                                                  range_tombstones);
+      }
+    }
+  }
+  if (range_tombstones != nullptr) {
+    range_tombstones->Finish();
+    if (range_tombstones->empty()) {
+      delete range_tombstones;
+      range_tombstones = nullptr;
+    }
+  }
+  compact->range_tombstones = range_tombstones;
+  for (size_t i = 0; i < subs.size(); i++) {
+    subs[i].state->range_tombstones = range_tombstones;
+  }
+
+  if (status.ok()) {
+    for (size_t i = 0; i < subs.size(); i++) {
+      env_->StartThread(&DBImpl::BGSubcompactionWork, &subs[i]);
+    }
+    status = ProcessCompactionRange(compact, input, nullptr,
+                                    keys.empty() ? nullptr : &keys[0],
+                                    &imm_micros);
+  } else {
+    for (size_t i = 0; i < subs.size(); i++) {
+      delete subs[i].input;
+      subs[i].input = nullptr;
+      subs[i].status = status;
+      subs[i].done = true;
+    }
+  }
+  delete input;
+  input = nullptr;
+
+  mutex_.Lock();
+  for (size_t i = 0; i < subs.size(); i++) {
+    Subcompaction* sub = &subs[i];
+    while (!sub->done) {
+      subcompactions_done.Wait();
+    }
+    if (status.ok()) {
+      status = sub->status;
+    }
+    // The outputs of all parts are installed together, so they stay in
+    // pending_outputs_ until *compact is cleaned up.
+    CompactionState* state = sub->state;
+    compact->outputs.insert(compact->outputs.end(), state->outputs.begin(),
+                            state->outputs.end());
+    compact->total_bytes += state->total_bytes;
+    state->outputs.clear();
+    Compaction* c = state->compaction;
+    CleanupCompaction(state);
+    delete c;
+  }
+  delete range_tombstones;
+  compact->range_tombstones = nullptr;
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros - imm_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+  stats_[compact->compaction->output_level()].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+void DBImpl::BGSubcompactionWork(void* arg) {
+  Subcompaction* sub = reinterpret_cast<Subcompaction*>(arg);
+  DBImpl* db = sub->db;
+  Status s = db->ProcessCompactionRange(sub->state, sub->input, sub->begin,
+                                        sub->end, nullptr);
+  delete sub->input;
+  sub->input = nullptr;
+
+  MutexLock l(&db->mutex_);
+  sub->status = s;
+  sub->done = true;
+  sub->done_signal->SignalAll();
+}
+
+// Combine the merge operands of a user key, starting with the one "*input"
+// is positioned at, whose sequence number is at most "smallest_snapshot".
+// Every snapshot sees all of these operands, so they can be replaced by
+// the result of merging them: a value if they end at the entry that they
+// apply to, or at the end of the key in a base level, and else a single
+// operand obtained with MergeOperator::PartialMerge().  The replacing
+// entries, which are the operands themselves if they cannot be merged, are
+// appended to *output.  Leaves *input at the first entry not replaced, and
+// returns true iff the replacement hides that entry and the older ones.
+static bool MergeCompactionOperands(
+    const Comparator* user_comparator, const MergeOperator* merge_operator,
+    const RangeTombstoneList* range_tombstones,
+    SequenceNumber smallest_snapshot, bool base_level, Iterator* input,
+    std::vector<std::pair<std::string, std::string>>* output) {
+  ParsedInternalKey ikey;
+  if (!ParseInternalKey(input->key(), &ikey)) {
+    assert(false);
+  }
+  const std::string user_key = ikey.user_key.ToString();
+  const SequenceNumber sequence = ikey.sequence;
+  // Pairs of internal key and operand, newest first
+  std::vector<std::pair<std::string, std::string>> operands;
+  operands.emplace_back(input->key().ToString(), input->value().ToString());
+
+  enum { kEndOfKey, kValue, kNoValue, kUnknown } end = kEndOfKey;
+  Slice base;
+  for (input->Next(); input->Valid(); input->Next()) {
+    if (!ParseInternalKey(input->key(), &ikey)) {
+      end = kUnknown;
+      break;
+    }
+    if (user_comparator->Compare(ikey.user_key, user_key) != 0) {
+      break;
+    }
+    if (range_tombstones != nullptr &&
+        range_tombstones->MaxCoveringSequence(user_key, smallest_snapshot) >
+            ikey.sequence) {
+      end = kNoValue;
+    } else if (ikey.type == kTypeMerge) {
+      operands.emplace_back(input->key().ToString(),
+                            input->value().ToString());
+      continue;
+    } else if (ikey.type == kTypeValue) {
+      end = kValue;
+      base = input->value();
+    } else {
+      end = kNoValue;
+    }
+    break;
+  }
+
+  std::vector<Slice> values;  // Oldest first
+  for (auto it = operands.rbegin(); it != operands.rend(); ++it) {
+    values.push_back(it->second);
+  }
+  std::string merged;
+  if (end == kValue || end == kNoValue || (end == kEndOfKey && base_level)) {
+    if (FullMerge(merge_operator, user_key, end == kValue ? &base : nullptr,
+                  values, &merged)
+            .ok()) {
+      std::string key;
+      AppendInternalKey(&key,
+                        ParsedInternalKey(user_key, sequence, kTypeValue));
+      output->emplace_back(std::move(key), std::move(merged));
+      return true;
+    }
+  } else if (end == kEndOfKey && values.size() > 1) {
+    merged = values[0].ToString();
+    bool ok = true;
+    for (size_t i = 1; ok && i < values.size(); i++) {
+      std::string combined;
+      ok = merge_operator->PartialMerge(user_key, merged, values[i],
+                                        &combined);
+      merged.swap(combined);
+    }
+    if (ok) {
+      std::string key;
+      AppendInternalKey(&key,
+                        ParsedInternalKey(user_key, sequence, kTypeMerge));
+      output->emplace_back(std::move(key), std::move(merged));
+      return false;
+    }
+  }
+  output->insert(output->end(), operands.begin(), operands.end());
+  return false;
+}
+
+void DBImpl::AddToCompactionOutput(CompactionState* compact, const Slice& key,
+                                   const Slice& value) {
+  if (compact->builder->NumEntries() == 0) {
+    compact->current_output()->smallest.DecodeFrom(key);
+  }
+  compact->current_output()->largest.DecodeFrom(key);
+  compact->builder->Add(key, value);
+}
+
+Status DBImpl::ProcessCompactionRange(CompactionState* compact,
+                                      Iterator* input, const Slice* begin,
+                                      const Slice* end, int64_t* imm_micros) {
+  const RangeTombstoneList* range_tombstones = compact->range_tombstones;
+  const CompactionFilter* const compaction_filter = options_.compaction_filter;
+  const MergeOperator* const merge_operator = options_.merge_operator;
+  if (begin == nullptr) {
+    input->SeekToFirst();
+  } else {
+    input->Seek(
+        InternalKey(*begin, kMaxSequenceNumber, kValueTypeForSeek).Encode());
+    if (range_tombstones != nullptr) {
+      compact->next_fragment = range_tombstones->FindFragment(*begin);
+      compact->has_tombstone_lower = true;
+      compact->tombstone_lower = begin->ToString();
+    }
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  bool stop_pending = false;  // The current output should be finished
+  std::string filtered_key;
+  std::string filtered_value;
+  // Entries that replace merge operands, if not empty
+  std::vector<std::pair<std::string, std::string>> merge_output;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
-    // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
+    // Prioritize immutable compaction work, unless it has a thread of
+    // its own.
+    if (imm_micros != nullptr && !parallel_compactions() &&
+        has_imm_.load(std::memory_order_relaxed)) {
       const uint64_t imm_start = env_->NowMicros();
       mutex_.Lock();
       if (imm_ != nullptr) {
@@ -936,20 +1497,43 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         background_work_finished_signal_.SignalAll();
       }
       mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
+      *imm_micros += (env_->NowMicros() - imm_start);
     }
 
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
-        compact->builder != nullptr) {
-      status = FinishCompactionOutputFile(compact, input);
+    Slice value = input->value();
+    const Slice user_key = ExtractUserKey(key);
+    if (end != nullptr && user_comparator()->Compare(user_key, *end) >= 0) {
+      // The rest of the key range belongs to another subcompaction
+      break;
+    }
+    const bool should_stop = compact->compaction->ShouldStopBefore(key);
+    if (compact->builder != nullptr &&
+        (should_stop || compact->builder->FileSize() >=
+                            compact->compaction->MaxOutputFileSize())) {
+      stop_pending = true;
+    }
+    // With range tombstones, the entries for a user key are not split
+    // between outputs, which would need to share the tombstones covering
+    // the key.
+    if (stop_pending && compact->builder != nullptr &&
+        (range_tombstones == nullptr || !has_current_user_key ||
+         user_comparator()->Compare(user_key, current_user_key) != 0)) {
+      if (range_tombstones != nullptr) {
+        status = AddCompactionRangeTombstones(compact, &user_key);
+      }
+      if (status.ok()) {
+        status = FinishCompactionOutputFile(compact, input);
+      }
       if (!status.ok()) {
         break;
       }
+      stop_pending = false;
     }
 
     // Handle key/value, add to state, etc.
     bool drop = false;
+    bool merged = false;  // input was advanced past the merged entries
     if (!ParseInternalKey(key, &ikey)) {
       // Do not hide error keys
       current_user_key.clear();
@@ -968,6 +1552,12 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       if (last_sequence_for_key <= compact->smallest_snapshot) {
         // Hidden by an newer entry for same user key
         drop = true;  // (A)
+      } else if (range_tombstones != nullptr &&
+                 range_tombstones->MaxCoveringSequence(
+                     ikey.user_key, compact->smallest_snapshot) >
+                     ikey.sequence) {
+        // Deleted by a range tombstone that every snapshot sees
+        drop = true;
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
                  compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
@@ -979,9 +1569,48 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         //     few iterations of this loop (by rule (A) above).
         // Therefore this deletion marker is obsolete and can be dropped.
         drop = true;
+      } else if (merge_operator != nullptr && ikey.type == kTypeMerge &&
+                 ikey.sequence <= compact->smallest_snapshot) {
+        const SequenceNumber sequence = ikey.sequence;
+        merge_output.clear();
+        merged = true;
+        if (MergeCompactionOperands(
+                user_comparator(), merge_operator, range_tombstones,
+                compact->smallest_snapshot,
+                compact->compaction->IsBaseLevelForKey(ikey.user_key), input,
+                &merge_output)) {
+          last_sequence_for_key = sequence;
+        }
+      } else if (compaction_filter != nullptr && ikey.type == kTypeValue &&
+                 last_sequence_for_key == kMaxSequenceNumber &&
+                 ikey.sequence > compact->newest_snapshot) {
+        bool value_changed = false;
+        filtered_value.clear();
+        if (compaction_filter->Filter(compact->compaction->level(),
+                                      ikey.user_key, value, &filtered_value,
+                                      &value_changed)) {
+          // Replace the entry by a deletion marker, which hides the older
+          // entries for the key, unless the marker could be dropped.
+          if (ikey.sequence <= compact->smallest_snapshot &&
+              compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+            drop = true;
+          } else {
+            filtered_key.clear();
+            AppendInternalKey(&filtered_key,
+                              ParsedInternalKey(ikey.user_key, ikey.sequence,
+                                                kTypeDeletion));
+            key = filtered_key;
+            value = Slice();
+          }
+        } else if (value_changed) {
+          value = filtered_value;
+        }
       }
 
-      last_sequence_for_key = ikey.sequence;
+      // The entries under a merge operand are not hidden by it
+      if (!merged && ikey.type != kTypeMerge) {
+        last_sequence_for_key = ikey.sequence;
+      }
     }
 #if 0
     Log(options_.info_log,
@@ -1001,59 +1630,32 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
           break;
         }
       }
-      if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
-      }
-      compact->current_output()->largest.DecodeFrom(key);
-      compact->builder->Add(key, input->value());
-
-      // Close output file if it is big enough
-      if (compact->builder->FileSize() >=
-          compact->compaction->MaxOutputFileSize()) {
-        status = FinishCompactionOutputFile(compact, input);
-        if (!status.ok()) {
-          break;
+      if (merged) {
+        for (const auto& entry : merge_output) {
+          AddToCompactionOutput(compact, entry.first, entry.second);
         }
+      } else {
+        AddToCompactionOutput(compact, key, value);
       }
     }
 
-    input->Next();
+    if (!merged) {
+      input->Next();
+    }
   }
 
   if (status.ok() && shutting_down_.load(std::memory_order_acquire)) {
     status = Status::IOError("Deleting DB during compaction");
   }
+  if (status.ok() && range_tombstones != nullptr) {
+    status = AddCompactionRangeTombstones(compact, end);
+  }
   if (status.ok() && compact->builder != nullptr) {
     status = FinishCompactionOutputFile(compact, input);
   }
   if (status.ok()) {
     status = input->status();
   }
-  delete input;
-  input = nullptr;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
   return status;
 }
 
@@ -1079,11 +1681,40 @@ static void CleanupIteratorState(void* arg1, void* arg2) {
   delete state;
 }
 
+static void DeleteRangeTombstones(void* arg1, void* arg2) {
+  delete reinterpret_cast<RangeTombstoneList*>(arg1);
+}
+
 }  // anonymous namespace
 
-Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
-                                      SequenceNumber* latest_snapshot,
-                                      uint32_t* seed) {
+// Append to *lists the range tombstones of "mem", if it has any.  Unless
+// the memtable is immutable, they are copied to a list that is deleted
+// along with *iter.
+static Status AddMemTableRangeTombstones(
+    const Comparator* ucmp, MemTable* mem, Iterator* iter,
+    std::vector<const RangeTombstoneList*>* lists) {
+  const RangeTombstoneList* shared = mem->range_tombstones();
+  if (shared != nullptr) {
+    lists->push_back(shared);
+    return Status::OK();
+  }
+  RangeTombstoneList* list = new RangeTombstoneList(ucmp);
+  Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+  Status s = list->AddAll(range_del_iter);
+  delete range_del_iter;
+  list->Finish();
+  if (!s.ok() || list->empty()) {
+    delete list;
+    return s;
+  }
+  iter->RegisterCleanup(DeleteRangeTombstones, list, nullptr);
+  lists->push_back(list);
+  return s;
+}
+
+Iterator* DBImpl::NewInternalIterator(
+    const ReadOptions& options, SequenceNumber* latest_snapshot,
+    uint32_t* seed, std::vector<const RangeTombstoneList*>* range_tombstones) {
   mutex_.Lock();
   *latest_snapshot = versions_->LastSequence();
 
@@ -1102,9 +1733,36 @@ Iterator* DBImpl::NewInternalIterator(const ReadOptions& options,
 
   IterState* cleanup = new IterState(&mutex_, mem_, imm_, versions_->current());
   internal_iter->RegisterCleanup(CleanupIteratorState, cleanup, nullptr);
+  MemTable* const mem = mem_;
+  MemTable* const imm = imm_;
+  Version* const current = versions_->current();
 
   *seed = ++seed_;
   mutex_.Unlock();
+
+  if (range_tombstones != nullptr) {
+    // The sources are kept alive by the references taken above.
+    range_tombstones->clear();
+    const Comparator* ucmp = internal_comparator_.user_comparator();
+    Status s = AddMemTableRangeTombstones(ucmp, mem, internal_iter,
+                                          range_tombstones);
+    if (s.ok() && imm != nullptr) {
+      s = AddMemTableRangeTombstones(ucmp, imm, internal_iter,
+                                     range_tombstones);
+    }
+    const RangeTombstoneList* list = nullptr;
+    if (s.ok()) {
+      s = current->GetRangeTombstones(&list);
+    }
+    if (!s.ok()) {
+      range_tombstones->clear();
+      delete internal_iter;
+      return NewErrorIterator(s);
+    }
+    if (list != nullptr) {
+      range_tombstones->push_back(list);
+    }
+  }
   return internal_iter;
 }
 
@@ -1121,6 +1779,38 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
 
 Status DBImpl::Get(const ReadOptions& options, const Slice& key,
                    std::string* value) {
+  return GetImpl(options, key, value, nullptr);
+}
+
+Status DBImpl::Get(const ReadOptions& options, const Slice& key,
+                   PinnableSlice* value) {
+  value->Reset();
+  return GetImpl(options, key, nullptr, value);
+}
+
+void DBImpl::UnrefMemTable(void* db, void* mem) {
+  DBImpl* impl = reinterpret_cast<DBImpl*>(db);
+  MutexLock l(&impl->mutex_);
+  reinterpret_cast<MemTable*>(mem)->Unref();
+}
+
+// Check the write time at the end of a value read from a database with a
+// TTL: returns NotFound if the value has expired at "now".
+static Status CheckTtl(uint64_t ttl, uint64_t now, const Slice& key,
+                       const Slice& stamped) {
+  Slice value;
+  uint64_t write_time;
+  if (!ParseTtlValue(stamped, &value, &write_time)) {
+    return Status::Corruption("missing write time for ", key);
+  }
+  if (IsTtlExpired(write_time, ttl, now)) {
+    return Status::NotFound(Slice());
+  }
+  return Status::OK();
+}
+
+Status DBImpl::GetImpl(const ReadOptions& options, const Slice& key,
+                       std::string* value, PinnableSlice* pinnable) {
   Status s;
   MutexLock l(&mutex_);
   SequenceNumber snapshot;
@@ -1140,42 +1830,230 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
 
   bool have_stat_update = false;
   Version::GetStats stats;
+  MemTable* found_in = nullptr;  // Memtable holding the value, if any
+  Slice found_value;
+  MergeContext merge_context;
 
   // Unlock while reading from files and memtables
   {
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
-    if (mem->Get(lkey, value, &s)) {
-      // Done
-    } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
-      // Done
+    if (mem->Get(lkey, &found_value, &s, &merge_context)) {
+      found_in = mem;
+    } else if (imm != nullptr &&
+               imm->Get(lkey, &found_value, &s, &merge_context)) {
+      found_in = imm;
     } else {
-      s = current->Get(options, lkey, value, &stats);
+      s = (pinnable != nullptr)
+              ? current->Get(options, lkey, pinnable, &stats, &merge_context)
+              : current->Get(options, lkey, value, &stats, &merge_context);
       have_stat_update = true;
     }
+    if (!merge_context.empty() && (s.ok() || s.IsNotFound())) {
+      // Apply the merge operands to the value found under them, if any
+      Slice base;
+      if (s.ok()) {
+        base = (found_in != nullptr)  ? found_value
+               : (pinnable != nullptr) ? Slice(*pinnable)
+                                       : Slice(*value);
+      }
+      std::string merged;
+      s = merge_context.Merge(options_.merge_operator, key,
+                              s.ok() ? &base : nullptr, &merged);
+      found_in = nullptr;
+      if (!s.ok()) {
+        // Return the error
+      } else if (pinnable != nullptr) {
+        pinnable->PinSelf(merged);
+      } else {
+        value->swap(merged);
+      }
+    }
+    if (options_.ttl > 0 && s.ok()) {
+      Slice stamped = (found_in != nullptr)  ? found_value
+                      : (pinnable != nullptr) ? Slice(*pinnable)
+                                              : Slice(*value);
+      s = CheckTtl(options_.ttl, TtlNow(env_), key, stamped);
+      if (!s.ok()) {
+        found_in = nullptr;
+        if (pinnable != nullptr) {
+          pinnable->Reset();
+        }
+      } else if (found_in != nullptr) {
+        found_value.remove_suffix(kTtlTimestampSize);
+      } else if (pinnable != nullptr) {
+        pinnable->remove_suffix(kTtlTimestampSize);
+      } else {
+        value->resize(value->size() - kTtlTimestampSize);
+      }
+    }
+    if (found_in != nullptr && s.ok() && value != nullptr) {
+      value->assign(found_value.data(), found_value.size());
+    }
     mutex_.Lock();
   }
 
   if (have_stat_update && current->UpdateStats(stats)) {
     MaybeScheduleCompaction();
   }
+  if (found_in != nullptr && s.ok() && pinnable != nullptr) {
+    // The reference keeps the memtable's storage alive until released
+    found_in->Ref();
+    pinnable->PinSlice(found_value, &UnrefMemTable, this, found_in);
+  }
   mem->Unref();
   if (imm != nullptr) imm->Unref();
   current->Unref();
   return s;
 }
 
+void DBImpl::MultiGet(const ReadOptions& options,
+                      const std::vector<Slice>& keys,
+                      std::vector<std::string>* values,
+                      std::vector<Status>* statuses) {
+  const size_t n = keys.size();
+  values->clear();
+  values->resize(n);
+  statuses->clear();
+  statuses->resize(n);
+  if (n == 0) {
+    return;
+  }
+
+  // Pin a single snapshot and set of memtables/version for the whole batch.
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  mem->Ref();
+  if (imm != nullptr) imm->Ref();
+  current->Ref();
+
+  std::vector<Version::MultiGetKey> lookups(n);
+  std::vector<Version::MultiGetKey*> pending;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+
+    // Visit the keys in sorted order so that the version lookups below
+    // can group them by file.
+    std::vector<size_t> order(n);
+    for (size_t i = 0; i < n; i++) {
+      order[i] = i;
+    }
+    const Comparator* ucmp = user_comparator();
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+      return ucmp->Compare(keys[a], keys[b]) < 0;
+    });
+
+    std::vector<std::unique_ptr<LookupKey>> lkeys(n);
+    std::vector<MergeContext> merge_contexts(n);
+    pending.reserve(n);
+    for (size_t i : order) {
+      lkeys[i].reset(new LookupKey(keys[i], snapshot));
+      Status* s = &(*statuses)[i];
+      std::string* value = &(*values)[i];
+      MergeContext* merge_context = &merge_contexts[i];
+      // First look in the memtable, then in the immutable memtable (if any).
+      if (mem->Get(*lkeys[i], value, s, merge_context)) {
+        // Done
+      } else if (imm != nullptr &&
+                 imm->Get(*lkeys[i], value, s, merge_context)) {
+        // Done
+      } else {
+        Version::MultiGetKey* lookup = &lookups[i];
+        lookup->key = lkeys[i].get();
+        lookup->value = value;
+        lookup->merge_context = merge_context;
+        pending.push_back(lookup);
+      }
+    }
+    if (!pending.empty()) {
+      current->MultiGet(options, pending.data(),
+                        static_cast<int>(pending.size()));
+      for (Version::MultiGetKey* lookup : pending) {
+        (*statuses)[lookup - lookups.data()] = lookup->status;
+      }
+    }
+
+    // Apply the merge operands to the values found under them, if any,
+    // and hide the expired values
+    const uint64_t now = (options_.ttl > 0) ? TtlNow(env_) : 0;
+    for (size_t i = 0; i < n; i++) {
+      Status* s = &(*statuses)[i];
+      if (!merge_contexts[i].empty() && (s->ok() || s->IsNotFound())) {
+        std::string* value = &(*values)[i];
+        const Slice base(*value);
+        std::string merged;
+        *s = merge_contexts[i].Merge(options_.merge_operator, keys[i],
+                                     s->ok() ? &base : nullptr, &merged);
+        if (s->ok()) {
+          value->swap(merged);
+        } else {
+          value->clear();
+        }
+      }
+      if (options_.ttl > 0 && s->ok()) {
+        std::string* value = &(*values)[i];
+        *s = CheckTtl(options_.ttl, now, keys[i], *value);
+        if (s->ok()) {
+          value->resize(value->size() - kTtlTimestampSize);
+        } else {
+          value->clear();
+        }
+      }
+    }
+    mutex_.Lock();
+  }
+
+  bool schedule_compaction = false;
+  for (Version::MultiGetKey* lookup : pending) {
+    if (current->UpdateStats(lookup->stats)) {
+      schedule_compaction = true;
+    }
+  }
+  if (schedule_compaction) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  if (imm != nullptr) imm->Unref();
+  current->Unref();
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
-  Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
-  return NewDBIterator(this, user_comparator(), iter,
+  std::vector<const RangeTombstoneList*> range_tombstones;
+  const SliceTransform* prefix_extractor = nullptr;
+  bool* prefix_seek = nullptr;
+  if (options.prefix_same_as_start && raw_prefix_extractor() != nullptr) {
+    prefix_extractor = raw_prefix_extractor();
+    prefix_seek = new bool(false);
+  }
+  // Table iterators only skip tables on the seeks that DBIter bounds
+  ReadOptions internal_options = options;
+  internal_options.prefix_seek = prefix_seek;
+  Iterator* iter = NewInternalIterator(internal_options, &latest_snapshot,
+                                       &seed, &range_tombstones);
+  return NewDBIterator(this, user_comparator(), prefix_extractor, prefix_seek,
+                       iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
                                   ->sequence_number()
                             : latest_snapshot),
-                       seed);
+                       seed, options_.merge_operator, options_.ttl,
+                       options_.ttl > 0 ? TtlNow(env_) : 0,
+                       std::move(range_tombstones));
 }
 
 void DBImpl::RecordReadSample(Slice key) {
@@ -1204,7 +2082,27 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
   return DB::Delete(options, key);
 }
 
+Status DBImpl::Merge(const WriteOptions& options, const Slice& key,
+                     const Slice& value) {
+  if (options_.merge_operator == nullptr) {
+    return Status::NotSupported("Merge() requires a merge operator");
+  }
+  return DB::Merge(options, key, value);
+}
+
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
+  WriteBatch stamped;
+  if (options_.ttl > 0 && updates != nullptr) {
+    Status s = AddTtlTimestamps(*updates, TtlNow(env_), &stamped);
+    if (!s.ok()) {
+      return s;
+    }
+    updates = &stamped;
+  }
+  if (options_.enable_pipelined_write) {
+    return PipelinedWrite(options, updates);
+  }
+
   Writer w(&mutex_);
   w.batch = updates;
   w.sync = options.sync;
@@ -1212,9 +2110,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
-    w.cv.Wait();
-  }
+  AwaitWriteTurn(&w);
   if (w.done) {
     return w.status;
   }
@@ -1224,9 +2120,11 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   uint64_t last_sequence = versions_->LastSequence();
   Writer* last_writer = &w;
   if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
+    WriteBatch* write_batch = BuildBatchGroup(&last_writer, tmp_batch_);
     WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
     last_sequence += WriteBatchInternal::Count(write_batch);
+    const bool parallel_insert =
+        options_.allow_concurrent_memtable_write && write_batch != w.batch;
 
     // Add to log and apply to memtable.  We can release the lock
     // during this phase since &w is currently responsible for logging
@@ -1242,7 +2140,7 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
           sync_error = true;
         }
       }
-      if (status.ok()) {
+      if (status.ok() && !parallel_insert) {
         status = WriteBatchInternal::InsertInto(write_batch, mem_);
       }
       mutex_.Lock();
@@ -1253,6 +2151,17 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
         RecordBackgroundError(status);
       }
     }
+    if (status.ok() && parallel_insert) {
+      std::vector<Writer*> followers;
+      std::deque<Writer*>::iterator iter = writers_.begin();
+      while (*iter != last_writer) {
+        ++iter;
+        if ((*iter)->batch != nullptr) {
+          followers.push_back(*iter);
+        }
+      }
+      status = ParallelInsertIntoMemTable(&w, write_batch, followers);
+    }
     if (write_batch == tmp_batch_) tmp_batch_->Clear();
 
     versions_->SetLastSequence(last_sequence);
@@ -1277,9 +2186,184 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   return status;
 }
 
+// The write is split into two stages.  The writer at the front of
+// writers_ appends its group to the log and then hands the log over to
+// the next group.  Logged groups queue up in memtable_writers_ and are
+// applied to the memtable one at a time in sequence order, so the next
+// group's log write overlaps with this group's memtable insert.  The
+// last sequence number of a group is only published once it and every
+// earlier group have been applied.
+Status DBImpl::PipelinedWrite(const WriteOptions& options,
+                              WriteBatch* updates) {
+  Writer w(&mutex_);
+  w.batch = updates;
+  w.sync = options.sync;
+  w.done = false;
+
+  MutexLock l(&mutex_);
+  writers_.push_back(&w);
+  AwaitWriteTurn(&w);
+  if (w.done) {
+    return w.status;
+  }
+
+  // May temporarily unlock and wait.
+  Status status = MakeRoomForWrite(updates == nullptr);
+  MemTableWriteGroup group;
+  group.batch = nullptr;
+  // Sequence numbers handed out to logged but unapplied groups are not
+  // yet reflected in versions_->LastSequence().
+  group.last_sequence = memtable_writers_.empty()
+                            ? versions_->LastSequence()
+                            : memtable_writers_.back()->last_sequence;
+  Writer* last_writer = &w;
+  if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
+    group.batch = BuildBatchGroup(&last_writer, &group.merged);
+    WriteBatchInternal::SetSequence(group.batch, group.last_sequence + 1);
+    group.last_sequence += WriteBatchInternal::Count(group.batch);
+
+    // Add to log.  We can release the lock during this phase since &w is
+    // currently responsible for logging and protects against concurrent
+    // loggers.
+    {
+      mutex_.Unlock();
+      status = log_->AddRecord(WriteBatchInternal::Contents(group.batch));
+      bool sync_error = false;
+      if (status.ok() && options.sync) {
+        status = logfile_->Sync();
+        if (!status.ok()) {
+          sync_error = true;
+        }
+      }
+      mutex_.Lock();
+      if (sync_error) {
+        // The state of the log file is indeterminate: the log record we
+        // just added may or may not show up when the DB is re-opened.
+        // So we force the DB into a mode where all future writes fail.
+        RecordBackgroundError(status);
+      }
+    }
+    // Queue up for the memtable even on failure so that the sequence
+    // numbers used by the group are published in order.
+    group.status = status;
+    memtable_writers_.push_back(&group);
+  }
+
+  while (true) {
+    Writer* ready = writers_.front();
+    writers_.pop_front();
+    if (ready != &w) {
+      group.followers.push_back(ready);
+    }
+    if (ready == last_writer) break;
+  }
+
+  // Notify new head of write queue: it may start logging right away.
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  if (group.batch != nullptr) {
+    while (memtable_writers_.front() != &group) {
+      memtable_write_signal_.Wait();
+    }
+    // mem_ cannot be switched while memtable_writers_ is non-empty.
+    if (status.ok() && options_.allow_concurrent_memtable_write &&
+        group.batch != w.batch) {
+      std::vector<Writer*> followers;
+      for (Writer* follower : group.followers) {
+        if (follower->batch != nullptr) {
+          followers.push_back(follower);
+        }
+      }
+      status = ParallelInsertIntoMemTable(&w, group.batch, followers);
+    } else if (status.ok()) {
+      MemTable* mem = mem_;
+      mutex_.Unlock();
+      status = WriteBatchInternal::InsertInto(group.batch, mem);
+      mutex_.Lock();
+    }
+    versions_->SetLastSequence(group.last_sequence);
+    memtable_writers_.pop_front();
+    memtable_write_signal_.SignalAll();
+  }
+
+  for (Writer* ready : group.followers) {
+    ready->status = status;
+    ready->done = true;
+    ready->cv.Signal();
+  }
+  return status;
+}
+
+// Waits until "w" is done or at the front of the writer queue.  While
+// waiting, applies w's batch to the memtable if its group leader asks for
+// it (see ParallelInsertIntoMemTable()).
+void DBImpl::AwaitWriteTurn(Writer* w) {
+  mutex_.AssertHeld();
+  while (!w->done && (writers_.empty() || w != writers_.front())) {
+    if (w->memtable != nullptr) {
+      MemTable* mem = w->memtable;
+      w->memtable = nullptr;
+      mutex_.Unlock();
+      Status s = WriteBatchInternal::InsertIntoConcurrently(w->batch, mem);
+      mutex_.Lock();
+      w->status = s;
+      if (--w->leader->pending_inserts == 0) {
+        w->leader->cv.Signal();
+      }
+    } else {
+      w->cv.Wait();
+    }
+  }
+}
+
+// Applies a logged write group to mem_ with every writer inserting its
+// own batch in parallel.  "group_batch" is the combined batch of "leader"
+// and "followers" (the group's writers with a non-null batch, in order),
+// and already carries the group's first sequence number.
+Status DBImpl::ParallelInsertIntoMemTable(
+    Writer* leader, WriteBatch* group_batch,
+    const std::vector<Writer*>& followers) {
+  mutex_.AssertHeld();
+  MemTable* mem = mem_;
+
+  // Hand each writer the range of sequence numbers its batch occupies
+  // within group_batch, then wake the followers up to insert.
+  SequenceNumber sequence = WriteBatchInternal::Sequence(group_batch);
+  WriteBatchInternal::SetSequence(leader->batch, sequence);
+  sequence += WriteBatchInternal::Count(leader->batch);
+  leader->pending_inserts = 0;
+  for (Writer* follower : followers) {
+    WriteBatchInternal::SetSequence(follower->batch, sequence);
+    sequence += WriteBatchInternal::Count(follower->batch);
+    follower->memtable = mem;
+    follower->leader = leader;
+    leader->pending_inserts++;
+    follower->cv.Signal();
+  }
+  assert(sequence == WriteBatchInternal::Sequence(group_batch) +
+                         WriteBatchInternal::Count(group_batch));
+
+  mutex_.Unlock();
+  Status status =
+      WriteBatchInternal::InsertIntoConcurrently(leader->batch, mem);
+  mutex_.Lock();
+  while (leader->pending_inserts > 0) {
+    leader->cv.Wait();
+  }
+  for (Writer* follower : followers) {
+    if (!status.ok()) break;
+    status = follower->status;
+  }
+  return status;
+}
+
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+// REQUIRES: tmp_batch must be empty
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* tmp_batch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1316,7 +2400,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       // Append to *result
       if (result == first->batch) {
         // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
+        result = tmp_batch;
         assert(WriteBatchInternal::Count(result) == 0);
         WriteBatchInternal::Append(result, first->batch);
       }
@@ -1324,33 +2408,59 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
     }
     *last_writer = w;
   }
+
+  // The followers ride along with the delay already paid by the first
+  // writer; bill their bytes to the next write group.
+  write_controller_.Charge(WriteBatchInternal::ByteSize(result) -
+                           WriteBatchInternal::ByteSize(first->batch));
   return result;
 }
 
+void DBImpl::UpdateWriteController() {
+  mutex_.AssertHeld();
+  const int level0_files = versions_->NumLevelFiles(0);
+  const uint64_t pending_bytes = versions_->PendingCompactionBytes();
+  const bool delay =
+      level0_files >= options_.level0_slowdown_writes_trigger ||
+      (options_.soft_pending_compaction_bytes_limit > 0 &&
+       pending_bytes >= options_.soft_pending_compaction_bytes_limit);
+  write_controller_.Update(delay, level0_files, pending_bytes,
+                           delay ? env_->NowMicros() : 0);
+}
+
 // REQUIRES: mutex_ is held
 // REQUIRES: this thread is currently at the front of the writer queue
 Status DBImpl::MakeRoomForWrite(bool force) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   bool allow_delay = !force;
+  bool allow_stall = true;  // Cleared if no compaction can pay off the debt
+  UpdateWriteController();
   Status s;
   while (true) {
     if (!bg_error_.ok()) {
       // Yield previous error
       s = bg_error_;
       break;
-    } else if (allow_delay && versions_->NumLevelFiles(0) >=
-                                  config::kL0_SlowdownWritesTrigger) {
+    } else if (allow_delay && write_controller_.IsDelayed()) {
       // We are getting close to hitting a hard limit on the number of
-      // L0 files.  Rather than delaying a single write by several
-      // seconds when we hit the hard limit, start delaying each
-      // individual write by 1ms to reduce latency variance.  Also,
-      // this delay hands over some CPU to the compaction thread in
-      // case it is sharing the same core as the writer.
-      mutex_.Unlock();
-      env_->SleepForMicroseconds(1000);
+      // L0 files or pending compaction bytes.  Rather than delaying a
+      // single write by several seconds when we hit the hard limit,
+      // throttle every write to the rate set by the write controller to
+      // reduce latency variance.  Also, this delay hands over some CPU to
+      // the compaction threads in case they share a core with the writer.
+      uint64_t delay = write_controller_.GetDelay(
+          env_->NowMicros(),
+          WriteBatchInternal::ByteSize(writers_.front()->batch));
       allow_delay = false;  // Do not delay a single write more than once
-      mutex_.Lock();
+      while (delay > 0 && bg_error_.ok() &&
+             !shutting_down_.load(std::memory_order_acquire)) {
+        const uint64_t slice = std::min(delay, kMaxDelaySliceMicros);
+        mutex_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(slice));
+        mutex_.Lock();
+        delay -= slice;
+      }
     } else if (!force &&
                (mem_->ApproximateMemoryUsage() <= options_.write_buffer_size)) {
       // There is room in current memtable
@@ -1360,10 +2470,30 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // one is still being compacted, so we wait.
       Log(options_.info_log, "Current memtable full; waiting...\n");
       background_work_finished_signal_.Wait();
-    } else if (versions_->NumLevelFiles(0) >= config::kL0_StopWritesTrigger) {
+    } else if (versions_->NumLevelFiles(0) >=
+               options_.level0_stop_writes_trigger) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
       background_work_finished_signal_.Wait();
+    } else if (allow_stall &&
+               options_.hard_pending_compaction_bytes_limit > 0 &&
+               versions_->PendingCompactionBytes() >=
+                   options_.hard_pending_compaction_bytes_limit) {
+      // Compactions are too far behind.  Wait for them to catch up, unless
+      // none is running or can be scheduled, in which case nothing would
+      // ever wake us up.
+      MaybeScheduleCompaction();
+      if (background_compactions_scheduled_ > 0) {
+        Log(options_.info_log,
+            "Too many pending compaction bytes; waiting...\n");
+        background_work_finished_signal_.Wait();
+      } else {
+        allow_stall = false;
+      }
+    } else if (!memtable_writers_.empty()) {
+      // Pipelined writes are still being applied to mem_; let them
+      // finish before it becomes immutable.
+      memtable_write_signal_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
@@ -1394,6 +2524,7 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       logfile_ = lfile;
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
+      mem_->MarkImmutable();
       imm_ = mem_;
       has_imm_.store(true, std::memory_order_release);
       mem_ = new MemTable(internal_comparator_);
@@ -1418,7 +2549,7 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
     in.remove_prefix(strlen("num-files-at-level"));
     uint64_t level;
     bool ok = ConsumeDecimalNumber(&in, &level) && in.empty();
-    if (!ok || level >= config::kNumLevels) {
+    if (!ok || level >= static_cast<uint64_t>(options_.num_levels)) {
       return false;
     } else {
       char buf[100];
@@ -1434,7 +2565,7 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
                   "Level  Files Size(MB) Time(sec) Read(MB) Write(MB)\n"
                   "--------------------------------------------------\n");
     value->append(buf);
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < options_.num_levels; level++) {
       int files = versions_->NumLevelFiles(level);
       if (stats_[level].micros > 0 || files > 0) {
         std::snprintf(buf, sizeof(buf), "%3d %8d %8.0f %9.0f %8.0f %9.0f\n",
@@ -1446,6 +2577,22 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
       }
     }
     return true;
+  } else if (in == "estimate-pending-compaction-bytes") {
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(
+                      versions_->PendingCompactionBytes()));
+    value->append(buf);
+    return true;
+  } else if (in == "actual-delayed-write-rate") {
+    const uint64_t rate = write_controller_.IsDelayed()
+                              ? write_controller_.delayed_write_rate()
+                              : 0;
+    char buf[50];
+    std::snprintf(buf, sizeof(buf), "%llu",
+                  static_cast<unsigned long long>(rate));
+    value->append(buf);
+    return true;
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
@@ -1499,6 +2646,55 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+Status DB::DeleteRange(const WriteOptions& opt, const Slice& begin_key,
+                       const Slice& end_key) {
+  WriteBatch batch;
+  batch.DeleteRange(begin_key, end_key);
+  return Write(opt, &batch);
+}
+
+Status DB::Merge(const WriteOptions& opt, const Slice& key,
+                 const Slice& value) {
+  WriteBatch batch;
+  batch.Merge(key, value);
+  return Write(opt, &batch);
+}
+
+Status DB::Get(const ReadOptions& options, const Slice& key,
+               PinnableSlice* value) {
+  value->Reset();
+  std::string copy;
+  Status s = Get(options, key, &copy);
+  if (s.ok()) {
+    value->PinSelf(copy);
+  }
+  return s;
+}
+
+void DB::MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                  std::vector<std::string>* values,
+                  std::vector<Status>* statuses) {
+  values->clear();
+  values->resize(keys.size());
+  statuses->clear();
+  statuses->reserve(keys.size());
+  ReadOptions read_options = options;
+  if (options.snapshot == nullptr) {
+    // Keep writes that land between the lookups out of the batch.
+    read_options.snapshot = GetSnapshot();
+  }
+  for (size_t i = 0; i < keys.size(); i++) {
+    statuses->push_back(Get(read_options, keys[i], &(*values)[i]));
+  }
+  if (options.snapshot == nullptr) {
+    ReleaseSnapshot(read_options.snapshot);
+  }
+}
+
+Status DB::DeleteFilesInRange(const Slice* begin, const Slice* end) {
+  return Status::NotSupported("DeleteFilesInRange");
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -9,10 +9,13 @@
 #include <deque>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "db/log_writer.h"
 #include "db/snapshot.h"
+#include "db/ttl.h"
+#include "db/write_controller.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "port/port.h"
@@ -62,6 +65,7 @@
 namespace leveldb {
 
 class MemTable;
+class RangeTombstoneList;
 class TableCache;
 class Version;
 class VersionEdit;
@@ -80,15 +84,23 @@ class DBImpl : public DB {
   Status Put(const WriteOptions&, const Slice& key,
              const Slice& value) override;
   Status Delete(const WriteOptions&, const Slice& key) override;
+  Status Merge(const WriteOptions&, const Slice& key,
+               const Slice& value) override;
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  Status Get(const ReadOptions& options, const Slice& key,
+             PinnableSlice* value) override;
+  void MultiGet(const ReadOptions& options, const std::vector<Slice>& keys,
+                std::vector<std::string>* values,
+                std::vector<Status>* statuses) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
   bool GetProperty(const Slice& property, std::string* value) override;
   void GetApproximateSizes(const Range* range, int n, uint64_t* sizes) override;
   void CompactRange(const Slice* begin, const Slice* end) override;
+  Status DeleteFilesInRange(const Slice* begin, const Slice* end) override;
 
   // Extra methods (for testing) that are not in the public DB interface
 
@@ -98,6 +110,10 @@ class DBImpl : public DB {
   // Force current memtable contents to be compacted.
   Status TEST_CompactMemTable();
 
+  // Wait until no memtable or table compaction is scheduled, including
+  // the ones that the finished compactions schedule in turn.
+  void TEST_WaitForCompactions();
+
   // Return an internal iterator over the current state of the database.
   // The keys of this iterator are internal keys (see format.h).
   // The returned iterator should be deleted when no longer needed.
@@ -115,12 +131,15 @@ class DBImpl : public DB {
  private:
   friend class DB;
   struct CompactionState;
+  struct MemTableWriteGroup;
+  struct Subcompaction;
   struct Writer;
 
   // Information for a manual compaction
   struct ManualCompaction {
     int level;
     bool done;
+    bool in_progress;          // Being run by a background compaction
     const InternalKey* begin;  // null means beginning of key range
     const InternalKey* end;    // null means end of key range
     InternalKey tmp_storage;   // Used to keep track of compaction progress
@@ -142,9 +161,20 @@ class DBImpl : public DB {
     int64_t bytes_written;
   };
 
-  Iterator* NewInternalIterator(const ReadOptions&,
-                                SequenceNumber* latest_snapshot,
-                                uint32_t* seed);
+  // If "range_tombstones" is non-null, sets *range_tombstones to the
+  // lists of range tombstones of the sources of the result that have any.
+  // The lists stay valid for as long as the result is live.
+  Iterator* NewInternalIterator(
+      const ReadOptions&, SequenceNumber* latest_snapshot, uint32_t* seed,
+      std::vector<const RangeTombstoneList*>* range_tombstones = nullptr);
+
+  // Implementation of the Get() methods: exactly one of "value" and
+  // "pinnable" is non-null.
+  Status GetImpl(const ReadOptions& options, const Slice& key,
+                 std::string* value, PinnableSlice* pinnable);
+
+  // Cleanup of values pinned in memtable "mem" of "db".
+  static void UnrefMemTable(void* db, void* mem);
 
   Status NewDB();
 
@@ -156,6 +186,10 @@ class DBImpl : public DB {
 
   void MaybeIgnoreError(Status* s) const;
 
+  // The creation time to record for a new table file: the current time
+  // with a TTL, and else 0, which keeps the descriptor format unchanged.
+  uint64_t NewFileCreationTime() const;
+
   // Delete any unneeded files and stale in-memory entries.
   void RemoveObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -168,26 +202,65 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
+  // Build a level-0 table from *mem and add it to *edit.  The number of
+  // the new table is stored in *file_number and stays in pending_outputs_
+  // until the caller erases it, which it should do once *edit has been
+  // applied.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          uint64_t* file_number)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* tmp_batch)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Feed the current compaction backlog to write_controller_.
+  void UpdateWriteController() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Implementation of Write() used when options_.enable_pipelined_write
+  // is set.
+  Status PipelinedWrite(const WriteOptions& options, WriteBatch* updates);
+
+  void AwaitWriteTurn(Writer* w) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  Status ParallelInsertIntoMemTable(Writer* leader, WriteBatch* group_batch,
+                                    const std::vector<Writer*>& followers)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   static void BGWork(void* db);
+  static void BGFlushWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  void BackgroundFlushCall();
+  // Returns false if there was no compaction that could be run.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Write the entries of *input whose user keys are in [*begin, *end), and
+  // the input range tombstones clipped to that range, to the outputs of
+  // *compact.  A null begin or end leaves the range unbounded on that
+  // side.  If imm_micros is non-null, memtable compactions are done in
+  // between and the time spent on them is added to *imm_micros.
+  Status ProcessCompactionRange(CompactionState* compact, Iterator* input,
+                                const Slice* begin, const Slice* end,
+                                int64_t* imm_micros);
+  static void BGSubcompactionWork(void* arg);
+
   Status OpenCompactionOutputFile(CompactionState* compact);
+  void AddToCompactionOutput(CompactionState* compact, const Slice& key,
+                             const Slice& value);
+
+  // Add to the current output of *compact the parts, before *upper (or
+  // all of them if upper is null), of the input range tombstones that are
+  // not written yet and are still needed.  Opens an output if there is
+  // none and some tombstone is needed.
+  Status AddCompactionRangeTombstones(CompactionState* compact,
+                                      const Slice* upper);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
   Status InstallCompactionResults(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
@@ -196,10 +269,24 @@ class DBImpl : public DB {
     return internal_comparator_.user_comparator();
   }
 
+  // Returns the user's prefix extractor, or null if there is none.
+  const SliceTransform* raw_prefix_extractor() const {
+    return internal_prefix_extractor_.user_transform();
+  }
+
+  // Whether several compactions may run at once.  If so, memtable
+  // compactions are scheduled separately from table compactions.
+  bool parallel_compactions() const {
+    return options_.max_background_compactions > 1;
+  }
+
   // Constant after construction
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  const InternalKeySliceTransform internal_prefix_extractor_;
+  const TtlCompactionFilter ttl_compaction_filter_;
+  const TtlMergeOperator ttl_merge_operator_;
   const Options options_;  // options_.comparator == &internal_comparator_
   const bool owns_info_log_;
   const bool owns_cache_;
@@ -227,14 +314,23 @@ class DBImpl : public DB {
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
   WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
 
+  // Groups that have been logged but not yet applied to mem_, in
+  // sequence number order.  Only used for pipelined writes.
+  std::deque<MemTableWriteGroup*> memtable_writers_ GUARDED_BY(mutex_);
+  port::CondVar memtable_write_signal_ GUARDED_BY(mutex_);
+
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
   // Set of table files to protect from deletion because they are
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Number of background compactions that are scheduled or running.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+
+  // Has a memtable compaction been scheduled on its own, or is it running?
+  // Only used if parallel_compactions().
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
@@ -243,14 +339,22 @@ class DBImpl : public DB {
   // Have we encountered a background error in paranoid mode?
   Status bg_error_ GUARDED_BY(mutex_);
 
-  CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+  std::vector<CompactionStats> stats_ GUARDED_BY(mutex_);
+
+  // Throttles writes while compactions are falling behind.
+  WriteController write_controller_ GUARDED_BY(mutex_);
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
-// it is not equal to src.info_log.
+// it is not equal to src.info_log.  If src.ttl is set, the compaction
+// filter and the merge operator are replaced by *ttl_filter and
+// *ttl_merge_operator, unless those are null.
 Options SanitizeOptions(const std::string& db,
                         const InternalKeyComparator* icmp,
                         const InternalFilterPolicy* ipolicy,
+                        const InternalKeySliceTransform* iprefix,
+                        const TtlCompactionFilter* ttl_filter,
+                        const TtlMergeOperator* ttl_merge_operator,
                         const Options& src);
 
 }  // namespace leveldb
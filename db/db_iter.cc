@@ -4,9 +4,14 @@
 
 #include "db/db_iter.h"
 
+#include <utility>
+
 #include "db/db_impl.h"
 #include "db/dbformat.h"
 #include "db/filename.h"
+#include "db/merge_context.h"
+#include "db/range_tombstone.h"
+#include "db/ttl.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "port/port.h"
@@ -43,31 +48,53 @@ class DBIter : public Iterator {
   //     the exact entry that yields this->key(), this->value()
   // (2) When moving backwards, the internal iterator is positioned
   //     just before all entries whose user key == this->key().
+  // Except that when moving forward over a key whose value is the result
+  // of a merge (merged_ is true), the internal iterator is positioned
+  // just after the merge operands of this->key().
   enum Direction { kForward, kReverse };
 
-  DBIter(DBImpl* db, const Comparator* cmp, Iterator* iter, SequenceNumber s,
-         uint32_t seed)
+  DBIter(DBImpl* db, const Comparator* cmp, const SliceTransform* prefix,
+         bool* prefix_seek, Iterator* iter, SequenceNumber s, uint32_t seed,
+         const MergeOperator* merge_operator, uint64_t ttl, uint64_t now,
+         std::vector<const RangeTombstoneList*> range_tombstones)
       : db_(db),
         user_comparator_(cmp),
+        prefix_extractor_(prefix),
+        prefix_seek_(prefix_seek),
+        merge_operator_(merge_operator),
+        ttl_(ttl),
+        now_(now),
         iter_(iter),
+        range_tombstones_(std::move(range_tombstones)),
         sequence_(s),
         direction_(kForward),
         valid_(false),
+        merged_(false),
+        prefix_bounded_(false),
         rnd_(seed),
         bytes_until_read_sampling_(RandomCompactionPeriod()) {}
 
   DBIter(const DBIter&) = delete;
   DBIter& operator=(const DBIter&) = delete;
 
-  ~DBIter() override { delete iter_; }
+  ~DBIter() override {
+    delete iter_;
+    delete prefix_seek_;
+  }
   bool Valid() const override { return valid_; }
   Slice key() const override {
     assert(valid_);
-    return (direction_ == kForward) ? ExtractUserKey(iter_->key()) : saved_key_;
+    return (direction_ == kForward && !merged_) ? ExtractUserKey(iter_->key())
+                                                : saved_key_;
   }
   Slice value() const override {
     assert(valid_);
-    return (direction_ == kForward) ? iter_->value() : saved_value_;
+    Slice v = (direction_ == kForward && !merged_) ? iter_->value()
+                                                   : Slice(saved_value_);
+    if (ttl_ > 0) {
+      v.remove_suffix(kTtlTimestampSize);  // Checked by IsExpired()
+    }
+    return v;
   }
   Status status() const override {
     if (status_.ok()) {
@@ -86,7 +113,36 @@ class DBIter : public Iterator {
  private:
   void FindNextUserEntry(bool skipping, std::string* skip);
   void FindPrevUserEntry();
+  bool MergeForward();
+  bool MergeReverse(const std::vector<std::string>& operands, bool has_base);
   bool ParseKey(ParsedInternalKey* key);
+  void CheckPrefix();
+
+  // Return true iff a range tombstone visible at sequence_ deletes the
+  // entry with the given key.
+  bool IsCovered(const ParsedInternalKey& ikey) const {
+    for (const RangeTombstoneList* list : range_tombstones_) {
+      if (list->MaxCoveringSequence(ikey.user_key, sequence_) > ikey.sequence) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Return true iff the value, with its write time appended, has expired.
+  // A value without a write time is reported as a corruption and hidden.
+  bool IsExpired(const Slice& stamped) {
+    if (ttl_ == 0) {
+      return false;
+    }
+    Slice value;
+    uint64_t write_time;
+    if (!ParseTtlValue(stamped, &value, &write_time)) {
+      status_ = Status::Corruption("missing write time in DBIter");
+      return true;
+    }
+    return IsTtlExpired(write_time, ttl_, now_);
+  }
 
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
@@ -108,13 +164,23 @@ class DBIter : public Iterator {
 
   DBImpl* db_;
   const Comparator* const user_comparator_;
+  const SliceTransform* const prefix_extractor_;  // Null unless bounded
+  bool* const prefix_seek_;  // True during prefix-bounded seeks, or null
+  const MergeOperator* const merge_operator_;
+  const uint64_t ttl_;  // Zero unless values carry their write time
+  const uint64_t now_;
   Iterator* const iter_;
+  // Kept alive by iter_
+  const std::vector<const RangeTombstoneList*> range_tombstones_;
   SequenceNumber const sequence_;
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
   Direction direction_;
   bool valid_;
+  bool merged_;  // Current key and value are in saved_key_, saved_value_
+  bool prefix_bounded_;       // Only keys with prefix_start_ are valid
+  std::string prefix_start_;  // Prefix of the last Seek() target
   Random rnd_;
   size_t bytes_until_read_sampling_;
 };
@@ -138,6 +204,17 @@ inline bool DBIter::ParseKey(ParsedInternalKey* ikey) {
   }
 }
 
+// Invalidate the iterator once it has left the prefix of the last Seek().
+inline void DBIter::CheckPrefix() {
+  if (valid_ && prefix_bounded_) {
+    const Slice k = key();
+    if (!prefix_extractor_->InDomain(k) ||
+        prefix_extractor_->Transform(k) != Slice(prefix_start_)) {
+      valid_ = false;
+    }
+  }
+}
+
 void DBIter::Next() {
   assert(valid_);
 
@@ -157,6 +234,16 @@ void DBIter::Next() {
       return;
     }
     // saved_key_ already contains the key to skip past.
+  } else if (merged_) {
+    // iter_ is already past the merge operands of saved_key_, and the
+    // normal skipping code below skips the entries they were merged with.
+    merged_ = false;
+    if (!iter_->Valid()) {
+      valid_ = false;
+      saved_key_.clear();
+      ClearSavedValue();
+      return;
+    }
   } else {
     // Store in saved_key_ the current key so we skip it below.
     SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
@@ -172,6 +259,7 @@ void DBIter::Next() {
   }
 
   FindNextUserEntry(true, &saved_key_);
+  CheckPrefix();
 }
 
 void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
@@ -183,6 +271,7 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
     if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
       switch (ikey.type) {
         case kTypeDeletion:
+        case kTypeRangeDeletion:
           // Arrange to skip all upcoming entries for this key since
           // they are hidden by this deletion.
           SaveKey(ikey.user_key, skip);
@@ -192,12 +281,33 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
           if (skipping &&
               user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
             // Entry hidden
+          } else if (IsCovered(ikey) || IsExpired(iter_->value())) {
+            // Deleted by a range tombstone or expired, and the older
+            // entries are hidden
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
           } else {
             valid_ = true;
             saved_key_.clear();
             return;
           }
           break;
+        case kTypeMerge:
+          if (skipping &&
+              user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            // Entry hidden
+          } else if (IsCovered(ikey)) {
+            SaveKey(ikey.user_key, skip);
+            skipping = true;
+          } else if (MergeForward()) {
+            return;
+          } else {
+            // The merged value has expired.  iter_ is past the operands.
+            *skip = saved_key_;
+            skipping = true;
+            continue;
+          }
+          break;
       }
     }
     iter_->Next();
@@ -206,14 +316,83 @@ void DBIter::FindNextUserEntry(bool skipping, std::string* skip) {
   valid_ = false;
 }
 
+// Returns false, leaving the key in saved_key_, if the merged value has
+// expired.
+bool DBIter::MergeForward() {
+  // iter_ is pointing at the newest visible merge operand of its key.
+  // Collect the operands down to the value or deletion they apply to.
+  SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+  MergeContext merge_context;
+  merge_context.PushOperand(iter_->value());
+  Slice base;
+  bool has_base = false;
+  for (iter_->Next(); iter_->Valid(); iter_->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseKey(&ikey) ||
+        user_comparator_->Compare(ikey.user_key, saved_key_) != 0 ||
+        IsCovered(ikey)) {
+      break;
+    }
+    if (ikey.type == kTypeMerge) {
+      merge_context.PushOperand(iter_->value());
+      continue;
+    }
+    if (ikey.type == kTypeValue) {
+      base = iter_->value();
+      has_base = true;
+    }
+    break;
+  }
+
+  std::string merged;
+  Status s = merge_context.Merge(merge_operator_, saved_key_,
+                                 has_base ? &base : nullptr, &merged);
+  if (!s.ok()) {
+    status_ = s;
+    saved_key_.clear();
+    valid_ = false;
+    return true;
+  }
+  saved_value_.swap(merged);
+  valid_ = !IsExpired(saved_value_);
+  merged_ = valid_;
+  return valid_;
+}
+
+// Replace saved_value_ by the result of applying "operands", oldest first,
+// to saved_value_ if has_base is true, and else to no value.  Returns
+// false if the merge fails or its result has expired.
+bool DBIter::MergeReverse(const std::vector<std::string>& operands,
+                          bool has_base) {
+  std::vector<Slice> operand_slices(operands.begin(), operands.end());
+  Slice base(saved_value_);
+  std::string merged;
+  Status s = FullMerge(merge_operator_, saved_key_, has_base ? &base : nullptr,
+                       operand_slices, &merged);
+  if (!s.ok()) {
+    status_ = s;
+    return false;
+  }
+  saved_value_.swap(merged);
+  return !IsExpired(saved_value_);
+}
+
 void DBIter::Prev() {
   assert(valid_);
 
   if (direction_ == kForward) {  // Switch directions?
     // iter_ is pointing at the current entry.  Scan backwards until
     // the key changes so we can use the normal reverse scanning code.
-    assert(iter_->Valid());  // Otherwise valid_ would have been false
-    SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    if (merged_) {
+      // iter_ is past the entries of saved_key_ that were merged
+      merged_ = false;
+      if (!iter_->Valid()) {
+        iter_->SeekToLast();
+      }
+    } else {
+      assert(iter_->Valid());  // Otherwise valid_ would have been false
+      SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+    }
     while (true) {
       iter_->Prev();
       if (!iter_->Valid()) {
@@ -231,26 +410,55 @@ void DBIter::Prev() {
   }
 
   FindPrevUserEntry();
+  CheckPrefix();
 }
 
 void DBIter::FindPrevUserEntry() {
   assert(direction_ == kReverse);
 
   ValueType value_type = kTypeDeletion;
+  // Merge operands newer than the value in saved_value_, if any
+  std::vector<std::string> operands;  // Oldest first
+  bool has_base = false;
   if (iter_->Valid()) {
     do {
       ParsedInternalKey ikey;
       if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
         if ((value_type != kTypeDeletion) &&
             user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
-          // We encountered a non-deleted value in entries for previous keys,
-          break;
+          if (value_type == kTypeMerge) {
+            value_type = MergeReverse(operands, has_base) ? kTypeValue
+                                                          : kTypeDeletion;
+          }
+          if (value_type != kTypeDeletion) {
+            // We encountered a non-deleted value in entries for previous
+            // keys,
+            break;
+          }
         }
-        value_type = ikey.type;
-        if (value_type == kTypeDeletion) {
+        const ValueType previous_type = value_type;
+        value_type = IsCovered(ikey) ? kTypeDeletion : ikey.type;
+        if (value_type == kTypeValue && IsExpired(iter_->value())) {
+          value_type = kTypeDeletion;
+        }
+        if (value_type == kTypeMerge) {
+          if (previous_type == kTypeDeletion) {
+            SaveKey(ExtractUserKey(iter_->key()), &saved_key_);
+            ClearSavedValue();
+            operands.clear();
+            has_base = false;
+          } else if (previous_type == kTypeValue) {
+            has_base = true;
+          }
+          Slice operand = iter_->value();
+          operands.emplace_back(operand.data(), operand.size());
+        } else if (value_type != kTypeValue) {
+          value_type = kTypeDeletion;
+          operands.clear();
           saved_key_.clear();
           ClearSavedValue();
         } else {
+          operands.clear();
           Slice raw_value = iter_->value();
           if (saved_value_.capacity() > raw_value.size() + 1048576) {
             std::string empty;
@@ -264,6 +472,11 @@ void DBIter::FindPrevUserEntry() {
     } while (iter_->Valid());
   }
 
+  if (value_type == kTypeMerge) {
+    value_type =
+        MergeReverse(operands, has_base) ? kTypeValue : kTypeDeletion;
+  }
+
   if (value_type == kTypeDeletion) {
     // End
     valid_ = false;
@@ -277,13 +490,27 @@ void DBIter::FindPrevUserEntry() {
 
 void DBIter::Seek(const Slice& target) {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
+  prefix_bounded_ =
+      prefix_extractor_ != nullptr && prefix_extractor_->InDomain(target);
+  if (prefix_bounded_) {
+    const Slice prefix = prefix_extractor_->Transform(target);
+    prefix_start_.assign(prefix.data(), prefix.size());
+  }
   saved_key_.clear();
   AppendInternalKey(&saved_key_,
                     ParsedInternalKey(target, sequence_, kValueTypeForSeek));
-  iter_->Seek(saved_key_);
+  if (prefix_bounded_ && prefix_seek_ != nullptr) {
+    *prefix_seek_ = true;
+    iter_->Seek(saved_key_);
+    *prefix_seek_ = false;
+  } else {
+    iter_->Seek(saved_key_);
+  }
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
+    CheckPrefix();
   } else {
     valid_ = false;
   }
@@ -291,7 +518,9 @@ void DBIter::Seek(const Slice& target) {
 
 void DBIter::SeekToFirst() {
   direction_ = kForward;
+  merged_ = false;
   ClearSavedValue();
+  prefix_bounded_ = false;
   iter_->SeekToFirst();
   if (iter_->Valid()) {
     FindNextUserEntry(false, &saved_key_ /* temporary storage */);
@@ -302,7 +531,9 @@ void DBIter::SeekToFirst() {
 
 void DBIter::SeekToLast() {
   direction_ = kReverse;
+  merged_ = false;
   ClearSavedValue();
+  prefix_bounded_ = false;
   iter_->SeekToLast();
   FindPrevUserEntry();
 }
@@ -310,9 +541,16 @@ void DBIter::SeekToLast() {
 }  // anonymous namespace
 
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
-                        Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed) {
-  return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
+                        const SliceTransform* prefix_extractor,
+                        bool* prefix_seek, Iterator* internal_iter,
+                        SequenceNumber sequence, uint32_t seed,
+                        const MergeOperator* merge_operator, uint64_t ttl,
+                        uint64_t now,
+                        std::vector<const RangeTombstoneList*>
+                            range_tombstones) {
+  return new DBIter(db, user_key_comparator, prefix_extractor, prefix_seek,
+                    internal_iter, sequence, seed, merge_operator, ttl, now,
+                    std::move(range_tombstones));
 }
 
 }  // namespace leveldb
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_DB_ITER_H_
 
 #include <cstdint>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "leveldb/db.h"
@@ -22,13 +23,29 @@
 namespace leveldb {
 
 class DBImpl;
+class MergeOperator;
+class RangeTombstoneList;
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  If "prefix_extractor" is non-null, the
+// iterator stops at the first key whose prefix differs from the prefix of
+// the last Seek() target, and "*prefix_seek" (if non-null) is set while
+// it seeks "*internal_iter" to such a target (see ReadOptions::prefix_seek).
+// "prefix_seek" is owned by the returned iterator.  "range_tombstones"
+// holds the range tombstones of the sources of "*internal_iter", in lists
+// that must stay valid while "*internal_iter" is live.  Merge operands
+// are combined with "merge_operator".  If "ttl" is non-zero, values carry
+// their write time, and the values that have expired at "now" are skipped
+// (see db/ttl.h).
 Iterator* NewDBIterator(DBImpl* db, const Comparator* user_key_comparator,
-                        Iterator* internal_iter, SequenceNumber sequence,
-                        uint32_t seed);
+                        const SliceTransform* prefix_extractor,
+                        bool* prefix_seek, Iterator* internal_iter,
+                        SequenceNumber sequence, uint32_t seed,
+                        const MergeOperator* merge_operator, uint64_t ttl,
+                        uint64_t now,
+                        std::vector<const RangeTombstoneList*>
+                            range_tombstones);
 
 }  // namespace leveldb
 
@@ -6,7 +6,9 @@
 
 #include <atomic>
 #include <cinttypes>
+#include <memory>
 #include <string>
+#include <thread>
 
 #include "gtest/gtest.h"
 #include "db/db_impl.h"
@@ -14,8 +16,12 @@
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "leveldb/cache.h"
+#include "leveldb/compaction_filter.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/rate_limiter.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -138,6 +144,12 @@ class SpecialEnv : public EnvWrapper {
   // Force log file close to fail while this bool is true.
   std::atomic<bool> log_file_close_;
 
+  // Background work scheduled through this env waits while this is true.
+  std::atomic<bool> delay_background_work_;
+
+  // Added to the time reported by NowMicros().
+  std::atomic<uint64_t> now_offset_micros_;
+
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
@@ -150,8 +162,20 @@ class SpecialEnv : public EnvWrapper {
         manifest_sync_error_(false),
         manifest_write_error_(false),
         log_file_close_(false),
+        delay_background_work_(false),
+        now_offset_micros_(0),
         count_random_reads_(false) {}
 
+  void Schedule(void (*function)(void*), void* arg) override {
+    target()->Schedule(&SpecialEnv::BackgroundWork,
+                       new BackgroundWorkItem{this, function, arg});
+  }
+
+  uint64_t NowMicros() override {
+    return target()->NowMicros() +
+           now_offset_micros_.load(std::memory_order_acquire);
+  }
+
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
      private:
@@ -255,6 +279,22 @@ class SpecialEnv : public EnvWrapper {
     }
     return s;
   }
+
+ private:
+  struct BackgroundWorkItem {
+    SpecialEnv* env;
+    void (*function)(void*);
+    void* arg;
+  };
+
+  static void BackgroundWork(void* arg) {
+    BackgroundWorkItem* item = reinterpret_cast<BackgroundWorkItem*>(arg);
+    while (item->env->delay_background_work_.load(std::memory_order_acquire)) {
+      DelayMilliseconds(10);
+    }
+    item->function(item->arg);
+    delete item;
+  }
 };
 
 class DBTest : public testing::Test {
@@ -292,6 +332,12 @@ class DBTest : public testing::Test {
     }
   }
 
+  // Returns true if memtable compactions may write to levels other than
+  // level-0 in the current option configuration.
+  bool CanPushMemTableOutput() const {
+    return option_config_ != kParallelCompactions;
+  }
+
   // Return the current option configuration.
   Options CurrentOptions() {
     Options options;
@@ -306,6 +352,21 @@ class DBTest : public testing::Test {
       case kUncompressed:
         options.compression = kNoCompression;
         break;
+      case kDataBlockHashIndex:
+        options.data_block_hash_index = true;
+        break;
+      case kPipelinedWrite:
+        options.enable_pipelined_write = true;
+        break;
+      case kConcurrentMemTableWrite:
+        options.allow_concurrent_memtable_write = true;
+        break;
+      case kParallelCompactions:
+        options.max_background_compactions = 4;
+        break;
+      case kSubcompactions:
+        options.max_subcompactions = 4;
+        break;
       default:
         break;
     }
@@ -351,6 +412,10 @@ class DBTest : public testing::Test {
 
   Status Delete(const std::string& k) { return db_->Delete(WriteOptions(), k); }
 
+  Status Merge(const std::string& k, const std::string& v) {
+    return db_->Merge(WriteOptions(), k, v);
+  }
+
   std::string Get(const std::string& k, const Snapshot* snapshot = nullptr) {
     ReadOptions options;
     options.snapshot = snapshot;
@@ -420,6 +485,12 @@ class DBTest : public testing::Test {
             case kTypeDeletion:
               result += "DEL";
               break;
+            case kTypeRangeDeletion:
+              result += "RANGEDEL";
+              break;
+            case kTypeMerge:
+              result += "MERGE:" + iter->value().ToString();
+              break;
           }
         }
         iter->Next();
@@ -442,7 +513,7 @@ class DBTest : public testing::Test {
 
   int TotalTableFiles() {
     int result = 0;
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < last_options_.num_levels; level++) {
       result += NumTableFilesAtLevel(level);
     }
     return result;
@@ -452,7 +523,7 @@ class DBTest : public testing::Test {
   std::string FilesPerLevel() {
     std::string result;
     int last_non_zero_offset = 0;
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < last_options_.num_levels; level++) {
       int f = NumTableFilesAtLevel(level);
       char buf[100];
       std::snprintf(buf, sizeof(buf), "%s%d", (level ? "," : ""), f);
@@ -496,7 +567,7 @@ class DBTest : public testing::Test {
   // Prevent pushing of new sstables into deeper levels by adding
   // tables that cover a specified range to all levels.
   void FillLevels(const std::string& smallest, const std::string& largest) {
-    MakeTables(config::kNumLevels, smallest, largest);
+    MakeTables(last_options_.num_levels, smallest, largest);
   }
 
   void DumpFileCounts(const char* label) {
@@ -504,7 +575,7 @@ class DBTest : public testing::Test {
     std::fprintf(
         stderr, "maxoverlap: %lld\n",
         static_cast<long long>(dbfull()->TEST_MaxNextLevelOverlappingBytes()));
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < last_options_.num_levels; level++) {
       int num = NumTableFilesAtLevel(level);
       if (num > 0) {
         std::fprintf(stderr, "  level %3d : %d files\n", level, num);
@@ -562,7 +633,18 @@ class DBTest : public testing::Test {
 
  private:
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kUncompressed,
+    kDataBlockHashIndex,
+    kPipelinedWrite,
+    kConcurrentMemTableWrite,
+    kParallelCompactions,
+    kSubcompactions,
+    kEnd
+  };
 
   const FilterPolicy* filter_policy_;
   int option_config_;
@@ -767,6 +849,8 @@ TEST_F(DBTest, GetPicksCorrectFile) {
 
 TEST_F(DBTest, GetEncountersEmptyLevel) {
   do {
+    if (!CanPushMemTableOutput()) continue;
+
     // Arrange for the following to happen:
     //   * sstable A in level 0
     //   * nothing in level 1
@@ -803,6 +887,239 @@ TEST_F(DBTest, GetEncountersEmptyLevel) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    // Spread entries over a deeper level, level-0 and the memtable.
+    ASSERT_LEVELDB_OK(Put("a", "va1"));
+    ASSERT_LEVELDB_OK(Put("c", "vc1"));
+    ASSERT_LEVELDB_OK(Put("e", "ve1"));
+    Compact("a", "e");
+    ASSERT_LEVELDB_OK(Put("x", "vx1"));
+    Compact("x", "y");
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_LEVELDB_OK(Delete("e"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put("a", "va2"));
+    ASSERT_LEVELDB_OK(Put("b", "vb1"));
+    ASSERT_LEVELDB_OK(Delete("x"));
+
+    std::vector<Slice> keys = {"x", "missing", "a", "e", "c", "b", "a", "z"};
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+    ASSERT_EQ(keys.size(), values.size());
+    ASSERT_EQ(keys.size(), statuses.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+      std::string expected = Get(keys[i].ToString());
+      if (expected == "NOT_FOUND") {
+        ASSERT_TRUE(statuses[i].IsNotFound()) << keys[i].ToString();
+      } else {
+        ASSERT_LEVELDB_OK(statuses[i]);
+        ASSERT_EQ(expected, values[i]);
+      }
+    }
+    ASSERT_EQ("va2", values[2]);
+    ASSERT_EQ("vc2", values[4]);
+    ASSERT_EQ("va2", values[6]);
+    ASSERT_TRUE(statuses[0].IsNotFound());
+    ASSERT_TRUE(statuses[3].IsNotFound());
+
+    ReadOptions options;
+    options.snapshot = snapshot;
+    db_->MultiGet(options, keys, &values, &statuses);
+    ASSERT_LEVELDB_OK(statuses[0]);
+    ASSERT_EQ("vx1", values[0]);
+    ASSERT_TRUE(statuses[1].IsNotFound());
+    ASSERT_EQ("va1", values[2]);
+    ASSERT_TRUE(statuses[3].IsNotFound());
+    ASSERT_EQ("vc2", values[4]);
+    ASSERT_TRUE(statuses[5].IsNotFound());
+    ASSERT_TRUE(statuses[7].IsNotFound());
+    db_->ReleaseSnapshot(snapshot);
+
+    db_->MultiGet(ReadOptions(), std::vector<Slice>(), &values, &statuses);
+    ASSERT_TRUE(values.empty());
+    ASSERT_TRUE(statuses.empty());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, GetPinnable) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va1"));
+    ASSERT_LEVELDB_OK(Put("b", "vb1"));
+    Compact("a", "b");
+    ASSERT_LEVELDB_OK(Put("c", "vc1"));
+
+    PinnableSlice a, c, missing;
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "a", &a));
+    ASSERT_EQ("va1", a.ToString());
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "c", &c));
+    ASSERT_EQ("vc1", c.ToString());
+    ASSERT_TRUE(c.IsPinned());
+    ASSERT_TRUE(db_->Get(ReadOptions(), "missing", &missing).IsNotFound());
+    ASSERT_TRUE(missing.empty());
+
+    // Pinned values outlive overwrites, flushes and compactions.
+    ASSERT_LEVELDB_OK(Put("a", "va2"));
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+    ASSERT_EQ("va1", a.ToString());
+    ASSERT_EQ("vc1", c.ToString());
+
+    // Reusing a slice releases what it pinned before.
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Delete("c"));
+    ASSERT_LEVELDB_OK(db_->Get(ReadOptions(), "a", &a));
+    ASSERT_EQ("va2", a.ToString());
+    ASSERT_TRUE(db_->Get(ReadOptions(), "c", &c).IsNotFound());
+    ASSERT_TRUE(c.empty());
+    ASSERT_FALSE(c.IsPinned());
+    ReadOptions options;
+    options.snapshot = snapshot;
+    ASSERT_LEVELDB_OK(db_->Get(options, "c", &c));
+    ASSERT_EQ("vc2", c.ToString());
+    db_->ReleaseSnapshot(snapshot);
+
+    // Values must be released before the database is closed.
+    a.Reset();
+    c.Reset();
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRange) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    ASSERT_LEVELDB_OK(Put("e", "ve"));
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "d"));
+    ASSERT_EQ("va", Get("a"));
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("vd", Get("d"));
+    ASSERT_EQ("(a->va)(d->vd)(e->ve)", Contents());
+
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("(a->va)(d->vd)(e->ve)", Contents());
+
+    Reopen();
+    ASSERT_EQ("NOT_FOUND", Get("c"));
+    ASSERT_EQ("(a->va)(d->vd)(e->ve)", Contents());
+
+    // Empty and inverted ranges delete nothing
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "e", "e"));
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "e", "a"));
+    ASSERT_EQ("(a->va)(d->vd)(e->ve)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRangeAcrossLevels) {
+  do {
+    ASSERT_LEVELDB_OK(Put("a", "va"));
+    ASSERT_LEVELDB_OK(Put("b", "vb"));
+    ASSERT_LEVELDB_OK(Put("c", "vc"));
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+    ASSERT_LEVELDB_OK(Put("d", "vd"));
+    dbfull()->TEST_CompactMemTable();
+
+    // The tombstone lives in the memtable and hides entries in files
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "b", "e"));
+    ASSERT_EQ("(a->va)", Contents());
+
+    // Newer writes inside the range are visible again
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("(a->va)(c->vc2)", Contents());
+
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_EQ("NOT_FOUND", Get("b"));
+    ASSERT_EQ("vc2", Get("c"));
+    ASSERT_EQ("(a->va)(c->vc2)", Contents());
+
+    // A full compaction drops the deleted entries
+    for (int level = 0; level < last_options_.num_levels - 1; level++) {
+      dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+    }
+    ASSERT_EQ("(a->va)(c->vc2)", Contents());
+    ASSERT_EQ("[ ]", AllEntriesFor("b"));
+    ASSERT_EQ("[ vc2 ]", AllEntriesFor("c"));
+    ASSERT_EQ("[ ]", AllEntriesFor("d"));
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteRangeSnapshot) {
+  do {
+    ASSERT_LEVELDB_OK(Put("k1", "v1"));
+    ASSERT_LEVELDB_OK(Put("k2", "v2"));
+    ASSERT_LEVELDB_OK(Put("k3", "v3"));
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), "k1", "k3"));
+    ASSERT_EQ("NOT_FOUND", Get("k1"));
+    ASSERT_EQ("v1", Get("k1", snapshot));
+    ASSERT_EQ("v2", Get("k2", snapshot));
+
+    dbfull()->TEST_CompactMemTable();
+    for (int level = 0; level < last_options_.num_levels - 1; level++) {
+      dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+    }
+    ASSERT_EQ("NOT_FOUND", Get("k2"));
+    ASSERT_EQ("v1", Get("k1", snapshot));
+    ASSERT_EQ("v2", Get("k2", snapshot));
+    ASSERT_EQ("[ v2 ]", AllEntriesFor("k2"));
+
+    ReadOptions options;
+    options.snapshot = snapshot;
+    Iterator* iter = db_->NewIterator(options);
+    iter->SeekToFirst();
+    ASSERT_EQ("k1->v1", IterStatus(iter));
+    iter->SeekToLast();
+    ASSERT_EQ("k3->v3", IterStatus(iter));
+    iter->Prev();
+    ASSERT_EQ("k2->v2", IterStatus(iter));
+    delete iter;
+
+    db_->ReleaseSnapshot(snapshot);
+    ASSERT_EQ("(k3->v3)", Contents());
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, DeleteFilesInRange) {
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(Put("c", "vc"));
+  ASSERT_LEVELDB_OK(Put("d", "vd"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(Put("e", "ve"));
+  ASSERT_LEVELDB_OK(Put("f", "vf"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(Put("c2", "vc2"));
+  ASSERT_EQ(3, TotalTableFiles());
+
+  // Files that extend beyond the range are kept
+  Slice begin("b"), end("e");
+  ASSERT_LEVELDB_OK(db_->DeleteFilesInRange(&begin, &end));
+  ASSERT_EQ(2, TotalTableFiles());
+  ASSERT_EQ("(a->va)(b->vb)(c2->vc2)(e->ve)(f->vf)", Contents());
+  ASSERT_EQ("NOT_FOUND", Get("d"));
+
+  Reopen();
+  ASSERT_EQ("(a->va)(b->vb)(c2->vc2)(e->ve)(f->vf)", Contents());
+  const int num_files = CountFiles();
+
+  ASSERT_LEVELDB_OK(db_->DeleteFilesInRange(nullptr, &end));
+  ASSERT_EQ("(e->ve)(f->vf)", Contents());
+  ASSERT_LEVELDB_OK(db_->DeleteFilesInRange(nullptr, nullptr));
+  ASSERT_EQ(0, TotalTableFiles());
+  ASSERT_EQ("", Contents());
+  ASSERT_EQ(num_files - 3, CountFiles());
+}
+
 TEST_F(DBTest, IterEmpty) {
   Iterator* iter = db_->NewIterator(ReadOptions());
 
@@ -1079,6 +1396,39 @@ static std::string Key(int i) {
   return std::string(buf);
 }
 
+TEST_F(DBTest, MultiGetManyFiles) {
+  do {
+    // Several files per level so that a batch spans many tables.
+    const int kNumKeys = 2000;
+    Random rnd(301);
+    for (int i = 0; i < kNumKeys; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), RandomString(&rnd, 1000)));
+    }
+    dbfull()->TEST_CompactMemTable();
+    dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+    for (int i = 0; i < kNumKeys; i += 3) {
+      ASSERT_LEVELDB_OK(Put(Key(i), "updated"));
+    }
+    dbfull()->TEST_CompactMemTable();
+    for (int i = 0; i < kNumKeys; i += 7) {
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+    }
+
+    std::vector<std::string> key_storage;
+    for (int i = kNumKeys + 10; i >= 0; i -= 5) {
+      key_storage.push_back(Key(i));
+    }
+    std::vector<Slice> keys(key_storage.begin(), key_storage.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses;
+    db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_EQ(Get(key_storage[i]),
+                statuses[i].ok() ? values[i] : "NOT_FOUND");
+    }
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, MinorCompactionsHappen) {
   Options options = CurrentOptions();
   options.write_buffer_size = 10000;
@@ -1154,6 +1504,270 @@ TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST_F(DBTest, ParallelCompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_background_compactions = 4;
+  Reopen(&options);
+
+  // Overwrite a key range several times so that compactions at several
+  // levels are needed, some of which may run at the same time.
+  Random rnd(301);
+  const int kNumKeys = 10000;
+  std::vector<std::string> values(kNumKeys);
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      const int k = rnd.Uniform(kNumKeys);
+      values[k] = RandomString(&rnd, 500);
+      ASSERT_LEVELDB_OK(Put(Key(k), values[k]));
+    }
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_GT(TotalTableFiles(), 1);
+
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i].empty() ? "NOT_FOUND" : values[i], Get(Key(i)));
+  }
+  Reopen(&options);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i].empty() ? "NOT_FOUND" : values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.max_subcompactions = 4;
+  Reopen(&options);
+
+  // Fill level-1 with many files, then overwrite and delete keys across
+  // the whole range so that the next compaction into level-1 has many
+  // level-1 inputs to split.
+  Random rnd(301);
+  const int kNumKeys = 6000;
+  std::vector<std::string> values(kNumKeys);
+  for (int i = 0; i < kNumKeys; i++) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(2, nullptr, nullptr);
+  ASSERT_GT(NumTableFilesAtLevel(3), 1);
+
+  for (int i = 0; i < kNumKeys; i += 7) {
+    if (i % 2 == 0) {
+      values[i] = RandomString(&rnd, 1000);
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    } else {
+      values[i].clear();
+      ASSERT_LEVELDB_OK(Delete(Key(i)));
+    }
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int level = 0; level < 3; level++) {
+    dbfull()->TEST_CompactRange(level, nullptr, nullptr);
+  }
+  ASSERT_EQ(TotalTableFiles(), NumTableFilesAtLevel(3));
+
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i].empty() ? "NOT_FOUND" : values[i], Get(Key(i)));
+  }
+
+  // The parts of the key range were written to separate files; check that
+  // they line up.
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->SeekToFirst();
+  for (int i = 0; i < kNumKeys; i++) {
+    if (values[i].empty()) continue;
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(Key(i), iter->key().ToString());
+    ASSERT_EQ(values[i], iter->value().ToString());
+    iter->Next();
+  }
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+}
+
+TEST_F(DBTest, DynamicLevelBytes) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.level_compaction_dynamic_level_bytes = true;
+  Reopen(&options);
+
+  // A small database needs a single level below level-0, so memtables and
+  // level-0 compactions go straight to the last level.
+  Random rnd(301);
+  const int kNumKeys = 2000;
+  std::vector<std::string> values(kNumKeys);
+  for (int i = 0; i < kNumKeys; i++) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  const int last = options.num_levels - 1;
+  ASSERT_GT(NumTableFilesAtLevel(last), 0);
+  ASSERT_EQ(TotalTableFiles(), NumTableFilesAtLevel(last));
+
+  for (int i = 0; i < kNumKeys; i += 3) {
+    values[i] = RandomString(&rnd, 1000);
+    ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+  }
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  for (int level = 1; level < last; level++) {
+    ASSERT_EQ(0, NumTableFilesAtLevel(level));
+  }
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(TotalTableFiles(), NumTableFilesAtLevel(last));
+
+  Reopen(&options);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+}
+
+TEST_F(DBTest, NumLevels) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;  // Small write buffer
+  options.num_levels = 3;
+  options.level0_file_num_compaction_trigger = 2;
+  options.level0_slowdown_writes_trigger = 3;
+  options.level0_stop_writes_trigger = 4;
+  Reopen(&options);
+
+  Random rnd(301);
+  const int kNumKeys = 2000;
+  std::vector<std::string> values(kNumKeys);
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < kNumKeys; i++) {
+      values[i] = RandomString(&rnd, 1000);
+      ASSERT_LEVELDB_OK(Put(Key(i), values[i]));
+    }
+  }
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_GT(NumTableFilesAtLevel(2), 0);
+  ASSERT_EQ(TotalTableFiles(), NumTableFilesAtLevel(2));
+  std::string property;
+  ASSERT_TRUE(!db_->GetProperty("leveldb.num-files-at-level3", &property));
+
+  Reopen(&options);
+  for (int i = 0; i < kNumKeys; i++) {
+    ASSERT_EQ(values[i], Get(Key(i)));
+  }
+
+  // The descriptor now refers to level 2, which a two-level database
+  // does not have.
+  options.num_levels = 2;
+  Status s = TryReopen(&options);
+  ASSERT_TRUE(s.IsInvalidArgument()) << s.ToString();
+}
+
+TEST_F(DBTest, WriteController) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.level0_file_num_compaction_trigger = 2;
+  options.level0_slowdown_writes_trigger = 2;
+  options.delayed_write_rate = 1 << 20;
+  Reopen(&options);
+
+  std::string property;
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &property));
+  ASSERT_EQ("0", property);
+  ASSERT_TRUE(db_->GetProperty("leveldb.actual-delayed-write-rate", &property));
+  ASSERT_EQ("0", property);
+
+  // Each reopen turns the log into a level-0 file.  Keep the compaction
+  // of the second one from running.
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("b", "v1"));
+  env_->delay_background_work_.store(true, std::memory_order_release);
+  Reopen(&options);
+  ASSERT_EQ(2, NumTableFilesAtLevel(0));
+
+  ASSERT_TRUE(
+      db_->GetProperty("leveldb.estimate-pending-compaction-bytes", &property));
+  ASSERT_GT(std::stoull(property), 0);
+  ASSERT_LEVELDB_OK(Put("c", "v1"));
+  ASSERT_TRUE(db_->GetProperty("leveldb.actual-delayed-write-rate", &property));
+  ASSERT_EQ(NumberToString(options.delayed_write_rate), property);
+
+  env_->delay_background_work_.store(false, std::memory_order_release);
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_LEVELDB_OK(Put("d", "v1"));
+  ASSERT_TRUE(db_->GetProperty("leveldb.actual-delayed-write-rate", &property));
+  ASSERT_EQ("0", property);
+  ASSERT_EQ("v1", Get("a"));
+  ASSERT_EQ("v1", Get("c"));
+}
+
+TEST_F(DBTest, DelayedWriteStopsOnError) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.level0_file_num_compaction_trigger = 2;
+  options.level0_slowdown_writes_trigger = 2;
+  options.delayed_write_rate = 1;  // Raised to the smallest rate
+  Reopen(&options);
+
+  // Two overlapping level-0 files whose compaction cannot run yet delay
+  // the writes.
+  for (int i = 0; i < 2; i++) {
+    ASSERT_LEVELDB_OK(Put("a", "v1"));
+    ASSERT_LEVELDB_OK(Put("z", "v1"));
+    if (i == 1) {
+      env_->delay_background_work_.store(true, std::memory_order_release);
+    }
+    Reopen(&options);
+  }
+  ASSERT_EQ(2, NumTableFilesAtLevel(0));
+
+  // At the smallest rate, this write is delayed for over a minute.  The
+  // compaction fails meanwhile, which ends the delay.
+  const uint64_t start_micros = env_->NowMicros();
+  Status s;
+  std::thread writer([&]() { s = Put("c", std::string(1 << 20, 'v')); });
+  DelayMilliseconds(100);
+  env_->non_writable_.store(true, std::memory_order_release);
+  env_->delay_background_work_.store(false, std::memory_order_release);
+  writer.join();
+  ASSERT_TRUE(!s.ok());
+  ASSERT_LT(env_->NowMicros() - start_micros, 10000000);
+  env_->non_writable_.store(false, std::memory_order_release);
+}
+
+TEST_F(DBTest, RateLimiter) {
+  std::unique_ptr<RateLimiter> limiter(NewGenericRateLimiter(64 << 20));
+  Options options = CurrentOptions();
+  options.rate_limiter = limiter.get();
+  Reopen(&options);
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(Put(Key(i), std::string(1000, 'a' + pass)));
+    }
+    ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  }
+  const int64_t flushed =
+      limiter->GetTotalBytesThrough(RateLimiter::kHighPriority);
+  ASSERT_GT(flushed, 2 * 100 * 1000);
+  ASSERT_EQ(0, limiter->GetTotalBytesThrough(RateLimiter::kLowPriority));
+
+  Compact(Key(0), Key(99));
+  ASSERT_GT(limiter->GetTotalBytesThrough(RateLimiter::kLowPriority),
+            100 * 1000);
+  ASSERT_EQ(std::string(1000, 'b'), Get(Key(50)));
+
+  // The limiter must outlive the database.
+  Close();
+}
+
 TEST_F(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -1161,8 +1775,9 @@ TEST_F(DBTest, RepeatedWritesToSameKey) {
   Reopen(&options);
 
   // We must have at most one file per level except for level-0,
-  // which may have up to kL0_StopWritesTrigger files.
-  const int kMaxFiles = config::kNumLevels + config::kL0_StopWritesTrigger;
+  // which may have up to level0_stop_writes_trigger files.
+  const int kMaxFiles =
+      options.num_levels + options.level0_stop_writes_trigger;
 
   Random rnd(301);
   std::string value = RandomString(&rnd, 2 * options.write_buffer_size);
@@ -1390,18 +2005,21 @@ TEST_F(DBTest, HiddenValuesAreRemoved) {
     Put("pastfoo2", "v2");  // Advance sequence number one more
 
     ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
-    ASSERT_GT(NumTableFilesAtLevel(0), 0);
+
+    // The tables made by FillLevels() and the flush above may trigger
+    // compactions that pick up "foo".  Let them finish while the snapshot
+    // still protects the hidden value, so that they all keep it.
+    dbfull()->TEST_WaitForCompactions();
 
     ASSERT_EQ(big, Get("foo", snapshot));
     ASSERT_TRUE(Between(Size("", "pastfoo"), 50000, 60000));
     db_->ReleaseSnapshot(snapshot);
     ASSERT_EQ(AllEntriesFor("foo"), "[ tiny, " + big + " ]");
+    // Those compactions may have left both values in any level.
     Slice x("x");
-    dbfull()->TEST_CompactRange(0, nullptr, &x);
-    ASSERT_EQ(AllEntriesFor("foo"), "[ tiny ]");
-    ASSERT_EQ(NumTableFilesAtLevel(0), 0);
-    ASSERT_GE(NumTableFilesAtLevel(1), 1);
-    dbfull()->TEST_CompactRange(1, nullptr, &x);
+    for (int level = 0; level < last_options_.num_levels - 1; level++) {
+      dbfull()->TEST_CompactRange(level, nullptr, &x);
+    }
     ASSERT_EQ(AllEntriesFor("foo"), "[ tiny ]");
 
     ASSERT_TRUE(Between(Size("", "pastfoo"), 0, 1000));
@@ -1411,7 +2029,7 @@ TEST_F(DBTest, HiddenValuesAreRemoved) {
 TEST_F(DBTest, DeletionMarkers1) {
   Put("foo", "v1");
   ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
-  const int last = config::kMaxMemCompactLevel;
+  const int last = last_options_.max_mem_compaction_level;
   ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
 
   // Place a table at level last-1 to prevent merging with preceding mutation
@@ -1440,7 +2058,7 @@ TEST_F(DBTest, DeletionMarkers1) {
 TEST_F(DBTest, DeletionMarkers2) {
   Put("foo", "v1");
   ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
-  const int last = config::kMaxMemCompactLevel;
+  const int last = last_options_.max_mem_compaction_level;
   ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
 
   // Place a table at level last-1 to prevent merging with preceding mutation
@@ -1463,16 +2081,365 @@ TEST_F(DBTest, DeletionMarkers2) {
   ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
 }
 
-TEST_F(DBTest, OverlapInLevel0) {
-  do {
-    ASSERT_EQ(config::kMaxMemCompactLevel, 2) << "Fix test to match config";
+namespace {
+// Removes the values "expired" and replaces the values "old" by "new".
+class ExpiryFilter : public CompactionFilter {
+ public:
+  const char* Name() const override { return "leveldb.ExpiryFilter"; }
 
-    // Fill levels 1 and 2 to disable the pushing of new memtables to levels >
-    // 0.
-    ASSERT_LEVELDB_OK(Put("100", "v100"));
-    ASSERT_LEVELDB_OK(Put("999", "v999"));
-    dbfull()->TEST_CompactMemTable();
-    ASSERT_LEVELDB_OK(Delete("100"));
+  bool Filter(int level, const Slice& key, const Slice& existing_value,
+              std::string* new_value, bool* value_changed) const override {
+    if (existing_value == Slice("expired")) {
+      return true;
+    }
+    if (existing_value == Slice("old")) {
+      new_value->assign("new");
+      *value_changed = true;
+    }
+    return false;
+  }
+};
+}  // namespace
+
+TEST_F(DBTest, CompactionFilter) {
+  ExpiryFilter filter;
+  Options options = CurrentOptions();
+  options.compaction_filter = &filter;
+  Reopen(&options);
+
+  Put("foo", "v1");
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const int last = last_options_.max_mem_compaction_level;
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
+
+  // Place a table at level last-1 to prevent merging with preceding mutation
+  Put("a", "begin");
+  Put("z", "end");
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);
+  ASSERT_EQ(NumTableFilesAtLevel(last - 1), 1);
+
+  Put("baz", "expired");
+  const Snapshot* snapshot = db_->GetSnapshot();
+  Put("foo", "expired");
+  Put("bar", "old");
+  Put("baz", "old");
+
+  // Memtable compactions do not filter
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());  // Moves to level last-2
+  ASSERT_EQ(AllEntriesFor("foo"), "[ expired, v1 ]");
+  ASSERT_EQ("old", Get("bar"));
+
+  dbfull()->TEST_CompactRange(last - 2, nullptr, nullptr);
+  // DEL replaces the removed value: "last" file overlaps
+  ASSERT_EQ(AllEntriesFor("foo"), "[ DEL, v1 ]");
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("new", Get("bar"));
+  // Values visible to the snapshot are not filtered
+  ASSERT_EQ(AllEntriesFor("baz"), "[ new, expired ]");
+  ASSERT_EQ("expired", Get("baz", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  dbfull()->TEST_CompactRange(last - 1, nullptr, nullptr);
+  // Merging last-1 w/ last, so we are the base level for "foo", so
+  // DEL is removed.  (as is v1).
+  ASSERT_EQ(AllEntriesFor("foo"), "[ ]");
+  ASSERT_EQ("(a->begin)(bar->new)(baz->new)(z->end)", Contents());
+}
+
+namespace {
+// Appends the operands to the value, separated by commas.
+class AppendOperator : public MergeOperator {
+ public:
+  const char* Name() const override { return "leveldb.AppendOperator"; }
+
+  bool FullMerge(const Slice& key, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    if (existing_value != nullptr) {
+      new_value->assign(existing_value->data(), existing_value->size());
+    }
+    for (const Slice& operand : operands) {
+      if (!new_value->empty()) {
+        new_value->push_back(',');
+      }
+      new_value->append(operand.data(), operand.size());
+    }
+    return true;
+  }
+
+  bool PartialMerge(const Slice& key, const Slice& left_operand,
+                    const Slice& right_operand,
+                    std::string* new_value) const override {
+    *new_value = left_operand.ToString() + "," + right_operand.ToString();
+    return true;
+  }
+};
+
+// Like AppendOperator, but fails on the existing value "bad", after it
+// has started to build the new value.
+class FailingAppendOperator : public AppendOperator {
+ public:
+  bool FullMerge(const Slice& key, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override {
+    AppendOperator::FullMerge(key, existing_value, operands, new_value);
+    return existing_value == nullptr || *existing_value != Slice("bad");
+  }
+};
+}  // namespace
+
+TEST_F(DBTest, MergeWithoutOperator) {
+  ASSERT_TRUE(Merge("foo", "m1").IsNotSupportedError());
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+}
+
+TEST_F(DBTest, Merge) {
+  AppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(Merge("a", "m1"));
+  ASSERT_LEVELDB_OK(Merge("b", "m1"));
+  ASSERT_EQ("v1,m1", Get("a"));
+  ASSERT_EQ("m1", Get("b"));
+  ASSERT_EQ("(a->v1,m1)(b->m1)", Contents());
+
+  // Operands in the memtable apply to the entries in tables
+  dbfull()->TEST_CompactMemTable();
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_LEVELDB_OK(Merge("a", "m2"));
+  ASSERT_LEVELDB_OK(Delete("b"));
+  ASSERT_LEVELDB_OK(Merge("b", "m2"));
+  ASSERT_LEVELDB_OK(Merge("c", "m1"));
+  ASSERT_LEVELDB_OK(Put("d", "v1"));
+  ASSERT_EQ("v1,m1,m2", Get("a"));
+  ASSERT_EQ("m2", Get("b"));
+  ASSERT_EQ("m1", Get("c"));
+  ASSERT_EQ("v1,m1", Get("a", snapshot));
+  ASSERT_EQ("m1", Get("b", snapshot));
+  ASSERT_EQ("NOT_FOUND", Get("c", snapshot));
+  ASSERT_EQ("(a->v1,m1,m2)(b->m2)(c->m1)(d->v1)", Contents());
+
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("(a->v1,m1,m2)(b->m2)(c->m1)(d->v1)", Contents());
+  ASSERT_EQ("v1,m1", Get("a", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  std::vector<Slice> keys = {"a", "b", "c", "d", "e"};
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  ASSERT_EQ("v1,m1,m2", values[0]);
+  ASSERT_EQ("m2", values[1]);
+  ASSERT_EQ("m1", values[2]);
+  ASSERT_EQ("v1", values[3]);
+  ASSERT_TRUE(statuses[4].IsNotFound());
+
+  // Change directions on merged keys
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("b");
+  ASSERT_EQ(IterStatus(iter), "b->m2");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "a->v1,m1,m2");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b->m2");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c->m1");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b->m2");
+  iter->Seek("c");
+  iter->Next();
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  iter->SeekToLast();
+  iter->Prev();
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "d->v1");
+  delete iter;
+}
+
+TEST_F(DBTest, MultiGetFailedMerge) {
+  FailingAppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("a", "bad"));
+  ASSERT_LEVELDB_OK(Merge("a", "m1"));
+  ASSERT_LEVELDB_OK(Put("b", "v1"));
+  ASSERT_LEVELDB_OK(Merge("b", "m1"));
+
+  std::vector<Slice> keys = {"a", "b"};
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  ASSERT_TRUE(!statuses[0].ok());
+  ASSERT_EQ("", values[0]);
+  ASSERT_LEVELDB_OK(statuses[1]);
+  ASSERT_EQ("v1,m1", values[1]);
+}
+
+TEST_F(DBTest, MergeCompaction) {
+  AppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.merge_operator = &merge_operator;
+  Reopen(&options);
+
+  Put("foo", "v1");
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  const int last = last_options_.max_mem_compaction_level;
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo => v1 is now in last level
+
+  // Place a table at level last-1 to prevent merging with preceding mutation
+  Put("a", "begin");
+  Put("z", "end");
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(NumTableFilesAtLevel(last), 1);
+  ASSERT_EQ(NumTableFilesAtLevel(last - 1), 1);
+
+  Merge("foo", "m1");
+  Merge("foo", "m2");
+  Merge("bar", "m1");
+  Merge("bar", "m2");
+  Merge("baz", "m1");
+  const Snapshot* snapshot = db_->GetSnapshot();
+  Merge("baz", "m2");
+
+  // Memtable compactions do not merge
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());  // Moves to level last-2
+  ASSERT_EQ(AllEntriesFor("foo"), "[ MERGE:m2, MERGE:m1, v1 ]");
+
+  dbfull()->TEST_CompactRange(last - 2, nullptr, nullptr);
+  // The "last" file holds the value of "foo": the operands are combined
+  ASSERT_EQ(AllEntriesFor("foo"), "[ MERGE:m1,m2, v1 ]");
+  ASSERT_EQ(AllEntriesFor("bar"), "[ m1,m2 ]");
+  // Operands that the snapshot does not see are kept
+  ASSERT_EQ(AllEntriesFor("baz"), "[ MERGE:m2, m1 ]");
+  ASSERT_EQ("m1", Get("baz", snapshot));
+  db_->ReleaseSnapshot(snapshot);
+
+  dbfull()->TEST_CompactRange(last - 1, nullptr, nullptr);
+  ASSERT_EQ(AllEntriesFor("foo"), "[ v1,m1,m2 ]");
+  ASSERT_EQ("(a->begin)(bar->m1,m2)(baz->m1,m2)(foo->v1,m1,m2)(z->end)",
+            Contents());
+}
+
+TEST_F(DBTest, Ttl) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.ttl = 100;
+  Reopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  ASSERT_LEVELDB_OK(Put("b", "v1"));
+  ASSERT_LEVELDB_OK(Put("e", "v1"));
+  ASSERT_EQ("v1", Get("a"));
+  ASSERT_EQ("(a->v1)(b->v1)(e->v1)", Contents());
+  dbfull()->TEST_CompactMemTable();
+
+  env_->now_offset_micros_.store(50 * 1000000, std::memory_order_release);
+  ASSERT_LEVELDB_OK(Put("b", "v2"));
+  ASSERT_LEVELDB_OK(Put("c", "v2"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("v1", Get("a"));
+  ASSERT_EQ("(a->v1)(b->v2)(c->v2)(e->v1)", Contents());
+
+  // Values written at time 0 have expired
+  env_->now_offset_micros_.store(120 * 1000000, std::memory_order_release);
+  ASSERT_LEVELDB_OK(Put("d", "v3"));
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("v2", Get("b"));
+  ASSERT_EQ("(b->v2)(c->v2)(d->v3)", Contents());
+
+  std::vector<Slice> keys = {"a", "b", "d"};
+  std::vector<std::string> values;
+  std::vector<Status> statuses;
+  db_->MultiGet(ReadOptions(), keys, &values, &statuses);
+  ASSERT_TRUE(statuses[0].IsNotFound());
+  ASSERT_EQ("v2", values[1]);
+  ASSERT_EQ("v3", values[2]);
+
+  // Compactions drop the expired values
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ(AllEntriesFor("a"), "[ ]");
+  ASSERT_EQ("(b->v2)(c->v2)(d->v3)", Contents());
+
+  env_->now_offset_micros_.store(0, std::memory_order_release);
+}
+
+TEST_F(DBTest, TtlMerge) {
+  AppendOperator merge_operator;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.ttl = 100;
+  options.merge_operator = &merge_operator;
+  Reopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  env_->now_offset_micros_.store(50 * 1000000, std::memory_order_release);
+  ASSERT_LEVELDB_OK(Merge("a", "m1"));
+  ASSERT_EQ("v1,m1", Get("a"));
+
+  // The expired value no longer contributes to the merge
+  env_->now_offset_micros_.store(120 * 1000000, std::memory_order_release);
+  ASSERT_EQ("m1", Get("a"));
+  ASSERT_EQ("(a->m1)", Contents());
+  db_->CompactRange(nullptr, nullptr);
+  ASSERT_EQ("m1", Get("a"));
+
+  // The merged value expires with its newest operand
+  env_->now_offset_micros_.store(160 * 1000000, std::memory_order_release);
+  ASSERT_EQ("NOT_FOUND", Get("a"));
+  ASSERT_EQ("", Contents());
+
+  env_->now_offset_micros_.store(0, std::memory_order_release);
+}
+
+TEST_F(DBTest, TtlCompaction) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.ttl = 100;
+  options.num_levels = 2;
+  Reopen(&options);
+
+  ASSERT_LEVELDB_OK(Put("a", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  env_->now_offset_micros_.store(50 * 1000000, std::memory_order_release);
+  ASSERT_LEVELDB_OK(Put("b", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(2, NumTableFilesAtLevel(1));
+
+  // The next flush notices that the first file has expired, and a
+  // compaction rewrites it in place without being asked to.
+  env_->now_offset_micros_.store(120 * 1000000, std::memory_order_release);
+  ASSERT_LEVELDB_OK(Put("c", "v1"));
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 100 && AllEntriesFor("a") != "[ ]"; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ(AllEntriesFor("a"), "[ ]");
+  ASSERT_EQ(2, NumTableFilesAtLevel(1));
+  ASSERT_EQ("(b->v1)(c->v1)", Contents());
+
+  env_->now_offset_micros_.store(0, std::memory_order_release);
+}
+
+TEST_F(DBTest, OverlapInLevel0) {
+  do {
+    if (!CanPushMemTableOutput()) continue;
+
+    ASSERT_EQ(last_options_.max_mem_compaction_level, 2)
+        << "Fix test to match config";
+
+    // Fill levels 1 and 2 to disable the pushing of new memtables to levels >
+    // 0.
+    ASSERT_LEVELDB_OK(Put("100", "v100"));
+    ASSERT_LEVELDB_OK(Put("999", "v999"));
+    dbfull()->TEST_CompactMemTable();
+    ASSERT_LEVELDB_OK(Delete("100"));
     ASSERT_LEVELDB_OK(Delete("999"));
     dbfull()->TEST_CompactMemTable();
     ASSERT_EQ("0,1,1", FilesPerLevel());
@@ -1637,8 +2604,8 @@ TEST_F(DBTest, CustomComparator) {
 }
 
 TEST_F(DBTest, ManualCompaction) {
-  ASSERT_EQ(config::kMaxMemCompactLevel, 2)
-      << "Need to update this test to match kMaxMemCompactLevel";
+  ASSERT_EQ(last_options_.max_mem_compaction_level, 2)
+      << "Need to update this test to match max_mem_compaction_level";
 
   MakeTables(3, "p", "q");
   ASSERT_EQ("1,1,1", FilesPerLevel());
@@ -1786,7 +2753,7 @@ TEST_F(DBTest, NoSpace) {
   // Force out-of-space errors.
   env_->no_space_.store(true, std::memory_order_release);
   for (int i = 0; i < 10; i++) {
-    for (int level = 0; level < config::kNumLevels - 1; level++) {
+    for (int level = 0; level < last_options_.num_levels - 1; level++) {
       dbfull()->TEST_CompactRange(level, nullptr, nullptr);
     }
   }
@@ -1871,7 +2838,7 @@ TEST_F(DBTest, ManifestWriteError) {
     // Memtable compaction (will succeed)
     dbfull()->TEST_CompactMemTable();
     ASSERT_EQ("bar", Get("foo"));
-    const int last = config::kMaxMemCompactLevel;
+    const int last = last_options_.max_mem_compaction_level;
     ASSERT_EQ(NumTableFilesAtLevel(last), 1);  // foo=>bar is now in last level
 
     // Merging compaction (will fail)
@@ -1977,6 +2944,316 @@ TEST_F(DBTest, BloomFilter) {
   delete options.filter_policy;
 }
 
+TEST_F(DBTest, FullFilter) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  Reopen(&options);
+
+  // Tables with per-block filters stay readable after switching to full
+  // filters.
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  options.full_filter = true;
+  Reopen(&options);
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(2, TotalTableFiles());
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  ASSERT_GE(reads, N);
+  ASSERT_LE(reads, N + 2 * N / 100);
+
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  ASSERT_LE(reads, 3 * N / 100);
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  // Rewrite everything with full filters.
+  Compact("a", "z");
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, 3 * N / 100);
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+TEST_F(DBTest, PartitionedIndexAndFilters) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(6);
+  Reopen(&options);
+
+  // Tables with a plain index stay readable after switching to partitions.
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  Compact("a", "z");
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 1024;  // Several partitions per table
+  Reopen(&options);
+  for (int i = 0; i < N; i += 100) {
+    ASSERT_LEVELDB_OK(Put(Key(i), Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(2, TotalTableFiles());
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+
+  // Rewrite everything with partitions.
+  Compact("a", "z");
+  ASSERT_EQ(1, TotalTableFiles());
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  // Each lookup reads a filter partition, an index partition and a data
+  // block.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+  }
+  int reads = env_->random_read_counter_.Read();
+  ASSERT_GE(reads, 3 * N);
+  ASSERT_LE(reads, 3 * N + 2 * N / 100);
+
+  // Lookups of missing keys mostly stop at the filter partition.
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing => %d reads\n", N, reads);
+  ASSERT_LE(reads, N + 6 * N / 100);
+
+  // The partitioned filter also holds the prefixes of the keys.
+  ReadOptions prefix_read;
+  prefix_read.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(prefix_read);
+  int count = 0;
+  for (iter->Seek("key005"); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(5000 + count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(1000, count);
+  iter->Seek("key099");
+  ASSERT_TRUE(!iter->Valid());
+  delete iter;
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
+TEST_F(DBTest, CacheIndexAndFilterBlocks) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(128 << 10);
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.cache_index_and_filter_blocks = true;
+  Reopen(&options);
+
+  const int N = 2000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_LEVELDB_OK(Put(Key(i), std::string(100, 'v')));
+  }
+  Compact("a", "z");
+  ASSERT_EQ(1, TotalTableFiles());
+
+  // Reopening charges nothing to the block cache.  The first read loads
+  // the table's index and filter blocks into it.
+  Reopen(&options);
+  ASSERT_EQ(0, options.block_cache->TotalCharge());
+  ASSERT_EQ("NOT_FOUND", Get(Key(0) + ".missing"));
+  ASSERT_GT(options.block_cache->TotalCharge(), 0);
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(std::string(100, 'v'), Get(Key(i)));
+  }
+  env_->random_read_counter_.Reset();
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + ".missing"));
+  }
+  ASSERT_LE(env_->random_read_counter_.Read(), N / 20);
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+
+  // Closing the table frees its blocks.  The table file is mmapped, so
+  // its data blocks never were in the cache.
+  Close();
+  ASSERT_EQ(0, options.block_cache->TotalCharge());
+  delete options.block_cache;
+  delete options.filter_policy;
+}
+
+namespace {
+std::string PrefixKey(int prefix, int i) {
+  char buf[100];
+  std::snprintf(buf, sizeof(buf), "p%03d.key%06d", prefix, i);
+  return std::string(buf);
+}
+}  // namespace
+
+TEST_F(DBTest, PrefixSeek) {
+  env_->count_random_reads_ = true;
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.block_cache = NewLRUCache(0);  // Prevent cache hits
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(4);
+  Reopen(&options);
+
+  // Only even prefixes have keys.  Each prefix spans several blocks.
+  const int kPrefixes = 100;
+  const int kKeysPerPrefix = 50;
+  Random rnd(301);
+  for (int p = 0; p < kPrefixes; p += 2) {
+    for (int i = 0; i < kKeysPerPrefix; i++) {
+      ASSERT_LEVELDB_OK(Put(PrefixKey(p, i), RandomString(&rnd, 200)));
+    }
+  }
+  Compact("a", "z");
+
+  // Prevent auto compactions triggered by seeks
+  env_->delay_data_sync_.store(true, std::memory_order_release);
+
+  ReadOptions prefix_read;
+  prefix_read.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(prefix_read);
+  int count = 0;
+  for (iter->Seek("p042"); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(PrefixKey(42, count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(kKeysPerPrefix, count);
+
+  // The bound also applies backwards.
+  count = 0;
+  for (iter->Seek(PrefixKey(42, 10)); iter->Valid(); iter->Prev()) {
+    count++;
+  }
+  ASSERT_EQ(11, count);
+
+  // Targets outside of the domain are not bounded.
+  iter->Seek("p");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(PrefixKey(0, 0), iter->key().ToString());
+  iter->SeekToFirst();
+  for (count = 0; iter->Valid(); iter->Next()) {
+    count++;
+  }
+  ASSERT_EQ(kPrefixes / 2 * kKeysPerPrefix, count);
+
+  // Seeks for missing prefixes should rarely read a data block.
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p < kPrefixes; p += 2) {
+    iter->Seek(PrefixKey(p, 0));
+    ASSERT_TRUE(!iter->Valid());
+  }
+  int reads = env_->random_read_counter_.Read();
+  std::fprintf(stderr, "%d missing prefixes => %d reads\n", kPrefixes / 2,
+               reads);
+  ASSERT_LE(reads, 5);
+  delete iter;
+
+  // Without prefix_same_as_start every seek reads a block.
+  iter = db_->NewIterator(ReadOptions());
+  env_->random_read_counter_.Reset();
+  for (int p = 1; p < kPrefixes - 1; p += 2) {
+    iter->Seek(PrefixKey(p, 0));
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(PrefixKey(p + 1, 0), iter->key().ToString());
+  }
+  reads = env_->random_read_counter_.Read();
+  ASSERT_GE(reads, kPrefixes / 2 - 1);
+  delete iter;
+
+  env_->delay_data_sync_.store(false, std::memory_order_release);
+  Close();
+  delete options.block_cache;
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
+TEST_F(DBTest, PrefixSeekChangeDirection) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.prefix_extractor = NewFixedPrefixTransform(1);
+  Reopen(&options);
+  ASSERT_LEVELDB_OK(Put("a2", "v"));
+  ASSERT_LEVELDB_OK(Put("c2", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_LEVELDB_OK(Put("b1", "v"));
+  ASSERT_LEVELDB_OK(Put("d1", "v"));
+  ASSERT_LEVELDB_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(2, TotalTableFiles());
+
+  // Changing direction re-seeks each table to the current key.  Those
+  // seeks must not skip the tables that lack its prefix.
+  ReadOptions prefix_read;
+  prefix_read.prefix_same_as_start = true;
+  Iterator* iter = db_->NewIterator(prefix_read);
+  iter->SeekToFirst();
+  ASSERT_EQ(IterStatus(iter), "a2->v");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "b1->v");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c2->v");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "b1->v");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "c2->v");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "d1->v");
+  iter->Prev();
+  ASSERT_EQ(IterStatus(iter), "c2->v");
+
+  // A prefix-bounded seek still skips the tables.
+  iter->Seek("b");
+  ASSERT_EQ(IterStatus(iter), "b1->v");
+  iter->Next();
+  ASSERT_EQ(IterStatus(iter), "(invalid)");
+  delete iter;
+
+  Close();
+  delete options.filter_policy;
+  delete options.prefix_extractor;
+}
+
 TEST_F(DBTest, LogCloseError) {
   // Regression test for bug where we could ignore log file
   // Close() error when switching to a new log file.
@@ -2153,6 +3430,13 @@ class ModelDB : public DB {
         (*map_)[key.ToString()] = value.ToString();
       }
       void Delete(const Slice& key) override { map_->erase(key.ToString()); }
+      void DeleteRange(const Slice& begin_key,
+                       const Slice& end_key) override {
+        if (begin_key.compare(end_key) < 0) {
+          map_->erase(map_->lower_bound(begin_key.ToString()),
+                      map_->lower_bound(end_key.ToString()));
+        }
+      }
     };
     Handler handler;
     handler.map_ = &map_;
@@ -2310,11 +3594,20 @@ TEST_F(DBTest, Randomized) {
         ASSERT_LEVELDB_OK(model.Put(WriteOptions(), k, v));
         ASSERT_LEVELDB_OK(db_->Put(WriteOptions(), k, v));
 
-      } else if (p < 90) {  // Delete
+      } else if (p < 85) {  // Delete
         k = RandomKey(&rnd);
         ASSERT_LEVELDB_OK(model.Delete(WriteOptions(), k));
         ASSERT_LEVELDB_OK(db_->Delete(WriteOptions(), k));
 
+      } else if (p < 90) {  // Range delete
+        k = RandomKey(&rnd);
+        std::string limit = RandomKey(&rnd);
+        if (limit < k) {
+          std::swap(k, limit);
+        }
+        ASSERT_LEVELDB_OK(model.DeleteRange(WriteOptions(), k, limit));
+        ASSERT_LEVELDB_OK(db_->DeleteRange(WriteOptions(), k, limit));
+
       } else {  // Multi-element batch
         WriteBatch b;
         const int num = rnd.Uniform(8);
@@ -96,24 +96,57 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
+bool InternalKeyComparator::HashKey(const Slice& key, Slice* hash_key) const {
+  // Lookups only need the entries of the user key of the target
+  return user_comparator_->HashKey(ExtractUserKey(key), hash_key);
+}
+
 const char* InternalFilterPolicy::Name() const { return user_policy_->Name(); }
 
 void InternalFilterPolicy::CreateFilter(const Slice* keys, int n,
                                         std::string* dst) const {
   // We rely on the fact that the code in table.cc does not mind us
   // adjusting keys[].
+  //
+  // Duplicates add nothing to a filter.  Drop user keys that repeat one
+  // of the two keys kept before them: this catches both the versions of
+  // a user key and the prefix that table_builder.cc adds after every key
+  // when a prefix extractor is in use.
   Slice* mkey = const_cast<Slice*>(keys);
+  int m = 0;
   for (int i = 0; i < n; i++) {
-    mkey[i] = ExtractUserKey(keys[i]);
-    // TODO(sanjay): Suppress dups?
+    const Slice user_key = ExtractUserKey(keys[i]);
+    if ((m >= 1 && mkey[m - 1] == user_key) ||
+        (m >= 2 && mkey[m - 2] == user_key)) {
+      continue;
+    }
+    mkey[m++] = user_key;
   }
-  user_policy_->CreateFilter(keys, n, dst);
+  user_policy_->CreateFilter(keys, m, dst);
 }
 
 bool InternalFilterPolicy::KeyMayMatch(const Slice& key, const Slice& f) const {
   return user_policy_->KeyMayMatch(ExtractUserKey(key), f);
 }
 
+const char* InternalKeySliceTransform::Name() const {
+  return user_transform_->Name();
+}
+
+Slice InternalKeySliceTransform::Transform(const Slice& key) const {
+  return user_transform_->Transform(ExtractUserKey(key));
+}
+
+bool InternalKeySliceTransform::InDomain(const Slice& key) const {
+  return user_transform_->InDomain(ExtractUserKey(key));
+}
+
+void InternalKeySliceTransform::AppendFilterKey(const Slice& key,
+                                                std::string* dst) const {
+  AppendInternalKey(dst, ParsedInternalKey(Transform(key), kMaxSequenceNumber,
+                                           kValueTypeForSeek));
+}
+
 LookupKey::LookupKey(const Slice& user_key, SequenceNumber s) {
   size_t usize = user_key.size();
   size_t needed = usize + 13;  // A conservative estimate
@@ -13,6 +13,7 @@
 #include "leveldb/db.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/slice.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -21,10 +22,7 @@
 // 代码重点
 // 1. 配置参数 (config 命名空间)
 // 定义了与存储和压缩相关的常量：
-// kNumLevels：多级存储的层数，默认为 7。
-// kL0_CompactionTrigger：触发 Level-0 层文件压缩的文件数量。
-// kL0_StopWritesTrigger：当 Level-0 文件数量超过此值时，停止写操作。
-// kMaxMemCompactLevel：MemTable 写入磁盘时，优先推送到的目标层级。
+// kMaxNumLevels：Options::num_levels 允许的最大层数。
 // kReadBytesPeriod：迭代过程中采样数据读取的字节间隔。
 // 2. InternalKey 和内部键的处理
 // InternalKey 的意义
@@ -66,27 +64,13 @@
 // 内存优化：预分配固定大小的 char 数组 (space_) 以减少堆分配。
 namespace leveldb {
 
-// Grouping of constants.  We may want to make some of these
-// parameters set via options.
+// Grouping of constants.  The shape of the level tree is set via
+// options (see Options::num_levels and the level-0 triggers).
 namespace config {
-static const int kNumLevels = 7;
 
-// Level-0 compaction is started when we hit this many files.
-static const int kL0_CompactionTrigger = 4;
-
-// Soft limit on number of level-0 files.  We slow down writes at this point.
-static const int kL0_SlowdownWritesTrigger = 8;
-
-// Maximum number of level-0 files.  We stop writes at this point.
-static const int kL0_StopWritesTrigger = 12;
-
-// Maximum level to which a new compacted memtable is pushed if it
-// does not create overlap.  We try to push to level 2 to avoid the
-// relatively expensive level 0=>1 compactions and to avoid some
-// expensive manifest file operations.  We do not push all the way to
-// the largest level since that can generate a lot of wasted disk
-// space if the same key space is being repeatedly overwritten.
-static const int kMaxMemCompactLevel = 2;
+// Largest allowed value of Options::num_levels.  Descriptors that name a
+// level beyond this are considered corrupt.
+static const int kMaxNumLevels = 20;
 
 // Approximate gap in bytes between samples of data read during iteration.
 static const int kReadBytesPeriod = 1048576;
@@ -98,14 +82,23 @@ class InternalKey;
 // Value types encoded as the last component of internal keys.
 // DO NOT CHANGE THESE ENUM VALUES: they are embedded in the on-disk
 // data structures.
-enum ValueType { kTypeDeletion = 0x0, kTypeValue = 0x1 };
+//
+// Range tombstones (kTypeRangeDeletion) are kept apart from the other
+// entries; see db/range_tombstone.h.  Merge operands (kTypeMerge) are
+// combined with the older entries for their key by Options::merge_operator.
+enum ValueType {
+  kTypeDeletion = 0x0,
+  kTypeValue = 0x1,
+  kTypeRangeDeletion = 0x2,
+  kTypeMerge = 0x3
+};
 // kValueTypeForSeek defines the ValueType that should be passed when
 // constructing a ParsedInternalKey object for seeking to a particular
 // sequence number (since we sort sequence numbers in decreasing order
 // and the value type is embedded as the low 8 bits in the sequence
 // number in internal keys, we need to use the highest-numbered
 // ValueType, not the lowest).
-static const ValueType kValueTypeForSeek = kTypeValue;
+static const ValueType kValueTypeForSeek = kTypeMerge;
 
 typedef uint64_t SequenceNumber;
 
@@ -157,6 +150,7 @@ class InternalKeyComparator : public Comparator {
   void FindShortestSeparator(std::string* start,
                              const Slice& limit) const override;
   void FindShortSuccessor(std::string* key) const override;
+  bool HashKey(const Slice& key, Slice* hash_key) const override;
 
   const Comparator* user_comparator() const { return user_comparator_; }
 
@@ -175,6 +169,24 @@ class InternalFilterPolicy : public FilterPolicy {
   bool KeyMayMatch(const Slice& key, const Slice& filter) const override;
 };
 
+// Apply a user prefix extractor to the user key portion of internal keys.
+// Filters record the prefix as an internal key with the prefix as its
+// user key, which InternalFilterPolicy maps back to the prefix.
+class InternalKeySliceTransform : public SliceTransform {
+ private:
+  const SliceTransform* const user_transform_;
+
+ public:
+  explicit InternalKeySliceTransform(const SliceTransform* t)
+      : user_transform_(t) {}
+  const char* Name() const override;
+  Slice Transform(const Slice& key) const override;
+  bool InDomain(const Slice& key) const override;
+  void AppendFilterKey(const Slice& key, std::string* dst) const override;
+
+  const SliceTransform* user_transform() const { return user_transform_; }
+};
+
 // Modules in this directory should keep internal keys wrapped inside
 // the following class instead of plain strings so that we do not
 // incorrectly use string comparisons instead of an InternalKeyComparator.
@@ -224,7 +236,7 @@ inline bool ParseInternalKey(const Slice& internal_key,
   result->sequence = num >> 8;
   result->type = static_cast<ValueType>(c);
   result->user_key = Slice(internal_key.data(), n - 8);
-  return (c <= static_cast<uint8_t>(kTypeValue));
+  return (c <= static_cast<uint8_t>(kValueTypeForSeek));
 }
 
 // A helper class useful for DBImpl::Get()
@@ -4,6 +4,8 @@
 
 #include "db/memtable.h"
 #include "db/dbformat.h"
+#include "db/merge_context.h"
+#include "db/range_tombstone.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
@@ -19,9 +21,17 @@ static Slice GetLengthPrefixedSlice(const char* data) {
 }
 
 MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
+    : comparator_(comparator),
+      refs_(0),
+      table_(comparator_, &arena_),
+      range_del_table_(comparator_, &arena_),
+      has_range_tombstones_(false),
+      range_tombstones_(nullptr) {}
 
-MemTable::~MemTable() { assert(refs_ == 0); }
+MemTable::~MemTable() {
+  assert(refs_ == 0);
+  delete range_tombstones_.load(std::memory_order_relaxed);
+}
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
 
@@ -73,8 +83,13 @@ class MemTableIterator : public Iterator {
 
 Iterator* MemTable::NewIterator() { return new MemTableIterator(&table_); }
 
-void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
-                   const Slice& value) {
+Iterator* MemTable::NewRangeTombstoneIterator() {
+  return new MemTableIterator(&range_del_table_);
+}
+
+const char* MemTable::EncodeEntry(SequenceNumber s, ValueType type,
+                                  const Slice& key, const Slice& value,
+                                  bool concurrent) {
   // Format of an entry is concatenation of:
   //  key_size     : varint32 of internal_key.size()
   //  key bytes    : char[internal_key.size()]
@@ -87,7 +102,8 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   const size_t encoded_len = VarintLength(internal_key_size) +
                              internal_key_size + VarintLength(val_size) +
                              val_size;
-  char* buf = arena_.Allocate(encoded_len);
+  char* buf = concurrent ? arena_.AllocateConcurrently(encoded_len)
+                         : arena_.Allocate(encoded_len);
   char* p = EncodeVarint32(buf, internal_key_size);
   std::memcpy(p, key.data(), key_size);
   p += key_size;
@@ -96,14 +112,106 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  return buf;
+}
+
+void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
+                   const Slice& value) {
+  if (type != kTypeRangeDeletion) {
+    table_.Insert(EncodeEntry(s, type, key, value, false));
+  } else if (comparator_.comparator.user_comparator()->Compare(key, value) <
+             0) {
+    range_del_table_.Insert(EncodeEntry(s, type, key, value, false));
+    has_range_tombstones_.store(true, std::memory_order_release);
+  }
 }
 
-bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+void MemTable::AddConcurrently(SequenceNumber s, ValueType type,
+                               const Slice& key, const Slice& value) {
+  if (type != kTypeRangeDeletion) {
+    table_.InsertConcurrently(EncodeEntry(s, type, key, value, true));
+  } else if (comparator_.comparator.user_comparator()->Compare(key, value) <
+             0) {
+    range_del_table_.InsertConcurrently(EncodeEntry(s, type, key, value, true));
+    has_range_tombstones_.store(true, std::memory_order_release);
+  }
+}
+
+void MemTable::MarkImmutable() {
+  assert(range_tombstones() == nullptr);
+  if (!has_range_tombstones_.load(std::memory_order_acquire)) {
+    return;
+  }
+  RangeTombstoneList* list =
+      new RangeTombstoneList(comparator_.comparator.user_comparator());
+  Iterator* iter = NewRangeTombstoneIterator();
+  Status s = list->AddAll(iter);
+  delete iter;
+  list->Finish();
+  if (!s.ok() || list->empty()) {
+    // Lookups keep scanning the skiplist
+    delete list;
+    return;
+  }
+  range_tombstones_.store(list, std::memory_order_release);
+}
+
+SequenceNumber MemTable::MaxCoveringTombstone(const Slice& user_key,
+                                              SequenceNumber snapshot) {
+  if (!has_range_tombstones_.load(std::memory_order_acquire)) {
+    return 0;
+  }
+  const RangeTombstoneList* list = range_tombstones();
+  if (list != nullptr) {
+    return list->MaxCoveringSequence(user_key, snapshot);
+  }
+
+  // Range deletions are expected to be rare, so while the memtable is
+  // still written to, the tombstones starting at or before user_key are
+  // simply scanned.
+  const Comparator* ucmp = comparator_.comparator.user_comparator();
+  SequenceNumber result = 0;
+  Table::Iterator iter(&range_del_table_);
+  for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+    const char* entry = iter.key();
+    uint32_t key_length;
+    const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
+    if (ucmp->Compare(Slice(key_ptr, key_length - 8), user_key) > 0) {
+      break;
+    }
+    const SequenceNumber seq = DecodeFixed64(key_ptr + key_length - 8) >> 8;
+    if (seq > result && seq <= snapshot &&
+        ucmp->Compare(GetLengthPrefixedSlice(key_ptr + key_length),
+                      user_key) > 0) {
+      result = seq;
+    }
+  }
+  return result;
+}
+
+bool MemTable::Get(const LookupKey& key, std::string* value, Status* s,
+                   MergeContext* merge_context) {
+  Slice v;
+  Status deleted;
+  if (!Get(key, &v, &deleted, merge_context)) {
+    return false;
+  }
+  if (deleted.ok()) {
+    value->assign(v.data(), v.size());
+  } else {
+    *s = deleted;
+  }
+  return true;
+}
+
+bool MemTable::Get(const LookupKey& key, Slice* value, Status* s,
+                   MergeContext* merge_context) {
   Slice memkey = key.memtable_key();
+  const Slice ikey = key.internal_key();
+  const SequenceNumber covering = MaxCoveringTombstone(
+      key.user_key(), DecodeFixed64(ikey.data() + ikey.size() - 8) >> 8);
   Table::Iterator iter(&table_);
-  iter.Seek(memkey.data());
-  if (iter.Valid()) {
+  for (iter.Seek(memkey.data()); iter.Valid(); iter.Next()) {
     // entry format is:
     //    klength  varint32
     //    userkey  char[klength]
@@ -117,21 +225,35 @@ bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     uint32_t key_length;
     const char* key_ptr = GetVarint32Ptr(entry, entry + 5, &key_length);
     if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
-      // Correct user key
-      const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
-      switch (static_cast<ValueType>(tag & 0xff)) {
-        case kTypeValue: {
-          Slice v = GetLengthPrefixedSlice(key_ptr + key_length);
-          value->assign(v.data(), v.size());
-          return true;
-        }
-        case kTypeDeletion:
-          *s = Status::NotFound(Slice());
-          return true;
+            Slice(key_ptr, key_length - 8), key.user_key()) != 0) {
+      break;
+    }
+    // Correct user key
+    const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
+    if (covering > (tag >> 8)) {
+      *s = Status::NotFound(Slice());
+      return true;
+    }
+    switch (static_cast<ValueType>(tag & 0xff)) {
+      case kTypeValue: {
+        *value = GetLengthPrefixedSlice(key_ptr + key_length);
+        return true;
       }
+      case kTypeDeletion:
+      case kTypeRangeDeletion:
+        *s = Status::NotFound(Slice());
+        return true;
+      case kTypeMerge:
+        // Keep looking for the value that the operand applies to
+        merge_context->PushOperand(
+            GetLengthPrefixedSlice(key_ptr + key_length));
+        break;
     }
   }
+  if (covering > 0) {
+    *s = Status::NotFound(Slice());
+    return true;
+  }
   return false;
 }
 
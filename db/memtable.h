@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <atomic>
 #include <string>
 
 #include "db/dbformat.h"
@@ -16,6 +17,8 @@ namespace leveldb {
 // 这两个 类 使用了 C++中前向声明的特性, 为了提升编译速度, 但是这个看起来更像是为了方式出现菱形依赖
 class InternalKeyComparator;
 class MemTableIterator;
+class MergeContext;
+class RangeTombstoneList;
 
 class MemTable {
  public: // public 方法
@@ -51,17 +54,49 @@ class MemTable {
   // db/format.{h,cc} module.
   Iterator* NewIterator();
 
+  // Return an iterator that yields the range tombstones of the memtable,
+  // in the format described in db/range_tombstone.h.  The same caveats
+  // as for NewIterator() apply.
+  Iterator* NewRangeTombstoneIterator();
+
+  // Return the range tombstones of the memtable, or null if there are
+  // none.  Only set once MarkImmutable() has been called: the list is owned
+  // by the memtable and stays valid for as long as it is referenced.
+  const RangeTombstoneList* range_tombstones() const {
+    return range_tombstones_.load(std::memory_order_acquire);
+  }
+
+  // Fragment the range tombstones, so that lookups no longer scan them.
+  // REQUIRES: no more entries are added to the memtable.
+  void MarkImmutable();
+
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
-  // Typically value will be empty if type==kTypeDeletion.
+  // Typically value will be empty if type==kTypeDeletion.  If
+  // type==kTypeRangeDeletion, key is the first deleted key and value is
+  // the key after the deleted range.
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
+  // Like Add(), but may be called by several threads at once.
+  // REQUIRES: no Add() is running concurrently.
+  void AddConcurrently(SequenceNumber seq, ValueType type, const Slice& key,
+                       const Slice& value);
+
   // If memtable contains a value for key, store it in *value and return true.
-  // If memtable contains a deletion for key, store a NotFound() error
-  // in *status and return true.
+  // If memtable contains a deletion for key, or a range tombstone covering
+  // it that is newer than its value, store a NotFound() error in *status
+  // and return true.
   // Else, return false.
-  bool Get(const LookupKey& key, std::string* value, Status* s);
+  // The merge operands for key that are newer than the value or deletion
+  // are added to *merge_context, whether or not one is found.
+  bool Get(const LookupKey& key, std::string* value, Status* s,
+           MergeContext* merge_context);
+
+  // Like Get(), but stores in *value a slice of the memtable's storage,
+  // which stays valid for as long as the memtable is referenced.
+  bool Get(const LookupKey& key, Slice* value, Status* s,
+           MergeContext* merge_context);
 
  private:
   friend class MemTableIterator; // 如果类A是类B的友元, 本质上就是 类B 获得类A得所有访问权限 
@@ -75,12 +110,24 @@ class MemTable {
 
   typedef SkipList<const char*, KeyComparator> Table;
 
+  // Allocate and fill in the encoded memtable entry for an Add() call.
+  const char* EncodeEntry(SequenceNumber seq, ValueType type, const Slice& key,
+                          const Slice& value, bool concurrent);
+
+  // Return the largest sequence number, no larger than "snapshot", of the
+  // range tombstones covering user_key, or zero if there is none.
+  SequenceNumber MaxCoveringTombstone(const Slice& user_key,
+                                      SequenceNumber snapshot);
+
   ~MemTable();  // 1. ~表示析构函数, 销毁函数 默认是public, 但是现在定义成prive, 表示 Private since only Unref() should be used to delete it
 
   KeyComparator comparator_;
   int refs_; // 记录被创建的次数, 和Unref 一起, 如果无人访问就销毁
   Arena arena_;
   Table table_;
+  Table range_del_table_;  // Range tombstones, kept apart from table_
+  std::atomic<bool> has_range_tombstones_;
+  std::atomic<const RangeTombstoneList*> range_tombstones_;  // See above
 };
 
 }  // namespace leveldb
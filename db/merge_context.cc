@@ -0,0 +1,32 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/merge_context.h"
+
+#include "leveldb/merge_operator.h"
+
+namespace leveldb {
+
+Status FullMerge(const MergeOperator* merge_operator, const Slice& user_key,
+                 const Slice* base, const std::vector<Slice>& operands,
+                 std::string* result) {
+  if (merge_operator == nullptr) {
+    return Status::NotSupported("merge operand without merge operator for ",
+                                user_key);
+  }
+  result->clear();
+  if (!merge_operator->FullMerge(user_key, base, operands, result)) {
+    return Status::Corruption("merge failed for ", user_key);
+  }
+  return Status::OK();
+}
+
+Status MergeContext::Merge(const MergeOperator* merge_operator,
+                           const Slice& user_key, const Slice* base,
+                           std::string* result) const {
+  std::vector<Slice> operands(operands_.rbegin(), operands_.rend());
+  return FullMerge(merge_operator, user_key, base, operands, result);
+}
+
+}  // namespace leveldb
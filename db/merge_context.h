@@ -0,0 +1,46 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
+#define STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class MergeOperator;
+
+// Store in *result the value obtained by applying "operands", oldest
+// first, to *base, or to no value if base is null.
+Status FullMerge(const MergeOperator* merge_operator, const Slice& user_key,
+                 const Slice* base, const std::vector<Slice>& operands,
+                 std::string* result);
+
+// A MergeContext collects the merge operands that a lookup finds for a
+// key, from the newest to the oldest, until it reaches the value or the
+// deletion that they apply to.
+class MergeContext {
+ public:
+  bool empty() const { return operands_.empty(); }
+
+  void PushOperand(const Slice& operand) {
+    operands_.emplace_back(operand.data(), operand.size());
+  }
+
+  // Store in *result the value obtained by applying the operands to
+  // *base, or to no value if base is null.
+  Status Merge(const MergeOperator* merge_operator, const Slice& user_key,
+               const Slice* base, std::string* result) const;
+
+ private:
+  std::vector<std::string> operands_;  // Newest first
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_MERGE_CONTEXT_H_
@@ -0,0 +1,179 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <set>
+
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+RangeTombstoneList::RangeTombstoneList(const Comparator* user_comparator)
+    : user_comparator_(user_comparator), finished_(false) {}
+
+RangeTombstoneList::~RangeTombstoneList() = default;
+
+void RangeTombstoneList::Add(const Slice& start, const Slice& end,
+                             SequenceNumber sequence) {
+  assert(!finished_);
+  if (user_comparator_->Compare(start, end) < 0) {
+    tombstones_.push_back({start.ToString(), end.ToString(), sequence});
+  }
+}
+
+Status RangeTombstoneList::AddAll(Iterator* iter) {
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey) ||
+        ikey.type != kTypeRangeDeletion) {
+      return Status::Corruption("bad range tombstone");
+    }
+    Add(ikey.user_key, iter->value(), ikey.sequence);
+  }
+  return iter->status();
+}
+
+void RangeTombstoneList::AddAll(const RangeTombstoneList& list) {
+  assert(list.finished_);
+  for (size_t i = 0; i < list.NumFragments(); i++) {
+    const Fragment f = list.fragment(i);
+    for (int j = 0; j < f.num_sequences; j++) {
+      Add(f.start, f.end, f.sequences[j]);
+    }
+  }
+}
+
+void RangeTombstoneList::Finish() {
+  assert(!finished_);
+  finished_ = true;
+  if (tombstones_.empty()) {
+    return;
+  }
+
+  auto less = [this](const std::string& a, const std::string& b) {
+    return user_comparator_->Compare(a, b) < 0;
+  };
+  for (const Tombstone& t : tombstones_) {
+    points_.push_back(t.start);
+    points_.push_back(t.end);
+  }
+  std::sort(points_.begin(), points_.end(), less);
+  points_.erase(std::unique(points_.begin(), points_.end(),
+                            [this](const std::string& a, const std::string& b) {
+                              return user_comparator_->Compare(a, b) == 0;
+                            }),
+                points_.end());
+
+  // Sweep the points, keeping track of the tombstones covering the part
+  // of the key space that starts at each of them.
+  std::vector<std::vector<SequenceNumber>> starting(points_.size());
+  std::vector<std::vector<SequenceNumber>> ending(points_.size());
+  for (const Tombstone& t : tombstones_) {
+    const size_t start =
+        std::lower_bound(points_.begin(), points_.end(), t.start, less) -
+        points_.begin();
+    const size_t end =
+        std::lower_bound(points_.begin(), points_.end(), t.end, less) -
+        points_.begin();
+    starting[start].push_back(t.sequence);
+    ending[end].push_back(t.sequence);
+  }
+  std::vector<Tombstone>().swap(tombstones_);
+
+  std::multiset<SequenceNumber, std::greater<SequenceNumber>> active;
+  for (size_t i = 0; i + 1 < points_.size(); i++) {
+    for (SequenceNumber s : ending[i]) {
+      active.erase(active.find(s));
+    }
+    active.insert(starting[i].begin(), starting[i].end());
+    if (active.empty()) {
+      continue;
+    }
+    FragmentRep rep;
+    rep.start = static_cast<uint32_t>(i);
+    rep.first_sequence = static_cast<uint32_t>(sequences_.size());
+    for (SequenceNumber s : active) {
+      if (sequences_.size() == rep.first_sequence || sequences_.back() != s) {
+        sequences_.push_back(s);
+      }
+    }
+    rep.num_sequences =
+        static_cast<uint32_t>(sequences_.size()) - rep.first_sequence;
+    fragments_.push_back(rep);
+  }
+}
+
+size_t RangeTombstoneList::FindFragment(const Slice& user_key) const {
+  assert(finished_);
+  // Binary search for the first fragment whose end is after user_key
+  size_t left = 0;
+  size_t right = fragments_.size();
+  while (left < right) {
+    const size_t mid = left + (right - left) / 2;
+    if (user_comparator_->Compare(points_[fragments_[mid].start + 1],
+                                  user_key) > 0) {
+      right = mid;
+    } else {
+      left = mid + 1;
+    }
+  }
+  return right;
+}
+
+RangeTombstoneList::Fragment RangeTombstoneList::fragment(size_t i) const {
+  assert(i < fragments_.size());
+  const FragmentRep& rep = fragments_[i];
+  Fragment f;
+  f.start = points_[rep.start];
+  f.end = points_[rep.start + 1];
+  f.sequences = &sequences_[rep.first_sequence];
+  f.num_sequences = static_cast<int>(rep.num_sequences);
+  return f;
+}
+
+SequenceNumber RangeTombstoneList::MaxCoveringSequence(
+    const Slice& user_key, SequenceNumber snapshot) const {
+  const size_t i = FindFragment(user_key);
+  if (i == fragments_.size()) {
+    return 0;
+  }
+  const FragmentRep& rep = fragments_[i];
+  if (user_comparator_->Compare(points_[rep.start], user_key) > 0) {
+    return 0;
+  }
+  for (uint32_t j = 0; j < rep.num_sequences; j++) {
+    const SequenceNumber s = sequences_[rep.first_sequence + j];
+    if (s <= snapshot) {
+      return s;
+    }
+  }
+  return 0;
+}
+
+void ExtendRangeForTombstone(const InternalKeyComparator& icmp,
+                             const Slice& tombstone_key, const Slice& end_key,
+                             bool empty, InternalKey* smallest,
+                             InternalKey* largest) {
+  if (empty || icmp.Compare(tombstone_key, smallest->Encode()) < 0) {
+    smallest->DecodeFrom(tombstone_key);
+  }
+  InternalKey sentinel(end_key, kMaxSequenceNumber, kTypeRangeDeletion);
+  if (empty || icmp.Compare(sentinel, *largest) > 0) {
+    *largest = sentinel;
+  }
+}
+
+bool IsRangeTombstoneSentinel(const InternalKey& key) {
+  ParsedInternalKey parsed;
+  return ParseInternalKey(key.Encode(), &parsed) &&
+         parsed.sequence == kMaxSequenceNumber &&
+         parsed.type == kTypeRangeDeletion;
+}
+
+}  // namespace leveldb
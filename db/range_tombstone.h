@@ -0,0 +1,131 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A range tombstone, written by WriteBatch::DeleteRange(), deletes the
+// entries for the user keys in [start, end) whose sequence numbers are
+// smaller than its own.  Range tombstones are kept apart from the other
+// entries.  Memtables and tables store each of them as an entry whose key
+// is the internal key (start, sequence, kTypeRangeDeletion) and whose
+// value is the end key, in a separate skiplist or block.
+//
+// The range covered by the tombstones of a table is part of the key range
+// of the table (see FileMetaData), so that a tombstone is always in the
+// same level or in a newer level than the entries it covers.  A lookup
+// can therefore check each table or memtable on its own: an entry is
+// deleted if a tombstone covering it is newer than the entry itself.
+
+#ifndef STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+#define STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Iterator;
+
+// A set of range tombstones, split into non-overlapping fragments so that
+// the tombstones covering a key can be found with a binary search.
+//
+// A list is filled by the Add() methods, then Finish() is called; after
+// that it is immutable, and safe to use from several threads.
+class RangeTombstoneList {
+ public:
+  // A part [start, end) of the key space covered by the same tombstones,
+  // whose sequence numbers are sequences[0, num_sequences-1], newest first.
+  struct Fragment {
+    Slice start;
+    Slice end;
+    const SequenceNumber* sequences;
+    int num_sequences;
+  };
+
+  explicit RangeTombstoneList(const Comparator* user_comparator);
+
+  RangeTombstoneList(const RangeTombstoneList&) = delete;
+  RangeTombstoneList& operator=(const RangeTombstoneList&) = delete;
+
+  ~RangeTombstoneList();
+
+  // Add a tombstone covering [start, end).  Empty ranges are ignored.
+  // REQUIRES: Finish() has not been called.
+  void Add(const Slice& start, const Slice& end, SequenceNumber sequence);
+
+  // Add the tombstones yielded by *iter, in the format used by memtables
+  // and tables.  Returns a non-OK status if an entry is malformed or if
+  // the iterator fails.
+  // REQUIRES: Finish() has not been called.
+  Status AddAll(Iterator* iter);
+
+  // Add the tombstones of *list.
+  // REQUIRES: Finish() has been called on *list but not on this list.
+  void AddAll(const RangeTombstoneList& list);
+
+  // Split the tombstones added so far into fragments.
+  void Finish();
+
+  // Return true iff the list holds no tombstone.
+  // REQUIRES: Finish() has been called.
+  bool empty() const { return fragments_.empty(); }
+
+  // Return the largest sequence number, no larger than "snapshot", of the
+  // tombstones covering user_key, or zero if no tombstone visible at
+  // "snapshot" covers it.
+  // REQUIRES: Finish() has been called.
+  SequenceNumber MaxCoveringSequence(const Slice& user_key,
+                                     SequenceNumber snapshot) const;
+
+  // Fragments are numbered from 0 to NumFragments()-1 in increasing key
+  // order.  Return the number of the first fragment that ends after
+  // user_key, or NumFragments() if there is none.
+  // REQUIRES: Finish() has been called.
+  size_t NumFragments() const { return fragments_.size(); }
+  size_t FindFragment(const Slice& user_key) const;
+  Fragment fragment(size_t i) const;
+
+ private:
+  struct Tombstone {
+    std::string start;
+    std::string end;
+    SequenceNumber sequence;
+  };
+
+  // Fragment i covers [points_[start], points_[start+1]).
+  struct FragmentRep {
+    uint32_t start;
+    uint32_t first_sequence;  // Index of the sequences in sequences_
+    uint32_t num_sequences;
+  };
+
+  const Comparator* const user_comparator_;
+  std::vector<Tombstone> tombstones_;  // Only until Finish()
+  std::vector<std::string> points_;    // Fragment boundaries, sorted
+  std::vector<SequenceNumber> sequences_;
+  std::vector<FragmentRep> fragments_;
+  bool finished_;
+};
+
+// Widen [*smallest, *largest], the key range of a table, to cover the
+// range tombstone with the given key and end key.  If "empty", the bounds
+// are not set yet and are set to the range of the tombstone.
+//
+// The end key of a tombstone is not deleted by it, so the table is given
+// a largest key that sorts before every entry for the end key: a "sentinel"
+// key that the table does not hold.
+void ExtendRangeForTombstone(const InternalKeyComparator& icmp,
+                             const Slice& tombstone_key, const Slice& end_key,
+                             bool empty, InternalKey* smallest,
+                             InternalKey* largest);
+
+// Return true iff key is the sentinel largest key of a table whose last
+// range tombstone ends after its last entry.
+bool IsRangeTombstoneSentinel(const InternalKey& key);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_RANGE_TOMBSTONE_H_
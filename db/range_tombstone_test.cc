@@ -0,0 +1,128 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/range_tombstone.h"
+
+#include <string>
+
+#include "gtest/gtest.h"
+#include "db/memtable.h"
+#include "db/merge_context.h"
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+
+namespace leveldb {
+
+static std::string Fragments(const RangeTombstoneList& list) {
+  std::string result;
+  for (size_t i = 0; i < list.NumFragments(); i++) {
+    RangeTombstoneList::Fragment f = list.fragment(i);
+    result += "[" + f.start.ToString() + "," + f.end.ToString() + ")";
+    for (int j = 0; j < f.num_sequences; j++) {
+      result += ":" + std::to_string(f.sequences[j]);
+    }
+    result += " ";
+  }
+  return result;
+}
+
+TEST(RangeTombstoneTest, Empty) {
+  RangeTombstoneList list(BytewiseComparator());
+  list.Add("b", "b", 10);
+  list.Add("c", "a", 10);
+  list.Finish();
+  ASSERT_TRUE(list.empty());
+  ASSERT_EQ(0, list.MaxCoveringSequence("b", kMaxSequenceNumber));
+}
+
+TEST(RangeTombstoneTest, Fragments) {
+  RangeTombstoneList list(BytewiseComparator());
+  list.Add("a", "e", 5);
+  list.Add("c", "g", 9);
+  list.Add("c", "d", 5);
+  list.Add("x", "z", 1);
+  list.Finish();
+  ASSERT_EQ("[a,c):5 [c,d):9:5 [d,e):9:5 [e,g):9 [x,z):1 ", Fragments(list));
+}
+
+TEST(RangeTombstoneTest, MaxCoveringSequence) {
+  RangeTombstoneList list(BytewiseComparator());
+  list.Add("b", "d", 3);
+  list.Add("c", "f", 7);
+  list.Finish();
+  ASSERT_FALSE(list.empty());
+
+  ASSERT_EQ(0, list.MaxCoveringSequence("a", kMaxSequenceNumber));
+  ASSERT_EQ(3, list.MaxCoveringSequence("b", kMaxSequenceNumber));
+  ASSERT_EQ(7, list.MaxCoveringSequence("c", kMaxSequenceNumber));
+  ASSERT_EQ(7, list.MaxCoveringSequence("e", kMaxSequenceNumber));
+  ASSERT_EQ(0, list.MaxCoveringSequence("f", kMaxSequenceNumber));
+  ASSERT_EQ(0, list.MaxCoveringSequence("g", kMaxSequenceNumber));
+
+  // Tombstones newer than the snapshot are ignored.
+  ASSERT_EQ(3, list.MaxCoveringSequence("c", 6));
+  ASSERT_EQ(0, list.MaxCoveringSequence("e", 6));
+  ASSERT_EQ(0, list.MaxCoveringSequence("c", 2));
+}
+
+TEST(RangeTombstoneTest, AddAll) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* mem = new MemTable(cmp);
+  mem->Ref();
+  mem->Add(10, kTypeRangeDeletion, "k", "m");
+  mem->Add(11, kTypeValue, "l", "value");
+  mem->Add(12, kTypeRangeDeletion, "a", "c");
+
+  RangeTombstoneList first(BytewiseComparator());
+  Iterator* iter = mem->NewRangeTombstoneIterator();
+  ASSERT_TRUE(first.AddAll(iter).ok());
+  delete iter;
+  first.Finish();
+  ASSERT_EQ("[a,c):12 [k,m):10 ", Fragments(first));
+
+  RangeTombstoneList second(BytewiseComparator());
+  second.Add("b", "l", 4);
+  second.AddAll(first);
+  second.Finish();
+  ASSERT_EQ("[a,b):12 [b,c):12:4 [c,k):4 [k,l):10:4 [l,m):10 ",
+            Fragments(second));
+  mem->Unref();
+}
+
+TEST(RangeTombstoneTest, ImmutableMemTable) {
+  InternalKeyComparator cmp(BytewiseComparator());
+  MemTable* mem = new MemTable(cmp);
+  mem->Ref();
+  mem->MarkImmutable();
+  ASSERT_TRUE(mem->range_tombstones() == nullptr);
+  mem->Unref();
+
+  mem = new MemTable(cmp);
+  mem->Ref();
+  mem->Add(10, kTypeValue, "b", "old");
+  mem->Add(11, kTypeRangeDeletion, "a", "c");
+  mem->Add(12, kTypeValue, "c", "new");
+  std::string value;
+  Status s;
+  MergeContext merge_context;
+  ASSERT_TRUE(mem->Get(LookupKey("b", 20), &value, &s, &merge_context));
+  ASSERT_TRUE(s.IsNotFound());
+
+  mem->MarkImmutable();
+  ASSERT_TRUE(mem->range_tombstones() != nullptr);
+  ASSERT_EQ("[a,c):11 ", Fragments(*mem->range_tombstones()));
+  s = Status::OK();
+  ASSERT_TRUE(mem->Get(LookupKey("b", 20), &value, &s, &merge_context));
+  ASSERT_TRUE(s.IsNotFound());
+  s = Status::OK();
+  ASSERT_TRUE(mem->Get(LookupKey("b", 10), &value, &s, &merge_context));
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ("old", value);
+  ASSERT_TRUE(mem->Get(LookupKey("c", 20), &value, &s, &merge_context));
+  ASSERT_TRUE(s.ok());
+  ASSERT_EQ("new", value);
+  mem->Unref();
+}
+
+}  // namespace leveldb
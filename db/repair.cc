@@ -31,6 +31,7 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
 #include "db/version_edit.h"
 #include "db/write_batch_internal.h"
@@ -49,7 +50,9 @@ class Repairer {
         env_(options.env),
         icmp_(options.comparator),
         ipolicy_(options.filter_policy),
-        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
+        iprefix_(options.prefix_extractor),
+        options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, &iprefix_,
+                                 nullptr, nullptr, options)),
         owns_info_log_(options_.info_log != options.info_log),
         owns_cache_(options_.block_cache != options.block_cache),
         next_file_number_(1) {
@@ -203,8 +206,11 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    Iterator* range_del_iter = mem->NewRangeTombstoneIterator();
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter,
+                        range_del_iter, &meta);
     delete iter;
+    delete range_del_iter;
     mem->Unref();
     mem = nullptr;
     if (status.ok()) {
@@ -281,6 +287,25 @@ class Repairer {
       status = iter->status();
     }
     delete iter;
+
+    // The range tombstones widen the key range of the table.
+    RangeTombstoneList tombstones(icmp_.user_comparator());
+    if (status.ok()) {
+      status = table_cache_->AddRangeTombstones(t.meta.number,
+                                                t.meta.file_size, &tombstones);
+    }
+    tombstones.Finish();
+    for (size_t i = 0; i < tombstones.NumFragments(); i++) {
+      const RangeTombstoneList::Fragment f = tombstones.fragment(i);
+      InternalKey start(f.start, f.sequences[0], kTypeRangeDeletion);
+      ExtendRangeForTombstone(icmp_, start.Encode(), f.end, empty,
+                              &t.meta.smallest, &t.meta.largest);
+      empty = false;
+      t.meta.has_range_tombstones = true;
+      if (f.sequences[0] > t.max_sequence) {
+        t.max_sequence = f.sequences[0];
+      }
+    }
     Log(options_.info_log, "Table #%llu: %d entries %s",
         (unsigned long long)t.meta.number, counter, status.ToString().c_str());
 
@@ -369,7 +394,7 @@ class Repairer {
       // TODO(opt): separate out into multiple levels
       const TableInfo& t = tables_[i];
       edit_.AddFile(0, t.meta.number, t.meta.file_size, t.meta.smallest,
-                    t.meta.largest);
+                    t.meta.largest, t.meta.has_range_tombstones);
     }
 
     // std::fprintf(stderr,
@@ -429,6 +454,7 @@ class Repairer {
   Env* const env_;
   InternalKeyComparator const icmp_;
   InternalFilterPolicy const ipolicy_;
+  InternalKeySliceTransform const iprefix_;
   const Options options_;
   bool owns_info_log_;
   bool owns_cache_;
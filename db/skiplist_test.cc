@@ -365,4 +365,62 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads using InsertConcurrently() on the same list.
+namespace {
+
+const int kInsertThreads = 4;
+const int kInsertsPerThread = 20000;
+
+struct InsertThreadState {
+  SkipList<Key, Comparator>* list;
+  int id;
+  std::atomic<int>* remaining;
+};
+
+void ConcurrentInserter(void* arg) {
+  InsertThreadState* state = reinterpret_cast<InsertThreadState*>(arg);
+  // Interleave the keys of all threads so that they contend for the same
+  // splices.
+  for (int i = 0; i < kInsertsPerThread; i++) {
+    state->list->InsertConcurrently(
+        static_cast<Key>(i) * kInsertThreads + state->id);
+  }
+  state->remaining->fetch_sub(1, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST(SkipTest, InsertConcurrently) {
+  Arena arena;
+  Comparator cmp;
+  SkipList<Key, Comparator> list(cmp, &arena);
+  std::atomic<int> remaining(kInsertThreads);
+  InsertThreadState states[kInsertThreads];
+  for (int id = 0; id < kInsertThreads; id++) {
+    states[id].list = &list;
+    states[id].id = id;
+    states[id].remaining = &remaining;
+    Env::Default()->StartThread(ConcurrentInserter, &states[id]);
+  }
+  while (remaining.load(std::memory_order_acquire) > 0) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+
+  const Key kNumKeys = static_cast<Key>(kInsertThreads) * kInsertsPerThread;
+  SkipList<Key, Comparator>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (Key k = 0; k < kNumKeys; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (Key k = 0; k < kNumKeys; k += 97) {
+    ASSERT_TRUE(list.Contains(k));
+    iter.Seek(k);
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+  }
+}
+
 }  // namespace leveldb
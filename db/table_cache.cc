@@ -5,6 +5,7 @@
 #include "db/table_cache.h"
 
 #include "db/filename.h"
+#include "db/range_tombstone.h"
 #include "leveldb/env.h"
 #include "leveldb/table.h"
 #include "util/coding.h"
@@ -14,10 +15,12 @@ namespace leveldb {
 struct TableAndFile {
   RandomAccessFile* file;
   Table* table;
+  RangeTombstoneList* range_tombstones;  // Null if the table has none
 };
 
 static void DeleteEntry(const Slice& key, void* value) {
   TableAndFile* tf = reinterpret_cast<TableAndFile*>(value);
+  delete tf->range_tombstones;
   delete tf->table;
   delete tf->file;
   delete tf;
@@ -60,6 +63,24 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       s = Table::Open(options_, file, file_size, &table);
     }
 
+    // Fragment the range tombstones once, when the table is opened.
+    RangeTombstoneList* range_tombstones = nullptr;
+    Iterator* range_del_iter =
+        s.ok() ? table->NewRangeTombstoneIterator() : nullptr;
+    if (range_del_iter != nullptr) {
+      range_tombstones = new RangeTombstoneList(
+          static_cast<const InternalKeyComparator*>(options_.comparator)
+              ->user_comparator());
+      s = range_tombstones->AddAll(range_del_iter);
+      range_tombstones->Finish();
+      delete range_del_iter;
+      if (!s.ok()) {
+        delete range_tombstones;
+        delete table;
+        table = nullptr;
+      }
+    }
+
     if (!s.ok()) {
       assert(table == nullptr);
       delete file;
@@ -69,6 +90,7 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
       TableAndFile* tf = new TableAndFile;
       tf->file = file;
       tf->table = table;
+      tf->range_tombstones = range_tombstones;
       *handle = cache_->Insert(key, tf, 1, &DeleteEntry);
     }
   }
@@ -100,12 +122,71 @@ Iterator* TableCache::NewIterator(const ReadOptions& options,
 Status TableCache::Get(const ReadOptions& options, uint64_t file_number,
                        uint64_t file_size, const Slice& k, void* arg,
                        void (*handle_result)(void*, const Slice&,
-                                             const Slice&)) {
+                                             const Slice&),
+                       Iterator** pinned) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    s = t->InternalGet(options, k, arg, handle_result, pinned);
+    if (pinned != nullptr && *pinned != nullptr) {
+      // The entry may point into the file, so keep the table open too.
+      (*pinned)->RegisterCleanup(&UnrefEntry, cache_, handle);
+    } else {
+      cache_->Release(handle);
+    }
+  } else if (pinned != nullptr) {
+    *pinned = nullptr;
+  }
+  return s;
+}
+
+Status TableCache::MultiGet(const ReadOptions& options, uint64_t file_number,
+                            uint64_t file_size, int n, const Slice* k,
+                            void* const* args,
+                            void (*handle_result)(void*, const Slice&,
+                                                  const Slice&)) {
   Cache::Handle* handle = nullptr;
   Status s = FindTable(file_number, file_size, &handle);
   if (s.ok()) {
     Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
-    s = t->InternalGet(options, k, arg, handle_result);
+    s = t->InternalMultiGet(options, n, k, args, handle_result);
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::MaxCoveringTombstone(uint64_t file_number,
+                                        uint64_t file_size, const Slice& k,
+                                        SequenceNumber* sequence) {
+  *sequence = 0;
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeTombstoneList* list =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))
+            ->range_tombstones;
+    if (list != nullptr) {
+      *sequence = list->MaxCoveringSequence(
+          ExtractUserKey(k), DecodeFixed64(k.data() + k.size() - 8) >> 8);
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::AddRangeTombstones(uint64_t file_number,
+                                      uint64_t file_size,
+                                      RangeTombstoneList* list) {
+  Cache::Handle* handle = nullptr;
+  Status s = FindTable(file_number, file_size, &handle);
+  if (s.ok()) {
+    const RangeTombstoneList* file_list =
+        reinterpret_cast<TableAndFile*>(cache_->Value(handle))
+            ->range_tombstones;
+    if (file_list != nullptr) {
+      list->AddAll(*file_list);
+    }
     cache_->Release(handle);
   }
   return s;
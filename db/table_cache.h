@@ -30,6 +30,7 @@
 namespace leveldb {
 
 class Env;
+class RangeTombstoneList;
 
 class TableCache {
  public:
@@ -51,10 +52,32 @@ class TableCache {
                         uint64_t file_size, Table** tableptr = nullptr);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  If "pinned" is
+  // non-null, sets *pinned to an iterator that keeps found_key and
+  // found_value valid until it is deleted (or to nullptr if no entry was
+  // found), which the caller must delete.
   Status Get(const ReadOptions& options, uint64_t file_number,
              uint64_t file_size, const Slice& k, void* arg,
-             void (*handle_result)(void*, const Slice&, const Slice&));
+             void (*handle_result)(void*, const Slice&, const Slice&),
+             Iterator** pinned = nullptr);
+
+  // Batched form of Get() for the sorted internal keys k[0,n-1]: for each
+  // i, if a seek to k[i] finds an entry, call
+  // (*handle_result)(args[i], found_key, found_value).  The table is
+  // looked up in the cache only once for the whole batch.
+  Status MultiGet(const ReadOptions& options, uint64_t file_number,
+                  uint64_t file_size, int n, const Slice* k, void* const* args,
+                  void (*handle_result)(void*, const Slice&, const Slice&));
+
+  // Set *sequence to the largest sequence number, no larger than the one
+  // of internal key "k", of the range tombstones of the specified file
+  // that cover the user key of "k", or to zero if there is none.
+  Status MaxCoveringTombstone(uint64_t file_number, uint64_t file_size,
+                              const Slice& k, SequenceNumber* sequence);
+
+  // Add the range tombstones of the specified file to *list.
+  Status AddRangeTombstones(uint64_t file_number, uint64_t file_size,
+                            RangeTombstoneList* list);
 
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
@@ -0,0 +1,148 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/ttl.h"
+
+#include <algorithm>
+
+#include "leveldb/env.h"
+#include "leveldb/write_batch.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+uint64_t TtlNow(Env* env) { return env->NowMicros() / 1000000; }
+
+void AppendTtlTimestamp(std::string* value, uint64_t now) {
+  PutFixed32(value, static_cast<uint32_t>(now));
+}
+
+bool ParseTtlValue(const Slice& input, Slice* value, uint64_t* write_time) {
+  if (input.size() < kTtlTimestampSize) {
+    return false;
+  }
+  const size_t n = input.size() - kTtlTimestampSize;
+  *value = Slice(input.data(), n);
+  *write_time = DecodeFixed32(input.data() + n);
+  return true;
+}
+
+namespace {
+
+class TimestampInserter : public WriteBatch::Handler {
+ public:
+  TimestampInserter(uint64_t now, WriteBatch* result)
+      : now_(now), result_(result) {}
+
+  void Put(const Slice& key, const Slice& value) override {
+    result_->Put(key, Stamp(value));
+  }
+  void Delete(const Slice& key) override { result_->Delete(key); }
+  void DeleteRange(const Slice& begin_key, const Slice& end_key) override {
+    result_->DeleteRange(begin_key, end_key);
+  }
+  void Merge(const Slice& key, const Slice& value) override {
+    result_->Merge(key, Stamp(value));
+  }
+
+ private:
+  Slice Stamp(const Slice& value) {
+    buffer_.assign(value.data(), value.size());
+    AppendTtlTimestamp(&buffer_, now_);
+    return buffer_;
+  }
+
+  const uint64_t now_;
+  WriteBatch* const result_;
+  std::string buffer_;
+};
+
+}  // namespace
+
+Status AddTtlTimestamps(const WriteBatch& batch, uint64_t now,
+                        WriteBatch* result) {
+  result->Clear();
+  TimestampInserter inserter(now, result);
+  return batch.Iterate(&inserter);
+}
+
+const char* TtlCompactionFilter::Name() const {
+  return "leveldb.TtlCompactionFilter";
+}
+
+bool TtlCompactionFilter::Filter(int level, const Slice& key,
+                                 const Slice& existing_value,
+                                 std::string* new_value,
+                                 bool* value_changed) const {
+  Slice value;
+  uint64_t write_time;
+  if (!ParseTtlValue(existing_value, &value, &write_time)) {
+    return false;  // Left for reads to report
+  }
+  if (IsTtlExpired(write_time, ttl_, TtlNow(env_))) {
+    return true;
+  }
+  if (user_filter_ == nullptr) {
+    return false;
+  }
+  if (user_filter_->Filter(level, key, value, new_value, value_changed)) {
+    return true;
+  }
+  if (*value_changed) {
+    AppendTtlTimestamp(new_value, write_time);
+  }
+  return false;
+}
+
+const char* TtlMergeOperator::Name() const {
+  return "leveldb.TtlMergeOperator";
+}
+
+bool TtlMergeOperator::FullMerge(const Slice& key,
+                                 const Slice* existing_value,
+                                 const std::vector<Slice>& operands,
+                                 std::string* new_value) const {
+  Slice base;
+  uint64_t write_time = 0;
+  const Slice* live_base = nullptr;
+  if (existing_value != nullptr) {
+    if (!ParseTtlValue(*existing_value, &base, &write_time)) {
+      return false;
+    }
+    if (!IsTtlExpired(write_time, ttl_, TtlNow(env_))) {
+      live_base = &base;
+    }
+  }
+
+  std::vector<Slice> values(operands.size());
+  uint64_t newest = 0;
+  for (size_t i = 0; i < operands.size(); i++) {
+    if (!ParseTtlValue(operands[i], &values[i], &write_time)) {
+      return false;
+    }
+    newest = std::max(newest, write_time);
+  }
+  if (!user_operator_->FullMerge(key, live_base, values, new_value)) {
+    return false;
+  }
+  AppendTtlTimestamp(new_value, newest);
+  return true;
+}
+
+bool TtlMergeOperator::PartialMerge(const Slice& key,
+                                    const Slice& left_operand,
+                                    const Slice& right_operand,
+                                    std::string* new_value) const {
+  Slice left, right;
+  uint64_t left_time, right_time;
+  if (!ParseTtlValue(left_operand, &left, &left_time) ||
+      !ParseTtlValue(right_operand, &right, &right_time) ||
+      !user_operator_->PartialMerge(key, left, right, new_value)) {
+    return false;
+  }
+  AppendTtlTimestamp(new_value, std::max(left_time, right_time));
+  return true;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,94 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// In a database opened with a TTL (see Options::ttl), every value and
+// merge operand is stored with its write time appended, as a fixed32
+// number of seconds since the epoch.  The helpers below add, check and
+// remove these timestamps, and wrap the user's compaction filter and
+// merge operator so that they only see the values without them.
+
+#ifndef STORAGE_LEVELDB_DB_TTL_H_
+#define STORAGE_LEVELDB_DB_TTL_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "leveldb/compaction_filter.h"
+#include "leveldb/merge_operator.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+class WriteBatch;
+
+static const size_t kTtlTimestampSize = 4;
+
+// Return the current time in seconds since the epoch.
+uint64_t TtlNow(Env* env);
+
+// Append the write time "now" to *value.
+void AppendTtlTimestamp(std::string* value, uint64_t now);
+
+// Split "input" into the value and its write time.  Returns false if
+// input is too short to hold a write time.
+bool ParseTtlValue(const Slice& input, Slice* value, uint64_t* write_time);
+
+// Return true iff something written at "write_time" is more than "ttl"
+// seconds old at "now".
+inline bool IsTtlExpired(uint64_t write_time, uint64_t ttl, uint64_t now) {
+  return now >= ttl && write_time <= now - ttl;
+}
+
+// Store in *result a copy of "batch" whose values and merge operands have
+// the write time "now" appended.
+Status AddTtlTimestamps(const WriteBatch& batch, uint64_t now,
+                        WriteBatch* result);
+
+// Removes expired values, and passes the others to "user_filter" (if
+// non-null) without their write times.
+class TtlCompactionFilter : public CompactionFilter {
+ public:
+  TtlCompactionFilter(const CompactionFilter* user_filter, uint64_t ttl,
+                      Env* env)
+      : user_filter_(user_filter), ttl_(ttl), env_(env) {}
+
+  const char* Name() const override;
+  bool Filter(int level, const Slice& key, const Slice& existing_value,
+              std::string* new_value, bool* value_changed) const override;
+
+ private:
+  const CompactionFilter* const user_filter_;
+  const uint64_t ttl_;
+  Env* const env_;
+};
+
+// Passes the operands and the existing value, unless it has expired, to
+// "user_operator" without their write times.  The result gets the write
+// time of the newest operand.
+class TtlMergeOperator : public MergeOperator {
+ public:
+  TtlMergeOperator(const MergeOperator* user_operator, uint64_t ttl,
+                   Env* env)
+      : user_operator_(user_operator), ttl_(ttl), env_(env) {}
+
+  const char* Name() const override;
+  bool FullMerge(const Slice& key, const Slice* existing_value,
+                 const std::vector<Slice>& operands,
+                 std::string* new_value) const override;
+  bool PartialMerge(const Slice& key, const Slice& left_operand,
+                    const Slice& right_operand,
+                    std::string* new_value) const override;
+
+ private:
+  const MergeOperator* const user_operator_;
+  const uint64_t ttl_;
+  Env* const env_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_TTL_H_
@@ -20,7 +20,10 @@ enum Tag {
   kDeletedFile = 6,
   kNewFile = 7,
   // 8 was used for large value refs
-  kPrevLogNumber = 9
+  kPrevLogNumber = 9,
+  kNewFileWithRangeTombstones = 10,  // Same payload as kNewFile
+  // kNewFile payload, then has_range_tombstones and creation_time
+  kNewFileWithCreationTime = 11
 };
 
 void VersionEdit::Clear() {
@@ -75,12 +78,21 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    if (f.creation_time != 0) {
+      PutVarint32(dst, kNewFileWithCreationTime);
+    } else {
+      PutVarint32(dst, f.has_range_tombstones ? kNewFileWithRangeTombstones
+                                              : kNewFile);
+    }
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (f.creation_time != 0) {
+      PutVarint32(dst, f.has_range_tombstones ? 1 : 0);
+      PutVarint64(dst, f.creation_time);
+    }
   }
 }
 
@@ -95,7 +107,7 @@ static bool GetInternalKey(Slice* input, InternalKey* dst) {
 
 static bool GetLevel(Slice* input, int* level) {
   uint32_t v;
-  if (GetVarint32(input, &v) && v < config::kNumLevels) {
+  if (GetVarint32(input, &v) && v < config::kMaxNumLevels) {
     *level = v;
     return true;
   } else {
@@ -176,16 +188,35 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
         break;
 
       case kNewFile:
+      case kNewFileWithRangeTombstones:
         if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
             GetVarint64(&input, &f.file_size) &&
             GetInternalKey(&input, &f.smallest) &&
             GetInternalKey(&input, &f.largest)) {
+          f.has_range_tombstones = (tag == kNewFileWithRangeTombstones);
+          f.creation_time = 0;
           new_files_.push_back(std::make_pair(level, f));
         } else {
           msg = "new-file entry";
         }
         break;
 
+      case kNewFileWithCreationTime: {
+        uint32_t has_range_tombstones;
+        if (GetLevel(&input, &level) && GetVarint64(&input, &f.number) &&
+            GetVarint64(&input, &f.file_size) &&
+            GetInternalKey(&input, &f.smallest) &&
+            GetInternalKey(&input, &f.largest) &&
+            GetVarint32(&input, &has_range_tombstones) &&
+            GetVarint64(&input, &f.creation_time)) {
+          f.has_range_tombstones = (has_range_tombstones != 0);
+          new_files_.push_back(std::make_pair(level, f));
+        } else {
+          msg = "new-file entry";
+        }
+        break;
+      }
+
       default:
         msg = "unknown tag";
         break;
@@ -250,6 +281,13 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.has_range_tombstones) {
+      r.append(" (range tombstones)");
+    }
+    if (f.creation_time != 0) {
+      r.append(" created ");
+      AppendNumberTo(&r, f.creation_time);
+    }
   }
   r.append("\n}\n");
   return r;
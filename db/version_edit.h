@@ -32,7 +32,13 @@ namespace leveldb {
 class VersionSet;
 
 struct FileMetaData {
-  FileMetaData() : refs(0), allowed_seeks(1 << 30), file_size(0) {}
+  FileMetaData()
+      : refs(0),
+        allowed_seeks(1 << 30),
+        file_size(0),
+        being_compacted(false),
+        has_range_tombstones(false),
+        creation_time(0) {}
 
   int refs;
   int allowed_seeks;  // Seeks allowed until compaction
@@ -40,6 +46,15 @@ struct FileMetaData {
   uint64_t file_size;    // File size in bytes
   InternalKey smallest;  // Smallest internal key served by table
   InternalKey largest;   // Largest internal key served by table
+  bool being_compacted;  // Input of a running compaction
+
+  // The table holds range tombstones.  Their range is included in
+  // [smallest, largest].
+  bool has_range_tombstones;
+
+  // Seconds since the epoch when the table was written, or 0 if unknown.
+  // Only recorded for databases with a TTL (see Options::ttl).
+  uint64_t creation_time;
 };
 
 class VersionEdit {
@@ -77,12 +92,16 @@ class VersionEdit {
   // REQUIRES: This version has not been saved (see VersionSet::SaveTo)
   // REQUIRES: "smallest" and "largest" are smallest and largest keys in file
   void AddFile(int level, uint64_t file, uint64_t file_size,
-               const InternalKey& smallest, const InternalKey& largest) {
+               const InternalKey& smallest, const InternalKey& largest,
+               bool has_range_tombstones = false,
+               uint64_t creation_time = 0) {
     FileMetaData f;
     f.number = file;
     f.file_size = file_size;
     f.smallest = smallest;
     f.largest = largest;
+    f.has_range_tombstones = has_range_tombstones;
+    f.creation_time = creation_time;
     new_files_.push_back(std::make_pair(level, f));
   }
 
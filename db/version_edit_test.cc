@@ -26,7 +26,8 @@ TEST(VersionEditTest, EncodeDecode) {
     TestEncodeDecode(edit);
     edit.AddFile(3, kBig + 300 + i, kBig + 400 + i,
                  InternalKey("foo", kBig + 500 + i, kTypeValue),
-                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion));
+                 InternalKey("zoo", kBig + 600 + i, kTypeDeletion),
+                 i % 2 == 1, i < 2 ? 0 : kBig + 800 + i);
     edit.RemoveFile(4, kBig + 700 + i);
     edit.SetCompactPointer(i, InternalKey("x", kBig + 900 + i, kTypeValue));
   }
@@ -36,6 +37,20 @@ TEST(VersionEditTest, EncodeDecode) {
   edit.SetNextFile(kBig + 200);
   edit.SetLastSequence(kBig + 1000);
   TestEncodeDecode(edit);
+
+  // Files holding range tombstones are recorded as such.
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_TRUE(parsed.DecodeFrom(encoded).ok());
+  const std::string debug = parsed.DebugString();
+  int marked = 0;
+  for (size_t pos = debug.find("(range tombstones)");
+       pos != std::string::npos;
+       pos = debug.find("(range tombstones)", pos + 1)) {
+    marked++;
+  }
+  ASSERT_EQ(2, marked);
 }
 
 }  // namespace leveldb
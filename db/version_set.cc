@@ -11,13 +11,18 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "db/memtable.h"
+#include "db/merge_context.h"
+#include "db/range_tombstone.h"
 #include "db/table_cache.h"
+#include "db/ttl.h"
 #include "leveldb/env.h"
+#include "leveldb/pinnable_slice.h"
 #include "leveldb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
 #include "util/coding.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
 
 namespace leveldb {
 
@@ -64,6 +69,23 @@ static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
   return sum;
 }
 
+Version::Version(VersionSet* vset)
+    : vset_(vset),
+      next_(this),
+      prev_(this),
+      refs_(0),
+      files_(vset->NumLevels()),
+      file_to_compact_(nullptr),
+      file_to_compact_level_(-1),
+      compaction_score_(-1),
+      compaction_level_(-1),
+      max_bytes_for_level_(vset->NumLevels(), 0),
+      base_level_(1),
+      pending_compaction_bytes_(0),
+      oldest_file_creation_time_(UINT64_MAX),
+      range_tombstones_built_(false),
+      range_tombstones_(nullptr) {}
+
 Version::~Version() {
   assert(refs_ == 0);
 
@@ -72,7 +94,7 @@ Version::~Version() {
   next_->prev_ = prev_;
 
   // Drop references to files
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < vset_->NumLevels(); level++) {
     for (size_t i = 0; i < files_[level].size(); i++) {
       FileMetaData* f = files_[level][i];
       assert(f->refs > 0);
@@ -82,6 +104,7 @@ Version::~Version() {
       }
     }
   }
+  delete range_tombstones_;
 }
 
 int FindFile(const InternalKeyComparator& icmp,
@@ -237,13 +260,49 @@ void Version::AddIterators(const ReadOptions& options,
   // For levels > 0, we can use a concatenating iterator that sequentially
   // walks through the non-overlapping files in the level, opening them
   // lazily.
-  for (int level = 1; level < config::kNumLevels; level++) {
+  for (int level = 1; level < vset_->NumLevels(); level++) {
     if (!files_[level].empty()) {
       iters->push_back(NewConcatenatingIterator(options, level));
     }
   }
 }
 
+Status Version::GetRangeTombstones(const RangeTombstoneList** list) {
+  MutexLock l(&range_tombstones_mu_);
+  if (!range_tombstones_built_) {
+    RangeTombstoneList* result = nullptr;
+    for (int level = 0; level < vset_->NumLevels(); level++) {
+      for (FileMetaData* f : files_[level]) {
+        if (!f->has_range_tombstones) {
+          continue;
+        }
+        if (result == nullptr) {
+          result = new RangeTombstoneList(vset_->icmp_.user_comparator());
+        }
+        Status s = vset_->table_cache_->AddRangeTombstones(
+            f->number, f->file_size, result);
+        if (!s.ok()) {
+          // Not cached, so that a later call retries
+          delete result;
+          *list = nullptr;
+          return s;
+        }
+      }
+    }
+    if (result != nullptr) {
+      result->Finish();
+      if (result->empty()) {
+        delete result;
+        result = nullptr;
+      }
+    }
+    range_tombstones_ = result;
+    range_tombstones_built_ = true;
+  }
+  *list = range_tombstones_;
+  return Status::OK();
+}
+
 // Callback from TableCache::Get()
 namespace {
 enum SaverState {
@@ -251,12 +310,19 @@ enum SaverState {
   kFound,
   kDeleted,
   kCorrupt,
+  kMerge,  // Found a merge operand; see ReadMergeOperands()
 };
 struct Saver {
   SaverState state;
   const Comparator* ucmp;
   Slice user_key;
-  std::string* value;
+  std::string* value;  // If null, the value found is only recorded
+  Slice found_value;
+  MergeContext* merge_context;
+
+  // Sequence number of the newest range tombstone of the file that covers
+  // user_key, or zero.  Entries older than it are deleted.
+  SequenceNumber covering;
 };
 }  // namespace
 static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
@@ -266,12 +332,63 @@ static void SaveValue(void* arg, const Slice& ikey, const Slice& v) {
     s->state = kCorrupt;
   } else {
     if (s->ucmp->Compare(parsed_key.user_key, s->user_key) == 0) {
-      s->state = (parsed_key.type == kTypeValue) ? kFound : kDeleted;
+      if (parsed_key.sequence <= s->covering) {
+        s->state = kDeleted;
+      } else if (parsed_key.type == kTypeValue) {
+        s->state = kFound;
+      } else if (parsed_key.type == kTypeMerge) {
+        s->state = kMerge;
+      } else {
+        s->state = kDeleted;
+      }
       if (s->state == kFound) {
-        s->value->assign(v.data(), v.size());
+        if (s->value != nullptr) {
+          s->value->assign(v.data(), v.size());
+        } else {
+          s->found_value = v;
+        }
+      }
+    }
+  }
+}
+
+// Called when the first entry for the key of a lookup in file "f" is a
+// merge operand.  Adds the merge operands for the key in "f" to the merge
+// context, and stores the value they apply to, if "f" holds it, in
+// saver->value, or in *pinnable if saver->value is null.
+static Status ReadMergeOperands(TableCache* table_cache,
+                                const ReadOptions& options, FileMetaData* f,
+                                const Slice& ikey, Saver* saver,
+                                PinnableSlice* pinnable) {
+  Iterator* iter = table_cache->NewIterator(options, f->number, f->file_size);
+  saver->state = kNotFound;
+  iter->Seek(ikey);
+  while (iter->Valid() && saver->state == kNotFound) {
+    ParsedInternalKey parsed_key;
+    if (!ParseInternalKey(iter->key(), &parsed_key)) {
+      saver->state = kCorrupt;
+    } else if (saver->ucmp->Compare(parsed_key.user_key, saver->user_key) !=
+               0) {
+      break;
+    } else if (parsed_key.sequence <= saver->covering) {
+      saver->state = kDeleted;
+    } else if (parsed_key.type == kTypeMerge) {
+      saver->merge_context->PushOperand(iter->value());
+      iter->Next();
+    } else if (parsed_key.type == kTypeValue) {
+      saver->state = kFound;
+      if (saver->value != nullptr) {
+        saver->value->assign(iter->value().data(), iter->value().size());
+      } else {
+        pinnable->PinSelf(iter->value());
       }
+    } else {
+      saver->state = kDeleted;
     }
   }
+  Status s = iter->status();
+  delete iter;
+  return s;
 }
 
 static bool NewestFirst(FileMetaData* a, FileMetaData* b) {
@@ -302,7 +419,7 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
   }
 
   // Search other levels.
-  for (int level = 1; level < config::kNumLevels; level++) {
+  for (int level = 1; level < vset_->NumLevels(); level++) {
     size_t num_files = files_[level].size();
     if (num_files == 0) continue;
 
@@ -321,13 +438,31 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key, void* arg,
   }
 }
 
+static void DeleteIterator(void* arg1, void* arg2) {
+  delete reinterpret_cast<Iterator*>(arg1);
+}
+
+Status Version::Get(const ReadOptions& options, const LookupKey& k,
+                    std::string* value, GetStats* stats,
+                    MergeContext* merge_context) {
+  return Lookup(options, k, value, nullptr, stats, merge_context);
+}
+
 Status Version::Get(const ReadOptions& options, const LookupKey& k,
-                    std::string* value, GetStats* stats) {
+                    PinnableSlice* value, GetStats* stats,
+                    MergeContext* merge_context) {
+  return Lookup(options, k, nullptr, value, stats, merge_context);
+}
+
+Status Version::Lookup(const ReadOptions& options, const LookupKey& k,
+                       std::string* value, PinnableSlice* pinnable,
+                       GetStats* stats, MergeContext* merge_context) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
 
   struct State {
     Saver saver;
+    PinnableSlice* pinnable;
     GetStats* stats;
     const ReadOptions* options;
     Slice ikey;
@@ -351,15 +486,48 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
       state->last_file_read = f;
       state->last_file_read_level = level;
 
-      state->s = state->vset->table_cache_->Get(*state->options, f->number,
-                                                f->file_size, state->ikey,
-                                                &state->saver, SaveValue);
+      state->saver.covering = 0;
+      if (f->has_range_tombstones) {
+        state->s = state->vset->table_cache_->MaxCoveringTombstone(
+            f->number, f->file_size, state->ikey, &state->saver.covering);
+        if (!state->s.ok()) {
+          state->found = true;
+          return false;
+        }
+      }
+
+      Iterator* pinned = nullptr;
+      state->s = state->vset->table_cache_->Get(
+          *state->options, f->number, f->file_size, state->ikey, &state->saver,
+          SaveValue, state->pinnable != nullptr ? &pinned : nullptr);
+      if (state->s.ok() && state->saver.state == kMerge) {
+        delete pinned;
+        pinned = nullptr;
+        state->s = ReadMergeOperands(state->vset->table_cache_,
+                                     *state->options, f, state->ikey,
+                                     &state->saver, state->pinnable);
+      }
+      if (state->s.ok() && state->saver.state == kNotFound &&
+          state->saver.covering > 0) {
+        // No entry in the file, but older files are covered
+        state->saver.state = kDeleted;
+      }
+      if (pinned != nullptr) {
+        // The iterator keeps the block holding the value alive
+        if (state->s.ok() && state->saver.state == kFound) {
+          state->pinnable->PinSlice(state->saver.found_value,
+                                    &DeleteIterator, pinned, nullptr);
+        } else {
+          delete pinned;
+        }
+      }
       if (!state->s.ok()) {
         state->found = true;
         return false;
       }
       switch (state->saver.state) {
         case kNotFound:
+        case kMerge:  // Not reached: resolved by ReadMergeOperands()
           return true;  // Keep searching in other files
         case kFound:
           state->found = true;
@@ -393,12 +561,169 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   state.saver.ucmp = vset_->icmp_.user_comparator();
   state.saver.user_key = k.user_key();
   state.saver.value = value;
+  state.saver.merge_context = merge_context;
+  state.pinnable = pinnable;
 
   ForEachOverlapping(state.saver.user_key, state.ikey, &state, &State::Match);
 
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+void Version::MultiGet(const ReadOptions& options, MultiGetKey* const* keys,
+                       int n) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+
+  struct KeyState {
+    Saver saver;
+    bool done;
+    FileMetaData* last_file_read;
+    int last_file_read_level;
+  };
+  std::vector<KeyState> states(n);
+  for (int i = 0; i < n; i++) {
+    MultiGetKey* k = keys[i];
+    k->stats.seek_file = nullptr;
+    k->stats.seek_file_level = -1;
+    k->status = Status::NotFound(Slice());
+    KeyState* state = &states[i];
+    state->saver.state = kNotFound;
+    state->saver.ucmp = ucmp;
+    state->saver.user_key = k->key->user_key();
+    state->saver.value = k->value;
+    state->saver.merge_context = k->merge_context;
+    state->saver.covering = 0;
+    state->done = false;
+    state->last_file_read = nullptr;
+    state->last_file_read_level = -1;
+  }
+
+  // Scratch space for the keys of the batch sent to a single file.
+  std::vector<int> batch;
+  std::vector<Slice> batch_keys;
+  std::vector<void*> batch_args;
+  batch.reserve(n);
+  batch_keys.reserve(n);
+  batch_args.reserve(n);
+
+  // Probe file "f" with the keys whose indices are in "batch" and
+  // record the outcome for each of them, mirroring Get()'s Match().
+  auto probe = [&](int level, FileMetaData* f) {
+    if (batch.empty()) {
+      return;
+    }
+    batch_keys.clear();
+    batch_args.clear();
+    for (int i : batch) {
+      KeyState* state = &states[i];
+      GetStats* stats = &keys[i]->stats;
+      if (stats->seek_file == nullptr && state->last_file_read != nullptr) {
+        // We have had more than one seek for this read.  Charge the 1st file.
+        stats->seek_file = state->last_file_read;
+        stats->seek_file_level = state->last_file_read_level;
+      }
+      state->last_file_read = f;
+      state->last_file_read_level = level;
+      batch_keys.push_back(keys[i]->key->internal_key());
+      batch_args.push_back(&state->saver);
+    }
+    Status s;
+    for (size_t j = 0; s.ok() && j < batch.size(); j++) {
+      Saver* saver = &states[batch[j]].saver;
+      saver->covering = 0;
+      if (f->has_range_tombstones) {
+        s = vset_->table_cache_->MaxCoveringTombstone(
+            f->number, f->file_size, batch_keys[j], &saver->covering);
+      }
+    }
+    if (s.ok()) {
+      s = vset_->table_cache_->MultiGet(
+          options, f->number, f->file_size, static_cast<int>(batch.size()),
+          batch_keys.data(), batch_args.data(), SaveValue);
+    }
+    for (size_t j = 0; s.ok() && j < batch.size(); j++) {
+      Saver* saver = &states[batch[j]].saver;
+      if (saver->state == kMerge) {
+        s = ReadMergeOperands(vset_->table_cache_, options, f, batch_keys[j],
+                              saver, nullptr);
+      }
+    }
+    for (int i : batch) {
+      KeyState* state = &states[i];
+      if (!s.ok()) {
+        keys[i]->status = s;
+        state->done = true;
+        continue;
+      }
+      if (state->saver.state == kNotFound && state->saver.covering > 0) {
+        // No entry in the file, but older files are covered
+        state->saver.state = kDeleted;
+      }
+      switch (state->saver.state) {
+        case kNotFound:
+        case kMerge:  // Not reached: resolved by ReadMergeOperands()
+          break;  // Keep searching in other files
+        case kFound:
+          keys[i]->status = Status::OK();
+          state->done = true;
+          break;
+        case kDeleted:
+          state->done = true;
+          break;
+        case kCorrupt:
+          keys[i]->status =
+              Status::Corruption("corrupted key for ", state->saver.user_key);
+          state->done = true;
+          break;
+      }
+    }
+    batch.clear();
+  };
+
+  // Search level-0 in order from newest to oldest.
+  std::vector<FileMetaData*> tmp(files_[0]);
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  for (FileMetaData* f : tmp) {
+    for (int i = 0; i < n; i++) {
+      if (!states[i].done &&
+          ucmp->Compare(states[i].saver.user_key, f->smallest.user_key()) >=
+              0 &&
+          ucmp->Compare(states[i].saver.user_key, f->largest.user_key()) <=
+              0) {
+        batch.push_back(i);
+      }
+    }
+    probe(0, f);
+  }
+
+  // Search other levels.  Files in a level are disjoint and sorted, so a
+  // single forward pass over the sorted keys groups them by file.
+  for (int level = 1; level < vset_->NumLevels(); level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    if (files.empty()) continue;
+
+    FileMetaData* current = nullptr;
+    for (int i = 0; i < n; i++) {
+      if (states[i].done) continue;
+      uint32_t index =
+          FindFile(vset_->icmp_, files, keys[i]->key->internal_key());
+      FileMetaData* f = (index < files.size()) ? files[index] : nullptr;
+      if (f != nullptr &&
+          ucmp->Compare(states[i].saver.user_key, f->smallest.user_key()) <
+              0) {
+        f = nullptr;  // All of "f" is past any data for this key
+      }
+      if (f != current) {
+        probe(level, current);
+        current = f;
+      }
+      if (f != nullptr) {
+        batch.push_back(i);
+      }
+    }
+    probe(level, current);
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -470,17 +795,21 @@ bool Version::OverlapInLevel(int level, const Slice* smallest_user_key,
 int Version::PickLevelForMemTableOutput(const Slice& smallest_user_key,
                                         const Slice& largest_user_key) {
   int level = 0;
+  if (vset_->options_->level_compaction_dynamic_level_bytes) {
+    // The levels below level-0 are kept empty down to base_level_.
+    return level;
+  }
   if (!OverlapInLevel(0, &smallest_user_key, &largest_user_key)) {
     // Push to next level if there is no overlap in next level,
     // and the #bytes overlapping in the level after that are limited.
     InternalKey start(smallest_user_key, kMaxSequenceNumber, kValueTypeForSeek);
     InternalKey limit(largest_user_key, 0, static_cast<ValueType>(0));
     std::vector<FileMetaData*> overlaps;
-    while (level < config::kMaxMemCompactLevel) {
+    while (level < vset_->options_->max_mem_compaction_level) {
       if (OverlapInLevel(level + 1, &smallest_user_key, &largest_user_key)) {
         break;
       }
-      if (level + 2 < config::kNumLevels) {
+      if (level + 2 < vset_->NumLevels()) {
         // Check that file does not overlap too many grandparent bytes.
         GetOverlappingInputs(level + 2, &start, &limit, &overlaps);
         const int64_t sum = TotalFileSize(overlaps);
@@ -499,7 +828,7 @@ void Version::GetOverlappingInputs(int level, const InternalKey* begin,
                                    const InternalKey* end,
                                    std::vector<FileMetaData*>* inputs) {
   assert(level >= 0);
-  assert(level < config::kNumLevels);
+  assert(level < vset_->NumLevels());
   inputs->clear();
   Slice user_begin, user_end;
   if (begin != nullptr) {
@@ -537,9 +866,46 @@ void Version::GetOverlappingInputs(int level, const InternalKey* begin,
   }
 }
 
+void Version::GetFilesInRange(int level, const Slice* begin, const Slice* end,
+                              std::vector<FileMetaData*>* files) {
+  assert(level >= 0);
+  assert(level < vset_->NumLevels());
+  files->clear();
+  const Comparator* user_cmp = vset_->icmp_.user_comparator();
+  const std::vector<FileMetaData*>& level_files = files_[level];
+  for (size_t i = 0; i < level_files.size(); i++) {
+    FileMetaData* f = level_files[i];
+    if (f->being_compacted) {
+      continue;
+    }
+    if (begin != nullptr &&
+        user_cmp->Compare(f->smallest.user_key(), *begin) < 0) {
+      continue;
+    }
+    if (end != nullptr && user_cmp->Compare(f->largest.user_key(), *end) > 0) {
+      continue;
+    }
+    if (level > 0) {
+      // A sentinel largest key is the exclusive end of a range tombstone,
+      // so the next file may start with that user key without sharing it.
+      if (i > 0 && !IsRangeTombstoneSentinel(level_files[i - 1]->largest) &&
+          user_cmp->Compare(level_files[i - 1]->largest.user_key(),
+                            f->smallest.user_key()) == 0) {
+        continue;
+      }
+      if (i + 1 < level_files.size() && !IsRangeTombstoneSentinel(f->largest) &&
+          user_cmp->Compare(f->largest.user_key(),
+                            level_files[i + 1]->smallest.user_key()) == 0) {
+        continue;
+      }
+    }
+    files->push_back(f);
+  }
+}
+
 std::string Version::DebugString() const {
   std::string r;
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < vset_->NumLevels(); level++) {
     // E.g.,
     //   --- level 1 ---
     //   17:123['a' .. 'd']
@@ -591,21 +957,22 @@ class VersionSet::Builder {
 
   VersionSet* vset_;
   Version* base_;
-  LevelState levels_[config::kNumLevels];
+  std::vector<LevelState> levels_;
 
  public:
   // Initialize a builder with the files from *base and other info from *vset
-  Builder(VersionSet* vset, Version* base) : vset_(vset), base_(base) {
+  Builder(VersionSet* vset, Version* base)
+      : vset_(vset), base_(base), levels_(vset->NumLevels()) {
     base_->Ref();
     BySmallestKey cmp;
     cmp.internal_comparator = &vset_->icmp_;
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < vset_->NumLevels(); level++) {
       levels_[level].added_files = new FileSet(cmp);
     }
   }
 
   ~Builder() {
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < vset_->NumLevels(); level++) {
       const FileSet* added = levels_[level].added_files;
       std::vector<FileMetaData*> to_unref;
       to_unref.reserve(added->size());
@@ -672,7 +1039,7 @@ class VersionSet::Builder {
   void SaveTo(Version* v) {
     BySmallestKey cmp;
     cmp.internal_comparator = &vset_->icmp_;
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < vset_->NumLevels(); level++) {
       // Merge the set of added files with the set of pre-existing files.
       // Drop any deleted files.  Store the result in *v.
       const std::vector<FileMetaData*>& base_files = base_->files_[level];
@@ -746,7 +1113,8 @@ VersionSet::VersionSet(const std::string& dbname, const Options* options,
       descriptor_file_(nullptr),
       descriptor_log_(nullptr),
       dummy_versions_(this),
-      current_(nullptr) {
+      current_(nullptr),
+      compact_pointer_(options->num_levels) {
   AppendVersion(new Version(this));
 }
 
@@ -775,6 +1143,15 @@ void VersionSet::AppendVersion(Version* v) {
 }
 
 Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
+  // Edits are written to the MANIFEST one at a time.  Concurrent callers
+  // wait for their turn and are then applied on top of the versions
+  // installed by the callers ahead of them.
+  port::CondVar turn(mu);
+  manifest_writers_.push_back(&turn);
+  while (manifest_writers_.front() != &turn) {
+    turn.Wait();
+  }
+
   if (edit->has_log_number_) {
     assert(edit->log_number_ >= log_number_);
     assert(edit->log_number_ < next_file_number_);
@@ -855,6 +1232,10 @@ Status VersionSet::LogAndApply(VersionEdit* edit, port::Mutex* mu) {
     }
   }
 
+  manifest_writers_.pop_front();
+  if (!manifest_writers_.empty()) {
+    manifest_writers_.front()->Signal();
+  }
   return s;
 }
 
@@ -919,6 +1300,26 @@ Status VersionSet::Recover(bool* save_manifest) {
         }
       }
 
+      if (s.ok()) {
+        // The descriptor may have been written with more levels than we
+        // are configured with now.
+        int max_level = -1;
+        for (const auto& cp : edit.compact_pointers_) {
+          max_level = std::max(max_level, cp.first);
+        }
+        for (const auto& deleted : edit.deleted_files_) {
+          max_level = std::max(max_level, deleted.first);
+        }
+        for (const auto& added : edit.new_files_) {
+          max_level = std::max(max_level, added.first);
+        }
+        if (max_level >= NumLevels()) {
+          s = Status::InvalidArgument(
+              "descriptor references a level beyond options.num_levels",
+              std::to_string(max_level));
+        }
+      }
+
       if (s.ok()) {
         builder.Apply(&edit);
       }
@@ -1028,34 +1429,110 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
   }
 }
 
+void VersionSet::ComputeLevelTargets(Version* v) {
+  if (!options_->level_compaction_dynamic_level_bytes) {
+    v->base_level_ = 1;
+    for (int level = 1; level < NumLevels(); level++) {
+      v->max_bytes_for_level_[level] = MaxBytesForLevel(options_, level);
+    }
+    return;
+  }
+
+  // Size the levels from the bottom up, starting from the largest level,
+  // until the target drops below the level-1 size of the static layout.
+  int first_non_empty_level = NumLevels() - 1;
+  int64_t max_level_bytes = 0;
+  for (int level = NumLevels() - 1; level > 0; level--) {
+    if (!v->files_[level].empty()) {
+      first_non_empty_level = level;
+    }
+    max_level_bytes =
+        std::max(max_level_bytes, TotalFileSize(v->files_[level]));
+  }
+  const double base_bytes = MaxBytesForLevel(options_, 1);
+  int base_level = NumLevels() - 1;
+  double target = std::max(static_cast<double>(max_level_bytes), base_bytes);
+  v->max_bytes_for_level_[base_level] = target;
+  while (base_level > 1 &&
+         (target / 10 >= base_bytes || base_level > first_non_empty_level)) {
+    // Levels that already hold data stay below the base level even if
+    // their target is small; compacting them drains them.
+    target /= 10;
+    base_level--;
+    v->max_bytes_for_level_[base_level] = target;
+  }
+  for (int level = 1; level < base_level; level++) {
+    v->max_bytes_for_level_[level] = 0;
+  }
+  v->base_level_ = base_level;
+}
+
+double VersionSet::CompactionScore(const Version* v, int level) const {
+  double score;
+  if (level > 0 && level < v->base_level_) {
+    // Empty level above the base level
+    score = 0;
+  } else if (level == 0) {
+    // We treat level-0 specially by bounding the number of files
+    // instead of number of bytes for two reasons:
+    //
+    // (1) With larger write-buffer sizes, it is nice not to do too
+    // many level-0 compactions.
+    //
+    // (2) The files in level-0 are merged on every read and
+    // therefore we wish to avoid too many files when the individual
+    // file size is small (perhaps because of a small write-buffer
+    // setting, or very high compression ratios, or lots of
+    // overwrites/deletions).
+    score = v->files_[level].size() /
+            static_cast<double>(options_->level0_file_num_compaction_trigger);
+  } else {
+    // Compute the ratio of current size to size limit.
+    const uint64_t level_bytes = TotalFileSize(v->files_[level]);
+    score = static_cast<double>(level_bytes) / v->max_bytes_for_level_[level];
+  }
+  return score;
+}
+
+uint64_t VersionSet::EstimatePendingCompactionBytes(const Version* v) const {
+  uint64_t pending = 0;
+
+  // Once compactions are triggered, all of level-0 gets rewritten.
+  uint64_t bytes_into_level = 0;
+  if (v->files_[0].size() >=
+      static_cast<size_t>(options_->level0_file_num_compaction_trigger)) {
+    bytes_into_level = TotalFileSize(v->files_[0]);
+    pending += bytes_into_level;
+  }
+
+  // Bytes in excess of a level's target get merged into the next level,
+  // rewriting the overlapping part of that level along the way.
+  for (int level = v->base_level_; level < NumLevels() - 1; level++) {
+    const uint64_t level_bytes =
+        TotalFileSize(v->files_[level]) + bytes_into_level;
+    const double target = v->max_bytes_for_level_[level];
+    if (level_bytes == 0 || level_bytes <= target) {
+      bytes_into_level = 0;
+      continue;
+    }
+    bytes_into_level = level_bytes - static_cast<uint64_t>(target);
+    const double next_level_ratio =
+        static_cast<double>(TotalFileSize(v->files_[level + 1])) / level_bytes;
+    pending += static_cast<uint64_t>(bytes_into_level * (next_level_ratio + 1));
+  }
+  return pending;
+}
+
 void VersionSet::Finalize(Version* v) {
+  ComputeLevelTargets(v);
+  v->pending_compaction_bytes_ = EstimatePendingCompactionBytes(v);
+
   // Precomputed best level for next compaction
   int best_level = -1;
   double best_score = -1;
 
-  for (int level = 0; level < config::kNumLevels - 1; level++) {
-    double score;
-    if (level == 0) {
-      // We treat level-0 specially by bounding the number of files
-      // instead of number of bytes for two reasons:
-      //
-      // (1) With larger write-buffer sizes, it is nice not to do too
-      // many level-0 compactions.
-      //
-      // (2) The files in level-0 are merged on every read and
-      // therefore we wish to avoid too many files when the individual
-      // file size is small (perhaps because of a small write-buffer
-      // setting, or very high compression ratios, or lots of
-      // overwrites/deletions).
-      score = v->files_[level].size() /
-              static_cast<double>(config::kL0_CompactionTrigger);
-    } else {
-      // Compute the ratio of current size to size limit.
-      const uint64_t level_bytes = TotalFileSize(v->files_[level]);
-      score =
-          static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
-    }
-
+  for (int level = 0; level < NumLevels() - 1; level++) {
+    const double score = CompactionScore(v, level);
     if (score > best_score) {
       best_level = level;
       best_score = score;
@@ -1064,6 +1541,20 @@ void VersionSet::Finalize(Version* v) {
 
   v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
+
+  v->oldest_file_creation_time_ = UINT64_MAX;
+  for (int level = 0; level < NumLevels(); level++) {
+    for (const FileMetaData* f : v->files_[level]) {
+      v->oldest_file_creation_time_ =
+          std::min(v->oldest_file_creation_time_, f->creation_time);
+    }
+  }
+}
+
+bool VersionSet::HasExpiredFiles(const Version* v) const {
+  return options_->ttl > 0 &&
+         IsTtlExpired(v->oldest_file_creation_time_, options_->ttl,
+                      TtlNow(env_));
 }
 
 Status VersionSet::WriteSnapshot(log::Writer* log) {
@@ -1074,7 +1565,7 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
   edit.SetComparatorName(icmp_.user_comparator()->Name());
 
   // Save compaction pointers
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < NumLevels(); level++) {
     if (!compact_pointer_[level].empty()) {
       InternalKey key;
       key.DecodeFrom(compact_pointer_[level]);
@@ -1083,11 +1574,12 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
   }
 
   // Save files
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < NumLevels(); level++) {
     const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest,
+                   f->has_range_tombstones, f->creation_time);
     }
   }
 
@@ -1098,25 +1590,25 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
 
 int VersionSet::NumLevelFiles(int level) const {
   assert(level >= 0);
-  assert(level < config::kNumLevels);
+  assert(level < NumLevels());
   return current_->files_[level].size();
 }
 
 const char* VersionSet::LevelSummary(LevelSummaryStorage* scratch) const {
-  // Update code if kNumLevels changes
-  static_assert(config::kNumLevels == 7, "");
-  std::snprintf(
-      scratch->buffer, sizeof(scratch->buffer), "files[ %d %d %d %d %d %d %d ]",
-      int(current_->files_[0].size()), int(current_->files_[1].size()),
-      int(current_->files_[2].size()), int(current_->files_[3].size()),
-      int(current_->files_[4].size()), int(current_->files_[5].size()),
-      int(current_->files_[6].size()));
+  std::string summary = "files[ ";
+  for (int level = 0; level < NumLevels(); level++) {
+    summary += std::to_string(current_->files_[level].size());
+    summary += ' ';
+  }
+  summary += ']';
+  std::snprintf(scratch->buffer, sizeof(scratch->buffer), "%s",
+                summary.c_str());
   return scratch->buffer;
 }
 
 uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
   uint64_t result = 0;
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < NumLevels(); level++) {
     const std::vector<FileMetaData*>& files = v->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       if (icmp_.Compare(files[i]->largest, ikey) <= 0) {
@@ -1149,7 +1641,7 @@ uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
 void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
   for (Version* v = dummy_versions_.next_; v != &dummy_versions_;
        v = v->next_) {
-    for (int level = 0; level < config::kNumLevels; level++) {
+    for (int level = 0; level < NumLevels(); level++) {
       const std::vector<FileMetaData*>& files = v->files_[level];
       for (size_t i = 0; i < files.size(); i++) {
         live->insert(files[i]->number);
@@ -1160,14 +1652,14 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
 
 int64_t VersionSet::NumLevelBytes(int level) const {
   assert(level >= 0);
-  assert(level < config::kNumLevels);
+  assert(level < NumLevels());
   return TotalFileSize(current_->files_[level]);
 }
 
 int64_t VersionSet::MaxNextLevelOverlappingBytes() {
   int64_t result = 0;
   std::vector<FileMetaData*> overlaps;
-  for (int level = 1; level < config::kNumLevels - 1; level++) {
+  for (int level = 1; level < NumLevels() - 1; level++) {
     for (size_t i = 0; i < current_->files_[level].size(); i++) {
       const FileMetaData* f = current_->files_[level][i];
       current_->GetOverlappingInputs(level + 1, &f->smallest, &f->largest,
@@ -1250,42 +1742,78 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 }
 
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
-
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
+  // the compactions triggered by seeks.  Levels are tried in decreasing
+  // order of score so that a level whose files are all busy with other
+  // compactions does not hold up the remaining ones.
+  std::vector<std::pair<double, int>> levels;
+  for (int level = 0; level < NumLevels() - 1; level++) {
+    const double score = CompactionScore(current_, level);
+    if (score >= 1) {
+      levels.emplace_back(score, level);
+    }
+  }
+  std::stable_sort(levels.begin(), levels.end(),
+                   [](const std::pair<double, int>& a,
+                      const std::pair<double, int>& b) {
+                     return a.first > b.first;
+                   });
+
+  for (size_t i = 0; i < levels.size(); i++) {
+    const int level = levels[i].second;
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    assert(!files.empty());
+
+    // Level-0 compactions pull in every overlapping level-0 file, so
+    // only one of them may run at a time.
+    if (level == 0 && std::any_of(files.begin(), files.end(),
+                                  [](const FileMetaData* f) {
+                                    return f->being_compacted;
+                                  })) {
+      continue;
+    }
+
+    // Start with the first file that comes after compact_pointer_[level],
+    // wrapping around to the beginning of the key space.
+    size_t start = 0;
+    if (!compact_pointer_[level].empty()) {
+      while (start < files.size() &&
+             icmp_.Compare(files[start]->largest.Encode(),
+                           compact_pointer_[level]) <= 0) {
+        start++;
+      }
+      if (start == files.size()) {
+        start = 0;
       }
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+    for (size_t n = 0; n < files.size(); n++) {
+      FileMetaData* f = files[(start + n) % files.size()];
+      if (f->being_compacted) {
+        continue;
+      }
+      Compaction* c = SetupCompaction(level, f);
+      if (c != nullptr) {
+        return c;
+      }
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
 
+  if (current_->file_to_compact_ != nullptr &&
+      !current_->file_to_compact_->being_compacted) {
+    Compaction* c = SetupCompaction(current_->file_to_compact_level_,
+                                    current_->file_to_compact_);
+    if (c != nullptr) {
+      return c;
+    }
+  }
+  return PickTtlCompaction();
+}
+
+Compaction* VersionSet::SetupCompaction(int level, FileMetaData* f) {
+  Compaction* c = new Compaction(options_, level, OutputLevel(level));
   c->input_version_ = current_;
   c->input_version_->Ref();
+  c->inputs_[0].push_back(f);
 
   // Files in level 0 may overlap each other, so pick up all overlapping ones
   if (level == 0) {
@@ -1299,7 +1827,11 @@ Compaction* VersionSet::PickCompaction() {
   }
 
   SetupOtherInputs(c);
-
+  if (!c->AcquireInputs()) {
+    delete c;
+    return nullptr;
+  }
+  UpdateCompactPointer(c);
   return c;
 }
 
@@ -1327,6 +1859,10 @@ FileMetaData* FindSmallestBoundaryFile(
     const InternalKeyComparator& icmp,
     const std::vector<FileMetaData*>& level_files,
     const InternalKey& largest_key) {
+  if (IsRangeTombstoneSentinel(largest_key)) {
+    // The file holds no entry for user_key(largest_key)
+    return nullptr;
+  }
   const Comparator* user_cmp = icmp.user_comparator();
   FileMetaData* smallest_boundary_file = nullptr;
   for (size_t i = 0; i < level_files.size(); ++i) {
@@ -1384,21 +1920,22 @@ void AddBoundaryInputs(const InternalKeyComparator& icmp,
 
 void VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
+  const int output_level = c->output_level();
   InternalKey smallest, largest;
 
   AddBoundaryInputs(icmp_, current_->files_[level], &c->inputs_[0]);
   GetRange(c->inputs_[0], &smallest, &largest);
 
-  current_->GetOverlappingInputs(level + 1, &smallest, &largest,
+  current_->GetOverlappingInputs(output_level, &smallest, &largest,
                                  &c->inputs_[1]);
-  AddBoundaryInputs(icmp_, current_->files_[level + 1], &c->inputs_[1]);
+  AddBoundaryInputs(icmp_, current_->files_[output_level], &c->inputs_[1]);
 
   // Get entire range covered by compaction
   InternalKey all_start, all_limit;
   GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
 
   // See if we can grow the number of inputs in "level" without
-  // changing the number of "level+1" files we pick up.
+  // changing the number of "output_level" files we pick up.
   if (!c->inputs_[1].empty()) {
     std::vector<FileMetaData*> expanded0;
     current_->GetOverlappingInputs(level, &all_start, &all_limit, &expanded0);
@@ -1412,17 +1949,15 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
-      current_->GetOverlappingInputs(level + 1, &new_start, &new_limit,
+      current_->GetOverlappingInputs(output_level, &new_start, &new_limit,
                                      &expanded1);
-      AddBoundaryInputs(icmp_, current_->files_[level + 1], &expanded1);
+      AddBoundaryInputs(icmp_, current_->files_[output_level], &expanded1);
       if (expanded1.size() == c->inputs_[1].size()) {
         Log(options_->info_log,
             "Expanding@%d %d+%d (%ld+%ld bytes) to %d+%d (%ld+%ld bytes)\n",
             level, int(c->inputs_[0].size()), int(c->inputs_[1].size()),
             long(inputs0_size), long(inputs1_size), int(expanded0.size()),
             int(expanded1.size()), long(expanded0_size), long(inputs1_size));
-        smallest = new_start;
-        largest = new_limit;
         c->inputs_[0] = expanded0;
         c->inputs_[1] = expanded1;
         GetRange2(c->inputs_[0], c->inputs_[1], &all_start, &all_limit);
@@ -1431,18 +1966,65 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   }
 
   // Compute the set of grandparent files that overlap this compaction
-  // (parent == level+1; grandparent == level+2)
-  if (level + 2 < config::kNumLevels) {
-    current_->GetOverlappingInputs(level + 2, &all_start, &all_limit,
+  // (parent == output_level; grandparent == output_level+1)
+  if (output_level + 1 < NumLevels()) {
+    current_->GetOverlappingInputs(output_level + 1, &all_start, &all_limit,
                                    &c->grandparents_);
   }
+}
+
+Compaction* VersionSet::PickTtlCompaction() {
+  if (!HasExpiredFiles(current_)) {
+    return nullptr;
+  }
+  const uint64_t now = TtlNow(env_);
+  int level = -1;
+  FileMetaData* oldest = nullptr;
+  for (int lvl = 0; lvl < NumLevels(); lvl++) {
+    for (FileMetaData* f : current_->files_[lvl]) {
+      if (!f->being_compacted &&
+          IsTtlExpired(f->creation_time, options_->ttl, now) &&
+          (oldest == nullptr || f->creation_time < oldest->creation_time)) {
+        level = lvl;
+        oldest = f;
+      }
+    }
+  }
+  if (oldest == nullptr) {
+    return nullptr;
+  }
+
+  Compaction* c;
+  if (level + 1 < NumLevels()) {
+    c = SetupCompaction(level, oldest);
+  } else {
+    // There is no next level: rewrite the file in place
+    c = new Compaction(options_, level, level);
+    c->input_version_ = current_;
+    c->input_version_->Ref();
+    c->inputs_[0].push_back(oldest);
+    AddBoundaryInputs(icmp_, current_->files_[level], &c->inputs_[0]);
+    if (!c->AcquireInputs()) {
+      delete c;
+      c = nullptr;
+    }
+  }
+  if (c != nullptr) {
+    c->ttl_compaction_ = true;
+  }
+  return c;
+}
+
+void VersionSet::UpdateCompactPointer(Compaction* c) {
+  InternalKey smallest, largest;
+  GetRange(c->inputs_[0], &smallest, &largest);
 
   // Update the place where we will do the next compaction for this level.
   // We update this immediately instead of waiting for the VersionEdit
   // to be applied so that if the compaction fails, we will try a different
   // key range next time.
-  compact_pointer_[level] = largest.Encode().ToString();
-  c->edit_.SetCompactPointer(level, largest);
+  compact_pointer_[c->level()] = largest.Encode().ToString();
+  c->edit_.SetCompactPointer(c->level(), largest);
 }
 
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
@@ -1470,30 +2052,45 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
     }
   }
 
-  Compaction* c = new Compaction(options_, level);
+  Compaction* c = new Compaction(options_, level, OutputLevel(level));
   c->input_version_ = current_;
   c->input_version_->Ref();
   c->inputs_[0] = inputs;
   SetupOtherInputs(c);
+  UpdateCompactPointer(c);
   return c;
 }
 
-Compaction::Compaction(const Options* options, int level)
+Compaction::Compaction(const Options* options, int level, int output_level)
     : level_(level),
+      output_level_(output_level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
       input_version_(nullptr),
       grandparent_index_(0),
       seen_key_(false),
-      overlapped_bytes_(0) {
-  for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
-  }
-}
+      overlapped_bytes_(0),
+      level_ptrs_(options->num_levels, 0),
+      inputs_acquired_(false),
+      ttl_compaction_(false) {}
 
-Compaction::~Compaction() {
-  if (input_version_ != nullptr) {
-    input_version_->Unref();
+Compaction::~Compaction() { ReleaseInputs(); }
+
+bool Compaction::AcquireInputs() {
+  assert(!inputs_acquired_);
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      if (inputs_[which][i]->being_compacted) {
+        return false;
+      }
+    }
+  }
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      inputs_[which][i]->being_compacted = true;
+    }
   }
+  inputs_acquired_ = true;
+  return true;
 }
 
 bool Compaction::IsTrivialMove() const {
@@ -1501,7 +2098,8 @@ bool Compaction::IsTrivialMove() const {
   // Avoid a move if there is lots of overlapping grandparent data.
   // Otherwise, the move could create a parent file that will require
   // a very expensive merge later on.
-  return (num_input_files(0) == 1 && num_input_files(1) == 0 &&
+  return (!ttl_compaction_ && num_input_files(0) == 1 &&
+          num_input_files(1) == 0 &&
           TotalFileSize(grandparents_) <=
               MaxGrandParentOverlapBytes(vset->options_));
 }
@@ -1509,7 +2107,8 @@ bool Compaction::IsTrivialMove() const {
 void Compaction::AddInputDeletions(VersionEdit* edit) {
   for (int which = 0; which < 2; which++) {
     for (size_t i = 0; i < inputs_[which].size(); i++) {
-      edit->RemoveFile(level_ + which, inputs_[which][i]->number);
+      edit->RemoveFile(which == 0 ? level_ : output_level_,
+                       inputs_[which][i]->number);
     }
   }
 }
@@ -1517,7 +2116,7 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
+  for (int lvl = output_level_ + 1; lvl < input_version_->vset_->NumLevels(); lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
     while (level_ptrs_[lvl] < files.size()) {
       FileMetaData* f = files[level_ptrs_[lvl]];
@@ -1535,6 +2134,16 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
   return true;
 }
 
+bool Compaction::IsBaseLevelForRange(const Slice& begin, const Slice& end) {
+  for (int lvl = output_level_ + 1; lvl < input_version_->vset_->NumLevels();
+       lvl++) {
+    if (input_version_->OverlapInLevel(lvl, &begin, &end)) {
+      return false;
+    }
+  }
+  return true;
+}
+
 bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
@@ -1559,7 +2168,54 @@ bool Compaction::ShouldStopBefore(const Slice& internal_key) {
   }
 }
 
+void Compaction::GetSubcompactionBoundaries(
+    int n, std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  const std::vector<FileMetaData*>& files = inputs_[1];
+  if (n <= 1 || files.size() < 2) {
+    return;
+  }
+
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  const int64_t target = TotalFileSize(files) / n;
+  int64_t size = 0;
+  for (size_t i = 0; i + 1 < files.size(); i++) {
+    size += files[i]->file_size;
+    if (size < target * static_cast<int64_t>(boundaries->size() + 1)) {
+      continue;
+    }
+    const Slice key = files[i + 1]->smallest.user_key();
+    if (boundaries->empty() || user_cmp->Compare(key, boundaries->back()) > 0) {
+      boundaries->push_back(key.ToString());
+      if (boundaries->size() + 1 == static_cast<size_t>(n)) {
+        break;
+      }
+    }
+  }
+}
+
+Compaction* Compaction::NewSubcompaction() const {
+  Compaction* c =
+      new Compaction(input_version_->vset_->options_, level_, output_level_);
+  c->input_version_ = input_version_;
+  c->input_version_->Ref();
+  c->inputs_[0] = inputs_[0];
+  c->inputs_[1] = inputs_[1];
+  c->grandparents_ = grandparents_;
+  c->ttl_compaction_ = ttl_compaction_;
+  return c;
+}
+
 void Compaction::ReleaseInputs() {
+  if (inputs_acquired_) {
+    // The input files are kept alive by input_version_.
+    for (int which = 0; which < 2; which++) {
+      for (size_t i = 0; i < inputs_[which].size(); i++) {
+        inputs_[which][i]->being_compacted = false;
+      }
+    }
+    inputs_acquired_ = false;
+  }
   if (input_version_ != nullptr) {
     input_version_->Unref();
     input_version_ = nullptr;
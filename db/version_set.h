@@ -15,8 +15,10 @@
 #ifndef STORAGE_LEVELDB_DB_VERSION_SET_H_
 #define STORAGE_LEVELDB_DB_VERSION_SET_H_
 
+#include <deque>
 #include <map>
 #include <set>
+#include <string>
 #include <vector>
 
 #include "db/dbformat.h"
@@ -47,6 +49,9 @@ class Writer;
 class Compaction;
 class Iterator;
 class MemTable;
+class MergeContext;
+class PinnableSlice;
+class RangeTombstoneList;
 class TableBuilder;
 class TableCache;
 class Version;
@@ -78,16 +83,47 @@ class Version {
     int seek_file_level;
   };
 
+  // One key of a MultiGet() batch.
+  struct MultiGetKey {
+    const LookupKey* key;
+    std::string* value;
+    MergeContext* merge_context;
+    Status status;  // Result of the lookup, as Get() would return it
+    GetStats stats;
+  };
+
   // Append to *iters a sequence of iterators that will
   // yield the contents of this Version when merged together.
   // REQUIRES: This version has been saved (see VersionSet::SaveTo)
   void AddIterators(const ReadOptions&, std::vector<Iterator*>* iters);
 
+  // Set *list to the range tombstones of the files of this version, or to
+  // null if there are none.  The list is built by the first call and then
+  // shared: it stays valid for as long as this version is referenced.
+  // REQUIRES: This version has been saved (see VersionSet::SaveTo)
+  // REQUIRES: lock is not held
+  Status GetRangeTombstones(const RangeTombstoneList** list);
+
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
+  // The merge operands for key that are newer than the value are added
+  // to *merge_context, whether or not a value is found.
   // REQUIRES: lock is not held
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
-             GetStats* stats);
+             GetStats* stats, MergeContext* merge_context);
+
+  // Like Get(), but pins the value found in *val instead of copying it.
+  // REQUIRES: lock is not held
+  Status Get(const ReadOptions&, const LookupKey& key, PinnableSlice* val,
+             GetStats* stats, MergeContext* merge_context);
+
+  // Batched form of Get().  keys[0,n-1] must be sorted by user key and
+  // share one snapshot sequence number.  Files are visited in the same
+  // order as Get() would visit them, but each file is opened once and
+  // probed only with the keys that are still unresolved and overlap it.
+  // Fills in status, value and stats of every key.
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, MultiGetKey* const* keys, int n);
 
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
@@ -111,6 +147,16 @@ class Version {
       const InternalKey* end,    // nullptr means after all keys
       std::vector<FileMetaData*>* inputs);
 
+  // Store in "*files" the files in "level" that lie entirely inside the
+  // user key range [*begin,*end] and are not being compacted.  In levels
+  // above 0, files that share a boundary user key with a neighbour are
+  // left out so the entries for a key are never split up.
+  void GetFilesInRange(
+      int level,
+      const Slice* begin,  // nullptr means before all keys
+      const Slice* end,    // nullptr means after all keys
+      std::vector<FileMetaData*>* files);
+
   // Returns true iff some file in the specified level overlaps
   // some part of [*smallest_user_key,*largest_user_key].
   // smallest_user_key==nullptr represents a key smaller than all the DB's keys.
@@ -134,15 +180,7 @@ class Version {
 
   class LevelFileNumIterator;
 
-  explicit Version(VersionSet* vset)
-      : vset_(vset),
-        next_(this),
-        prev_(this),
-        refs_(0),
-        file_to_compact_(nullptr),
-        file_to_compact_level_(-1),
-        compaction_score_(-1),
-        compaction_level_(-1) {}
+  explicit Version(VersionSet* vset);
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -151,6 +189,12 @@ class Version {
 
   Iterator* NewConcatenatingIterator(const ReadOptions&, int level) const;
 
+  // Implementation of the Get() methods: exactly one of "value" and
+  // "pinnable" is non-null.
+  Status Lookup(const ReadOptions&, const LookupKey& key, std::string* value,
+                PinnableSlice* pinnable, GetStats* stats,
+                MergeContext* merge_context);
+
   // Call func(arg, level, f) for every file that overlaps user_key in
   // order from newest to oldest.  If an invocation of func returns
   // false, makes no more calls.
@@ -165,7 +209,7 @@ class Version {
   int refs_;          // Number of live refs to this version
 
   // List of files per level
-  std::vector<FileMetaData*> files_[config::kNumLevels];
+  std::vector<std::vector<FileMetaData*>> files_;
 
   // Next file to compact based on seek stats.
   FileMetaData* file_to_compact_;
@@ -176,6 +220,25 @@ class Version {
   // are initialized by Finalize().
   double compaction_score_;
   int compaction_level_;
+
+  // Target size of each level above level-0, and the level that level-0
+  // is compacted into.  The levels between level-0 and base_level_ are
+  // empty.  These fields are initialized by Finalize().
+  std::vector<double> max_bytes_for_level_;
+  int base_level_;
+
+  // Estimated number of bytes compactions have to write to bring every
+  // level within its target size.  Initialized by Finalize().
+  uint64_t pending_compaction_bytes_;
+
+  // Smallest creation time of the files, or UINT64_MAX if there are none.
+  // Initialized by Finalize().
+  uint64_t oldest_file_creation_time_;
+
+  // Range tombstones of the files, built by GetRangeTombstones().
+  port::Mutex range_tombstones_mu_;
+  bool range_tombstones_built_ GUARDED_BY(range_tombstones_mu_);
+  RangeTombstoneList* range_tombstones_ GUARDED_BY(range_tombstones_mu_);
 };
 
 class VersionSet {
@@ -191,7 +254,8 @@ class VersionSet {
   // is both saved to persistent state and installed as the new
   // current version.  Will release *mu while actually writing to the file.
   // REQUIRES: *mu is held on entry.
-  // REQUIRES: no other thread concurrently calls LogAndApply()
+  // Concurrent calls are serialized: each one waits for the calls that
+  // started before it to finish.
   Status LogAndApply(VersionEdit* edit, port::Mutex* mu)
       EXCLUSIVE_LOCKS_REQUIRED(mu);
 
@@ -201,6 +265,9 @@ class VersionSet {
   // Return the current version.
   Version* current() const { return current_; }
 
+  // Return the number of levels, as configured by options.num_levels.
+  int NumLevels() const { return options_->num_levels; }
+
   // Return the current manifest file number
   uint64_t ManifestFileNumber() const { return manifest_file_number_; }
 
@@ -222,6 +289,12 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(int level) const;
 
+  // Return an estimate of the number of bytes compactions still have to
+  // write before no level of the current version exceeds its target.
+  uint64_t PendingCompactionBytes() const {
+    return current_->pending_compaction_bytes_;
+  }
+
   // Return the last sequence number.
   uint64_t LastSequence() const { return last_sequence_; }
 
@@ -242,14 +315,17 @@ class VersionSet {
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
   // Pick level and inputs for a new compaction.
-  // Returns nullptr if there is no compaction to be done.
+  // Returns nullptr if there is no compaction to be done, or if every
+  // candidate overlaps files that are already being compacted.
   // Otherwise returns a pointer to a heap-allocated object that
-  // describes the compaction.  Caller should delete the result.
+  // describes the compaction, with its inputs already acquired.
+  // Caller should delete the result.
   Compaction* PickCompaction();
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns nullptr if there is nothing in that
-  // level that overlaps the specified range.  Caller should delete
+  // level that overlaps the specified range.  The caller must
+  // AcquireInputs() before running the compaction, and should delete
   // the result.
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
@@ -265,7 +341,8 @@ class VersionSet {
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction() const {
     Version* v = current_;
-    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr);
+    return (v->compaction_score_ >= 1) || (v->file_to_compact_ != nullptr) ||
+           HasExpiredFiles(v);
   }
 
   // Add all files listed in any live version to *live.
@@ -279,7 +356,7 @@ class VersionSet {
   // Return a human-readable short (single-line) summary of the number
   // of files per level.  Uses *scratch as backing store.
   struct LevelSummaryStorage {
-    char buffer[100];
+    char buffer[256];
   };
   const char* LevelSummary(LevelSummaryStorage* scratch) const;
 
@@ -293,6 +370,18 @@ class VersionSet {
 
   void Finalize(Version* v);
 
+  // Compute the target size of each level of *v and its base level.
+  void ComputeLevelTargets(Version* v);
+
+  // Return the compaction score of "level" in *v.  A score >= 1 means
+  // the level needs to be compacted.
+  // REQUIRES: ComputeLevelTargets(v) has been called.
+  double CompactionScore(const Version* v, int level) const;
+
+  // Return the estimated compaction debt of *v.
+  // REQUIRES: ComputeLevelTargets(v) has been called.
+  uint64_t EstimatePendingCompactionBytes(const Version* v) const;
+
   void GetRange(const std::vector<FileMetaData*>& inputs, InternalKey* smallest,
                 InternalKey* largest);
 
@@ -302,6 +391,27 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Return a compaction of level "level" starting from file *f, or
+  // nullptr if its inputs overlap a running compaction.
+  Compaction* SetupCompaction(int level, FileMetaData* f);
+
+  // Return true iff options_->ttl is set and some file of *v was created
+  // at least that many seconds ago.
+  bool HasExpiredFiles(const Version* v) const;
+
+  // Return a compaction that rewrites the oldest of the files created
+  // over options_->ttl seconds ago, to drop the values that expired in
+  // it, or nullptr if there is none.
+  Compaction* PickTtlCompaction();
+
+  void UpdateCompactPointer(Compaction* c);
+
+  // Return the level that a compaction of "level" in the current version
+  // writes to.
+  int OutputLevel(int level) const {
+    return (level == 0) ? current_->base_level_ : level + 1;
+  }
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -326,7 +436,11 @@ class VersionSet {
 
   // Per-level key at which the next compaction at that level should start.
   // Either an empty string, or a valid InternalKey.
-  std::string compact_pointer_[config::kNumLevels];
+  std::vector<std::string> compact_pointer_;
+
+  // Callers of LogAndApply() waiting to write to the MANIFEST.  The
+  // front entry is the one currently writing.
+  std::deque<port::CondVar*> manifest_writers_;
 };
 
 // A Compaction encapsulates information about a compaction.
@@ -335,9 +449,15 @@ class Compaction {
   ~Compaction();
 
   // Return the level that is being compacted.  Inputs from "level"
-  // and "level+1" will be merged to produce a set of "level+1" files.
+  // and "output_level" will be merged to produce a set of "output_level"
+  // files.
   int level() const { return level_; }
 
+  // Return the level that the compaction writes to.  This is level+1,
+  // except for level-0 compactions, which may skip empty levels when the
+  // level sizes are dynamic.
+  int output_level() const { return output_level_; }
+
   // Return the object that holds the edits to the descriptor done
   // by this compaction.
   VersionEdit* edit() { return &edit_; }
@@ -345,7 +465,8 @@ class Compaction {
   // "which" must be either 0 or 1
   int num_input_files(int which) const { return inputs_[which].size(); }
 
-  // Return the ith input file at "level()+which" ("which" must be 0 or 1).
+  // Return the ith input file at "level()" if "which" is 0, or at
+  // "output_level()" if "which" is 1.
   FileMetaData* input(int which, int i) const { return inputs_[which][i]; }
 
   // Maximum size of files to build during this compaction.
@@ -355,38 +476,67 @@ class Compaction {
   // moving a single input file to the next level (no merging or splitting)
   bool IsTrivialMove() const;
 
+  // Return true iff the compaction rewrites files because of their age
+  // (see Options::ttl).  Files in the last level are rewritten into the
+  // same level.
+  bool is_ttl_compaction() const { return ttl_compaction_; }
+
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
+  // the compaction is producing data in "output_level" for which no data
+  // exists in levels greater than "output_level".
   bool IsBaseLevelForKey(const Slice& user_key);
 
+  // Like IsBaseLevelForKey(), for all the user keys in [begin, end).
+  // Unlike IsBaseLevelForKey(), may be called with ranges in any order.
+  bool IsBaseLevelForRange(const Slice& begin, const Slice& end);
+
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
   bool ShouldStopBefore(const Slice& internal_key);
 
-  // Release the input version for the compaction, once the compaction
-  // is successful.
+  // Mark the input files as being compacted, so that no other
+  // compaction picks them until ReleaseInputs() is called.  Returns
+  // false, and marks nothing, if some input file is already being
+  // compacted.
+  bool AcquireInputs();
+
+  // Release the input files and the input version for the compaction,
+  // once the compaction is finished.
   void ReleaseInputs();
 
+  // Store in *boundaries up to n-1 user keys that split the key range of
+  // this compaction into parts with similar amounts of "output_level" data.
+  // Part i covers the user keys in [(*boundaries)[i-1], (*boundaries)[i]).
+  // The boundaries are taken from the "output_level" input file boundaries.
+  void GetSubcompactionBoundaries(int n,
+                                  std::vector<std::string>* boundaries) const;
+
+  // Return a compaction over the same inputs with its own state for
+  // ShouldStopBefore() and IsBaseLevelForKey(), so that a part of the key
+  // range can be processed by another thread.  The inputs are not
+  // acquired.  Caller should delete the result.
+  Compaction* NewSubcompaction() const;
+
  private:
   friend class Version;
   friend class VersionSet;
 
-  Compaction(const Options* options, int level);
+  Compaction(const Options* options, int level, int output_level);
 
   int level_;
+  int output_level_;
   uint64_t max_output_file_size_;
   Version* input_version_;
   VersionEdit edit_;
 
-  // Each compaction reads inputs from "level_" and "level_+1"
+  // Each compaction reads inputs from "level_" and "output_level_"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
   // State used to check for number of overlapping grandparent files
-  // (parent == level_ + 1, grandparent == level_ + 2)
+  // (parent == output_level_, grandparent == output_level_ + 1)
   std::vector<FileMetaData*> grandparents_;
   size_t grandparent_index_;  // Index in grandparent_starts_
   bool seen_key_;             // Some output key has been seen
@@ -398,8 +548,13 @@ class Compaction {
   // level_ptrs_ holds indices into input_version_->levels_: our state
   // is that we are positioned at one of the file ranges for each
   // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
+  // all L >= output_level_ + 1).
+  std::vector<size_t> level_ptrs_;
+
+  // True between a successful AcquireInputs() and ReleaseInputs().
+  bool inputs_acquired_;
+
+  bool ttl_compaction_;
 };
 
 }  // namespace leveldb
@@ -0,0 +1,95 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include <algorithm>
+
+namespace leveldb {
+
+static const uint64_t kMicrosPerSecond = 1000000;
+
+// Largest burst, in microseconds worth of writes at the current rate, that
+// an idle writer may accumulate.
+static const uint64_t kMaxBurstMicros = 1000;
+
+const uint64_t WriteController::kMinDelayedWriteRate;
+
+WriteController::WriteController(uint64_t max_delayed_write_rate)
+    : max_delayed_write_rate_(
+          std::max(max_delayed_write_rate, kMinDelayedWriteRate)),
+      delayed_write_rate_(max_delayed_write_rate_),
+      delayed_(false),
+      last_level0_files_(0),
+      last_pending_compaction_bytes_(0),
+      available_bytes_(0),
+      refill_micros_(0) {}
+
+void WriteController::Update(bool delay, int level0_files,
+                             uint64_t pending_compaction_bytes,
+                             uint64_t now_micros) {
+  if (!delay) {
+    delayed_ = false;
+  } else if (!delayed_) {
+    // Start out at the full rate with an empty bucket.
+    delayed_ = true;
+    delayed_write_rate_ = max_delayed_write_rate_;
+    available_bytes_ = 0;
+    refill_micros_ = now_micros;
+  } else if (level0_files > last_level0_files_ ||
+             pending_compaction_bytes > last_pending_compaction_bytes_) {
+    // Compactions are still losing ground: slow down further.
+    delayed_write_rate_ =
+        std::max(delayed_write_rate_ / 5 * 4, kMinDelayedWriteRate);
+  } else if (level0_files < last_level0_files_ ||
+             pending_compaction_bytes < last_pending_compaction_bytes_) {
+    // Compactions are catching up: speed up again.
+    delayed_write_rate_ =
+        std::min(delayed_write_rate_ / 4 * 5, max_delayed_write_rate_);
+  }
+  last_level0_files_ = level0_files;
+  last_pending_compaction_bytes_ = pending_compaction_bytes;
+}
+
+void WriteController::Refill(uint64_t now_micros) {
+  if (now_micros > refill_micros_) {
+    const uint64_t max_bytes =
+        delayed_write_rate_ * kMaxBurstMicros / kMicrosPerSecond;
+    const uint64_t elapsed = now_micros - refill_micros_;
+    if (elapsed >= kMaxBurstMicros) {
+      available_bytes_ = max_bytes;
+    } else {
+      available_bytes_ = std::min(
+          max_bytes,
+          available_bytes_ + elapsed * delayed_write_rate_ / kMicrosPerSecond);
+    }
+    refill_micros_ = now_micros;
+  }
+}
+
+void WriteController::Charge(uint64_t num_bytes) {
+  if (!delayed_) {
+    return;
+  }
+  if (available_bytes_ >= num_bytes) {
+    available_bytes_ -= num_bytes;
+  } else {
+    // Borrow against future refills.
+    const uint64_t deficit = num_bytes - available_bytes_;
+    available_bytes_ = 0;
+    refill_micros_ += (deficit * kMicrosPerSecond + delayed_write_rate_ - 1) /
+                      delayed_write_rate_;
+  }
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros, uint64_t num_bytes) {
+  if (!delayed_) {
+    return 0;
+  }
+  Refill(now_micros);
+  Charge(num_bytes);
+  return refill_micros_ > now_micros ? refill_micros_ - now_micros : 0;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,70 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+#define STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
+
+#include <cstdint>
+
+namespace leveldb {
+
+// WriteController paces writes with a token bucket while compactions are
+// falling behind.  Once writes are delayed, the write rate starts out at
+// the configured maximum, drops each time the compaction backlog grows
+// and recovers each time the backlog shrinks.
+//
+// Not thread-safe: callers must provide external synchronization.
+class WriteController {
+ public:
+  // The rate never drops below this many bytes per second.
+  static const uint64_t kMinDelayedWriteRate = 16 << 10;
+
+  explicit WriteController(uint64_t max_delayed_write_rate);
+
+  WriteController(const WriteController&) = delete;
+  WriteController& operator=(const WriteController&) = delete;
+
+  // Record the current compaction backlog: the number of level-0 files
+  // and the estimated number of bytes compactions still have to write.
+  // "delay" says whether that backlog is large enough to throttle writes.
+  void Update(bool delay, int level0_files, uint64_t pending_compaction_bytes,
+              uint64_t now_micros);
+
+  bool IsDelayed() const { return delayed_; }
+
+  // Current write rate in bytes per second.  Only meaningful while
+  // IsDelayed().
+  uint64_t delayed_write_rate() const { return delayed_write_rate_; }
+
+  // Account for a write of "num_bytes" at time "now_micros" and return the
+  // number of microseconds the writer should sleep before proceeding.
+  // Returns 0 if writes are not delayed.
+  uint64_t GetDelay(uint64_t now_micros, uint64_t num_bytes);
+
+  // Account for "num_bytes" written without delaying the current writer.
+  // The next call to GetDelay() pays for them.
+  void Charge(uint64_t num_bytes);
+
+ private:
+  void Refill(uint64_t now_micros);
+
+  const uint64_t max_delayed_write_rate_;
+  uint64_t delayed_write_rate_;
+  bool delayed_;
+
+  // Backlog seen by the previous Update()
+  int last_level0_files_;
+  uint64_t last_pending_compaction_bytes_;
+
+  // Bytes that may still be written without delay
+  uint64_t available_bytes_;
+
+  // Time up to which the bucket has been refilled.  Ahead of the clock
+  // when writers have borrowed against future refills.
+  uint64_t refill_micros_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_WRITE_CONTROLLER_H_
@@ -0,0 +1,84 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/write_controller.h"
+
+#include "gtest/gtest.h"
+
+namespace leveldb {
+
+static const uint64_t kMB = 1 << 20;
+
+TEST(WriteControllerTest, NotDelayed) {
+  WriteController controller(kMB);
+  ASSERT_FALSE(controller.IsDelayed());
+  ASSERT_EQ(0, controller.GetDelay(1000, 10 * kMB));
+
+  controller.Update(false, 5, 100, 1000);
+  ASSERT_FALSE(controller.IsDelayed());
+  ASSERT_EQ(0, controller.GetDelay(2000, 10 * kMB));
+}
+
+TEST(WriteControllerTest, TokenBucket) {
+  WriteController controller(kMB);  // 1MB/s
+  uint64_t now = 1000000;
+  controller.Update(true, 8, 0, now);
+  ASSERT_TRUE(controller.IsDelayed());
+  ASSERT_EQ(kMB, controller.delayed_write_rate());
+
+  // Writing 1MB at 1MB/s takes a second.
+  ASSERT_EQ(1000000, controller.GetDelay(now, kMB));
+  now += 1000000;
+
+  // Bytes written without delay are paid for by the next writer.
+  controller.Charge(kMB / 2);
+  ASSERT_EQ(1000000, controller.GetDelay(now, kMB / 2));
+  now += 1000000;
+
+  // A writer that arrives early also waits for the writers before it.
+  ASSERT_EQ(1500000, controller.GetDelay(now - 500000, kMB));
+  now += 1000000;
+
+  // Idle time builds up only a small burst allowance.
+  now += 10000000;
+  ASSERT_EQ(0, controller.GetDelay(now, 1024));
+  ASSERT_GT(controller.GetDelay(now, kMB), 990000);
+}
+
+TEST(WriteControllerTest, RateAdjustsToBacklog) {
+  WriteController controller(kMB);
+  controller.Update(true, 8, 1000, 0);
+  ASSERT_EQ(kMB, controller.delayed_write_rate());
+
+  // Backlog unchanged
+  controller.Update(true, 8, 1000, 0);
+  ASSERT_EQ(kMB, controller.delayed_write_rate());
+
+  // Backlog grows
+  controller.Update(true, 9, 1000, 0);
+  ASSERT_EQ(kMB / 5 * 4, controller.delayed_write_rate());
+  controller.Update(true, 9, 2000, 0);
+  ASSERT_EQ(kMB / 5 * 4 / 5 * 4, controller.delayed_write_rate());
+
+  // Backlog shrinks, but never above the configured rate
+  for (int i = 0; i < 10; i++) {
+    controller.Update(true, 8 - i, 1000, 0);
+  }
+  ASSERT_EQ(kMB, controller.delayed_write_rate());
+
+  // Never below the minimum rate
+  for (int i = 0; i < 100; i++) {
+    controller.Update(true, 10 + i, 1000, 0);
+  }
+  ASSERT_EQ(WriteController::kMinDelayedWriteRate,
+            controller.delayed_write_rate());
+
+  // Leaving and re-entering the delayed state starts from the full rate.
+  controller.Update(false, 0, 0, 0);
+  ASSERT_FALSE(controller.IsDelayed());
+  controller.Update(true, 8, 0, 0);
+  ASSERT_EQ(kMB, controller.delayed_write_rate());
+}
+
+}  // namespace leveldb
@@ -31,6 +31,28 @@ class LEVELDB_EXPORT Cache;
 // of Cache uses a least-recently-used eviction policy.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Like NewLRUCache(capacity), but up to high_pri_pool_ratio of the
+// capacity is reserved for entries inserted with Cache::kHighPriority.
+// Such entries are only evicted before low-priority entries once they
+// fill their share of the capacity.  NewLRUCache(capacity) reserves half
+// of the capacity.
+LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity, double high_pri_pool_ratio);
+
+// Create a new cache with a fixed size capacity.  This implementation
+// of Cache uses the CLOCK eviction policy, and looks up and releases
+// entries without taking locks, which scales better than NewLRUCache()
+// when many threads read from the cache.  Entries inserted with
+// Cache::kHighPriority survive longer before being evicted.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity);
+
+// Like NewClockCache(capacity), but with 2^num_shard_bits shards.  Each
+// shard keeps its entries in a fixed-size table, sized for entries of
+// estimated_entry_charge.  Entries that do not fit in the table are not
+// cached, so the estimate should not be much larger than the typical
+// charge.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity, int num_shard_bits,
+                                    size_t estimated_entry_charge);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -45,6 +67,9 @@ class LEVELDB_EXPORT Cache {
   // Opaque handle to an entry stored in the cache.
   struct Handle {};
 
+  // Eviction priority of an entry.
+  enum Priority { kHighPriority, kLowPriority };
+
   // Insert a mapping from key->value into the cache and assign it
   // the specified charge against the total cache capacity.
   //
@@ -57,6 +82,15 @@ class LEVELDB_EXPORT Cache {
   virtual Handle* Insert(const Slice& key, void* value, size_t charge,
                          void (*deleter)(const Slice& key, void* value)) = 0;
 
+  // Like Insert() above, but give the entry the specified priority.  The
+  // cache should prefer to evict low-priority entries.  The default
+  // implementation ignores the priority.
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value),
+                         Priority priority) {
+    return Insert(key, value, charge, deleter);
+  }
+
   // If the cache has no mapping for "key", returns nullptr.
   //
   // Else return a handle that corresponds to the mapping.  The caller
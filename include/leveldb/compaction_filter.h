@@ -0,0 +1,51 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A CompactionFilter lets an application remove or rewrite entries while
+// compactions copy them from one level to the next.  This makes expired
+// or otherwise obsolete data disappear as a side effect of compactions
+// the database performs anyway, without a separate scan and deletion.
+//
+// A database can be configured with a compaction filter (see
+// Options::compaction_filter).  Since compactions run at unpredictable
+// times, a filter should not be used for data whose removal must take
+// effect at a precise moment.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+#define STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT CompactionFilter {
+ public:
+  virtual ~CompactionFilter();
+
+  // Return the name of this filter.  Used for logging only.
+  virtual const char* Name() const = 0;
+
+  // Called for the newest value of "key" in a compaction of "level" into
+  // the next level.  Return true to remove the key: reads stop seeing it
+  // as soon as the compaction finishes.  Otherwise, to replace the value,
+  // store the new value in *new_value and set *value_changed to true.
+  //
+  // Values that are deleted or overwritten are not passed to the filter,
+  // and neither are values that a live snapshot can read, so that
+  // snapshots keep reading what they saw.  Memtable compactions and files
+  // moved to the next level without being rewritten do not call the
+  // filter.
+  //
+  // Compactions may run in several threads at once, so the filter must
+  // be thread-safe.
+  virtual bool Filter(int level, const Slice& key, const Slice& existing_value,
+                      std::string* new_value, bool* value_changed) const = 0;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_COMPACTION_FILTER_H_
@@ -52,6 +52,17 @@ class LEVELDB_EXPORT Comparator {
   // Simple comparator implementations may return with *key unchanged,
   // i.e., an implementation of this method that does nothing is correct.
   virtual void FindShortSuccessor(std::string* key) const = 0;
+
+  // Advanced function used by the hash index of data blocks (see
+  // Options::data_block_hash_index).
+  //
+  // If point lookups can find keys by hashing part of them, sets *hash_key
+  // to that part of "key" and returns true.  A lookup for a target only
+  // needs the entries whose hash key is the target's, entries with equal
+  // hash keys are adjacent in the key order, and hash keys compare equal
+  // only if their bytes are equal.  The default implementation returns
+  // false, which disables the hash index.
+  virtual bool HashKey(const Slice& key, Slice* hash_key) const;
 };
 
 // Return a builtin comparator that uses lexicographic byte-wise
@@ -7,10 +7,13 @@
 
 #include <cstdint>
 #include <cstdio>
+#include <string>
+#include <vector>
 
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/pinnable_slice.h"
 
 namespace leveldb {
 
@@ -72,6 +75,26 @@ class LEVELDB_EXPORT DB {
   // Note: consider setting options.sync = true.
   virtual Status Delete(const WriteOptions& options, const Slice& key) = 0;
 
+  // Remove the database entries (if any) for the keys in ["begin_key",
+  // "end_key").  Does nothing if "begin_key" is not before "end_key".
+  // Returns OK on success, and a non-OK status on error.
+  //
+  // The entries are not looked up: the range is recorded as a single
+  // update, and the deleted entries are dropped by later compactions.
+  // Note: consider setting options.sync = true.
+  virtual Status DeleteRange(const WriteOptions& options,
+                             const Slice& begin_key, const Slice& end_key);
+
+  // Merge "value" into the database entry for "key", using the merge
+  // operator of the database (see leveldb/merge_operator.h).  The entry
+  // is not read: the merge operator combines the value with the entry
+  // when the key is read or compacted.  Returns OK on success, and a
+  // non-OK status on error, such as NotSupported if the database has no
+  // merge operator.
+  // Note: consider setting options.sync = true.
+  virtual Status Merge(const WriteOptions& options, const Slice& key,
+                       const Slice& value);
+
   // Apply the specified updates to the database.
   // Returns OK on success, non-OK on failure.
   // Note: consider setting options.sync = true.
@@ -87,6 +110,29 @@ class LEVELDB_EXPORT DB {
   virtual Status Get(const ReadOptions& options, const Slice& key,
                      std::string* value) = 0;
 
+  // Like Get(), but on success *value refers to the value without copying
+  // it where possible, keeping the storage that holds it (a block cache
+  // entry, or a memtable) alive until value->Reset() is called or value is
+  // destroyed.  Pinned values must be released before this db is deleted.
+  //
+  // The default implementation copies the value.
+  virtual Status Get(const ReadOptions& options, const Slice& key,
+                     PinnableSlice* value);
+
+  // Look up several keys at once.  On return, (*values)[i] and
+  // (*statuses)[i] hold the result of looking up keys[i], with the same
+  // meaning as for Get().  All keys are read from one consistent view of
+  // the database (options.snapshot, or an implicit snapshot taken at the
+  // start of the call), and the batch is cheaper than the equivalent
+  // sequence of Get() calls.
+  //
+  // The default implementation calls Get() for every key, reading them
+  // from a snapshot it takes if options.snapshot is null.
+  virtual void MultiGet(const ReadOptions& options,
+                        const std::vector<Slice>& keys,
+                        std::vector<std::string>* values,
+                        std::vector<Status>* statuses);
+
   // Return a heap-allocated iterator over the contents of the database.
   // The result of NewIterator() is initially invalid (caller must
   // call one of the Seek methods on the iterator before using it).
@@ -121,6 +167,12 @@ class LEVELDB_EXPORT DB {
   //     of the sstables that make up the db contents.
   //  "leveldb.approximate-memory-usage" - returns the approximate number of
   //     bytes of memory in use by the DB.
+  //  "leveldb.estimate-pending-compaction-bytes" - returns the estimated
+  //     number of bytes compactions have to write to bring every level
+  //     within its target size.
+  //  "leveldb.actual-delayed-write-rate" - returns the rate, in bytes per
+  //     second, that writes are currently throttled to, or 0 if writes are
+  //     not throttled.
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -145,6 +197,23 @@ class LEVELDB_EXPORT DB {
   // Therefore the following call will compact the entire database:
   //    db->CompactRange(nullptr, nullptr);
   virtual void CompactRange(const Slice* begin, const Slice* end) = 0;
+
+  // Delete the table files whose keys all lie in the range [*begin,*end],
+  // without reading or rewriting any data.  This reclaims the space held
+  // by a large range of keys much faster than deleting the keys does.
+  //
+  // Unlike DeleteRange(), this is not a consistent deletion: keys in the
+  // range that are stored in the memtable or in files that extend beyond
+  // the range are left in place, and older versions of deleted keys may
+  // become visible again.  Files used by a running compaction are skipped.
+  // Callers that need the whole range gone should follow this with a
+  // DeleteRange() of the same keys.
+  //
+  // begin==nullptr is treated as a key before all keys in the database.
+  // end==nullptr is treated as a key after all keys in the database.
+  //
+  // The default implementation returns a NotSupported error.
+  virtual Status DeleteFilesInRange(const Slice* begin, const Slice* end);
 };
 
 // Destroy the contents of the specified database.
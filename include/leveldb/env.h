@@ -197,6 +197,13 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Ask the Env to run up to "num" Schedule()d functions at once.  Never
+  // shrinks the number of background threads.  Envs that only support a
+  // single background thread may ignore the request.
+  //
+  // The default implementation does nothing.
+  virtual void IncBackgroundThreadsIfNeeded(int num);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -384,6 +391,9 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void IncBackgroundThreadsIfNeeded(int num) override {
+    target_->IncBackgroundThreadsIfNeeded(num);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
@@ -67,6 +67,31 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy that uses a bloom filter whose probes for a
+// key all fall into a single 64-byte block of the filter.  A lookup then
+// costs at most one cache miss, at the price of a slightly higher false
+// positive rate than NewBloomFilterPolicy() for the same bits_per_key.
+// Probing uses AVX2 when the library is built for a CPU that supports it.
+//
+// The filters are stored under a different name than those of
+// NewBloomFilterPolicy(), so switching an existing database to this policy
+// leaves its old tables readable; their filters are just not used until
+// the tables are rewritten by compactions.  The same caveats about custom
+// comparators apply.
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(
+    int bits_per_key);
+
+// Return a new filter policy that uses an xor filter with approximately
+// the specified number of bits per key.  An xor filter is built once from
+// the complete set of keys and needs ~1.23 * log2(1/rate) bits per key
+// for a false positive rate of "rate", against ~1.44 * log2(1/rate) for
+// a bloom filter.  For instance, a bits_per_key of 9 yields a filter with
+// ~ 0.8% false positive rate, about what NewBloomFilterPolicy(10) gives.
+// Building the filter is slower than building a bloom filter.
+//
+// The same caveats about custom comparators apply.
+LEVELDB_EXPORT const FilterPolicy* NewXorFilterPolicy(int bits_per_key);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_FILTER_POLICY_H_
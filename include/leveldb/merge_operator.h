@@ -0,0 +1,55 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A MergeOperator turns read-modify-write updates, such as incrementing a
+// counter or appending to a list, into blind writes.  DB::Merge() stores
+// an operand describing the update, and the operator applies the operands
+// of a key to its value when the key is read or compacted.
+//
+// A database can be configured with a merge operator (see
+// Options::merge_operator).  The operator must stay the same across runs
+// of the database for as long as it holds merge operands.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+#define STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
+
+#include <string>
+#include <vector>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT MergeOperator {
+ public:
+  virtual ~MergeOperator();
+
+  // Return the name of this operator.  Used for logging only.
+  virtual const char* Name() const = 0;
+
+  // Apply "operands", oldest first, to the value of "key" and store the
+  // result in *new_value.  "existing_value" is null if the key has no
+  // value, because it was never written or was deleted.  Return false if
+  // the operands cannot be applied, which fails the read with a
+  // Corruption error.
+  virtual bool FullMerge(const Slice& key, const Slice* existing_value,
+                         const std::vector<Slice>& operands,
+                         std::string* new_value) const = 0;
+
+  // Combine two consecutive operands of "key", "left_operand" being the
+  // older one, into a single operand with the same effect, and store it
+  // in *new_value.  Compactions use this to shrink the operands of keys
+  // whose value they do not see.  Return false if the operands cannot be
+  // combined, in which case both are kept.
+  //
+  // The default implementation returns false.
+  virtual bool PartialMerge(const Slice& key, const Slice& left_operand,
+                            const Slice& right_operand,
+                            std::string* new_value) const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_MERGE_OPERATOR_H_
@@ -6,16 +6,22 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
 
 #include "leveldb/export.h"
 
 namespace leveldb {
 
 class Cache;
+class CompactionFilter;
 class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class MergeOperator;
+class RateLimiter;
+class SecondaryCache;
+class SliceTransform;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -94,12 +100,37 @@ struct LEVELDB_EXPORT Options {
   // If null, leveldb will automatically create and use an 8MB internal cache.
   Cache* block_cache = nullptr;
 
+  // If non-null, compressed blocks read from table files are also kept
+  // in this cache in compressed form, and it is consulted on block_cache
+  // misses before reading the table file.  A block_cache_compressed holds
+  // more blocks than a block_cache of the same capacity, at the cost of
+  // decompressing them on every block_cache miss.  May be shared by
+  // several DBs.  Not used by tables opened without a block_cache.
+  Cache* block_cache_compressed = nullptr;
+
+  // If non-null, blocks read from table files are also added to this
+  // cache, in the form they are stored in the file, and it is consulted
+  // on block_cache misses before reading the table file.  Useful when
+  // table files live on slower storage than the secondary cache.  May be
+  // shared by several DBs, and outlive them.  Not used by tables opened
+  // without a block_cache.
+  SecondaryCache* secondary_cache = nullptr;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
   // compression is enabled.  This parameter can be changed dynamically.
   size_t block_size = 4 * 1024;
 
+  // If true, data blocks of new sstables end with a hash index that maps
+  // the keys of the block to their restart points, so that a Get() finds
+  // a key in a block without a binary search.  Requires a comparator that
+  // supports it (see Comparator::HashKey()), such as the default one, and
+  // blocks of less than 254 restart points; other blocks are written
+  // without a hash index.  Older versions of leveldb cannot read tables
+  // written with this option.
+  bool data_block_hash_index = false;
+
   // Number of keys between restart points for delta encoding of keys.
   // This parameter can be changed dynamically.  Most clients should
   // leave this parameter alone.
@@ -141,10 +172,172 @@ struct LEVELDB_EXPORT Options {
   // Default: currently false, but may become true later.
   bool reuse_logs = false;
 
+  // If true, a group of writes releases the log to the next group as soon
+  // as its log record has been written, and is applied to the memtable
+  // while the next group is logging.  Sequence numbers still become
+  // visible to readers in write order.  This improves throughput for
+  // workloads with many small concurrent writes.
+  //
+  // Default: false
+  bool enable_pipelined_write = false;
+
+  // If true, each writer of a write group inserts its own batch into the
+  // memtable, in parallel with the other writers of the group, instead of
+  // the group leader inserting the whole group by itself.  This helps
+  // write throughput with many concurrent writers on machines with many
+  // cores.
+  //
+  // Default: false
+  bool allow_concurrent_memtable_write = false;
+
+  // Maximum number of compactions that may run at the same time.
+  // Compactions only run in parallel when their input files do not
+  // overlap.  When greater than one, memtable compactions also get a
+  // background thread of their own so that they are not held up behind
+  // long-running table compactions.
+  //
+  // Default: 1
+  int max_background_compactions = 1;
+
+  // Maximum number of threads a single compaction may be split into.
+  // Each thread compacts a part of the key range, chosen from the file
+  // boundaries in the output level, and writes its own output files.
+  // This speeds up large compactions, such as those done by
+  // DB::CompactRange(), on machines with many cores.
+  //
+  // Default: 1
+  int max_subcompactions = 1;
+
+  // If true, the target size of each level is derived from the actual
+  // size of the largest level, instead of being fixed at 10MB for level-1
+  // and ten times more for every level after that.  Each level targets a
+  // tenth of the size of the next one, and level-0 is compacted directly
+  // into the first level whose target is at least 10MB, leaving the levels
+  // in between empty.  This keeps the number of levels, and with it the
+  // write amplification, as small as the amount of data allows.
+  //
+  // Default: false
+  bool level_compaction_dynamic_level_bytes = false;
+
+  // Number of levels in the database.  Opening a database whose descriptor
+  // refers to a level at or beyond num_levels fails with InvalidArgument.
+  //
+  // Default: 7
+  int num_levels = 7;
+
+  // Level-0 compaction is started when we hit this many files.
+  //
+  // Default: 4
+  int level0_file_num_compaction_trigger = 4;
+
+  // Soft limit on number of level-0 files.  We slow down writes at this
+  // point.
+  //
+  // Default: 8
+  int level0_slowdown_writes_trigger = 8;
+
+  // Maximum number of level-0 files.  We stop writes at this point.
+  //
+  // Default: 12
+  int level0_stop_writes_trigger = 12;
+
+  // Maximum level to which a new compacted memtable is pushed if it does
+  // not create overlap.  Pushing to level 2 avoids the relatively
+  // expensive level 0=>1 compactions and some expensive manifest file
+  // operations.  We do not push all the way to the largest level since
+  // that can generate a lot of wasted disk space if the same key space is
+  // being repeatedly overwritten.
+  //
+  // Default: 2
+  int max_mem_compaction_level = 2;
+
+  // Once writes are throttled, because level0_slowdown_writes_trigger or
+  // soft_pending_compaction_bytes_limit has been reached, they are limited
+  // to this many bytes per second.  The rate is lowered further while the
+  // compaction backlog keeps growing and raised again as it shrinks.
+  //
+  // Default: 16MB/s
+  uint64_t delayed_write_rate = 16 << 20;
+
+  // Throttle writes once compactions are estimated to have this many
+  // bytes left to write.  Zero disables the limit.
+  //
+  // Default: 64GB
+  uint64_t soft_pending_compaction_bytes_limit = uint64_t{64} << 30;
+
+  // Stop writes once compactions are estimated to have this many bytes
+  // left to write.  Zero disables the limit.
+  //
+  // Default: 256GB
+  uint64_t hard_pending_compaction_bytes_limit = uint64_t{256} << 30;
+
+  // If non-null, use the specified rate limiter to throttle the writes of
+  // memtable compactions and table compactions, so that they do not
+  // saturate the device.  Memtable compactions are served first.
+  // See leveldb/rate_limiter.h.
+  RateLimiter* rate_limiter = nullptr;
+
   // If non-null, use the specified filter policy to reduce disk reads.
   // Many applications will benefit from passing the result of
   // NewBloomFilterPolicy() here.
   const FilterPolicy* filter_policy = nullptr;
+
+  // If true, new sstables store a single filter for all of their keys
+  // instead of one filter per 2KB of data.  A lookup can then check the
+  // filter before it searches the table's index, which makes lookups of
+  // missing keys cheaper at the cost of buffering the keys of a table
+  // while it is built.  Tables in either format can always be read.
+  bool full_filter = false;
+
+  // If true, the index of new sstables is split into partitions of about
+  // metadata_block_size bytes, with a small top-level index that points to
+  // them, and their filter is split along the same partitions.  Only the
+  // top-level blocks stay in memory while a table is open; partitions are
+  // read on demand through the block cache.  This keeps the memory of
+  // open tables proportional to the working set rather than to the size
+  // of the database, at the cost of an extra block read when a partition
+  // is not cached.  Tables in either format can always be read.
+  bool partition_index_and_filters = false;
+
+  // Approximate size of the index and filter partitions written when
+  // partition_index_and_filters is set.
+  size_t metadata_block_size = 4 * 1024;
+
+  // If true, the index and filter blocks of open sstables are held in the
+  // block cache, and charged against its capacity, instead of being kept
+  // in memory for as long as a table is open.  They are inserted with high
+  // priority (see NewLRUCache()), so that scans do not evict them, and
+  // tables whose blocks were evicted read them again when next used.  This
+  // bounds the memory used by open tables.  Partitions of a partitioned
+  // index or filter are then also inserted with high priority.
+  bool cache_index_and_filter_blocks = false;
+
+  // If non-null, the filters of new sstables also record the prefix of
+  // every key, as computed by this transform, so that iterators opened
+  // with ReadOptions::prefix_same_as_start can skip sstables without any
+  // key of the sought prefix.  Has no effect unless filter_policy is set.
+  // See leveldb/slice_transform.h.
+  const SliceTransform* prefix_extractor = nullptr;
+
+  // If non-null, compactions pass the values they copy to this filter,
+  // which may remove them or change them.  Entries removed by the filter
+  // are deleted, and older versions of their keys stay hidden.
+  // See leveldb/compaction_filter.h.
+  const CompactionFilter* compaction_filter = nullptr;
+
+  // If non-null, DB::Merge() may be used, and this operator combines the
+  // merge operands of a key with its value when the key is read, and
+  // during compactions.
+  // See leveldb/merge_operator.h.
+  const MergeOperator* merge_operator = nullptr;
+
+  // If non-zero, values expire this many seconds after they are written.
+  // Reads ignore expired values, compactions drop them, and table files
+  // are compacted again once they are this old, so that expired values
+  // do not stay on disk indefinitely.  The write time is stored with each
+  // value, so a database must always be opened with a non-zero ttl, or
+  // always with zero.
+  uint64_t ttl = 0;
 };
 
 // Options that control read operations
@@ -162,6 +355,22 @@ struct LEVELDB_EXPORT ReadOptions {
   // not have been released).  If "snapshot" is null, use an implicit
   // snapshot of the state at the beginning of this read operation.
   const Snapshot* snapshot = nullptr;
+
+  // If true, an iterator only yields keys that have the same prefix, as
+  // computed by Options::prefix_extractor, as the target of the last
+  // Seek(), and becomes invalid once it moves past them.  This lets Seek()
+  // skip sstables whose filters show that they hold no key with that
+  // prefix.  Has no effect if the database has no prefix_extractor or the
+  // target is outside of its domain.  SeekToFirst() and SeekToLast() are
+  // not restricted.
+  bool prefix_same_as_start = false;
+
+  // Set by DB iterators, which only hold *prefix_seek true while they
+  // perform a prefix-bounded Seek().  Table iterators then leave the other
+  // seeks, such as those that merge a table with the other sources of a
+  // DB iterator when it changes direction, unfiltered.  If null, every
+  // Seek() of a table iterator with prefix_same_as_start is filtered.
+  const bool* prefix_seek = nullptr;
 };
 
 // Options that control write operations
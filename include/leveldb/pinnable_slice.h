@@ -0,0 +1,77 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// PinnableSlice is a Slice that can keep its data alive by itself.  Its
+// data is either a copy it owns, or storage owned by somebody else, such
+// as a block cache entry or a memtable, that it holds a reference to on
+// the user's behalf.  The reference is released by Reset() or when the
+// PinnableSlice is destroyed, after which the data must not be used.
+//
+// DB::Get() can fill a PinnableSlice without copying the value it finds.
+//
+// Like a Slice, a PinnableSlice needs external synchronization if any of
+// the threads accessing it may call a non-const method.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+#define STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
+
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT PinnableSlice : public Slice {
+ public:
+  using CleanupFunction = void (*)(void* arg1, void* arg2);
+
+  // Create an empty slice.
+  PinnableSlice() : cleanup_(nullptr), arg1_(nullptr), arg2_(nullptr) {}
+
+  PinnableSlice(const PinnableSlice&) = delete;
+  PinnableSlice& operator=(const PinnableSlice&) = delete;
+
+  ~PinnableSlice() { Reset(); }
+
+  // Refer to s, whose storage stays valid until (*cleanup)(arg1, arg2) is
+  // called.  The cleanup is called by the next Reset().
+  void PinSlice(const Slice& s, CleanupFunction cleanup, void* arg1,
+                void* arg2) {
+    Reset();
+    Slice::operator=(s);
+    cleanup_ = cleanup;
+    arg1_ = arg1;
+    arg2_ = arg2;
+  }
+
+  // Refer to a copy of s.
+  void PinSelf(const Slice& s) {
+    Reset();
+    self_.assign(s.data(), s.size());
+    Slice::operator=(self_);
+  }
+
+  // Return true iff the data is pinned storage rather than a copy.
+  bool IsPinned() const { return cleanup_ != nullptr; }
+
+  // Release any pinned storage and make the slice empty.
+  void Reset() {
+    if (cleanup_ != nullptr) {
+      (*cleanup_)(arg1_, arg2_);
+      cleanup_ = nullptr;
+    }
+    clear();
+  }
+
+ private:
+  std::string self_;
+  CleanupFunction cleanup_;
+  void* arg1_;
+  void* arg2_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PINNABLE_SLICE_H_
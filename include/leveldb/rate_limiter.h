@@ -0,0 +1,64 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A RateLimiter bounds the rate at which a database writes table files.
+// Memtable compactions and table compactions ask the limiter for
+// permission before writing, so that a large compaction cannot saturate
+// the device at the expense of foreground reads.  A single RateLimiter
+// may be shared by several databases to bound their combined rate.
+//
+// Most people will want to use the builtin token bucket (see
+// NewGenericRateLimiter() below).
+
+#ifndef STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
+
+#include <cstdint>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT RateLimiter {
+ public:
+  enum IOPriority {
+    kLowPriority = 0,   // Table compactions
+    kHighPriority = 1,  // Memtable compactions
+    kNumPriorities = 2
+  };
+
+  RateLimiter() = default;
+
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  virtual ~RateLimiter();
+
+  // Block until "bytes" may be written at priority "pri".  Requests for
+  // more than GetSingleBurstBytes() are granted over several refills.
+  virtual void Request(int64_t bytes, IOPriority pri) = 0;
+
+  // Return the number of bytes handed out per refill.  Callers should
+  // split large writes into requests of at most this size.
+  virtual int64_t GetSingleBurstBytes() const = 0;
+
+  // Return the total number of bytes granted at priority "pri".
+  virtual int64_t GetTotalBytesThrough(IOPriority pri) const = 0;
+};
+
+// Return a new token bucket rate limiter that grants
+// "rate_bytes_per_sec" bytes per second, refilled every
+// "refill_period_us" microseconds.  High priority requests are served
+// first, except that one refill in every "fairness" serves low priority
+// requests first so that they are not starved.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT RateLimiter* NewGenericRateLimiter(
+    int64_t rate_bytes_per_sec, int64_t refill_period_us = 100 * 1000,
+    int32_t fairness = 10);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_RATE_LIMITER_H_
@@ -0,0 +1,78 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SecondaryCache is a second tier below the block cache.  Blocks read
+// from table files are added to it in the form they are stored in the
+// file (compressed, if compression is enabled), and it is consulted when
+// a block is missing from the block cache, before reading the table file.
+// A secondary cache on a fast local device absorbs most block cache
+// misses of tables that live on slower storage.
+//
+// Entries are only hints: a secondary cache may drop any entry at any
+// time, and the contents of entries are verified before they are used.
+//
+// Most people will want to use one of the builtin implementations (see
+// NewMemorySecondaryCache() and NewFileSecondaryCache() below).
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SECONDARY_CACHE_H_
+#define STORAGE_LEVELDB_INCLUDE_SECONDARY_CACHE_H_
+
+#include <cstddef>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+class Env;
+
+class LEVELDB_EXPORT SecondaryCache {
+ public:
+  SecondaryCache() = default;
+
+  SecondaryCache(const SecondaryCache&) = delete;
+  SecondaryCache& operator=(const SecondaryCache&) = delete;
+
+  virtual ~SecondaryCache();
+
+  // Store a copy of value under key, replacing any previous entry, and
+  // evicting other entries as needed to stay within the capacity.
+  virtual void Insert(const Slice& key, const Slice& value) = 0;
+
+  // If the cache holds an entry for key, store a copy of its value in
+  // *value and return true.  Else return false.
+  virtual bool Lookup(const Slice& key, std::string* value) = 0;
+
+  // Drop the entry for key, if any.
+  virtual void Erase(const Slice& key) = 0;
+
+  // Return an estimate of the combined size of the stored values.
+  virtual size_t TotalCharge() const = 0;
+};
+
+// Return a new secondary cache that keeps up to "capacity" bytes of
+// values in memory, evicting the least recently used entries first.
+// Since it stores blocks compressed, it holds more blocks than a block
+// cache of the same capacity, at the cost of decompressing them on hits.
+LEVELDB_EXPORT SecondaryCache* NewMemorySecondaryCache(size_t capacity);
+
+// Create a secondary cache that keeps up to "capacity" bytes of values in
+// files in the directory "dir", which is created if needed, and store a
+// pointer to it in *result.  The cache appends values to a log of
+// fixed-size segment files and evicts the oldest segment when full.  It
+// needs an amount of memory equal to one segment, up to 64MB, to buffer
+// the segment being written.
+//
+// The contents of the files do not survive the cache: any segment files
+// left in "dir" by a previous cache are removed, and the files are removed
+// when the cache is deleted.  Only one cache at a time may use "dir".
+LEVELDB_EXPORT Status NewFileSecondaryCache(Env* env, const std::string& dir,
+                                            size_t capacity,
+                                            SecondaryCache** result);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SECONDARY_CACHE_H_
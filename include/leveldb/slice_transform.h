@@ -0,0 +1,62 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SliceTransform maps a key to its prefix.  Keys that share a prefix
+// must be adjacent in the order of the database's comparator.
+//
+// A database can be configured with a prefix extractor (see
+// Options::prefix_extractor), in which case its filters also record the
+// prefix of every key, and iterators opened with
+// ReadOptions::prefix_same_as_start can skip sstables that hold no key
+// with the prefix of the Seek() target.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+#define STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
+
+#include <cstddef>
+#include <string>
+
+#include "leveldb/export.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+class LEVELDB_EXPORT SliceTransform {
+ public:
+  virtual ~SliceTransform();
+
+  // Return the name of this transform.  The name is recorded in every
+  // sstable, and the prefixes stored in a table are only used if the
+  // table was built with a transform of the same name.  If the mapping
+  // changes in an incompatible way, the name must change too.
+  virtual const char* Name() const = 0;
+
+  // Return the prefix of "key".  The result must be a leading part of
+  // "key": it must start at key.data() and be no longer than key.
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice& key) const = 0;
+
+  // Return true iff "key" has a prefix.  Keys outside of the domain are
+  // never skipped by prefix filtering.
+  virtual bool InDomain(const Slice& key) const = 0;
+
+  // Append to *dst the key under which filters record the prefix of
+  // "key".  The default implementation appends Transform(key).  Wrappers
+  // of keys that carry more than the prefix override it to give the
+  // filter key the shape that their filter policy expects.
+  // REQUIRES: InDomain(key)
+  virtual void AppendFilterKey(const Slice& key, std::string* dst) const;
+};
+
+// Return a transform that maps a key to its first "prefix_len" bytes.
+// Keys shorter than "prefix_len" are outside of the domain.
+//
+// Callers must delete the result after any database that is using the
+// result has been closed.
+LEVELDB_EXPORT const SliceTransform* NewFixedPrefixTransform(
+    size_t prefix_len);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_SLICE_TRANSFORM_H_
@@ -7,6 +7,7 @@
 
 #include <cstdint>
 
+#include "leveldb/cache.h"
 #include "leveldb/export.h"
 #include "leveldb/iterator.h"
 
@@ -14,6 +15,7 @@ namespace leveldb {
 
 class Block;
 class BlockHandle;
+class FilterBlockReader;
 class Footer;
 struct Options;
 class RandomAccessFile;
@@ -61,20 +63,83 @@ class LEVELDB_EXPORT Table {
  private:
   friend class TableCache;
   struct Rep;
+  class PrefixSeekIterator;
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
+  static Iterator* IndexPartitionReader(void*, const ReadOptions&,
+                                        const Slice&);
 
   explicit Table(Rep* rep) : rep_(rep) {}
 
   // Calls (*handle_result)(arg, ...) with the entry found after a call
-  // to Seek(key).  May not make such a call if filter policy says
-  // that key is not present.
+  // to Seek(key).  May not make such a call if filter policy or the hash
+  // index of the data block says that key is not present.
+  // If "pinned" is non-null, sets *pinned to the block iterator that
+  // holds the entry passed to handle_result instead of deleting it, or to
+  // nullptr if there was no such entry.
   Status InternalGet(const ReadOptions&, const Slice& key, void* arg,
                      void (*handle_result)(void* arg, const Slice& k,
-                                           const Slice& v));
-
-  void ReadMeta(const Footer& footer);
-  void ReadFilter(const Slice& filter_handle_value);
+                                           const Slice& v),
+                     Iterator** pinned = nullptr);
+
+  // Batched form of InternalGet().  keys[0,n-1] must be sorted in
+  // increasing order.  For each i, calls (*handle_result)(args[i], ...)
+  // with the entry found after a call to Seek(keys[i]).  The index block
+  // is walked once and consecutive keys that fall in the same data block
+  // share a single block read.
+  Status InternalMultiGet(const ReadOptions&, int n, const Slice* keys,
+                          void* const* args,
+                          void (*handle_result)(void* arg, const Slice& k,
+                                                const Slice& v));
+
+  // Return false if the filter shows that the table has no key >= target
+  // with the prefix of target.
+  bool PrefixMayMatch(const ReadOptions&, const Slice& target) const;
+
+  // Return an iterator over the index entries of the data blocks, whether
+  // or not the index is partitioned.
+  Iterator* NewIndexIterator(const ReadOptions&) const;
+
+  // Return false if the partitioned filter shows that key is not in the
+  // table.
+  bool PartitionedFilterMayMatch(const ReadOptions&, const Slice& key) const;
+
+  // Return false if the filter partition whose encoded handle is
+  // handle_value does not hold key.  The partition is read through the
+  // block cache.
+  bool FilterPartitionMayMatch(const ReadOptions&, const Slice& handle_value,
+                               const Slice& key) const;
+
+  // Return an iterator over the block whose encoded handle is
+  // index_value, inserting it into the block cache with priority on a miss.
+  // If point_lookup, the iterator is only used for InternalGet()-style
+  // seeks and may use the hash index of the block.
+  Iterator* NewBlockIterator(const ReadOptions&, const Slice& index_value,
+                             Cache::Priority priority,
+                             bool point_lookup) const;
+
+  // Look up the index, filter or filter index block at handle in the block
+  // cache, reading it from the file on a miss.  On success, *cache_handle
+  // pins it until it is released.  Only used if the table keeps these
+  // blocks in the block cache.
+  Status PinMetaBlock(const BlockHandle& handle, bool is_filter,
+                      Cache::Handle** cache_handle) const;
+
+  // Return the filter (or the index of a partitioned filter), or null if
+  // the table has none or it cannot be read.  The caller must pass
+  // *cache_handle to Unpin() once done with the result.
+  FilterBlockReader* PinFilter(Cache::Handle** cache_handle) const;
+  Block* PinFilterIndex(Cache::Handle** cache_handle) const;
+  void Unpin(Cache::Handle* cache_handle) const;
+
+  // Return an iterator over the range tombstones of the table, or null if
+  // it has none.  See db/range_tombstone.h for their format.
+  Iterator* NewRangeTombstoneIterator() const;
+
+  Status ReadMeta(const Footer& footer);
+  void ReadFilter(const Slice& filter_handle_value, bool full);
+  void ReadFilterIndex(const Slice& filter_handle_value);
+  void PrefetchFilter(const BlockHandle& filter_handle, int type);
 
   Rep* const rep_;
 };
@@ -37,6 +37,10 @@ class LEVELDB_EXPORT WriteBatch {
     virtual ~Handler();
     virtual void Put(const Slice& key, const Slice& value) = 0;
     virtual void Delete(const Slice& key) = 0;
+    // The default implementations ignore range deletions and merges;
+    // handlers that must see every update should override them.
+    virtual void DeleteRange(const Slice& begin_key, const Slice& end_key);
+    virtual void Merge(const Slice& key, const Slice& value);
   };
 
   WriteBatch();
@@ -53,6 +57,15 @@ class LEVELDB_EXPORT WriteBatch {
   // If the database contains a mapping for "key", erase it.  Else do nothing.
   void Delete(const Slice& key);
 
+  // Erase the mappings for the keys in ["begin_key", "end_key") that the
+  // database contains.  Does nothing if "begin_key" is not before
+  // "end_key" in the comparator order of the database.
+  void DeleteRange(const Slice& begin_key, const Slice& end_key);
+
+  // Merge "value" into the mapping for "key", using the merge operator of
+  // the database (see leveldb/merge_operator.h).
+  void Merge(const Slice& key, const Slice& value);
+
   // Clear all updates buffered in this batch.
   void Clear();
 
@@ -19,23 +19,41 @@ namespace leveldb {
 
 inline uint32_t Block::NumRestarts() const {
   assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & ~kBlockHashIndexFlag;
 }
 
 Block::Block(const BlockContents& contents)
     : data_(contents.data.data()),
       size_(contents.data.size()),
+      hash_index_(nullptr),
+      num_buckets_(0),
       owned_(contents.heap_allocated) {
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
-  } else {
-    size_t max_restarts_allowed = (size_ - sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
-      // The size is too small for NumRestarts()
+    return;
+  }
+
+  // Offset just past the restart array
+  size_t limit = size_ - sizeof(uint32_t);
+  if (DecodeFixed32(data_ + limit) & kBlockHashIndexFlag) {
+    if (limit >= sizeof(uint32_t)) {
+      limit -= sizeof(uint32_t);
+      num_buckets_ = DecodeFixed32(data_ + limit);
+    }
+    if (num_buckets_ == 0 || num_buckets_ > limit) {
+      // The size is too small for the hash index
       size_ = 0;
-    } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      return;
     }
+    limit -= num_buckets_;
+    hash_index_ = data_ + limit;
+  }
+  size_t max_restarts_allowed = limit / sizeof(uint32_t);
+  if (NumRestarts() > max_restarts_allowed) {
+    // The size is too small for NumRestarts()
+    size_ = 0;
+  } else {
+    restart_offset_ = limit - NumRestarts() * sizeof(uint32_t);
   }
 }
 
@@ -80,6 +98,8 @@ class Block::Iter : public Iterator {
   const char* const data_;       // underlying block contents
   uint32_t const restarts_;      // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
+  const char* const hash_index_;  // Used by Seek() if non-null
+  uint32_t const num_buckets_;
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -114,11 +134,13 @@ class Block::Iter : public Iterator {
 
  public:
   Iter(const Comparator* comparator, const char* data, uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts, const char* hash_index, uint32_t num_buckets)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        hash_index_(hash_index),
+        num_buckets_(num_buckets),
         current_(restarts_),
         restart_index_(num_restarts_) {
     assert(num_restarts_ > 0);
@@ -162,6 +184,22 @@ class Block::Iter : public Iterator {
   }
 
   void Seek(const Slice& target) override {
+    Slice hash_key;
+    if (hash_index_ != nullptr && comparator_->HashKey(target, &hash_key)) {
+      const uint32_t bucket = BlockHashIndexHash(hash_key) % num_buckets_;
+      const uint8_t restart = static_cast<uint8_t>(hash_index_[bucket]);
+      if (restart == kBlockHashIndexNoEntry) {
+        // No key with the hash key of target
+        current_ = restarts_;
+        restart_index_ = num_restarts_;
+        return;
+      } else if (restart < num_restarts_) {
+        SeekInRun(restart, target, hash_key);
+        return;
+      }
+      // Else keys in different restart intervals share the bucket
+    }
+
     // Binary search in restart array to find the last restart point
     // with a key < target
     uint32_t left = 0;
@@ -226,6 +264,28 @@ class Block::Iter : public Iterator {
     }
   }
 
+  // Seek to the first key >= target, from the restart point "restart"
+  // where the first key with the hash key of target would be.
+  void SeekInRun(uint32_t restart, const Slice& target,
+                 const Slice& hash_key) {
+    SeekToRestartPoint(restart);
+    while (ParseNextKey()) {
+      if (Compare(key_, target) >= 0) {
+        return;
+      }
+      // Keys with the hash key of target are adjacent, so once past the
+      // restart interval where they start, any other key ends them.
+      Slice key_hash_key;
+      if (restart_index_ != restart &&
+          (!comparator_->HashKey(key_, &key_hash_key) ||
+           key_hash_key != hash_key)) {
+        current_ = restarts_;
+        restart_index_ = num_restarts_;
+        return;
+      }
+    }
+  }
+
   void SeekToFirst() override {
     SeekToRestartPoint(0);
     ParseNextKey();
@@ -285,7 +345,21 @@ Iterator* Block::NewIterator(const Comparator* comparator) {
   if (num_restarts == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(comparator, data_, restart_offset_, num_restarts);
+    return new Iter(comparator, data_, restart_offset_, num_restarts, nullptr,
+                    0);
+  }
+}
+
+Iterator* Block::NewPointLookupIterator(const Comparator* comparator) {
+  if (size_ < sizeof(uint32_t)) {
+    return NewErrorIterator(Status::Corruption("bad block contents"));
+  }
+  const uint32_t num_restarts = NumRestarts();
+  if (num_restarts == 0) {
+    return NewEmptyIterator();
+  } else {
+    return new Iter(comparator, data_, restart_offset_, num_restarts,
+                    hash_index_, num_buckets_);
   }
 }
 
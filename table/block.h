@@ -28,6 +28,13 @@ class Block {
   size_t size() const { return size_; }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Like NewIterator(), but Seek() uses the hash index of the block, if it
+  // has one, for point lookups.  Seek(target) then either finds the first
+  // key >= target, or leaves the iterator invalid if the block has no key
+  // with the hash key of target (see Comparator::HashKey()) that is >=
+  // target.
+  Iterator* NewPointLookupIterator(const Comparator* comparator);
+
  private:
   class Iter;
 
@@ -36,6 +43,8 @@ class Block {
   const char* data_;
   size_t size_;
   uint32_t restart_offset_;  // Offset in data_ of restart array
+  const char* hash_index_;   // Buckets of the hash index, or nullptr
+  uint32_t num_buckets_;
   bool owned_;               // Block owns data_[]
 };
 
@@ -25,6 +25,18 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// If options.data_block_hash_index is set, the trailer instead has the form:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint32
+//     num_restarts | kBlockHashIndexFlag: uint32
+// Each bucket holds the index of the restart point where the first entry
+// with a hash key (see Comparator::HashKey()) hashing to the bucket is,
+// kBlockHashIndexNoEntry if there is no such key, or
+// kBlockHashIndexCollision if such keys are in different restart
+// intervals.  Blocks of kBlockHashIndexCollision or more restart points
+// have no hash index.
 
 #include "table/block_builder.h"
 
@@ -33,10 +45,17 @@
 
 #include "leveldb/comparator.h"
 #include "leveldb/options.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
 
+// Number of buckets of a hash index of n hash keys, for a load factor of
+// 0.75.
+static uint32_t NumHashIndexBuckets(size_t n) {
+  return static_cast<uint32_t>(n * 4 / 3 + 1);
+}
+
 BlockBuilder::BlockBuilder(const Options* options)
     : options_(options), restarts_(), counter_(0), finished_(false) {
   assert(options->block_restart_interval >= 1);
@@ -50,12 +69,17 @@ void BlockBuilder::Reset() {
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
+  hash_index_.clear();
 }
 
 size_t BlockBuilder::CurrentSizeEstimate() const {
-  return (buffer_.size() +                       // Raw data buffer
-          restarts_.size() * sizeof(uint32_t) +  // Restart array
-          sizeof(uint32_t));                     // Restart array length
+  size_t estimate = (buffer_.size() +                       // Raw data buffer
+                     restarts_.size() * sizeof(uint32_t) +  // Restart array
+                     sizeof(uint32_t));  // Restart array length
+  if (!hash_index_.empty()) {
+    estimate += NumHashIndexBuckets(hash_index_.size()) + sizeof(uint32_t);
+  }
+  return estimate;
 }
 
 Slice BlockBuilder::Finish() {
@@ -63,7 +87,26 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  uint32_t num_restarts = restarts_.size();
+  if (!hash_index_.empty() && restarts_.size() < kBlockHashIndexCollision) {
+    // Append hash index
+    const uint32_t num_buckets = NumHashIndexBuckets(hash_index_.size());
+    std::string buckets(num_buckets, static_cast<char>(kBlockHashIndexNoEntry));
+    for (const auto& entry : hash_index_) {
+      const uint32_t bucket = entry.first % num_buckets;
+      const uint8_t restart = static_cast<uint8_t>(entry.second);
+      const uint8_t current = static_cast<uint8_t>(buckets[bucket]);
+      if (current == kBlockHashIndexNoEntry) {
+        buckets[bucket] = static_cast<char>(restart);
+      } else if (current != restart) {
+        buckets[bucket] = static_cast<char>(kBlockHashIndexCollision);
+      }
+    }
+    buffer_.append(buckets);
+    PutFixed32(&buffer_, num_buckets);
+    num_restarts |= kBlockHashIndexFlag;
+  }
+  PutFixed32(&buffer_, num_restarts);
   finished_ = true;
   return Slice(buffer_);
 }
@@ -88,6 +131,19 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
   }
   const size_t non_shared = key.size() - shared;
 
+  if (options_->data_block_hash_index) {
+    // Entries with the same hash key are adjacent; record the restart
+    // point of the first one.
+    Slice hash_key, last_hash_key;
+    if (options_->comparator->HashKey(key, &hash_key) &&
+        (buffer_.empty() ||
+         !options_->comparator->HashKey(last_key_piece, &last_hash_key) ||
+         hash_key != last_hash_key)) {
+      hash_index_.emplace_back(BlockHashIndexHash(hash_key),
+                               restarts_.size() - 1);
+    }
+  }
+
   // Add "<shared><non_shared><value_size>" to buffer_
   PutVarint32(&buffer_, shared);
   PutVarint32(&buffer_, non_shared);
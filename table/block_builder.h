@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_TABLE_BLOCK_BUILDER_H_
 
 #include <cstdint>
+#include <utility>
 #include <vector>
 
 #include "leveldb/slice.h"
@@ -47,6 +48,10 @@ class BlockBuilder {
   int counter_;                     // Number of entries emitted since restart
   bool finished_;                   // Has Finish() been called?
   std::string last_key_;
+
+  // Hash of the hash key of each run of entries with the same hash key,
+  // and the restart point of the first entry of the run.
+  std::vector<std::pair<uint32_t, uint32_t>> hash_index_;
 };
 
 }  // namespace leveldb
@@ -15,10 +15,13 @@ namespace leveldb {
 static const size_t kFilterBaseLg = 11;
 static const size_t kFilterBase = 1 << kFilterBaseLg;
 
-FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy)
-    : policy_(policy) {}
+FilterBlockBuilder::FilterBlockBuilder(const FilterPolicy* policy, bool full)
+    : policy_(policy), full_(full) {}
 
 void FilterBlockBuilder::StartBlock(uint64_t block_offset) {
+  if (full_) {
+    return;
+  }
   uint64_t filter_index = (block_offset / kFilterBase);
   assert(filter_index >= filter_offsets_.size());
   while (filter_index > filter_offsets_.size()) {
@@ -36,6 +39,10 @@ Slice FilterBlockBuilder::Finish() {
   if (!start_.empty()) {
     GenerateFilter();
   }
+  if (full_) {
+    // A full filter block holds just the filter
+    return Slice(result_);
+  }
 
   // Append array of per-filter offsets
   const uint32_t array_offset = result_.size();
@@ -75,8 +82,17 @@ void FilterBlockBuilder::GenerateFilter() {
 }
 
 FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
-                                     const Slice& contents)
-    : policy_(policy), data_(nullptr), offset_(nullptr), num_(0), base_lg_(0) {
+                                     const Slice& contents, bool full)
+    : policy_(policy),
+      full_(full),
+      data_(nullptr),
+      offset_(nullptr),
+      num_(0),
+      base_lg_(0) {
+  if (full_) {
+    full_filter_ = contents;
+    return;
+  }
   size_t n = contents.size();
   if (n < 5) return;  // 1 byte for base_lg_ and 4 for start of offset array
   base_lg_ = contents[n - 1];
@@ -88,6 +104,9 @@ FilterBlockReader::FilterBlockReader(const FilterPolicy* policy,
 }
 
 bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
+  if (full_) {
+    return KeyMayMatch(key);
+  }
   uint64_t index = block_offset >> base_lg_;
   if (index < num_) {
     uint32_t start = DecodeFixed32(offset_ + index * 4);
@@ -103,4 +122,13 @@ bool FilterBlockReader::KeyMayMatch(uint64_t block_offset, const Slice& key) {
   return true;  // Errors are treated as potential matches
 }
 
+bool FilterBlockReader::KeyMayMatch(const Slice& key) {
+  assert(full_);
+  if (full_filter_.empty()) {
+    // Tables without keys have an empty filter
+    return false;
+  }
+  return policy_->KeyMayMatch(key, full_filter_);
+}
+
 }  // namespace leveldb
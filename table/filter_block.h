@@ -4,7 +4,9 @@
 //
 // A filter block is stored near the end of a Table file.  It contains
 // filters (e.g., bloom filters) for all data blocks in the table combined
-// into a single filter block.
+// into a single filter block.  A "full" filter block instead holds a
+// single filter for all keys of the table, which can be checked without
+// knowing which data block could hold a key.
 
 #ifndef STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
 #define STORAGE_LEVELDB_TABLE_FILTER_BLOCK_H_
@@ -27,9 +29,12 @@ class FilterPolicy;
 //
 // The sequence of calls to FilterBlockBuilder must match the regexp:
 //      (StartBlock AddKey*)* Finish
+//
+// If "full" is true, StartBlock() is ignored and Finish() returns a
+// single filter for all keys that were added.
 class FilterBlockBuilder {
  public:
-  explicit FilterBlockBuilder(const FilterPolicy*);
+  explicit FilterBlockBuilder(const FilterPolicy*, bool full = false);
 
   FilterBlockBuilder(const FilterBlockBuilder&) = delete;
   FilterBlockBuilder& operator=(const FilterBlockBuilder&) = delete;
@@ -42,6 +47,7 @@ class FilterBlockBuilder {
   void GenerateFilter();
 
   const FilterPolicy* policy_;
+  const bool full_;
   std::string keys_;             // Flattened key contents
   std::vector<size_t> start_;    // Starting index in keys_ of each key
   std::string result_;           // Filter data computed so far
@@ -52,11 +58,21 @@ class FilterBlockBuilder {
 class FilterBlockReader {
  public:
   // REQUIRES: "contents" and *policy must stay live while *this is live.
-  FilterBlockReader(const FilterPolicy* policy, const Slice& contents);
+  FilterBlockReader(const FilterPolicy* policy, const Slice& contents,
+                    bool full = false);
   bool KeyMayMatch(uint64_t block_offset, const Slice& key);
 
+  // Returns true if the filter covers the whole table, in which case
+  // KeyMayMatch(key) below may be used.
+  bool is_full() const { return full_; }
+
+  // REQUIRES: is_full()
+  bool KeyMayMatch(const Slice& key);
+
  private:
   const FilterPolicy* policy_;
+  const bool full_;
+  Slice full_filter_;   // The filter if full_
   const char* data_;    // Pointer to filter data (at block-start)
   const char* offset_;  // Pointer to beginning of offset array (at block-end)
   size_t num_;          // Number of entries in offset array
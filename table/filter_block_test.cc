@@ -119,4 +119,40 @@ TEST_F(FilterBlockTest, MultiChunk) {
   ASSERT_TRUE(!reader.KeyMayMatch(9000, "bar"));
 }
 
+TEST_F(FilterBlockTest, FullEmptyBuilder) {
+  FilterBlockBuilder builder(&policy_, true);
+  Slice block = builder.Finish();
+  ASSERT_EQ("", EscapeString(block));
+  FilterBlockReader reader(&policy_, block, true);
+  ASSERT_TRUE(reader.is_full());
+  ASSERT_TRUE(!reader.KeyMayMatch("foo"));
+  ASSERT_TRUE(!reader.KeyMayMatch(100000, "foo"));
+}
+
+TEST_F(FilterBlockTest, Full) {
+  FilterBlockBuilder builder(&policy_, true);
+  builder.StartBlock(0);
+  builder.AddKey("foo");
+  builder.StartBlock(3100);
+  builder.AddKey("bar");
+  builder.StartBlock(9000);
+  builder.AddKey("box");
+  builder.AddKey("hello");
+
+  // One filter for all keys, without offset array
+  Slice block = builder.Finish();
+  ASSERT_EQ(4 * 4, block.size());
+  FilterBlockReader reader(&policy_, block, true);
+  ASSERT_TRUE(reader.KeyMayMatch("foo"));
+  ASSERT_TRUE(reader.KeyMayMatch("bar"));
+  ASSERT_TRUE(reader.KeyMayMatch("box"));
+  ASSERT_TRUE(reader.KeyMayMatch("hello"));
+  ASSERT_TRUE(!reader.KeyMayMatch("missing"));
+  ASSERT_TRUE(!reader.KeyMayMatch("other"));
+
+  // Block offsets are ignored
+  ASSERT_TRUE(reader.KeyMayMatch(0, "hello"));
+  ASSERT_TRUE(!reader.KeyMayMatch(9000, "missing"));
+}
+
 }  // namespace leveldb
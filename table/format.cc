@@ -4,12 +4,17 @@
 
 #include "table/format.h"
 
+#include <cstring>
+
+#include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/options.h"
+#include "leveldb/secondary_cache.h"
 #include "port/port.h"
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
@@ -29,6 +34,10 @@ Status BlockHandle::DecodeFrom(Slice* input) {
   }
 }
 
+uint32_t BlockHashIndexHash(const Slice& hash_key) {
+  return Hash(hash_key.data(), hash_key.size(), 0x5d2c3b1a);
+}
+
 void Footer::EncodeTo(std::string* dst) const {
   const size_t original_size = dst->size();
   metaindex_handle_.EncodeTo(dst);
@@ -68,34 +77,21 @@ Status Footer::DecodeFrom(Slice* input) {
 
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result) {
-  result->data = Slice();
-  result->cachable = false;
-  result->heap_allocated = false;
-
-  // Read the block contents as well as the type/crc footer.
-  // See table_builder.cc for the code that built this structure.
-  size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
-  Slice contents;
-  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
-  if (!s.ok()) {
-    delete[] buf;
-    return s;
-  }
-  if (contents.size() != n + kBlockTrailerSize) {
-    delete[] buf;
-    return Status::Corruption("truncated block read");
-  }
+  return ReadBlock(file, options, handle, nullptr, nullptr, Slice(), result);
+}
 
+// Decode the n bytes of block contents at "data", followed by the block
+// trailer, into *result.  "buf" is the heap buffer that holds "data", if
+// any; it is either deleted or handed over to *result.
+static Status DecodeBlock(const char* data, size_t n, char* buf,
+                          bool verify_checksum, BlockContents* result) {
   // Check the crc of the type and the block contents
-  const char* data = contents.data();  // Pointer to where Read put the data
-  if (options.verify_checksums) {
+  if (verify_checksum) {
     const uint32_t crc = crc32c::Unmask(DecodeFixed32(data + n + 1));
     const uint32_t actual = crc32c::Value(data, n + 1);
     if (actual != crc) {
       delete[] buf;
-      s = Status::Corruption("block checksum mismatch");
-      return s;
+      return Status::Corruption("block checksum mismatch");
     }
   }
 
@@ -161,4 +157,97 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   return Status::OK();
 }
 
+static void DeleteCachedCompressedBlock(const Slice& key, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+// Add "raw", the contents of a block followed by its trailer, to
+// "compressed_cache" if the block is compressed.
+static void InsertCompressedBlock(Cache* compressed_cache,
+                                  const Slice& cache_key, const Slice& raw) {
+  if (raw[raw.size() - kBlockTrailerSize] != kNoCompression) {
+    std::string* value = new std::string(raw.data(), raw.size());
+    compressed_cache->Release(compressed_cache->Insert(
+        cache_key, value, value->size(), &DeleteCachedCompressedBlock));
+  }
+}
+
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, Cache* compressed_cache,
+                 SecondaryCache* secondary_cache, const Slice& cache_key,
+                 BlockContents* result) {
+  result->data = Slice();
+  result->cachable = false;
+  result->heap_allocated = false;
+
+  size_t n = static_cast<size_t>(handle.size());
+  if (compressed_cache != nullptr) {
+    Cache::Handle* cache_handle = compressed_cache->Lookup(cache_key);
+    if (cache_handle != nullptr) {
+      const std::string* raw =
+          reinterpret_cast<std::string*>(compressed_cache->Value(cache_handle));
+      // Only compressed blocks are cached, so decoding leaves the cached
+      // contents alone.
+      Status s = Status::Corruption("bad compressed block cache entry");
+      if (raw->size() == n + kBlockTrailerSize && (*raw)[n] != kNoCompression) {
+        s = DecodeBlock(raw->data(), n, nullptr, options.verify_checksums,
+                        result);
+      }
+      compressed_cache->Release(cache_handle);
+      if (s.ok()) {
+        return s;
+      }
+      compressed_cache->Erase(cache_key);
+    }
+  }
+  const bool fill_compressed_cache =
+      compressed_cache != nullptr && options.fill_cache;
+
+  if (secondary_cache != nullptr) {
+    std::string raw;
+    if (secondary_cache->Lookup(cache_key, &raw)) {
+      if (raw.size() == n + kBlockTrailerSize) {
+        char* buf = new char[raw.size()];
+        std::memcpy(buf, raw.data(), raw.size());
+        // Always verify entries of the secondary cache, which may live on
+        // a less reliable device than the table.
+        if (DecodeBlock(buf, n, buf, true, result).ok()) {
+          if (fill_compressed_cache) {
+            InsertCompressedBlock(compressed_cache, cache_key, raw);
+          }
+          return Status::OK();
+        }
+      }
+      secondary_cache->Erase(cache_key);
+    }
+  }
+
+  // Read the block contents as well as the type/crc footer.
+  // See table_builder.cc for the code that built this structure.
+  char* buf = new char[n + kBlockTrailerSize];
+  Slice contents;
+  Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
+  if (!s.ok()) {
+    delete[] buf;
+    return s;
+  }
+  if (contents.size() != n + kBlockTrailerSize) {
+    delete[] buf;
+    return Status::Corruption("truncated block read");
+  }
+
+  const char* data = contents.data();  // Pointer to where Read put the data
+  if (secondary_cache != nullptr && options.fill_cache) {
+    // Also taken from files that the Env maps into memory, since those
+    // may still live on slower storage.
+    secondary_cache->Insert(cache_key, contents);
+  }
+  if (fill_compressed_cache && data == buf) {
+    // Blocks of files that the Env maps into memory are not worth copying
+    // to memory again.
+    InsertCompressedBlock(compressed_cache, cache_key, contents);
+  }
+  return DecodeBlock(data, n, buf, options.verify_checksums, result);
+}
+
 }  // namespace leveldb
@@ -15,7 +15,9 @@
 namespace leveldb {
 
 class Block;
+class Cache;
 class RandomAccessFile;
+class SecondaryCache;
 struct ReadOptions;
 
 // BlockHandle is a pointer to the extent of a file that stores a data
@@ -78,6 +80,23 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Size of the random id that a table built with a block_cache_compressed or
+// secondary_cache stores under "uniqueid" in its metaindex block.  Caches
+// that may outlive the table's block cache, or be shared by several DBs,
+// key the table's blocks by this id.
+static const size_t kTableUniqueIdSize = 16;
+
+// The top bit of the number of restarts of a block is set if the block
+// has a hash index (see block_builder.cc).  Each bucket of the index holds
+// the index of a restart point, or one of these markers.
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+static const uint8_t kBlockHashIndexNoEntry = 255;
+static const uint8_t kBlockHashIndexCollision = 254;
+
+// Return the hash of hash_key for block hash indexes.  The bucket of
+// hash_key is the hash modulo the number of buckets.
+uint32_t BlockHashIndexHash(const Slice& hash_key);
+
 struct BlockContents {
   Slice data;           // Actual contents of data
   bool cachable;        // True iff data can be cached
@@ -89,6 +108,16 @@ struct BlockContents {
 Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
                  const BlockHandle& handle, BlockContents* result);
 
+// Like ReadBlock(), but first looks for the block under "cache_key" in
+// "compressed_cache" and then in "secondary_cache", where non-null, and
+// adds the block to them when it has to be read from a lower tier (unless
+// options.fill_cache is false).  Only compressed blocks are added to
+// "compressed_cache".
+Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
+                 const BlockHandle& handle, Cache* compressed_cache,
+                 SecondaryCache* secondary_cache, const Slice& cache_key,
+                 BlockContents* result);
+
 // Implementation details follow.  Clients should ignore,
 
 inline BlockHandle::BlockHandle()
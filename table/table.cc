@@ -4,11 +4,15 @@
 
 #include "leveldb/table.h"
 
+#include <atomic>
+#include <cstring>
+
 #include "leveldb/cache.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -21,20 +25,72 @@ struct Table::Rep {
   ~Rep() {
     delete filter;
     delete[] filter_data;
+    delete filter_index;
     delete index_block;
+    delete range_tombstone_block;
   }
 
+  enum FilterType { kNoFilter, kBlockFilter, kFullFilter, kPartitionedFilter };
+
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
+  // Identifies the table in block_cache_compressed and secondary_cache,
+  // which may outlive block_cache or be shared by several DBs.  Tables
+  // built without those caches get an id that is unique to this process.
+  std::string unique_id;
   FilterBlockReader* filter;
   const char* filter_data;
+  Block* filter_index;       // Top-level index of a partitioned filter
+  FilterType filter_type;
+  bool filter_has_prefixes;  // Filter also holds options.prefix_extractor keys
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
-  Block* index_block;
+  Block* index_block;            // Top-level index if index_partitioned
+  bool index_partitioned;
+  Block* range_tombstone_block;  // Null if the table has no range tombstones
+
+  // If options.cache_index_and_filter_blocks is set, index_block, filter
+  // and filter_index are null and the blocks live in the block cache, from
+  // which they may be evicted.  These handles locate them in the file.
+  bool cache_meta_blocks;
+  BlockHandle index_handle;
+  BlockHandle filter_handle;  // Of the filter or of filter_index
+  Cache::Priority partition_priority;
 };
 
+// An index, filter or filter index block held in the block cache.
+struct CachedMetaBlock {
+  CachedMetaBlock() : block(nullptr), filter(nullptr), filter_data(nullptr) {}
+  ~CachedMetaBlock() {
+    delete block;
+    delete filter;
+    delete[] filter_data;
+  }
+
+  Block* block;
+  FilterBlockReader* filter;
+  const char* filter_data;
+};
+
+static void DeleteCachedMetaBlock(const Slice& key, void* value) {
+  delete reinterpret_cast<CachedMetaBlock*>(value);
+}
+
+// Return an id for a table that does not store one.  It is unique within
+// the process, and is shorter than the stored ids so that it cannot match
+// them.
+static std::string NewProcessUniqueId() {
+  static std::atomic<uint64_t> last_id(0);
+  std::string id;
+  PutFixed64(&id, last_id.fetch_add(1, std::memory_order_relaxed) + 1);
+  return id;
+}
+
+// An empty block holds nothing but its restart array.
+static const uint64_t kEmptyBlockSize = 2 * sizeof(uint32_t);
+
 Status Table::Open(const Options& options, RandomAccessFile* file,
                    uint64_t size, Table** table) {
   *table = nullptr;
@@ -52,69 +108,160 @@ Status Table::Open(const Options& options, RandomAccessFile* file,
   s = footer.DecodeFrom(&footer_input);
   if (!s.ok()) return s;
 
+  Rep* rep = new Table::Rep;
+  rep->options = options;
+  rep->file = file;
+  rep->metaindex_handle = footer.metaindex_handle();
+  rep->index_block = nullptr;
+  rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+  rep->filter_data = nullptr;
+  rep->filter = nullptr;
+  rep->filter_index = nullptr;
+  rep->filter_type = Rep::kNoFilter;
+  rep->filter_has_prefixes = false;
+  rep->index_partitioned = false;
+  rep->range_tombstone_block = nullptr;
+  rep->cache_meta_blocks = (options.cache_index_and_filter_blocks &&
+                            options.block_cache != nullptr);
+  rep->index_handle = footer.index_handle();
+  rep->partition_priority = (options.cache_index_and_filter_blocks
+                                 ? Cache::kHighPriority
+                                 : Cache::kLowPriority);
+  *table = new Table(rep);
+
   // Read the index block
-  BlockContents index_block_contents;
-  ReadOptions opt;
-  if (options.paranoid_checks) {
-    opt.verify_checksums = true;
+  if (rep->cache_meta_blocks) {
+    Cache::Handle* cache_handle;
+    s = (*table)->PinMetaBlock(rep->index_handle, false, &cache_handle);
+    if (s.ok()) {
+      options.block_cache->Release(cache_handle);
+    }
+  } else {
+    BlockContents index_block_contents;
+    ReadOptions opt;
+    if (options.paranoid_checks) {
+      opt.verify_checksums = true;
+    }
+    s = ReadBlock(file, opt, rep->index_handle, &index_block_contents);
+    if (s.ok()) {
+      rep->index_block = new Block(index_block_contents);
+    }
   }
-  s = ReadBlock(file, opt, footer.index_handle(), &index_block_contents);
 
+  // We've successfully read the footer and the index block: we're
+  // ready to serve requests once the metadata is read.
   if (s.ok()) {
-    // We've successfully read the footer and the index block: we're
-    // ready to serve requests.
-    Block* index_block = new Block(index_block_contents);
-    Rep* rep = new Table::Rep;
-    rep->options = options;
-    rep->file = file;
-    rep->metaindex_handle = footer.metaindex_handle();
-    rep->index_block = index_block;
-    rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
-    rep->filter_data = nullptr;
-    rep->filter = nullptr;
-    *table = new Table(rep);
-    (*table)->ReadMeta(footer);
+    s = (*table)->ReadMeta(footer);
+  }
+  if (s.ok() && rep->unique_id.empty()) {
+    rep->unique_id = NewProcessUniqueId();
+  }
+  if (!s.ok()) {
+    delete *table;
+    *table = nullptr;
   }
-
   return s;
 }
 
-void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == nullptr) {
-    return;  // Do not need any metadata
+Status Table::ReadMeta(const Footer& footer) {
+  if (footer.metaindex_handle().size() <= kEmptyBlockSize) {
+    return Status::OK();  // No metadata
   }
 
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   if (rep_->options.paranoid_checks) {
     opt.verify_checksums = true;
   }
   BlockContents contents;
-  if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
-    // Do not propagate errors since meta info is not needed for operation
-    return;
+  Status s = ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents);
+  if (!s.ok()) {
+    // The filter is not needed for operation, but how to read the index
+    // block is.
+    return s;
   }
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
+  std::string key = "partitionedindex";
+  iter->Seek(key);
+  rep_->index_partitioned = iter->Valid() && iter->key() == Slice(key);
+
+  const FilterPolicy* policy = rep_->options.filter_policy;
+  if (policy != nullptr) {
+    key = "filter.";
+    key.append(policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value(), false);
+    } else {
+      key = "fullfilter.";
+      key.append(policy->Name());
+      iter->Seek(key);
+      if (iter->Valid() && iter->key() == Slice(key)) {
+        ReadFilter(iter->value(), true);
+      } else {
+        key = "partitionedfilter.";
+        key.append(policy->Name());
+        iter->Seek(key);
+        if (iter->Valid() && iter->key() == Slice(key)) {
+          ReadFilterIndex(iter->value());
+        }
+      }
+    }
+  }
+  if (rep_->filter_type != Rep::kNoFilter &&
+      rep_->options.prefix_extractor != nullptr) {
+    key = "prefix.";
+    key.append(rep_->options.prefix_extractor->Name());
+    iter->Seek(key);
+    rep_->filter_has_prefixes = iter->Valid() && iter->key() == Slice(key);
+  }
+
+  key = "uniqueid";
+  iter->Seek(key);
+  if (iter->Valid() && iter->key() == Slice(key) &&
+      iter->value().size() == kTableUniqueIdSize) {
+    rep_->unique_id = iter->value().ToString();
+  }
+
+  // Unlike the filter, the range tombstones are needed for correctness.
+  key = "rangetombstones";
   iter->Seek(key);
   if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+    Slice v = iter->value();
+    BlockHandle handle;
+    s = handle.DecodeFrom(&v);
+    if (s.ok()) {
+      s = ReadBlock(rep_->file, opt, handle, &contents);
+    }
+    if (s.ok()) {
+      rep_->range_tombstone_block = new Block(contents);
+    }
   }
   delete iter;
   delete meta;
+  return s;
+}
+
+Iterator* Table::NewRangeTombstoneIterator() const {
+  if (rep_->range_tombstone_block == nullptr) {
+    return nullptr;
+  }
+  return rep_->range_tombstone_block->NewIterator(rep_->options.comparator);
 }
 
-void Table::ReadFilter(const Slice& filter_handle_value) {
+void Table::ReadFilter(const Slice& filter_handle_value, bool full) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
   if (!filter_handle.DecodeFrom(&v).ok()) {
     return;
   }
 
+  if (rep_->cache_meta_blocks) {
+    PrefetchFilter(filter_handle, full ? Rep::kFullFilter : Rep::kBlockFilter);
+    return;
+  }
+
   // We might want to unify with ReadBlock() if we start
   // requiring checksum verification in Table::Open.
   ReadOptions opt;
@@ -128,10 +275,154 @@ void Table::ReadFilter(const Slice& filter_handle_value) {
   if (block.heap_allocated) {
     rep_->filter_data = block.data.data();  // Will need to delete later
   }
-  rep_->filter = new FilterBlockReader(rep_->options.filter_policy, block.data);
+  rep_->filter =
+      new FilterBlockReader(rep_->options.filter_policy, block.data, full);
+  rep_->filter_type = full ? Rep::kFullFilter : Rep::kBlockFilter;
+}
+
+void Table::ReadFilterIndex(const Slice& filter_handle_value) {
+  Slice v = filter_handle_value;
+  BlockHandle filter_handle;
+  if (!filter_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  if (rep_->cache_meta_blocks) {
+    PrefetchFilter(filter_handle, Rep::kPartitionedFilter);
+    return;
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, filter_handle, &block).ok()) {
+    return;
+  }
+  rep_->filter_index = new Block(block);
+  rep_->filter_type = Rep::kPartitionedFilter;
+}
+
+void Table::PrefetchFilter(const BlockHandle& filter_handle, int type) {
+  // As when the filter is kept in memory, a filter that cannot be read is
+  // ignored.
+  rep_->filter_handle = filter_handle;
+  rep_->filter_type = static_cast<Rep::FilterType>(type);
+  Cache::Handle* cache_handle;
+  if (PinMetaBlock(filter_handle, type != Rep::kPartitionedFilter,
+                   &cache_handle)
+          .ok()) {
+    rep_->options.block_cache->Release(cache_handle);
+  } else {
+    rep_->filter_type = Rep::kNoFilter;
+  }
+}
+
+static void EncodeBlockCacheKey(uint64_t cache_id, uint64_t offset,
+                                char* buffer) {
+  EncodeFixed64(buffer, cache_id);
+  EncodeFixed64(buffer + 8, offset);
+}
+
+Status Table::PinMetaBlock(const BlockHandle& handle, bool is_filter,
+                           Cache::Handle** cache_handle) const {
+  Cache* block_cache = rep_->options.block_cache;
+  char cache_key_buffer[16];
+  EncodeBlockCacheKey(rep_->cache_id, handle.offset(), cache_key_buffer);
+  Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+  *cache_handle = block_cache->Lookup(key);
+  if (*cache_handle != nullptr) {
+    return Status::OK();
+  }
+
+  ReadOptions opt;
+  if (rep_->options.paranoid_checks) {
+    opt.verify_checksums = true;
+  }
+  BlockContents contents;
+  Status s = ReadBlock(rep_->file, opt, handle, &contents);
+  if (!s.ok()) {
+    return s;
+  }
+  if (!contents.heap_allocated) {
+    // The contents point into the file (e.g. an mmap), which the cached
+    // block may outlive.
+    char* buf = new char[contents.data.size()];
+    std::memcpy(buf, contents.data.data(), contents.data.size());
+    contents.data = Slice(buf, contents.data.size());
+    contents.heap_allocated = true;
+  }
+
+  CachedMetaBlock* meta = new CachedMetaBlock;
+  if (is_filter) {
+    meta->filter_data = contents.data.data();
+    meta->filter =
+        new FilterBlockReader(rep_->options.filter_policy, contents.data,
+                              rep_->filter_type == Rep::kFullFilter);
+  } else {
+    meta->block = new Block(contents);
+  }
+  *cache_handle =
+      block_cache->Insert(key, meta, contents.data.size(),
+                          &DeleteCachedMetaBlock, Cache::kHighPriority);
+  return Status::OK();
+}
+
+FilterBlockReader* Table::PinFilter(Cache::Handle** cache_handle) const {
+  *cache_handle = nullptr;
+  if (!rep_->cache_meta_blocks) {
+    return rep_->filter;
+  }
+  if (rep_->filter_type != Rep::kBlockFilter &&
+      rep_->filter_type != Rep::kFullFilter) {
+    return nullptr;
+  }
+  if (!PinMetaBlock(rep_->filter_handle, true, cache_handle).ok()) {
+    return nullptr;  // Treated like a table without a filter
+  }
+  return reinterpret_cast<CachedMetaBlock*>(
+             rep_->options.block_cache->Value(*cache_handle))
+      ->filter;
+}
+
+Block* Table::PinFilterIndex(Cache::Handle** cache_handle) const {
+  *cache_handle = nullptr;
+  if (!rep_->cache_meta_blocks) {
+    return rep_->filter_index;
+  }
+  if (rep_->filter_type != Rep::kPartitionedFilter ||
+      !PinMetaBlock(rep_->filter_handle, false, cache_handle).ok()) {
+    return nullptr;
+  }
+  return reinterpret_cast<CachedMetaBlock*>(
+             rep_->options.block_cache->Value(*cache_handle))
+      ->block;
+}
+
+void Table::Unpin(Cache::Handle* cache_handle) const {
+  if (cache_handle != nullptr) {
+    rep_->options.block_cache->Release(cache_handle);
+  }
 }
 
-Table::~Table() { delete rep_; }
+Table::~Table() {
+  if (rep_->cache_meta_blocks) {
+    // Nothing can look up the blocks of this table once it is closed, so
+    // free their space instead of waiting for them to be evicted.
+    Cache* block_cache = rep_->options.block_cache;
+    char cache_key_buffer[16];
+    EncodeBlockCacheKey(rep_->cache_id, rep_->index_handle.offset(),
+                        cache_key_buffer);
+    block_cache->Erase(Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+    if (rep_->filter_type != Rep::kNoFilter) {
+      EncodeBlockCacheKey(rep_->cache_id, rep_->filter_handle.offset(),
+                          cache_key_buffer);
+      block_cache->Erase(Slice(cache_key_buffer, sizeof(cache_key_buffer)));
+    }
+  }
+  delete rep_;
+}
 
 static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
@@ -152,8 +443,23 @@ static void ReleaseBlock(void* arg, void* h) {
 // into an iterator over the contents of the corresponding block.
 Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
                              const Slice& index_value) {
+  return reinterpret_cast<Table*>(arg)->NewBlockIterator(
+      options, index_value, Cache::kLowPriority, false);
+}
+
+// Like BlockReader, for the index partitions of a partitioned index.
+Iterator* Table::IndexPartitionReader(void* arg, const ReadOptions& options,
+                                      const Slice& index_value) {
   Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
+  return table->NewBlockIterator(options, index_value,
+                                 table->rep_->partition_priority, false);
+}
+
+Iterator* Table::NewBlockIterator(const ReadOptions& options,
+                                  const Slice& index_value,
+                                  Cache::Priority priority,
+                                  bool point_lookup) const {
+  Cache* block_cache = rep_->options.block_cache;
   Block* block = nullptr;
   Cache::Handle* cache_handle = nullptr;
 
@@ -167,24 +473,29 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
     BlockContents contents;
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
+      EncodeFixed64(cache_key_buffer, rep_->cache_id);
       EncodeFixed64(cache_key_buffer + 8, handle.offset());
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != nullptr) {
         block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        // The lower tiers use a key that does not depend on block_cache.
+        std::string tier_key = rep_->unique_id;
+        PutFixed64(&tier_key, handle.offset());
+        s = ReadBlock(rep_->file, options, handle,
+                      rep_->options.block_cache_compressed,
+                      rep_->options.secondary_cache, tier_key, &contents);
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
             cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
+                                               &DeleteCachedBlock, priority);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(rep_->file, options, handle, &contents);
       if (s.ok()) {
         block = new Block(contents);
       }
@@ -193,7 +504,9 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
 
   Iterator* iter;
   if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    iter = point_lookup
+               ? block->NewPointLookupIterator(rep_->options.comparator)
+               : block->NewIterator(rep_->options.comparator);
     if (cache_handle == nullptr) {
       iter->RegisterCleanup(&DeleteBlock, block, nullptr);
     } else {
@@ -205,45 +518,345 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
   return iter;
 }
 
+// A filter partition held in the block cache.
+struct FilterPartition {
+  ~FilterPartition() {
+    if (contents.heap_allocated) {
+      delete[] contents.data.data();
+    }
+  }
+
+  BlockContents contents;
+};
+
+static void DeleteCachedFilterPartition(const Slice& key, void* value) {
+  delete reinterpret_cast<FilterPartition*>(value);
+}
+
+bool Table::FilterPartitionMayMatch(const ReadOptions& options,
+                                    const Slice& handle_value,
+                                    const Slice& key) const {
+  Cache* block_cache = rep_->options.block_cache;
+  BlockHandle handle;
+  Slice input = handle_value;
+  if (!handle.DecodeFrom(&input).ok()) {
+    return true;  // Errors are treated as potential matches
+  }
+
+  char cache_key_buffer[16];
+  EncodeFixed64(cache_key_buffer, rep_->cache_id);
+  EncodeFixed64(cache_key_buffer + 8, handle.offset());
+  Slice cache_key(cache_key_buffer, sizeof(cache_key_buffer));
+  Cache::Handle* cache_handle = nullptr;
+  FilterPartition* partition = nullptr;
+  if (block_cache != nullptr) {
+    cache_handle = block_cache->Lookup(cache_key);
+  }
+  if (cache_handle != nullptr) {
+    partition =
+        reinterpret_cast<FilterPartition*>(block_cache->Value(cache_handle));
+  } else {
+    partition = new FilterPartition;
+    if (!ReadBlock(rep_->file, options, handle, &partition->contents).ok()) {
+      delete partition;
+      return true;
+    }
+    if (block_cache != nullptr && partition->contents.cachable &&
+        options.fill_cache) {
+      cache_handle = block_cache->Insert(
+          cache_key, partition, partition->contents.data.size(),
+          &DeleteCachedFilterPartition, rep_->partition_priority);
+    }
+  }
+
+  FilterBlockReader reader(rep_->options.filter_policy,
+                           partition->contents.data, true);
+  const bool may_match = reader.KeyMayMatch(key);
+  if (cache_handle != nullptr) {
+    block_cache->Release(cache_handle);
+  } else {
+    delete partition;
+  }
+  return may_match;
+}
+
+bool Table::PartitionedFilterMayMatch(const ReadOptions& options,
+                                      const Slice& key) const {
+  // The partitions split the table at the same keys as the index
+  // partitions, so the first partition whose last key is >= key is the
+  // only one that may hold it.
+  Cache::Handle* cache_handle;
+  Block* filter_index = PinFilterIndex(&cache_handle);
+  if (filter_index == nullptr) {
+    return true;
+  }
+  Iterator* iter = filter_index->NewIterator(rep_->options.comparator);
+  iter->Seek(key);
+  bool may_match;
+  if (iter->Valid()) {
+    may_match = FilterPartitionMayMatch(options, iter->value(), key);
+  } else {
+    // Past the end of the table, unless the index could not be read
+    may_match = !iter->status().ok();
+  }
+  delete iter;
+  Unpin(cache_handle);
+  return may_match;
+}
+
+Iterator* Table::NewIndexIterator(const ReadOptions& options) const {
+  Iterator* iter;
+  if (rep_->cache_meta_blocks) {
+    Cache::Handle* cache_handle;
+    Status s = PinMetaBlock(rep_->index_handle, false, &cache_handle);
+    if (!s.ok()) {
+      return NewErrorIterator(s);
+    }
+    Cache* block_cache = rep_->options.block_cache;
+    Block* index_block =
+        reinterpret_cast<CachedMetaBlock*>(block_cache->Value(cache_handle))
+            ->block;
+    iter = index_block->NewIterator(rep_->options.comparator);
+    iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
+  } else {
+    iter = rep_->index_block->NewIterator(rep_->options.comparator);
+  }
+  if (rep_->index_partitioned) {
+    // The top-level index maps to index partitions, which are read like
+    // data blocks.
+    iter = NewTwoLevelIterator(iter, &Table::IndexPartitionReader,
+                               const_cast<Table*>(this), options);
+  }
+  return iter;
+}
+
+// Wraps a table iterator for ReadOptions::prefix_same_as_start.  A
+// prefix-bounded Seek() (see ReadOptions::prefix_seek) leaves the iterator
+// invalid, without reading any data block, when the filter shows that the
+// table has no key with the prefix of the target.
+class Table::PrefixSeekIterator : public Iterator {
+ public:
+  PrefixSeekIterator(const Table* table, const ReadOptions& options,
+                     Iterator* iter)
+      : table_(table), options_(options), iter_(iter), skipped_(false) {}
+
+  ~PrefixSeekIterator() override { delete iter_; }
+
+  bool Valid() const override { return !skipped_ && iter_->Valid(); }
+  void Seek(const Slice& target) override {
+    skipped_ = (options_.prefix_seek == nullptr || *options_.prefix_seek) &&
+               !table_->PrefixMayMatch(options_, target);
+    if (!skipped_) {
+      iter_->Seek(target);
+    }
+  }
+  void SeekToFirst() override {
+    skipped_ = false;
+    iter_->SeekToFirst();
+  }
+  void SeekToLast() override {
+    skipped_ = false;
+    iter_->SeekToLast();
+  }
+  void Next() override {
+    assert(Valid());
+    iter_->Next();
+  }
+  void Prev() override {
+    assert(Valid());
+    iter_->Prev();
+  }
+  Slice key() const override {
+    assert(Valid());
+    return iter_->key();
+  }
+  Slice value() const override {
+    assert(Valid());
+    return iter_->value();
+  }
+  Status status() const override { return iter_->status(); }
+
+ private:
+  const Table* const table_;
+  const ReadOptions options_;
+  Iterator* const iter_;
+  bool skipped_;
+};
+
 Iterator* Table::NewIterator(const ReadOptions& options) const {
-  return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
-      &Table::BlockReader, const_cast<Table*>(this), options);
+  Iterator* iter =
+      NewTwoLevelIterator(NewIndexIterator(options), &Table::BlockReader,
+                          const_cast<Table*>(this), options);
+  if (options.prefix_same_as_start && rep_->filter_has_prefixes) {
+    iter = new PrefixSeekIterator(this, options, iter);
+  }
+  return iter;
+}
+
+bool Table::PrefixMayMatch(const ReadOptions& options,
+                           const Slice& target) const {
+  const SliceTransform* prefix_extractor = rep_->options.prefix_extractor;
+  if (!rep_->filter_has_prefixes || !prefix_extractor->InDomain(target)) {
+    return true;
+  }
+  std::string prefix;
+  prefix_extractor->AppendFilterKey(target, &prefix);
+  const bool partitioned = (rep_->filter_type == Rep::kPartitionedFilter);
+  Cache::Handle* cache_handle;
+  FilterBlockReader* filter = nullptr;
+  Block* filter_index = nullptr;
+  if (partitioned) {
+    filter_index = PinFilterIndex(&cache_handle);
+  } else {
+    filter = PinFilter(&cache_handle);
+  }
+  if (filter == nullptr && filter_index == nullptr) {
+    return true;
+  }
+  if (filter != nullptr && filter->is_full()) {
+    const bool may_match = filter->KeyMayMatch(prefix);
+    Unpin(cache_handle);
+    return may_match;
+  }
+
+  // Keys with the prefix that are >= target start in the block (or filter
+  // partition) found by the index, unless all keys of that block are <
+  // target.  In that case they start in the following block.
+  Iterator* iiter = partitioned
+                        ? filter_index->NewIterator(rep_->options.comparator)
+                        : NewIndexIterator(options);
+  iiter->Seek(target);
+  bool may_match = false;
+  for (int i = 0; i < 2 && iiter->Valid() && !may_match; i++) {
+    if (partitioned) {
+      may_match = FilterPartitionMayMatch(options, iiter->value(), prefix);
+    } else {
+      Slice handle_value = iiter->value();
+      BlockHandle handle;
+      may_match = !handle.DecodeFrom(&handle_value).ok() ||
+                  filter->KeyMayMatch(handle.offset(), prefix);
+    }
+    iiter->Next();
+  }
+  if (!iiter->status().ok()) {
+    may_match = true;  // Let the regular iterator report the error
+  }
+  delete iiter;
+  Unpin(cache_handle);
+  return may_match;
 }
 
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
-                                                const Slice&)) {
+                                                const Slice&),
+                          Iterator** pinned) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  if (pinned != nullptr) {
+    *pinned = nullptr;
+  }
+  Cache::Handle* filter_cache_handle;
+  FilterBlockReader* filter = PinFilter(&filter_cache_handle);
+  if (filter != nullptr && filter->is_full() && !filter->KeyMayMatch(k)) {
+    Unpin(filter_cache_handle);
+    return s;  // Not found, without searching the index
+  }
+  if (rep_->filter_type == Rep::kPartitionedFilter &&
+      !PartitionedFilterMayMatch(options, k)) {
+    return s;  // Likewise
+  }
+  Iterator* iiter = NewIndexIterator(options);
   iiter->Seek(k);
   if (iiter->Valid()) {
     Slice handle_value = iiter->value();
-    FilterBlockReader* filter = rep_->filter;
     BlockHandle handle;
-    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
+    if (filter != nullptr && !filter->is_full() &&
+        handle.DecodeFrom(&handle_value).ok() &&
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
+      Iterator* block_iter = NewBlockIterator(options, iiter->value(),
+                                              Cache::kLowPriority, true);
       block_iter->Seek(k);
       if (block_iter->Valid()) {
         (*handle_result)(arg, block_iter->key(), block_iter->value());
       }
       s = block_iter->status();
+      if (pinned != nullptr && block_iter->Valid()) {
+        *pinned = block_iter;
+      } else {
+        delete block_iter;
+      }
+    }
+  }
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  Unpin(filter_cache_handle);
+  return s;
+}
+
+Status Table::InternalMultiGet(const ReadOptions& options, int n,
+                               const Slice* keys, void* const* args,
+                               void (*handle_result)(void*, const Slice&,
+                                                     const Slice&)) {
+  const Comparator* cmp = rep_->options.comparator;
+  Cache::Handle* filter_cache_handle;
+  FilterBlockReader* filter = PinFilter(&filter_cache_handle);
+  Status s;
+  Iterator* iiter = NewIndexIterator(options);
+  Iterator* block_iter = nullptr;
+  uint64_t block_offset = 0;
+  for (int i = 0; i < n && s.ok(); i++) {
+    const Slice& k = keys[i];
+    if (filter != nullptr && filter->is_full() && !filter->KeyMayMatch(k)) {
+      continue;  // Not found, without searching the index
+    }
+    if (rep_->filter_type == Rep::kPartitionedFilter &&
+        !PartitionedFilterMayMatch(options, k)) {
+      continue;  // Likewise
+    }
+    // Keys are sorted, so the index entry found for the previous key is
+    // still the right one as long as its separator is >= k.
+    if (i == 0 || !iiter->Valid() || cmp->Compare(iiter->key(), k) < 0) {
+      iiter->Seek(k);
+    }
+    if (!iiter->Valid()) {
+      break;  // All remaining keys are past the end of the table
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    if (!handle.DecodeFrom(&handle_value).ok()) {
+      s = Status::Corruption("bad block handle in table index");
+      break;
+    }
+    if (filter != nullptr && !filter->is_full() &&
+        !filter->KeyMayMatch(handle.offset(), k)) {
+      continue;  // Not found
+    }
+    if (block_iter == nullptr || block_offset != handle.offset()) {
       delete block_iter;
+      block_iter = NewBlockIterator(options, iiter->value(),
+                                    Cache::kLowPriority, true);
+      block_offset = handle.offset();
+    }
+    block_iter->Seek(k);
+    if (block_iter->Valid()) {
+      (*handle_result)(args[i], block_iter->key(), block_iter->value());
     }
+    s = block_iter->status();
   }
+  delete block_iter;
   if (s.ok()) {
     s = iiter->status();
   }
   delete iiter;
+  Unpin(filter_cache_handle);
   return s;
 }
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
-  Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* index_iter = NewIndexIterator(ReadOptions());
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
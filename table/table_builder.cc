@@ -5,11 +5,13 @@
 #include "leveldb/table_builder.h"
 
 #include <cassert>
+#include <random>
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
 #include "leveldb/options.h"
+#include "leveldb/slice_transform.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -18,6 +20,16 @@
 
 namespace leveldb {
 
+// Return a new random id for a table.
+static std::string NewTableUniqueId() {
+  std::random_device rd;
+  std::string id;
+  while (id.size() < kTableUniqueIdSize) {
+    PutFixed32(&id, rd());
+  }
+  return id;
+}
+
 struct TableBuilder::Rep {
   Rep(const Options& opt, WritableFile* f)
       : options(opt),
@@ -26,13 +38,20 @@ struct TableBuilder::Rep {
         offset(0),
         data_block(&options),
         index_block(&index_block_options),
+        top_index_block(&index_block_options),
+        filter_index_block(&index_block_options),
+        range_tombstone_block(&index_block_options),
         num_entries(0),
         closed(false),
         filter_block(opt.filter_policy == nullptr
                          ? nullptr
-                         : new FilterBlockBuilder(opt.filter_policy)),
+                         : new FilterBlockBuilder(
+                               opt.filter_policy,
+                               opt.full_filter ||
+                                   opt.partition_index_and_filters)),
         pending_index_entry(false) {
     index_block_options.block_restart_interval = 1;
+    index_block_options.data_block_hash_index = false;
   }
 
   Options options;
@@ -41,11 +60,18 @@ struct TableBuilder::Rep {
   uint64_t offset;
   Status status;
   BlockBuilder data_block;
-  BlockBuilder index_block;
+  BlockBuilder index_block;  // Current partition if partitioning the index
+
+  // If partitioning, the top-level index and filter index blocks map the
+  // last key of each partition to the location of the partition.
+  BlockBuilder top_index_block;
+  BlockBuilder filter_index_block;
+  BlockBuilder range_tombstone_block;
   std::string last_key;
   int64_t num_entries;
   bool closed;  // Either Finish() or Abandon() has been called.
-  FilterBlockBuilder* filter_block;
+  FilterBlockBuilder* filter_block;  // Current partition if partitioning
+  std::string filter_key;            // Scratch space for prefix filter keys
 
   // We do not emit the index entry for a block until we have seen the
   // first key for the next data block.  This allows us to use shorter
@@ -82,12 +108,18 @@ Status TableBuilder::ChangeOptions(const Options& options) {
   if (options.comparator != rep_->options.comparator) {
     return Status::InvalidArgument("changing comparator while building table");
   }
+  if (options.partition_index_and_filters !=
+      rep_->options.partition_index_and_filters) {
+    return Status::InvalidArgument(
+        "changing index partitioning while building table");
+  }
 
   // Note that any live BlockBuilders point to rep_->options and therefore
   // will automatically pick up the updated options.
   rep_->options = options;
   rep_->index_block_options = options;
   rep_->index_block_options.block_restart_interval = 1;
+  rep_->index_block_options.data_block_hash_index = false;
   return Status::OK();
 }
 
@@ -106,10 +138,21 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
     r->pending_handle.EncodeTo(&handle_encoding);
     r->index_block.Add(r->last_key, Slice(handle_encoding));
     r->pending_index_entry = false;
+    if (r->options.partition_index_and_filters &&
+        r->index_block.CurrentSizeEstimate() >=
+            r->options.metadata_block_size) {
+      FlushIndexPartition();
+    }
   }
 
   if (r->filter_block != nullptr) {
     r->filter_block->AddKey(key);
+    const SliceTransform* prefix_extractor = r->options.prefix_extractor;
+    if (prefix_extractor != nullptr && prefix_extractor->InDomain(key)) {
+      r->filter_key.clear();
+      prefix_extractor->AppendFilterKey(key, &r->filter_key);
+      r->filter_block->AddKey(r->filter_key);
+    }
   }
 
   r->last_key.assign(key.data(), key.size());
@@ -122,6 +165,13 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 }
 
+void TableBuilder::AddRangeTombstone(const Slice& key, const Slice& value) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  if (!ok()) return;
+  r->range_tombstone_block.Add(key, value);
+}
+
 void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
@@ -210,31 +260,108 @@ void TableBuilder::WriteRawBlock(const Slice& block_contents,
 
 Status TableBuilder::status() const { return rep_->status; }
 
+void TableBuilder::FlushIndexPartition() {
+  Rep* r = rep_;
+  assert(r->options.partition_index_and_filters);
+  if (!ok()) return;
+  BlockHandle handle;
+  std::string handle_encoding;
+  WriteBlock(&r->index_block, &handle);
+  if (ok()) {
+    handle.EncodeTo(&handle_encoding);
+    r->top_index_block.Add(r->last_key, Slice(handle_encoding));
+  }
+
+  // The filter partition holds the keys of the data blocks indexed by
+  // the index partition.
+  if (ok() && r->filter_block != nullptr) {
+    WriteRawBlock(r->filter_block->Finish(), kNoCompression, &handle);
+    handle_encoding.clear();
+    handle.EncodeTo(&handle_encoding);
+    r->filter_index_block.Add(r->last_key, Slice(handle_encoding));
+    delete r->filter_block;
+    r->filter_block = new FilterBlockBuilder(r->options.filter_policy, true);
+  }
+}
+
 Status TableBuilder::Finish() {
   Rep* r = rep_;
+  const bool partitioned = r->options.partition_index_and_filters;
   Flush();
   assert(!r->closed);
   r->closed = true;
 
-  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle,
+      range_tombstone_block_handle;
 
-  // Write filter block
-  if (ok() && r->filter_block != nullptr) {
+  // Add the index entry of the last data block
+  if (ok() && r->pending_index_entry) {
+    r->options.comparator->FindShortSuccessor(&r->last_key);
+    std::string handle_encoding;
+    r->pending_handle.EncodeTo(&handle_encoding);
+    r->index_block.Add(r->last_key, Slice(handle_encoding));
+    r->pending_index_entry = false;
+  }
+
+  if (partitioned) {
+    // Write the last index and filter partitions, then the filter index
+    if (!r->index_block.empty()) {
+      FlushIndexPartition();
+    }
+    if (ok() && r->filter_block != nullptr) {
+      WriteBlock(&r->filter_index_block, &filter_block_handle);
+    }
+  } else if (ok() && r->filter_block != nullptr) {
+    // Write filter block
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
   }
 
+  // Write range tombstone block
+  const bool has_range_tombstones = !r->range_tombstone_block.empty();
+  if (ok() && has_range_tombstones) {
+    WriteBlock(&r->range_tombstone_block, &range_tombstone_block_handle);
+  }
+
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    Options meta_index_block_options = r->options;
+    meta_index_block_options.comparator = BytewiseComparator();
+    meta_index_block_options.data_block_hash_index = false;
+    BlockBuilder meta_index_block(&meta_index_block_options);
     if (r->filter_block != nullptr) {
-      // Add mapping from "filter.Name" to location of filter data
-      std::string key = "filter.";
+      // Add mapping from "filter.Name" (or "fullfilter.Name" or
+      // "partitionedfilter.Name") to location of filter data
+      std::string key = partitioned            ? "partitionedfilter."
+                        : r->options.full_filter ? "fullfilter."
+                                                 : "filter.";
       key.append(r->options.filter_policy->Name());
       std::string handle_encoding;
       filter_block_handle.EncodeTo(&handle_encoding);
       meta_index_block.Add(key, handle_encoding);
     }
+    if (partitioned) {
+      // Record that the index block is a top-level index of partitions
+      meta_index_block.Add("partitionedindex", Slice());
+    }
+    if (r->filter_block != nullptr && r->options.prefix_extractor != nullptr) {
+      // Record that the filter also holds key prefixes
+      std::string key = "prefix.";
+      key.append(r->options.prefix_extractor->Name());
+      meta_index_block.Add(key, Slice());
+    }
+    if (has_range_tombstones) {
+      // Add mapping from "rangetombstones" to location of the tombstones
+      std::string handle_encoding;
+      range_tombstone_block_handle.EncodeTo(&handle_encoding);
+      meta_index_block.Add("rangetombstones", handle_encoding);
+    }
+    if (r->options.block_cache_compressed != nullptr ||
+        r->options.secondary_cache != nullptr) {
+      // Let the lower cache tiers find the table's blocks after a reopen.
+      // Without them the table stays identical for identical inputs.
+      meta_index_block.Add("uniqueid", NewTableUniqueId());
+    }
 
     // TODO(postrelease): Add stats and other meta blocks
     WriteBlock(&meta_index_block, &metaindex_block_handle);
@@ -242,14 +369,8 @@ Status TableBuilder::Finish() {
 
   // Write index block
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
-    }
-    WriteBlock(&r->index_block, &index_block_handle);
+    WriteBlock(partitioned ? &r->top_index_block : &r->index_block,
+               &index_block_handle);
   }
 
   // Write footer
@@ -5,16 +5,21 @@
 #include "leveldb/table.h"
 
 #include <map>
+#include <memory>
 #include <string>
 
 #include "gtest/gtest.h"
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
+#include "leveldb/secondary_cache.h"
+#include "leveldb/slice_transform.h"
 #include "leveldb/table_builder.h"
 #include "table/block.h"
 #include "table/block_builder.h"
@@ -231,6 +236,12 @@ class TableConstructor : public Constructor {
     source_ = new StringSource(sink.contents());
     Options table_options;
     table_options.comparator = options.comparator;
+    table_options.block_cache = options.block_cache;
+    table_options.block_cache_compressed = options.block_cache_compressed;
+    table_options.secondary_cache = options.secondary_cache;
+    table_options.filter_policy = options.filter_policy;
+    table_options.cache_index_and_filter_blocks =
+        options.cache_index_and_filter_blocks;
     return Table::Open(table_options, source_, sink.contents().size(), &table_);
   }
 
@@ -377,6 +388,9 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool partition_index;
+  bool cache_meta_blocks;
+  bool hash_index;
 };
 
 static const TestArgs kTestArgList[] = {
@@ -401,22 +415,53 @@ static const TestArgs kTestArgList[] = {
     // Do not bother with restart interval variations for DB
     {DB_TEST, false, 16},
     {DB_TEST, true, 16},
+
+    // Partitioned index
+    {TABLE_TEST, false, 16, true},
+    {TABLE_TEST, true, 1, true},
+    {DB_TEST, false, 16, true},
+
+    // Index and filter blocks in a block cache too small to hold them all
+    {TABLE_TEST, false, 16, false, true},
+    {TABLE_TEST, true, 1, true, true},
+    {DB_TEST, false, 16, true, true},
+
+    // Data blocks with a hash index
+    {BLOCK_TEST, false, 16, false, false, true},
+    {BLOCK_TEST, false, 1, false, false, true},
+    {TABLE_TEST, false, 16, false, false, true},
+    {TABLE_TEST, true, 16, false, false, true},
+    {DB_TEST, false, 16, false, false, true},
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
 class Harness : public testing::Test {
  public:
-  Harness() : constructor_(nullptr) {}
+  Harness()
+      : constructor_(nullptr),
+        block_cache_(nullptr),
+        filter_policy_(NewBloomFilterPolicy(10)) {}
 
   void Init(const TestArgs& args) {
     delete constructor_;
     constructor_ = nullptr;
+    delete block_cache_;
+    block_cache_ = nullptr;
     options_ = Options();
 
     options_.block_restart_interval = args.restart_interval;
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
+    options_.partition_index_and_filters = args.partition_index;
+    options_.metadata_block_size = 256;
+    options_.data_block_hash_index = args.hash_index;
+    if (args.cache_meta_blocks) {
+      block_cache_ = NewLRUCache(2048);
+      options_.block_cache = block_cache_;
+      options_.filter_policy = filter_policy_;
+      options_.cache_index_and_filter_blocks = true;
+    }
     if (args.reverse_compare) {
       options_.comparator = &reverse_key_comparator;
     }
@@ -436,7 +481,11 @@ class Harness : public testing::Test {
     }
   }
 
-  ~Harness() { delete constructor_; }
+  ~Harness() {
+    delete constructor_;
+    delete block_cache_;
+    delete filter_policy_;
+  }
 
   void Add(const std::string& key, const std::string& value) {
     constructor_->Add(key, value);
@@ -607,6 +656,8 @@ class Harness : public testing::Test {
  private:
   Options options_;
   Constructor* constructor_;
+  Cache* block_cache_;
+  const FilterPolicy* filter_policy_;
 };
 
 // Test empty table/block.
@@ -712,7 +763,7 @@ TEST_F(Harness, RandomizedLongDB) {
 
   // We must have created enough data to force merging
   int files = 0;
-  for (int level = 0; level < config::kNumLevels; level++) {
+  for (int level = 0; level < Options().num_levels; level++) {
     std::string value;
     char name[100];
     std::snprintf(name, sizeof(name), "leveldb.num-files-at-level%d", level);
@@ -722,6 +773,51 @@ TEST_F(Harness, RandomizedLongDB) {
   ASSERT_GT(files, 0);
 }
 
+TEST(BlockTest, HashIndexPointLookups) {
+  Options options;
+  options.block_restart_interval = 4;
+  options.data_block_hash_index = true;
+  BlockBuilder builder(&options);
+  char buf[20];
+  for (int i = 0; i < 200; i++) {
+    std::snprintf(buf, sizeof(buf), "key%06d", 2 * i);
+    builder.Add(buf, std::string(i % 7, 'v'));
+  }
+  BlockContents contents;
+  contents.data = builder.Finish();
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+
+  Iterator* iter = block.NewPointLookupIterator(BytewiseComparator());
+  int missing = 0;
+  for (int i = 0; i < 400; i++) {
+    std::snprintf(buf, sizeof(buf), "key%06d", i);
+    iter->Seek(buf);
+    if (i % 2 == 0) {
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(buf, iter->key().ToString());
+      ASSERT_EQ(std::string((i / 2) % 7, 'v'), iter->value().ToString());
+    } else if (iter->Valid()) {
+      // Missing keys may land on the next key
+      ASSERT_GT(iter->key().ToString(), buf);
+    } else {
+      missing++;
+    }
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  // Most missing keys are found missing without a search
+  ASSERT_GT(missing, 100);
+  delete iter;
+
+  // Regular iterators ignore the hash index
+  iter = block.NewIterator(BytewiseComparator());
+  iter->Seek("key000001");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("key000002", iter->key().ToString());
+  delete iter;
+}
+
 TEST(MemTableTest, Simple) {
   InternalKeyComparator cmp(BytewiseComparator());
   MemTable* memtable = new MemTable(cmp);
@@ -785,6 +881,91 @@ TEST(TableTest, ApproximateOffsetOfPlain) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
 }
 
+TEST(TableTest, ApproximateOffsetOfPartitioned) {
+  TableConstructor c(BytewiseComparator());
+  c.Add("k01", "hello");
+  c.Add("k02", "hello2");
+  c.Add("k03", std::string(10000, 'x'));
+  c.Add("k04", std::string(200000, 'x'));
+  c.Add("k05", std::string(300000, 'x'));
+  c.Add("k06", "hello3");
+  c.Add("k07", std::string(100000, 'x'));
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 16;  // One data block per partition
+  c.Finish(options, &keys, &kvmap);
+
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("abc"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k01"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k03"), 0, 0));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k04"), 10000, 11000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k05"), 210000, 211000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("k07"), 510000, 511000));
+  ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 610000, 612000));
+}
+
+TEST(TableTest, PrefixFilterWithReverseComparator) {
+  // The metaindex entries are ordered bytewise whatever the comparator.
+  TableConstructor c(&reverse_key_comparator);
+  for (int i = 0; i < 100; i++) {
+    c.Add("k" + std::to_string(1000 + i), "v");
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  std::unique_ptr<const FilterPolicy> policy(NewBloomFilterPolicy(10));
+  std::unique_ptr<const SliceTransform> prefix_extractor(
+      NewFixedPrefixTransform(1));
+  Options options;
+  options.comparator = &reverse_key_comparator;
+  options.filter_policy = policy.get();
+  options.prefix_extractor = prefix_extractor.get();
+  options.block_size = 256;
+  c.Finish(options, &keys, &kvmap);
+
+  std::unique_ptr<Iterator> iter(c.NewIterator());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(keys[count], iter->key().ToString());
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  ASSERT_EQ(100, count);
+}
+
+TEST(TableTest, PartitionedIndexAndFilterWithInternalKeys) {
+  // The internal key comparator ignores the last 8 bytes of each key, so
+  // it must not be used to order the entries of the metaindex block.
+  InternalKeyComparator cmp(BytewiseComparator());
+  TableConstructor c(&cmp);
+  for (int i = 0; i < 100; i++) {
+    InternalKey key("k" + std::to_string(1000 + i), 100 - i, kTypeValue);
+    c.Add(key.Encode().ToString(), "v");
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  std::unique_ptr<const FilterPolicy> policy(NewBloomFilterPolicy(10));
+  Options options;
+  options.comparator = &cmp;
+  options.filter_policy = policy.get();
+  options.block_size = 256;
+  options.partition_index_and_filters = true;
+  options.metadata_block_size = 256;
+  c.Finish(options, &keys, &kvmap);
+
+  std::unique_ptr<Iterator> iter(c.NewIterator());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(keys[count], iter->key().ToString());
+    count++;
+  }
+  ASSERT_LEVELDB_OK(iter->status());
+  ASSERT_EQ(100, count);
+}
+
 static bool CompressionSupported(CompressionType type) {
   std::string out;
   Slice in = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa";
@@ -839,4 +1020,290 @@ TEST_P(CompressionTableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+// A secondary cache that counts its hits and can corrupt the values it
+// returns.
+class CountingSecondaryCache : public SecondaryCache {
+ public:
+  CountingSecondaryCache()
+      : base_(NewMemorySecondaryCache(1 << 20)),
+        inserts_(0),
+        hits_(0),
+        corrupt_(false) {}
+  ~CountingSecondaryCache() override { delete base_; }
+
+  void Insert(const Slice& key, const Slice& value) override {
+    inserts_++;
+    base_->Insert(key, value);
+  }
+  bool Lookup(const Slice& key, std::string* value) override {
+    if (!base_->Lookup(key, value)) {
+      return false;
+    }
+    hits_++;
+    if (corrupt_) {
+      (*value)[0] ^= 0x80;
+    }
+    return true;
+  }
+  void Erase(const Slice& key) override { base_->Erase(key); }
+  size_t TotalCharge() const override { return base_->TotalCharge(); }
+
+  int inserts() const { return inserts_; }
+  int hits() const { return hits_; }
+  void set_corrupt(bool corrupt) { corrupt_ = corrupt; }
+
+ private:
+  SecondaryCache* const base_;
+  int inserts_;
+  int hits_;
+  bool corrupt_;
+};
+
+static void CheckTableContents(const TableConstructor& c, const KVMap& kvmap) {
+  Iterator* iter = c.NewIterator();
+  iter->SeekToFirst();
+  for (const auto& kvp : kvmap) {
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(kvp.first, iter->key().ToString());
+    ASSERT_EQ(kvp.second, iter->value().ToString());
+    iter->Next();
+  }
+  ASSERT_TRUE(!iter->Valid());
+  ASSERT_LEVELDB_OK(iter->status());
+  delete iter;
+}
+
+TEST(TableTest, SecondaryCache) {
+  std::unique_ptr<Cache> block_cache(NewLRUCache(0));  // Every block misses
+  CountingSecondaryCache secondary_cache;
+  Random rnd(301);
+  TableConstructor c(BytewiseComparator());
+  std::string tmp;
+  for (int i = 0; i < 100; i++) {
+    c.Add("k" + std::to_string(1000 + i),
+          test::CompressibleString(&rnd, 0.25, 1000, &tmp));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.block_cache = block_cache.get();
+  options.secondary_cache = &secondary_cache;
+  c.Finish(options, &keys, &kvmap);
+
+  // The first scan reads the blocks from the table and adds them to the
+  // secondary cache, where the second scan finds them.
+  CheckTableContents(c, kvmap);
+  const int blocks = secondary_cache.inserts();
+  ASSERT_GE(blocks, 50);
+  ASSERT_EQ(0, secondary_cache.hits());
+  CheckTableContents(c, kvmap);
+  ASSERT_EQ(blocks, secondary_cache.inserts());
+  ASSERT_EQ(blocks, secondary_cache.hits());
+
+  // Corrupted entries are dropped in favor of the table contents.
+  secondary_cache.set_corrupt(true);
+  CheckTableContents(c, kvmap);
+  ASSERT_EQ(2 * blocks, secondary_cache.inserts());
+  ASSERT_EQ(2 * blocks, secondary_cache.hits());
+}
+
+static std::string BuildTable(const Options& options) {
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  for (int i = 0; i < 100; i++) {
+    builder.Add("k" + std::to_string(1000 + i), std::string(100, 'v'));
+  }
+  EXPECT_LEVELDB_OK(builder.Finish());
+  return sink.contents();
+}
+
+TEST(TableTest, UniqueIdOnlyWithLowerCacheTiers) {
+  // Without a cache that keys blocks by a table id, identical inputs give
+  // identical tables.
+  Options options;
+  ASSERT_EQ(BuildTable(options), BuildTable(options));
+
+  CountingSecondaryCache secondary_cache;
+  options.secondary_cache = &secondary_cache;
+  ASSERT_NE(BuildTable(options), BuildTable(options));
+}
+
+TEST(TableTest, SecondaryCacheWithDB) {
+  // The default Env maps table files into memory; their blocks are added
+  // to the secondary cache too.
+  std::unique_ptr<Cache> block_cache(NewLRUCache(0));  // Every block misses
+  CountingSecondaryCache secondary_cache;
+  const std::string name = testing::TempDir() + "table_test_secondary";
+  Options options;
+  options.create_if_missing = true;
+  options.block_cache = block_cache.get();
+  options.secondary_cache = &secondary_cache;
+  ASSERT_LEVELDB_OK(DestroyDB(name, options));
+  DB* db;
+  ASSERT_LEVELDB_OK(DB::Open(options, name, &db));
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(db->Put(WriteOptions(), "k" + std::to_string(1000 + i),
+                              std::string(1000, 'a' + i % 26)));
+  }
+  db->CompactRange(nullptr, nullptr);
+
+  std::string value;
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(
+        db->Get(ReadOptions(), "k" + std::to_string(1000 + i), &value));
+  }
+  const int inserts = secondary_cache.inserts();
+  const int hits = secondary_cache.hits();
+  ASSERT_GT(inserts, 0);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(
+        db->Get(ReadOptions(), "k" + std::to_string(1000 + i), &value));
+    ASSERT_EQ(std::string(1000, 'a' + i % 26), value);
+  }
+  ASSERT_EQ(inserts, secondary_cache.inserts());
+  ASSERT_EQ(hits + 100, secondary_cache.hits());
+
+  delete db;
+  ASSERT_LEVELDB_OK(DestroyDB(name, options));
+}
+
+TEST(TableTest, SecondaryCacheSharedByDBs) {
+  // The ids that block caches hand out restart for every cache, so they
+  // do not tell apart the tables of DBs that share a secondary cache.
+  CountingSecondaryCache secondary_cache;
+  std::unique_ptr<Cache> block_caches[2];
+  std::string names[2];
+  DB* dbs[2];
+  Options options;
+  options.create_if_missing = true;
+  options.secondary_cache = &secondary_cache;
+  for (int j = 0; j < 2; j++) {
+    block_caches[j].reset(NewLRUCache(0));  // Every block misses
+    names[j] = testing::TempDir() + "table_test_shared" + std::to_string(j);
+    options.block_cache = block_caches[j].get();
+    ASSERT_LEVELDB_OK(DestroyDB(names[j], options));
+    ASSERT_LEVELDB_OK(DB::Open(options, names[j], &dbs[j]));
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(dbs[j]->Put(WriteOptions(),
+                                    "k" + std::to_string(1000 + i),
+                                    std::string(1000, 'a' + j)));
+    }
+    dbs[j]->CompactRange(nullptr, nullptr);
+  }
+
+  std::string value;
+  for (int j = 0; j < 2; j++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_LEVELDB_OK(
+          dbs[j]->Get(ReadOptions(), "k" + std::to_string(1000 + i), &value));
+      ASSERT_EQ(std::string(1000, 'a' + j), value);
+    }
+  }
+
+  // A reopened DB finds the blocks of its tables again.
+  delete dbs[0];
+  block_caches[0].reset(NewLRUCache(0));
+  options.block_cache = block_caches[0].get();
+  ASSERT_LEVELDB_OK(DB::Open(options, names[0], &dbs[0]));
+  const int inserts = secondary_cache.inserts();
+  const int hits = secondary_cache.hits();
+  for (int i = 0; i < 100; i++) {
+    ASSERT_LEVELDB_OK(
+        dbs[0]->Get(ReadOptions(), "k" + std::to_string(1000 + i), &value));
+    ASSERT_EQ(std::string(1000, 'a'), value);
+  }
+  ASSERT_EQ(inserts, secondary_cache.inserts());
+  ASSERT_EQ(hits + 100, secondary_cache.hits());
+
+  for (int j = 0; j < 2; j++) {
+    delete dbs[j];
+    ASSERT_LEVELDB_OK(DestroyDB(names[j], options));
+  }
+}
+
+TEST_P(CompressionTableTest, CompressedBlockCache) {
+  CompressionType type = ::testing::get<0>(GetParam());
+  if (!CompressionSupported(type)) {
+    GTEST_SKIP() << "skipping compression test: " << type;
+  }
+
+  std::unique_ptr<Cache> block_cache(NewLRUCache(0));  // Every block misses
+  std::unique_ptr<Cache> compressed_cache(NewLRUCache(1 << 20));
+  CountingSecondaryCache secondary_cache;
+  Random rnd(301);
+  TableConstructor c(BytewiseComparator());
+  std::string tmp;
+  for (int i = 0; i < 100; i++) {
+    c.Add("k" + std::to_string(1000 + i),
+          test::CompressibleString(&rnd, 0.25, 1000, &tmp));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = type;
+  options.block_cache = block_cache.get();
+  options.block_cache_compressed = compressed_cache.get();
+  options.secondary_cache = &secondary_cache;
+  c.Finish(options, &keys, &kvmap);
+
+  // The compressed cache serves the second scan, which reaches neither
+  // the secondary cache nor the table.
+  CheckTableContents(c, kvmap);
+  const int blocks = secondary_cache.inserts();
+  ASSERT_GE(blocks, 50);
+  ASSERT_GT(compressed_cache->TotalCharge(), 0);
+  ASSERT_LT(compressed_cache->TotalCharge(), 100 * 1000 / 2);
+  CheckTableContents(c, kvmap);
+  ASSERT_EQ(blocks, secondary_cache.inserts());
+  ASSERT_EQ(0, secondary_cache.hits());
+
+  // Blocks found in the secondary cache are added to the compressed cache.
+  compressed_cache->Prune();
+  ASSERT_EQ(0, compressed_cache->TotalCharge());
+  CheckTableContents(c, kvmap);
+  ASSERT_EQ(blocks, secondary_cache.hits());
+  CheckTableContents(c, kvmap);
+  ASSERT_EQ(blocks, secondary_cache.hits());
+  ASSERT_EQ(blocks, secondary_cache.inserts());
+}
+
+TEST_P(CompressionTableTest, CompressedBlockCacheSharedByTables) {
+  CompressionType type = ::testing::get<0>(GetParam());
+  if (!CompressionSupported(type)) {
+    GTEST_SKIP() << "skipping compression test: " << type;
+  }
+
+  // Two tables with the same layout, each with its own block cache, so
+  // that the block cache ids of their blocks are the same.
+  std::unique_ptr<Cache> compressed_cache(NewLRUCache(1 << 20));
+  std::unique_ptr<Cache> block_caches[2];
+  TableConstructor c0(BytewiseComparator()), c1(BytewiseComparator());
+  TableConstructor* constructors[2] = {&c0, &c1};
+  KVMap kvmaps[2];
+  for (int j = 0; j < 2; j++) {
+    block_caches[j].reset(NewLRUCache(0));  // Every block misses
+    for (int i = 0; i < 100; i++) {
+      constructors[j]->Add("k" + std::to_string(1000 + i),
+                           std::string(1000, 'a' + j));
+    }
+    std::vector<std::string> keys;
+    Options options;
+    options.block_size = 1024;
+    options.compression = type;
+    options.block_cache = block_caches[j].get();
+    options.block_cache_compressed = compressed_cache.get();
+    constructors[j]->Finish(options, &keys, &kvmaps[j]);
+  }
+
+  for (int j = 0; j < 2; j++) {
+    CheckTableContents(*constructors[j], kvmaps[j]);
+  }
+  ASSERT_GT(compressed_cache->TotalCharge(), 0);
+  for (int j = 0; j < 2; j++) {
+    CheckTableContents(*constructors[j], kvmaps[j]);
+  }
+}
+
 }  // namespace leveldb
@@ -4,6 +4,10 @@
 
 #include "leveldb/filter_policy.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif  // defined(__AVX2__)
+
 #include "leveldb/slice.h"
 #include "util/hash.h"
 
@@ -83,10 +87,147 @@ class BloomFilterPolicy : public FilterPolicy {
   size_t bits_per_key_;
   size_t k_;
 };
+
+// A bloom filter that keeps all probes for a key within one 64-byte block
+// of the filter, so that a lookup touches a single cache line instead of
+// up to k of them.  The block is picked with the key's hash, and the bits
+// within it with successive multiplications of a remix of that hash, which
+// lets all probes be computed in parallel.
+//
+// The filter is a sequence of 64-byte blocks followed by one byte holding
+// the number of probes.
+class BlockedBloomFilterPolicy : public FilterPolicy {
+ public:
+  explicit BlockedBloomFilterPolicy(int bits_per_key)
+      : bits_per_key_(bits_per_key) {
+    k_ = static_cast<size_t>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+    if (k_ < 1) k_ = 1;
+    if (k_ > 30) k_ = 30;
+  }
+
+  const char* Name() const override { return "leveldb.BlockedBloomFilter"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    size_t lines = (n * bits_per_key_ + kLineBits - 1) / kLineBits;
+    if (lines < 1) lines = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + lines * kLineBytes, 0);
+    dst->push_back(static_cast<char>(k_));  // Remember # of probes in filter
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      const uint32_t h = BloomHash(keys[i]);
+      char* line = array + LineIndex(h, lines) * kLineBytes;
+      uint32_t probe = ProbeHash(h);
+      for (size_t j = 0; j < k_; j++) {
+        const uint32_t bitpos = probe >> 23;  // 9 bits: 0 .. kLineBits-1
+        line[bitpos / 8] |= (1 << (bitpos % 8));
+        probe *= kMultiplier[1];
+      }
+    }
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& bloom_filter) const override {
+    const size_t len = bloom_filter.size();
+    if (len < 2) return false;
+    if ((len - 1) % kLineBytes != 0) {
+      // Not a filter built by this policy.  Consider it a match.
+      return true;
+    }
+
+    const char* array = bloom_filter.data();
+    const size_t lines = (len - 1) / kLineBytes;
+    const size_t k = array[len - 1];
+    if (k > 30) {
+      // Reserved for potentially new encodings.  Consider it a match.
+      return true;
+    }
+
+    const uint32_t h = BloomHash(key);
+    const char* line = array + LineIndex(h, lines) * kLineBytes;
+    return ProbeLine(line, ProbeHash(h), k);
+  }
+
+ private:
+  static const size_t kLineBytes = 64;
+  static const size_t kLineBits = kLineBytes * 8;
+
+  // kMultiplier[i] == kMultiplier[1]^i, so that probe i of a key uses
+  // ProbeHash(h) * kMultiplier[i].
+  static const uint32_t kMultiplier[9];
+
+  static size_t LineIndex(uint32_t h, size_t lines) {
+    // Map h uniformly onto [0, lines) without a division.
+    return static_cast<size_t>((static_cast<uint64_t>(h) * lines) >> 32);
+  }
+
+  // The block is picked by the high bits of h, so derive the probes from a
+  // full remix of it (the finalizer of MurmurHash3).
+  static uint32_t ProbeHash(uint32_t h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+  }
+
+#if defined(__AVX2__)
+  // Check eight probes at once: compute their bit positions in the lanes
+  // of a vector, gather the 32-bit words of the block that hold them and
+  // test all bits together.
+  static bool ProbeLine(const char* line, uint32_t probe, size_t k) {
+    const __m256i powers = _mm256_setr_epi32(
+        kMultiplier[0], kMultiplier[1], kMultiplier[2], kMultiplier[3],
+        kMultiplier[4], kMultiplier[5], kMultiplier[6], kMultiplier[7]);
+    const __m256i lane = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i ones = _mm256_set1_epi32(1);
+    const __m256i low5 = _mm256_set1_epi32(31);
+    for (size_t i = 0; i < k; i += 8) {
+      const __m256i hashes =
+          _mm256_mullo_epi32(_mm256_set1_epi32(probe), powers);
+      const __m256i bitpos = _mm256_srli_epi32(hashes, 23);
+      const __m256i words = _mm256_i32gather_epi32(
+          reinterpret_cast<const int*>(line), _mm256_srli_epi32(bitpos, 5), 4);
+      __m256i bits = _mm256_sllv_epi32(ones, _mm256_and_si256(bitpos, low5));
+      // Ignore the lanes past the last probe
+      bits = _mm256_and_si256(
+          bits, _mm256_cmpgt_epi32(_mm256_set1_epi32(static_cast<int>(k - i)),
+                                   lane));
+      if (!_mm256_testc_si256(words, bits)) {
+        return false;
+      }
+      probe *= kMultiplier[8];
+    }
+    return true;
+  }
+#else
+  static bool ProbeLine(const char* line, uint32_t probe, size_t k) {
+    for (size_t j = 0; j < k; j++) {
+      const uint32_t bitpos = probe >> 23;
+      if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+      probe *= kMultiplier[1];
+    }
+    return true;
+  }
+#endif  // defined(__AVX2__)
+
+  size_t bits_per_key_;
+  size_t k_;
+};
+
+const uint32_t BlockedBloomFilterPolicy::kMultiplier[9] = {
+    0x00000001, 0x9e3779b9, 0xe35e67b1, 0x734297e9, 0x35fbe861,
+    0xdeb7c719, 0x0448b211, 0x3459b749, 0xab25f4c1};
+
 }  // namespace
 
 const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BlockedBloomFilterPolicy(bits_per_key);
+}
+
 }  // namespace leveldb
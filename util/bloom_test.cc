@@ -19,7 +19,8 @@ static Slice Key(int i, char* buffer) {
 
 class BloomTest : public testing::Test {
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  BloomTest() : BloomTest(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy) : policy_(policy) {}
 
   ~BloomTest() { delete policy_; }
 
@@ -73,6 +74,8 @@ class BloomTest : public testing::Test {
     return result / 10000.0;
   }
 
+  void CheckVaryingLengths(size_t size_slack);
+
  private:
   const FilterPolicy* policy_;
   std::string filter_;
@@ -106,7 +109,12 @@ static int NextLength(int length) {
   return length;
 }
 
-TEST_F(BloomTest, VaryingLengths) {
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) {}
+};
+
+void BloomTest::CheckVaryingLengths(size_t size_slack) {
   char buffer[sizeof(int)];
 
   // Count number of filters that significantly exceed the false positive rate
@@ -120,8 +128,7 @@ TEST_F(BloomTest, VaryingLengths) {
     }
     Build();
 
-    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
-        << length;
+    ASSERT_LE(FilterSize(), (length * 10 / 8) + size_slack) << length;
 
     // All added keys must match
     for (int i = 0; i < length; i++) {
@@ -149,6 +156,44 @@ TEST_F(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters / 5);
 }
 
+TEST_F(BloomTest, VaryingLengths) { CheckVaryingLengths(40); }
+
+TEST_F(BlockedBloomTest, EmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST_F(BlockedBloomTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+// Filters are rounded up to whole 64-byte blocks.
+TEST_F(BlockedBloomTest, VaryingLengths) { CheckVaryingLengths(65); }
+
+// An xor filter with 9 bits per key is no larger and no less accurate than
+// a bloom filter with 10.  See xor_filter_test.cc for the cases that only
+// apply to xor filters.
+class XorFilterTest : public BloomTest {
+ public:
+  XorFilterTest() : BloomTest(NewXorFilterPolicy(9)) {}
+};
+
+TEST_F(XorFilterTest, Small) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST_F(XorFilterTest, VaryingLengths) { CheckVaryingLengths(50); }
+
 // Different bits-per-byte
 
 }  // namespace leveldb
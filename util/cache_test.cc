@@ -24,7 +24,7 @@ static int DecodeKey(const Slice& k) {
 static void* EncodeValue(uintptr_t v) { return reinterpret_cast<void*>(v); }
 static int DecodeValue(void* v) { return reinterpret_cast<uintptr_t>(v); }
 
-class CacheTest : public testing::Test {
+class CacheTestBase : public testing::Test {
  public:
   static void Deleter(const Slice& key, void* v) {
     current_->deleted_keys_.push_back(DecodeKey(key));
@@ -36,9 +36,9 @@ class CacheTest : public testing::Test {
   std::vector<int> deleted_values_;
   Cache* cache_;
 
-  CacheTest() : cache_(NewLRUCache(kCacheSize)) { current_ = this; }
+  explicit CacheTestBase(Cache* cache) : cache_(cache) { current_ = this; }
 
-  ~CacheTest() { delete cache_; }
+  ~CacheTestBase() { delete cache_; }
 
   int Lookup(int key) {
     Cache::Handle* handle = cache_->Lookup(EncodeKey(key));
@@ -51,20 +51,50 @@ class CacheTest : public testing::Test {
 
   void Insert(int key, int value, int charge = 1) {
     cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
-                                   &CacheTest::Deleter));
+                                   &CacheTestBase::Deleter));
+  }
+
+  void InsertHighPriority(int key, int value, int charge = 1) {
+    cache_->Release(cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
+                                   &CacheTestBase::Deleter,
+                                   Cache::kHighPriority));
   }
 
   Cache::Handle* InsertAndReturnHandle(int key, int value, int charge = 1) {
     return cache_->Insert(EncodeKey(key), EncodeValue(value), charge,
-                          &CacheTest::Deleter);
+                          &CacheTestBase::Deleter);
   }
 
   void Erase(int key) { cache_->Erase(EncodeKey(key)); }
-  static CacheTest* current_;
+  static CacheTestBase* current_;
 };
-CacheTest* CacheTest::current_;
+CacheTestBase* CacheTestBase::current_;
+
+typedef Cache* (*CacheFactory)(size_t capacity);
+
+static Cache* NewLRU(size_t capacity) { return NewLRUCache(capacity); }
+
+// A single shard gets the whole capacity, as a single LRU cache does.
+static Cache* NewClock(size_t capacity) {
+  return NewClockCache(capacity, 0, 1);
+}
 
-TEST_F(CacheTest, HitAndMiss) {
+// The cases that every cache implementation must pass.
+class CacheTest : public CacheTestBase,
+                  public testing::WithParamInterface<CacheFactory> {
+ public:
+  CacheTest() : CacheTestBase(GetParam()(kCacheSize)) {}
+};
+
+INSTANTIATE_TEST_SUITE_P(LRU, CacheTest, testing::Values(&NewLRU));
+INSTANTIATE_TEST_SUITE_P(Clock, CacheTest, testing::Values(&NewClock));
+
+class LRUCacheTest : public CacheTestBase {
+ public:
+  LRUCacheTest() : CacheTestBase(NewLRU(kCacheSize)) {}
+};
+
+TEST_P(CacheTest, HitAndMiss) {
   ASSERT_EQ(-1, Lookup(100));
 
   Insert(100, 101);
@@ -87,7 +117,7 @@ TEST_F(CacheTest, HitAndMiss) {
   ASSERT_EQ(101, deleted_values_[0]);
 }
 
-TEST_F(CacheTest, Erase) {
+TEST_P(CacheTest, Erase) {
   Erase(200);
   ASSERT_EQ(0, deleted_keys_.size());
 
@@ -106,7 +136,7 @@ TEST_F(CacheTest, Erase) {
   ASSERT_EQ(1, deleted_keys_.size());
 }
 
-TEST_F(CacheTest, EntriesArePinned) {
+TEST_P(CacheTest, EntriesArePinned) {
   Insert(100, 101);
   Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
   ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
@@ -131,7 +161,7 @@ TEST_F(CacheTest, EntriesArePinned) {
   ASSERT_EQ(102, deleted_values_[1]);
 }
 
-TEST_F(CacheTest, EvictionPolicy) {
+TEST_P(CacheTest, EvictionPolicy) {
   Insert(100, 101);
   Insert(200, 201);
   Insert(300, 301);
@@ -150,7 +180,32 @@ TEST_F(CacheTest, EvictionPolicy) {
   cache_->Release(h);
 }
 
-TEST_F(CacheTest, UseExceedsCacheSize) {
+TEST_F(LRUCacheTest, HighPriorityEntriesSurviveScans) {
+  for (int i = 0; i < 10; i++) {
+    InsertHighPriority(i, 100 + i);
+  }
+
+  // Entries of a scan are evicted before the high-priority entries, even
+  // though those were used less recently.
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    Insert(1000 + i, 2000 + i);
+  }
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(100 + i, Lookup(i));
+  }
+  ASSERT_EQ(-1, Lookup(1000));
+
+  // The high-priority entries may not take the whole cache.
+  for (int i = 0; i < 2 * kCacheSize; i++) {
+    InsertHighPriority(10000 + i, 20000 + i);
+  }
+  for (int i = 0; i < 10; i++) {
+    ASSERT_EQ(-1, Lookup(i));
+  }
+  ASSERT_EQ(20000 + 2 * kCacheSize - 1, Lookup(10000 + 2 * kCacheSize - 1));
+}
+
+TEST_P(CacheTest, UseExceedsCacheSize) {
   // Overfill the cache, keeping handles on all inserted entries.
   std::vector<Cache::Handle*> h;
   for (int i = 0; i < kCacheSize + 100; i++) {
@@ -167,7 +222,7 @@ TEST_F(CacheTest, UseExceedsCacheSize) {
   }
 }
 
-TEST_F(CacheTest, HeavyEntries) {
+TEST_P(CacheTest, HeavyEntries) {
   // Add a bunch of light and heavy entries and then count the combined
   // size of items still in the cache, which must be approximately the
   // same as the total capacity.
@@ -192,15 +247,16 @@ TEST_F(CacheTest, HeavyEntries) {
     }
   }
   ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + kCacheSize / 10);
 }
 
-TEST_F(CacheTest, NewId) {
+TEST_P(CacheTest, NewId) {
   uint64_t a = cache_->NewId();
   uint64_t b = cache_->NewId();
   ASSERT_NE(a, b);
 }
 
-TEST_F(CacheTest, Prune) {
+TEST_P(CacheTest, Prune) {
   Insert(1, 100);
   Insert(2, 200);
 
@@ -213,12 +269,13 @@ TEST_F(CacheTest, Prune) {
   ASSERT_EQ(-1, Lookup(2));
 }
 
-TEST_F(CacheTest, ZeroSizeCache) {
+TEST_P(CacheTest, ZeroSizeCache) {
   delete cache_;
-  cache_ = NewLRUCache(0);
+  cache_ = GetParam()(0);
 
   Insert(1, 100);
   ASSERT_EQ(-1, Lookup(1));
+  ASSERT_EQ(1, deleted_keys_.size());
 }
 
 }  // namespace leveldb
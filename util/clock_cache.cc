@@ -0,0 +1,452 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+
+#include "leveldb/cache.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+// CLOCK cache implementation
+//
+// Each shard keeps its entries in a fixed-size open-addressing hash table
+// with linear probing.  The state of a slot that concurrent operations
+// coordinate on is packed into a single atomic word, so that Lookup() and
+// Release() only use atomic operations and never block:
+//
+//    refs: number of references held by clients (bits 0..31)
+//    clock: CLOCK counter of the entry, 0..kMaxClock (bits 32..33)
+//    state: kEmpty, kConstruction, kVisible or kInvisible (bits 40..41)
+//
+// An unused slot is kEmpty.  The thread that moves a slot to kConstruction,
+// either from kEmpty or from an unreferenced kVisible or kInvisible entry,
+// owns it and is the only one to access the fields of the entry until it
+// moves the slot on.  kVisible entries are in the cache.  Erased entries
+// become kInvisible, and whoever releases their last reference frees them.
+//
+// Lookup() takes a reference on a slot before it checks the state and key
+// of the entry, which keeps the entry from being freed meanwhile, and
+// releases the reference if the entry does not match.  Such transient
+// references can hit a slot in any state, so the owner of a slot always
+// changes its state with additions that preserve the references.
+//
+// Each slot also counts the entries whose probe sequence passes over it,
+// so that probing for a key stops at the first slot no entry displaced.
+//
+// Insert() makes room for the new entry, both in the capacity and in the
+// table, by evicting unreferenced entries with the CLOCK algorithm: a hand
+// sweeps the table, decrementing the counter of the entries it passes and
+// evicting those whose counter is already zero.  Lookups set the counter
+// to kMaxClock, and new entries start with a higher counter if they are
+// inserted with Cache::kHighPriority.
+//
+// Entries that do not fit in the table are returned to the caller without
+// being cached, like entries of a cache of capacity zero.
+
+static const uint64_t kOneRef = 1;
+static const uint64_t kRefMask = (uint64_t{1} << 32) - 1;
+static const int kClockShift = 32;
+static const uint64_t kMaxClock = 3;
+static const uint64_t kClockMask = kMaxClock << kClockShift;
+static const int kStateShift = 40;
+
+enum SlotState : uint64_t {
+  kEmpty = 0,
+  kConstruction = 1,
+  kVisible = 2,
+  kInvisible = 3
+};
+
+inline uint64_t StateOf(uint64_t meta) { return meta >> kStateShift; }
+inline uint64_t RefsOf(uint64_t meta) { return meta & kRefMask; }
+inline uint64_t ClockOf(uint64_t meta) {
+  return (meta & kClockMask) >> kClockShift;
+}
+
+struct ClockHandle {
+  ClockHandle() : meta(0), displacements(0) {}
+
+  std::atomic<uint64_t> meta;
+  std::atomic<uint32_t> displacements;
+
+  // Only accessed by the owner of the slot, or by holders of a reference
+  // while the entry is kVisible or kInvisible.
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  char* key_data;
+  size_t key_length;
+  size_t charge;
+  uint32_t hash;
+  bool detached;  // Not in a table
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+class ClockCacheShard {
+ public:
+  ClockCacheShard()
+      : table_(nullptr),
+        mask_(0),
+        capacity_(0),
+        max_occupancy_(0),
+        usage_(0),
+        occupancy_(0),
+        clock_hand_(0) {}
+  ~ClockCacheShard();
+
+  // Separate from constructor so caller can easily make an array of shards.
+  // num_slots must be a power of two.
+  void Init(size_t capacity, size_t num_slots) {
+    capacity_ = capacity;
+    mask_ = num_slots - 1;
+    max_occupancy_ = num_slots - num_slots / 8;
+    table_ = new ClockHandle[num_slots];
+  }
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value),
+                        Cache::Priority priority);
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle);
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const { return usage_.load(std::memory_order_relaxed); }
+
+ private:
+  ClockHandle* Slot(uint32_t hash, size_t probe) const {
+    return &table_[(hash + probe) & mask_];
+  }
+
+  // Take a reference on h if it is a kVisible entry for key.
+  bool RefIfMatches(ClockHandle* h, const Slice& key, uint32_t hash);
+  void Unref(ClockHandle* h);
+
+  // Evict unreferenced entries until charge more fits in the capacity and
+  // the table has free slots, or until the hand has given every entry the
+  // chance to be evicted.
+  void EvictFor(size_t charge);
+
+  // Make the kVisible entry h kInvisible.
+  void MakeInvisible(ClockHandle* h);
+
+  // Free the entry of h, which the caller owns, and empty its slot.
+  void Free(ClockHandle* h);
+
+  ClockHandle* table_;
+  size_t mask_;
+  size_t capacity_;
+  size_t max_occupancy_;  // Keeps probe sequences short
+  std::atomic<size_t> usage_;
+  std::atomic<size_t> occupancy_;  // Number of non-empty slots
+  std::atomic<size_t> clock_hand_;
+};
+
+ClockCacheShard::~ClockCacheShard() {
+  for (size_t i = 0; i <= mask_; i++) {
+    ClockHandle* h = &table_[i];
+    const uint64_t meta = h->meta.load(std::memory_order_acquire);
+    assert(RefsOf(meta) == 0);  // Error if caller has an unreleased handle
+    if (StateOf(meta) == kVisible) {
+      (*h->deleter)(h->key(), h->value);
+      delete[] h->key_data;
+    }
+  }
+  delete[] table_;
+}
+
+bool ClockCacheShard::RefIfMatches(ClockHandle* h, const Slice& key,
+                                   uint32_t hash) {
+  if (StateOf(h->meta.load(std::memory_order_acquire)) != kVisible) {
+    return false;
+  }
+  const uint64_t old = h->meta.fetch_add(kOneRef, std::memory_order_acq_rel);
+  if (StateOf(old) == kVisible && h->hash == hash && h->key() == key) {
+    return true;
+  }
+  Unref(h);
+  return false;
+}
+
+void ClockCacheShard::Unref(ClockHandle* h) {
+  const uint64_t old = h->meta.fetch_sub(kOneRef, std::memory_order_acq_rel);
+  assert(RefsOf(old) > 0);
+  if (StateOf(old) == kInvisible && RefsOf(old) == 1) {
+    // Last reference to an erased entry.  Transient references may race
+    // with us to free it; only one of us takes the slot.
+    uint64_t expected = old - kOneRef;
+    if (h->meta.compare_exchange_strong(expected,
+                                        kConstruction << kStateShift,
+                                        std::memory_order_acq_rel)) {
+      Free(h);
+    }
+  }
+}
+
+Cache::Handle* ClockCacheShard::Lookup(const Slice& key, uint32_t hash) {
+  for (size_t probe = 0; probe <= mask_; probe++) {
+    ClockHandle* h = Slot(hash, probe);
+    if (RefIfMatches(h, key, hash)) {
+      h->meta.fetch_or(kMaxClock << kClockShift, std::memory_order_relaxed);
+      return reinterpret_cast<Cache::Handle*>(h);
+    }
+    if (h->displacements.load(std::memory_order_acquire) == 0) {
+      break;
+    }
+  }
+  return nullptr;
+}
+
+void ClockCacheShard::Release(Cache::Handle* handle) {
+  Unref(reinterpret_cast<ClockHandle*>(handle));
+}
+
+void ClockCacheShard::MakeInvisible(ClockHandle* h) {
+  uint64_t meta = h->meta.load(std::memory_order_acquire);
+  while (StateOf(meta) == kVisible) {
+    const uint64_t invisible =
+        meta + ((kInvisible - kVisible) << kStateShift) - (meta & kClockMask);
+    if (h->meta.compare_exchange_weak(meta, invisible,
+                                      std::memory_order_acq_rel)) {
+      usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+      return;
+    }
+  }
+}
+
+void ClockCacheShard::Erase(const Slice& key, uint32_t hash) {
+  for (size_t probe = 0; probe <= mask_; probe++) {
+    ClockHandle* h = Slot(hash, probe);
+    if (RefIfMatches(h, key, hash)) {
+      MakeInvisible(h);
+      Unref(h);
+    }
+    if (h->displacements.load(std::memory_order_acquire) == 0) {
+      break;
+    }
+  }
+}
+
+void ClockCacheShard::Free(ClockHandle* h) {
+  (*h->deleter)(h->key(), h->value);
+  delete[] h->key_data;
+  if (h->detached) {
+    delete h;
+    return;
+  }
+
+  // The entry no longer displaces the entries on its probe sequence
+  const size_t slot = h - table_;
+  for (size_t i = h->hash & mask_; i != slot; i = (i + 1) & mask_) {
+    table_[i].displacements.fetch_sub(1, std::memory_order_release);
+  }
+  occupancy_.fetch_sub(1, std::memory_order_relaxed);
+  h->meta.fetch_sub(kConstruction << kStateShift, std::memory_order_release);
+}
+
+void ClockCacheShard::EvictFor(size_t charge) {
+  const size_t max_steps = (kMaxClock + 1) * (mask_ + 1);
+  for (size_t step = 0; step < max_steps; step++) {
+    if (usage_.load(std::memory_order_relaxed) + charge <= capacity_ &&
+        occupancy_.load(std::memory_order_relaxed) < max_occupancy_) {
+      break;
+    }
+    ClockHandle* h =
+        &table_[clock_hand_.fetch_add(1, std::memory_order_relaxed) & mask_];
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (StateOf(meta) != kVisible || RefsOf(meta) != 0) {
+      continue;  // Empty, in use, or being changed
+    }
+    if (ClockOf(meta) > 0) {
+      h->meta.compare_exchange_strong(meta, meta - (uint64_t{1} << kClockShift),
+                                      std::memory_order_relaxed);
+    } else if (h->meta.compare_exchange_strong(meta,
+                                               kConstruction << kStateShift,
+                                               std::memory_order_acq_rel)) {
+      usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+      Free(h);
+    }
+  }
+}
+
+void ClockCacheShard::Prune() {
+  for (size_t i = 0; i <= mask_; i++) {
+    ClockHandle* h = &table_[i];
+    uint64_t meta = h->meta.load(std::memory_order_acquire);
+    if (StateOf(meta) == kVisible && RefsOf(meta) == 0 &&
+        h->meta.compare_exchange_strong(meta, kConstruction << kStateShift,
+                                        std::memory_order_acq_rel)) {
+      usage_.fetch_sub(h->charge, std::memory_order_relaxed);
+      Free(h);
+    }
+  }
+}
+
+Cache::Handle* ClockCacheShard::Insert(const Slice& key, uint32_t hash,
+                                       void* value, size_t charge,
+                                       void (*deleter)(const Slice& key,
+                                                       void* value),
+                                       Cache::Priority priority) {
+  // Replace any existing entry for key
+  Erase(key, hash);
+
+  ClockHandle* h = nullptr;
+  bool detached = false;
+  size_t probe = 0;
+  if (capacity_ > 0) {
+    EvictFor(charge);
+    for (; probe <= mask_; probe++) {
+      ClockHandle* slot = Slot(hash, probe);
+      uint64_t expected = 0;
+      if (slot->meta.compare_exchange_strong(expected,
+                                             kConstruction << kStateShift,
+                                             std::memory_order_acq_rel)) {
+        occupancy_.fetch_add(1, std::memory_order_relaxed);
+        h = slot;
+        break;
+      }
+      slot->displacements.fetch_add(1, std::memory_order_release);
+    }
+  }
+  if (h == nullptr) {
+    // No room in the table: return an entry that is not in the cache
+    for (size_t i = 0; i < probe; i++) {
+      Slot(hash, i)->displacements.fetch_sub(1, std::memory_order_release);
+    }
+    h = new ClockHandle;
+    detached = true;
+    h->meta.store(kConstruction << kStateShift, std::memory_order_relaxed);
+  }
+
+  h->value = value;
+  h->deleter = deleter;
+  h->key_data = new char[key.size()];
+  std::memcpy(h->key_data, key.data(), key.size());
+  h->key_length = key.size();
+  h->charge = charge;
+  h->hash = hash;
+  h->detached = detached;
+
+  uint64_t publish = kOneRef;  // for the returned handle.
+  if (h->detached) {
+    // Freed when the handle is released
+    publish += (kInvisible - kConstruction) << kStateShift;
+  } else {
+    const uint64_t clock = (priority == Cache::kHighPriority) ? 2 : 1;
+    publish += ((kVisible - kConstruction) << kStateShift) |
+               (clock << kClockShift);
+    usage_.fetch_add(charge, std::memory_order_relaxed);
+  }
+  h->meta.fetch_add(publish, std::memory_order_acq_rel);
+  return reinterpret_cast<Cache::Handle*>(h);
+}
+
+static const size_t kDefaultEstimatedEntryCharge = 4 * 1024;
+
+class ShardedClockCache : public Cache {
+ public:
+  ShardedClockCache(size_t capacity, int num_shard_bits,
+                    size_t estimated_entry_charge)
+      : num_shard_bits_(num_shard_bits),
+        shards_(new ClockCacheShard[size_t{1} << num_shard_bits]),
+        last_id_(0) {
+    const size_t num_shards = size_t{1} << num_shard_bits;
+    const size_t per_shard = (capacity + (num_shards - 1)) / num_shards;
+    // Size the tables for a load factor of at most 0.5 when full of
+    // entries of the estimated charge.
+    size_t num_slots = 16;
+    while (num_slots < 2 * (per_shard / estimated_entry_charge)) {
+      num_slots *= 2;
+    }
+    for (size_t s = 0; s < num_shards; s++) {
+      shards_[s].Init(per_shard, num_slots);
+    }
+  }
+  ~ShardedClockCache() override { delete[] shards_; }
+
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value)) override {
+    return Insert(key, value, charge, deleter, kLowPriority);
+  }
+  Handle* Insert(const Slice& key, void* value, size_t charge,
+                 void (*deleter)(const Slice& key, void* value),
+                 Priority priority) override {
+    const uint32_t hash = HashSlice(key);
+    return shards_[Shard(hash)].Insert(key, hash, value, charge, deleter,
+                                       priority);
+  }
+  Handle* Lookup(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    return shards_[Shard(hash)].Lookup(key, hash);
+  }
+  void Release(Handle* handle) override {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    shards_[Shard(h->hash)].Release(handle);
+  }
+  void Erase(const Slice& key) override {
+    const uint32_t hash = HashSlice(key);
+    shards_[Shard(hash)].Erase(key, hash);
+  }
+  void* Value(Handle* handle) override {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  uint64_t NewId() override {
+    return last_id_.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
+  void Prune() override {
+    for (size_t s = 0; s < (size_t{1} << num_shard_bits_); s++) {
+      shards_[s].Prune();
+    }
+  }
+  size_t TotalCharge() const override {
+    size_t total = 0;
+    for (size_t s = 0; s < (size_t{1} << num_shard_bits_); s++) {
+      total += shards_[s].TotalCharge();
+    }
+    return total;
+  }
+
+ private:
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  uint32_t Shard(uint32_t hash) const {
+    return num_shard_bits_ == 0 ? 0 : hash >> (32 - num_shard_bits_);
+  }
+
+  const int num_shard_bits_;
+  ClockCacheShard* const shards_;
+  std::atomic<uint64_t> last_id_;
+};
+
+}  // end anonymous namespace
+
+Cache* NewClockCache(size_t capacity) {
+  // Shards of at least 512KB, and at most 64 shards
+  int num_shard_bits = 0;
+  for (size_t n = capacity / (512 << 10); n > 1 && num_shard_bits < 6;
+       n /= 2) {
+    num_shard_bits++;
+  }
+  return NewClockCache(capacity, num_shard_bits, kDefaultEstimatedEntryCharge);
+}
+
+Cache* NewClockCache(size_t capacity, int num_shard_bits,
+                     size_t estimated_entry_charge) {
+  if (num_shard_bits < 0) num_shard_bits = 0;
+  if (num_shard_bits > 20) num_shard_bits = 20;
+  if (estimated_entry_charge == 0) estimated_entry_charge = 1;
+  return new ShardedClockCache(capacity, num_shard_bits,
+                               estimated_entry_charge);
+}
+
+}  // namespace leveldb
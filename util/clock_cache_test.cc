@@ -0,0 +1,91 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The cases that the clock cache shares with the LRU cache are in
+// cache_test.cc.
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/cache.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+// Conversions between numeric keys/values and the types expected by Cache.
+static std::string EncodeKey(int k) {
+  std::string result;
+  PutFixed32(&result, k);
+  return result;
+}
+static void* EncodeValue(uintptr_t v) { return reinterpret_cast<void*>(v); }
+static int DecodeValue(void* v) { return reinterpret_cast<uintptr_t>(v); }
+
+static std::atomic<int> deletions{0};
+
+static void CountingDeleter(const Slice& key, void* v) {
+  deletions.fetch_add(1, std::memory_order_relaxed);
+}
+
+TEST(ClockCacheTest, EntriesThatDoNotFitAreNotCached) {
+  // A table sized for a handful of entries of the estimated charge.
+  const int kCacheSize = 1000;
+  Cache* cache = NewClockCache(kCacheSize, 0, kCacheSize);
+
+  deletions = 0;
+  std::vector<Cache::Handle*> h;
+  for (int i = 0; i < 100; i++) {
+    h.push_back(cache->Insert(EncodeKey(1000 + i), EncodeValue(2000 + i), 1,
+                              &CountingDeleter));
+    ASSERT_EQ(2000 + i, DecodeValue(cache->Value(h[i])));
+  }
+  ASSERT_LT(cache->TotalCharge(), 100);
+  ASSERT_EQ(0, deletions.load());
+
+  for (int i = 0; i < h.size(); i++) {
+    cache->Release(h[i]);
+  }
+  ASSERT_EQ(100 - cache->TotalCharge(), deletions.load());
+  delete cache;
+}
+
+TEST(ClockCacheTest, LookupsRaceWithInserts) {
+  const int kNumThreads = 4;
+  const int kNumKeys = 500;
+  const int kOps = 20000;
+  Cache* cache = NewClockCache(kNumKeys / 2, 2, 1);
+
+  deletions = 0;
+  std::atomic<int> inserted{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kNumThreads; t++) {
+    threads.emplace_back([cache, t, &inserted]() {
+      for (int i = 0; i < kOps; i++) {
+        const int key = (i * 7 + t * 13) % kNumKeys;
+        Cache::Handle* h = cache->Lookup(EncodeKey(key));
+        if (h == nullptr) {
+          h = cache->Insert(EncodeKey(key), EncodeValue(key), 1,
+                            &CountingDeleter);
+          inserted.fetch_add(1, std::memory_order_relaxed);
+        }
+        ASSERT_EQ(key, DecodeValue(cache->Value(h)));
+        cache->Release(h);
+        if (i % 100 == 0) {
+          cache->Erase(EncodeKey(key));
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  ASSERT_LT(cache->TotalCharge(), kNumKeys);
+  delete cache;
+  ASSERT_EQ(inserted.load(), deletions.load());
+}
+
+}  // namespace leveldb
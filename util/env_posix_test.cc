@@ -212,6 +212,53 @@ TEST_F(EnvPosixTest, TestOpenOnRead) {
   ASSERT_LEVELDB_OK(env_->RemoveFile(test_file));
 }
 
+TEST_F(EnvPosixTest, TestRunScheduledInParallel) {
+  struct State {
+    port::Mutex mu;
+    port::CondVar cv;
+    bool first_started = false;
+    bool second_started = false;
+    bool first_done = false;
+
+    State() : cv(&mu) {}
+  };
+
+  // The first item can only finish once the second one has started, which
+  // requires a second background thread.
+  State state;
+  env_->IncBackgroundThreadsIfNeeded(2);
+  env_->Schedule(
+      [](void* arg) {
+        State* state = reinterpret_cast<State*>(arg);
+        state->mu.Lock();
+        state->first_started = true;
+        while (!state->second_started) {
+          state->cv.Wait();
+        }
+        state->first_done = true;
+        state->cv.SignalAll();
+        state->mu.Unlock();
+      },
+      &state);
+  env_->Schedule(
+      [](void* arg) {
+        State* state = reinterpret_cast<State*>(arg);
+        state->mu.Lock();
+        state->second_started = true;
+        state->cv.SignalAll();
+        state->mu.Unlock();
+      },
+      &state);
+
+  state.mu.Lock();
+  while (!state.first_done) {
+    state.cv.Wait();
+  }
+  ASSERT_TRUE(state.first_started);
+  ASSERT_TRUE(state.second_started);
+  state.mu.Unlock();
+}
+
 #if HAVE_O_CLOEXEC
 
 TEST_F(EnvPosixTest, TestCloseOnExecSequentialFile) {
@@ -0,0 +1,198 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limiter.h"
+
+#include <algorithm>
+#include <deque>
+
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+
+namespace leveldb {
+
+RateLimiter::~RateLimiter() = default;
+
+namespace {
+
+class GenericRateLimiter : public RateLimiter {
+ public:
+  GenericRateLimiter(Env* env, int64_t rate_bytes_per_sec,
+                     int64_t refill_period_us, int32_t fairness)
+      : env_(env),
+        refill_period_us_(std::max<int64_t>(refill_period_us, 1)),
+        refill_bytes_per_period_(std::max<int64_t>(
+            rate_bytes_per_sec * refill_period_us_ / 1000000, 1)),
+        fairness_(std::max<int32_t>(fairness, 1)),
+        rnd_(0xdeadbeef),
+        leader_active_(false),
+        available_bytes_(0),
+        next_refill_us_(0),
+        total_bytes_through_{0, 0} {}
+
+  void Request(int64_t bytes, IOPriority pri) override {
+    MutexLock l(&mu_);
+    if (queue_[kLowPriority].empty() && queue_[kHighPriority].empty()) {
+      const uint64_t now = env_->NowMicros();
+      if (now >= next_refill_us_) {
+        available_bytes_ = refill_bytes_per_period_;
+        next_refill_us_ = now + refill_period_us_;
+      }
+      if (available_bytes_ >= bytes) {
+        available_bytes_ -= bytes;
+        total_bytes_through_[pri] += bytes;
+        return;
+      }
+    }
+
+    Req r(bytes, &mu_);
+    queue_[pri].push_back(&r);
+    while (!r.granted) {
+      if (leader_active_) {
+        r.cv.Wait();
+        continue;
+      }
+
+      // Become the leader: wait for the next refill and hand out the new
+      // bytes to the queued requests, ourselves included.
+      leader_active_ = true;
+      const uint64_t now = env_->NowMicros();
+      if (now < next_refill_us_) {
+        mu_.Unlock();
+        env_->SleepForMicroseconds(static_cast<int>(next_refill_us_ - now));
+        mu_.Lock();
+      }
+      Refill();
+      leader_active_ = false;
+    }
+
+    // Hand over the leadership to a request that is still waiting.
+    for (int p = kNumPriorities - 1; p >= 0; p--) {
+      if (!queue_[p].empty()) {
+        queue_[p].front()->cv.Signal();
+        break;
+      }
+    }
+  }
+
+  int64_t GetSingleBurstBytes() const override {
+    return refill_bytes_per_period_;
+  }
+
+  int64_t GetTotalBytesThrough(IOPriority pri) const override {
+    MutexLock l(&mu_);
+    return total_bytes_through_[pri];
+  }
+
+ private:
+  struct Req {
+    Req(int64_t bytes, port::Mutex* mu)
+        : bytes(bytes), granted(false), cv(mu) {}
+
+    int64_t bytes;  // Bytes not granted yet
+    bool granted;
+    port::CondVar cv;
+  };
+
+  void Refill() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    next_refill_us_ = env_->NowMicros() + refill_period_us_;
+    available_bytes_ = refill_bytes_per_period_;
+
+    // Serve the high priority queue first, except on one refill in
+    // every fairness_ so that low priority requests are not starved.
+    const bool low_first = rnd_.OneIn(fairness_);
+    for (int i = 0; i < kNumPriorities; i++) {
+      const IOPriority pri =
+          (low_first == (i == 0)) ? kLowPriority : kHighPriority;
+      std::deque<Req*>* queue = &queue_[pri];
+      while (!queue->empty()) {
+        Req* next = queue->front();
+        if (available_bytes_ < next->bytes) {
+          // Grant a part now and the rest on later refills.
+          next->bytes -= available_bytes_;
+          total_bytes_through_[pri] += available_bytes_;
+          available_bytes_ = 0;
+          break;
+        }
+        available_bytes_ -= next->bytes;
+        total_bytes_through_[pri] += next->bytes;
+        next->granted = true;
+        next->cv.Signal();
+        queue->pop_front();
+      }
+      if (available_bytes_ == 0) {
+        break;
+      }
+    }
+  }
+
+  Env* const env_;
+  const int64_t refill_period_us_;
+  const int64_t refill_bytes_per_period_;
+  const int32_t fairness_;
+
+  mutable port::Mutex mu_;
+  Random rnd_ GUARDED_BY(mu_);
+  bool leader_active_ GUARDED_BY(mu_);
+  int64_t available_bytes_ GUARDED_BY(mu_);
+  uint64_t next_refill_us_ GUARDED_BY(mu_);
+  int64_t total_bytes_through_[kNumPriorities] GUARDED_BY(mu_);
+  std::deque<Req*> queue_[kNumPriorities] GUARDED_BY(mu_);
+};
+
+class RateLimitedWritableFile : public WritableFile {
+ public:
+  RateLimitedWritableFile(WritableFile* base, RateLimiter* limiter,
+                          RateLimiter::IOPriority pri)
+      : base_(base), limiter_(limiter), pri_(pri) {}
+
+  ~RateLimitedWritableFile() override { delete base_; }
+
+  Status Append(const Slice& data) override {
+    const size_t burst = static_cast<size_t>(limiter_->GetSingleBurstBytes());
+    Slice left = data;
+    Status s;
+    while (s.ok() && !left.empty()) {
+      const size_t n = std::min(left.size(), burst);
+      limiter_->Request(static_cast<int64_t>(n), pri_);
+      s = base_->Append(Slice(left.data(), n));
+      left.remove_prefix(n);
+    }
+    return s;
+  }
+
+  Status Close() override { return base_->Close(); }
+  Status Flush() override { return base_->Flush(); }
+  Status Sync() override { return base_->Sync(); }
+
+ private:
+  WritableFile* const base_;
+  RateLimiter* const limiter_;
+  const RateLimiter::IOPriority pri_;
+};
+
+}  // namespace
+
+RateLimiter* NewGenericRateLimiter(Env* env, int64_t rate_bytes_per_sec,
+                                   int64_t refill_period_us, int32_t fairness) {
+  return new GenericRateLimiter(env, rate_bytes_per_sec, refill_period_us,
+                                fairness);
+}
+
+RateLimiter* NewGenericRateLimiter(int64_t rate_bytes_per_sec,
+                                   int64_t refill_period_us, int32_t fairness) {
+  return NewGenericRateLimiter(Env::Default(), rate_bytes_per_sec,
+                               refill_period_us, fairness);
+}
+
+WritableFile* NewRateLimitedWritableFile(WritableFile* base,
+                                         RateLimiter* limiter,
+                                         RateLimiter::IOPriority pri) {
+  return new RateLimitedWritableFile(base, limiter, pri);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,27 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+#define STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
+
+#include "leveldb/rate_limiter.h"
+
+namespace leveldb {
+
+class Env;
+class WritableFile;
+
+// Return a token bucket rate limiter that reads the time from "env".
+RateLimiter* NewGenericRateLimiter(Env* env, int64_t rate_bytes_per_sec,
+                                   int64_t refill_period_us, int32_t fairness);
+
+// Return a file that asks "limiter" for permission at priority "pri"
+// before appending to "base".  The result takes ownership of "base".
+WritableFile* NewRateLimitedWritableFile(WritableFile* base,
+                                         RateLimiter* limiter,
+                                         RateLimiter::IOPriority pri);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_RATE_LIMITER_H_
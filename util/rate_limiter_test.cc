@@ -0,0 +1,119 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/rate_limiter.h"
+
+#include <atomic>
+#include <memory>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+// An Env whose clock only moves when somebody sleeps.
+class ManualClockEnv : public EnvWrapper {
+ public:
+  ManualClockEnv() : EnvWrapper(Env::Default()), now_micros_(0) {}
+
+  uint64_t NowMicros() override { return now_micros_.load(); }
+
+  void SleepForMicroseconds(int micros) override {
+    now_micros_.fetch_add(micros);
+  }
+
+ private:
+  std::atomic<uint64_t> now_micros_;
+};
+
+TEST(RateLimiterTest, SingleBurstBytes) {
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(1 << 20, 100 * 1000, 10));
+  ASSERT_EQ((1 << 20) / 10, limiter->GetSingleBurstBytes());
+}
+
+TEST(RateLimiterTest, Rate) {
+  ManualClockEnv env;
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(&env, 1000, 100 * 1000, 10));
+  ASSERT_EQ(100, limiter->GetSingleBurstBytes());
+
+  // The first burst is available right away.
+  limiter->Request(100, RateLimiter::kHighPriority);
+  ASSERT_EQ(0, env.NowMicros());
+
+  // Every further burst takes a refill period.
+  for (int i = 0; i < 10; i++) {
+    limiter->Request(50, RateLimiter::kLowPriority);
+  }
+  ASSERT_EQ(500 * 1000, env.NowMicros());
+
+  // Large requests are granted over several refills.
+  limiter->Request(1000, RateLimiter::kHighPriority);
+  ASSERT_EQ(1500 * 1000, env.NowMicros());
+
+  ASSERT_EQ(1100, limiter->GetTotalBytesThrough(RateLimiter::kHighPriority));
+  ASSERT_EQ(500, limiter->GetTotalBytesThrough(RateLimiter::kLowPriority));
+}
+
+namespace {
+
+struct RequestState {
+  RateLimiter* limiter;
+  RateLimiter::IOPriority pri;
+  int requests;
+  port::Mutex mu;
+  port::CondVar cv{&mu};
+  bool done = false;
+  int64_t other_bytes_at_done = 0;
+};
+
+void RequestLoop(void* arg) {
+  RequestState* state = reinterpret_cast<RequestState*>(arg);
+  const int64_t burst = state->limiter->GetSingleBurstBytes();
+  for (int i = 0; i < state->requests; i++) {
+    state->limiter->Request(burst, state->pri);
+  }
+  const RateLimiter::IOPriority other =
+      state->pri == RateLimiter::kHighPriority ? RateLimiter::kLowPriority
+                                               : RateLimiter::kHighPriority;
+  MutexLock l(&state->mu);
+  state->other_bytes_at_done = state->limiter->GetTotalBytesThrough(other);
+  state->done = true;
+  state->cv.Signal();
+}
+
+}  // namespace
+
+TEST(RateLimiterTest, HighPriorityFirst) {
+  const int kRequests = 20;
+  std::unique_ptr<RateLimiter> limiter(
+      NewGenericRateLimiter(1 << 20, 10 * 1000, 10));
+  const int64_t burst = limiter->GetSingleBurstBytes();
+
+  RequestState high, low;
+  high.limiter = low.limiter = limiter.get();
+  high.requests = low.requests = kRequests;
+  high.pri = RateLimiter::kHighPriority;
+  low.pri = RateLimiter::kLowPriority;
+  Env::Default()->StartThread(&RequestLoop, &low);
+  Env::Default()->StartThread(&RequestLoop, &high);
+  for (RequestState* state : {&high, &low}) {
+    MutexLock l(&state->mu);
+    while (!state->done) {
+      state->cv.Wait();
+    }
+  }
+
+  ASSERT_EQ(kRequests * burst,
+            limiter->GetTotalBytesThrough(RateLimiter::kHighPriority));
+  ASSERT_EQ(kRequests * burst,
+            limiter->GetTotalBytesThrough(RateLimiter::kLowPriority));
+  // High priority requests were served first.
+  ASSERT_LT(high.other_bytes_at_done, kRequests * burst);
+}
+
+}  // namespace leveldb
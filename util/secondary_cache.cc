@@ -0,0 +1,344 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/secondary_cache.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "leveldb/cache.h"
+#include "leveldb/env.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/logging.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+SecondaryCache::~SecondaryCache() = default;
+
+namespace {
+
+class MemorySecondaryCache : public SecondaryCache {
+ public:
+  explicit MemorySecondaryCache(size_t capacity)
+      : cache_(NewLRUCache(capacity)) {}
+  ~MemorySecondaryCache() override { delete cache_; }
+
+  void Insert(const Slice& key, const Slice& value) override {
+    std::string* copy = new std::string(value.data(), value.size());
+    cache_->Release(cache_->Insert(key, copy, copy->size(), &DeleteValue));
+  }
+
+  bool Lookup(const Slice& key, std::string* value) override {
+    Cache::Handle* handle = cache_->Lookup(key);
+    if (handle == nullptr) {
+      return false;
+    }
+    *value = *reinterpret_cast<std::string*>(cache_->Value(handle));
+    cache_->Release(handle);
+    return true;
+  }
+
+  void Erase(const Slice& key) override { cache_->Erase(key); }
+
+  size_t TotalCharge() const override { return cache_->TotalCharge(); }
+
+ private:
+  static void DeleteValue(const Slice& key, void* value) {
+    delete reinterpret_cast<std::string*>(value);
+  }
+
+  Cache* const cache_;
+};
+
+static const char kSuffix[] = ".scache";
+static const char kLockFileName[] = "/scache.lock";
+
+// FileSecondaryCache appends values to a log of segment files.  The
+// segment being filled is kept in memory; once full, it is written out
+// as a file and a new segment is started.  When the segments exceed the
+// capacity, the oldest one is dropped along with all its entries.
+class FileSecondaryCache : public SecondaryCache {
+ public:
+  FileSecondaryCache(Env* env, const std::string& dir, size_t capacity)
+      : env_(env),
+        dir_(dir),
+        segment_size_(std::min<size_t>(std::max<size_t>(capacity / 16, 1),
+                                       64 << 20)),
+        max_segments_(std::max<size_t>(capacity / segment_size_, 1)),
+        capacity_(capacity),
+        lock_(nullptr),
+        next_segment_number_(1),
+        usage_(0) {
+    MutexLock l(&mu_);
+    segments_.push_back(NewSegment());
+  }
+
+  ~FileSecondaryCache() override {
+    MutexLock l(&mu_);
+    while (!segments_.empty()) {
+      DropOldestSegment();
+    }
+    if (lock_ != nullptr) {
+      env_->UnlockFile(lock_);
+    }
+  }
+
+  // Take ownership of dir_, and remove the segment files left in it by a
+  // previous cache.  Other files are left alone.
+  Status Open() {
+    Status s = env_->LockFile(dir_ + kLockFileName, &lock_);
+    if (!s.ok()) {
+      return s;
+    }
+    std::vector<std::string> children;
+    s = env_->GetChildren(dir_, &children);
+    for (size_t i = 0; s.ok() && i < children.size(); i++) {
+      Slice name(children[i]);
+      uint64_t number;
+      if (ConsumeDecimalNumber(&name, &number) && name == Slice(kSuffix)) {
+        s = env_->RemoveFile(dir_ + "/" + children[i]);
+      }
+    }
+    return s;
+  }
+
+  void Insert(const Slice& key, const Slice& value) override {
+    if (capacity_ == 0 || value.size() > segment_size_) {
+      return;
+    }
+
+    MutexLock l(&mu_);
+    while (segments_.back()->data.size() + value.size() > segment_size_) {
+      SealActiveSegment();
+    }
+    // Only now, since SealActiveSegment() lets other inserts of key in.
+    EraseLocked(key);
+    Segment* segment = segments_.back();
+    Location& location = index_[key.ToString()];
+    location.segment = segment;
+    location.offset = segment->data.size();
+    location.size = value.size();
+    segment->data.append(value.data(), value.size());
+    segment->keys.push_back(key.ToString());
+    usage_ += value.size();
+  }
+
+  bool Lookup(const Slice& key, std::string* value) override {
+    mu_.Lock();
+    auto iter = index_.find(key.ToString());
+    if (iter == index_.end()) {
+      mu_.Unlock();
+      return false;
+    }
+    const Location location = iter->second;
+    Segment* segment = location.segment;
+    if (segment->file == nullptr) {
+      // Not written out yet
+      value->assign(segment->data.data() + location.offset, location.size);
+      mu_.Unlock();
+      return true;
+    }
+    segment->refs++;
+    mu_.Unlock();
+
+    value->resize(location.size);
+    Slice result;
+    Status s = segment->file->Read(location.offset, location.size, &result,
+                                   &(*value)[0]);
+    if (s.ok() && result.size() == location.size) {
+      if (result.data() != value->data()) {
+        value->assign(result.data(), result.size());
+      }
+    } else {
+      s = Status::Corruption("short read of secondary cache segment");
+    }
+
+    mu_.Lock();
+    if (!s.ok()) {
+      // Keep any entry that replaced the one we failed to read
+      iter = index_.find(key.ToString());
+      if (iter != index_.end() && iter->second.segment == segment &&
+          iter->second.offset == location.offset) {
+        usage_ -= iter->second.size;
+        index_.erase(iter);
+      }
+    }
+    Unref(segment);
+    mu_.Unlock();
+    return s.ok();
+  }
+
+  void Erase(const Slice& key) override {
+    MutexLock l(&mu_);
+    EraseLocked(key);
+  }
+
+  size_t TotalCharge() const override {
+    MutexLock l(&mu_);
+    return usage_;
+  }
+
+ private:
+  struct Segment {
+    uint64_t number;
+    int refs;      // One for segments_, one per reader or writer
+    bool dropped;  // No longer in segments_
+    bool written;  // The file of the segment exists
+
+    // The contents of the segment until the file is readable.  Only
+    // appended to while the segment is the last of segments_.
+    std::string data;
+    RandomAccessFile* file;
+
+    // Keys of the entries stored in the segment, some of which may have
+    // been erased or stored again in a later segment since.
+    std::vector<std::string> keys;
+  };
+
+  struct Location {
+    Segment* segment;
+    uint32_t offset;
+    uint32_t size;
+  };
+
+  std::string SegmentFileName(uint64_t number) const {
+    char buf[100];
+    std::snprintf(buf, sizeof(buf), "/%06llu",
+                  static_cast<unsigned long long>(number));
+    return dir_ + buf + kSuffix;
+  }
+
+  Segment* NewSegment() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    Segment* segment = new Segment;
+    segment->number = next_segment_number_++;
+    segment->refs = 1;
+    segment->dropped = false;
+    segment->written = false;
+    segment->file = nullptr;
+    return segment;
+  }
+
+  void EraseLocked(const Slice& key) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    auto iter = index_.find(key.ToString());
+    if (iter != index_.end()) {
+      usage_ -= iter->second.size;
+      index_.erase(iter);
+    }
+  }
+
+  void Unref(Segment* segment) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    assert(segment->refs > 0);
+    if (--segment->refs == 0) {
+      delete segment->file;
+      if (segment->written) {
+        env_->RemoveFile(SegmentFileName(segment->number));
+      }
+      delete segment;
+    }
+  }
+
+  // Erase the entries stored in segment.
+  void EraseEntries(Segment* segment) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    for (const std::string& key : segment->keys) {
+      auto iter = index_.find(key);
+      if (iter != index_.end() && iter->second.segment == segment) {
+        usage_ -= iter->second.size;
+        index_.erase(iter);
+      }
+    }
+    segment->keys.clear();
+  }
+
+  void DropOldestSegment() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    Segment* segment = segments_.front();
+    segments_.pop_front();
+    EraseEntries(segment);
+    segment->dropped = true;
+    Unref(segment);
+  }
+
+  // Start a new segment, and write out the one that was being filled.
+  // Releases mu_ while writing, so that other operations can proceed.
+  void SealActiveSegment() EXCLUSIVE_LOCKS_REQUIRED(mu_) {
+    Segment* segment = segments_.back();
+    segments_.push_back(NewSegment());
+    while (segments_.size() > max_segments_) {
+      DropOldestSegment();
+    }
+    if (segment->dropped) {
+      return;
+    }
+
+    // Entries of the segment are served from segment->data until the
+    // file is readable, and nothing appends to it anymore.
+    segment->refs++;
+    segment->written = true;
+    mu_.Unlock();
+    const std::string fname = SegmentFileName(segment->number);
+    WritableFile* writable;
+    RandomAccessFile* file = nullptr;
+    Status s = env_->NewWritableFile(fname, &writable);
+    if (s.ok()) {
+      s = writable->Append(segment->data);
+      if (s.ok()) {
+        s = writable->Close();
+      }
+      delete writable;
+    }
+    if (s.ok()) {
+      s = env_->NewRandomAccessFile(fname, &file);
+    }
+    mu_.Lock();
+
+    if (s.ok()) {
+      segment->file = file;
+    } else {
+      // Drop the entries of the segment rather than keep them in memory.
+      EraseEntries(segment);
+    }
+    std::string().swap(segment->data);
+    Unref(segment);
+  }
+
+  Env* const env_;
+  const std::string dir_;
+  const size_t segment_size_;
+  const size_t max_segments_;
+  const size_t capacity_;
+  FileLock* lock_;
+
+  mutable port::Mutex mu_;
+  uint64_t next_segment_number_ GUARDED_BY(mu_);
+  std::deque<Segment*> segments_ GUARDED_BY(mu_);  // Oldest first
+  std::map<std::string, Location> index_ GUARDED_BY(mu_);
+  size_t usage_ GUARDED_BY(mu_);
+};
+
+}  // end anonymous namespace
+
+SecondaryCache* NewMemorySecondaryCache(size_t capacity) {
+  return new MemorySecondaryCache(capacity);
+}
+
+Status NewFileSecondaryCache(Env* env, const std::string& dir,
+                             size_t capacity, SecondaryCache** result) {
+  *result = nullptr;
+  env->CreateDir(dir);  // Ignore error from CreateDir
+  FileSecondaryCache* cache = new FileSecondaryCache(env, dir, capacity);
+  Status s = cache->Open();
+  if (s.ok()) {
+    *result = cache;
+  } else {
+    delete cache;
+  }
+  return s;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,251 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/secondary_cache.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "leveldb/env.h"
+#include "util/testutil.h"
+
+namespace leveldb {
+
+static std::string Key(int i) { return "key" + std::to_string(i); }
+
+static std::string Value(int i, size_t size) {
+  std::string result = std::to_string(i);
+  result.resize(size, 'x');
+  return result;
+}
+
+static std::string Get(SecondaryCache* cache, int i) {
+  std::string value;
+  return cache->Lookup(Key(i), &value) ? value : "NOT_FOUND";
+}
+
+TEST(SecondaryCacheTest, Memory) {
+  std::unique_ptr<SecondaryCache> cache(NewMemorySecondaryCache(100000));
+  ASSERT_EQ("NOT_FOUND", Get(cache.get(), 1));
+
+  cache->Insert(Key(1), Value(1, 100));
+  cache->Insert(Key(2), Value(2, 100));
+  ASSERT_EQ(Value(1, 100), Get(cache.get(), 1));
+  ASSERT_EQ(Value(2, 100), Get(cache.get(), 2));
+  ASSERT_EQ(200, cache->TotalCharge());
+
+  cache->Insert(Key(1), Value(1, 50));
+  ASSERT_EQ(Value(1, 50), Get(cache.get(), 1));
+  ASSERT_EQ(150, cache->TotalCharge());
+
+  cache->Erase(Key(2));
+  ASSERT_EQ("NOT_FOUND", Get(cache.get(), 2));
+  ASSERT_EQ(50, cache->TotalCharge());
+
+  // The capacity bounds the size of the values kept.
+  for (int i = 0; i < 10000; i++) {
+    cache->Insert(Key(i), Value(i, 100));
+  }
+  ASSERT_LE(cache->TotalCharge(), 100000);
+  ASSERT_EQ(Value(9999, 100), Get(cache.get(), 9999));
+}
+
+class FileSecondaryCacheTest : public testing::Test {
+ public:
+  FileSecondaryCacheTest() : env_(Env::Default()) {
+    EXPECT_LEVELDB_OK(env_->GetTestDirectory(&dir_));
+    dir_ += "/file_secondary_cache_test";
+  }
+
+  ~FileSecondaryCacheTest() override {
+    env_->RemoveFile(dir_ + "/scache.lock");  // Ignore error
+    env_->RemoveDir(dir_);                    // Ignore error
+  }
+
+  // Return the number of segment files in dir_.
+  int CountSegmentFiles() {
+    std::vector<std::string> children;
+    EXPECT_LEVELDB_OK(env_->GetChildren(dir_, &children));
+    int count = 0;
+    for (const std::string& child : children) {
+      if (child.size() > 7 && child.substr(child.size() - 7) == ".scache") {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  Env* const env_;
+  std::string dir_;
+};
+
+TEST_F(FileSecondaryCacheTest, InsertLookupErase) {
+  // 16 segments of 1000 bytes
+  SecondaryCache* cache;
+  ASSERT_LEVELDB_OK(NewFileSecondaryCache(env_, dir_, 16000, &cache));
+  ASSERT_EQ("NOT_FOUND", Get(cache, 1));
+
+  // Three values per segment, so most of them are written out.
+  for (int i = 0; i < 30; i++) {
+    cache->Insert(Key(i), Value(i, 300));
+  }
+  ASSERT_EQ(9, CountSegmentFiles());
+  ASSERT_EQ(30 * 300, cache->TotalCharge());
+  for (int i = 0; i < 30; i++) {
+    ASSERT_EQ(Value(i, 300), Get(cache, i));
+  }
+
+  // Replaced and erased values.
+  cache->Insert(Key(3), Value(3, 200));
+  ASSERT_EQ(Value(3, 200), Get(cache, 3));
+  cache->Erase(Key(4));
+  ASSERT_EQ("NOT_FOUND", Get(cache, 4));
+  ASSERT_EQ(28 * 300 + 200, cache->TotalCharge());
+
+  // Values larger than a segment are not stored.
+  cache->Insert(Key(100), Value(100, 2000));
+  ASSERT_EQ("NOT_FOUND", Get(cache, 100));
+
+  delete cache;
+  ASSERT_EQ(0, CountSegmentFiles());
+}
+
+TEST_F(FileSecondaryCacheTest, EvictsOldestSegments) {
+  SecondaryCache* cache;
+  ASSERT_LEVELDB_OK(NewFileSecondaryCache(env_, dir_, 16000, &cache));
+
+  for (int i = 0; i < 300; i++) {
+    cache->Insert(Key(i), Value(i, 300));
+  }
+  ASSERT_LE(cache->TotalCharge(), 16000);
+  ASSERT_LE(CountSegmentFiles(), 16);
+  ASSERT_EQ("NOT_FOUND", Get(cache, 0));
+  ASSERT_EQ("NOT_FOUND", Get(cache, 200));
+  for (int i = 260; i < 300; i++) {
+    ASSERT_EQ(Value(i, 300), Get(cache, i));
+  }
+  delete cache;
+}
+
+// Inserts a value into a cache while the cache writes out a segment.
+class InsertOnWriteEnv : public EnvWrapper {
+ public:
+  explicit InsertOnWriteEnv(Env* base) : EnvWrapper(base), cache_(nullptr) {}
+
+  void InsertOnNextWrite(SecondaryCache* cache, int i, size_t size) {
+    cache_ = cache;
+    i_ = i;
+    size_ = size;
+  }
+
+  Status NewWritableFile(const std::string& f, WritableFile** r) override {
+    if (cache_ != nullptr) {
+      SecondaryCache* cache = cache_;
+      cache_ = nullptr;
+      cache->Insert(Key(i_), Value(i_, size_));
+    }
+    return target()->NewWritableFile(f, r);
+  }
+
+ private:
+  SecondaryCache* cache_;
+  int i_;
+  size_t size_;
+};
+
+TEST_F(FileSecondaryCacheTest, InsertWhileWriting) {
+  InsertOnWriteEnv env(env_);
+  SecondaryCache* cache;
+  ASSERT_LEVELDB_OK(NewFileSecondaryCache(&env, dir_, 16000, &cache));
+
+  // Writing out the first segment lets a second insert of key 2 in
+  // before the first one completes.
+  cache->Insert(Key(1), Value(1, 600));
+  env.InsertOnNextWrite(cache, 2, 600);
+  cache->Insert(Key(2), Value(2, 500));
+  ASSERT_EQ(Value(2, 500), Get(cache, 2));
+  ASSERT_EQ(600 + 500, cache->TotalCharge());
+  delete cache;
+}
+
+// Fails the reads of segment files, and inserts a value into a cache
+// while it reads.
+class FailReadEnv : public EnvWrapper {
+ public:
+  explicit FailReadEnv(Env* base) : EnvWrapper(base), cache_(nullptr) {}
+
+  void InsertOnNextRead(SecondaryCache* cache, int i, size_t size) {
+    cache_ = cache;
+    i_ = i;
+    size_ = size;
+  }
+
+  Status NewRandomAccessFile(const std::string& f,
+                             RandomAccessFile** r) override {
+    class FailReadFile : public RandomAccessFile {
+     public:
+      explicit FailReadFile(FailReadEnv* env) : env_(env) {}
+      Status Read(uint64_t offset, size_t n, Slice* result,
+                  char* scratch) const override {
+        if (env_->cache_ != nullptr) {
+          SecondaryCache* cache = env_->cache_;
+          env_->cache_ = nullptr;
+          cache->Insert(Key(env_->i_), Value(env_->i_, env_->size_));
+        }
+        return Status::IOError("injected read error");
+      }
+
+     private:
+      FailReadEnv* const env_;
+    };
+    *r = new FailReadFile(this);
+    return Status::OK();
+  }
+
+ private:
+  SecondaryCache* cache_;
+  int i_;
+  size_t size_;
+};
+
+TEST_F(FileSecondaryCacheTest, ReadErrorKeepsNewerValue) {
+  FailReadEnv env(env_);
+  SecondaryCache* cache;
+  ASSERT_LEVELDB_OK(NewFileSecondaryCache(&env, dir_, 16000, &cache));
+
+  // The value of key 1 is written out, and replaced while it is read.
+  cache->Insert(Key(1), Value(1, 600));
+  cache->Insert(Key(2), Value(2, 600));
+  env.InsertOnNextRead(cache, 1, 500);
+  ASSERT_EQ("NOT_FOUND", Get(cache, 1));
+  ASSERT_EQ(Value(1, 500), Get(cache, 1));
+  ASSERT_EQ(500 + 600, cache->TotalCharge());
+  delete cache;
+}
+
+TEST_F(FileSecondaryCacheTest, RemovesStaleFiles) {
+  env_->CreateDir(dir_);
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, "stale", dir_ + "/000001.scache"));
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, "other", dir_ + "/other"));
+  ASSERT_LEVELDB_OK(
+      WriteStringToFile(env_, "other", dir_ + "/other.scache"));
+
+  SecondaryCache* cache;
+  ASSERT_LEVELDB_OK(NewFileSecondaryCache(env_, dir_, 16000, &cache));
+  ASSERT_TRUE(!env_->FileExists(dir_ + "/000001.scache"));
+  ASSERT_TRUE(env_->FileExists(dir_ + "/other"));
+  ASSERT_TRUE(env_->FileExists(dir_ + "/other.scache"));
+
+  // A second cache may not use the directory meanwhile.
+  SecondaryCache* second;
+  ASSERT_TRUE(!NewFileSecondaryCache(env_, dir_, 16000, &second).ok());
+  ASSERT_TRUE(second == nullptr);
+  delete cache;
+  ASSERT_LEVELDB_OK(env_->RemoveFile(dir_ + "/other"));
+  ASSERT_LEVELDB_OK(env_->RemoveFile(dir_ + "/other.scache"));
+}
+
+}  // namespace leveldb
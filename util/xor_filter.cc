@@ -0,0 +1,214 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include <algorithm>
+#include <vector>
+
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+#include "util/coding.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+
+// An xor filter [Graf,Lemire 2020].  The filter is an array of 3*m f-bit
+// fingerprints split into three segments of m slots.  Each key hashes to
+// one slot per segment, and the construction assigns the slots so that
+// the xor of a key's three slots equals the key's fingerprint.  A lookup
+// is three reads, and keys not in the set match with probability 2^-f.
+//
+// The filter is the bit-packed slot array followed by a trailer:
+//    seed: fixed32
+//    m: fixed32
+//    f: uint8
+class XorFilterPolicy : public FilterPolicy {
+ public:
+  explicit XorFilterPolicy(int bits_per_key) {
+    // The slot array takes ~1.23 slots per key.
+    fingerprint_bits_ = static_cast<size_t>(bits_per_key / 1.23);
+    if (fingerprint_bits_ < 1) fingerprint_bits_ = 1;
+    if (fingerprint_bits_ > 16) fingerprint_bits_ = 16;
+  }
+
+  const char* Name() const override { return "leveldb.BuiltinXorFilter"; }
+
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+    // The construction fails on repeated keys, and keys with the same hash
+    // are indistinguishable to the filter anyway, so keep one of each.
+    std::vector<uint32_t> hashes(n);
+    for (int i = 0; i < n; i++) {
+      hashes[i] = XorHash(keys[i]);
+    }
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+    const size_t f = fingerprint_bits_;
+    const size_t num_keys = hashes.size();
+    const size_t m =
+        num_keys == 0 ? 0 : (32 + static_cast<size_t>(num_keys * 1.23)) / 3 + 1;
+
+    std::vector<uint16_t> slots(3 * m, 0);
+    uint32_t seed = 0;
+    if (num_keys > 0) {
+      // Each attempt fails with a small probability; retry with another
+      // seed until one succeeds.
+      while (!Assign(hashes, seed, m, f, &slots)) {
+        seed++;
+      }
+    }
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + (3 * m * f + 7) / 8, 0);
+    char* array = &(*dst)[init_size];
+    for (size_t i = 0; i < slots.size(); i++) {
+      const size_t bitpos = i * f;
+      uint32_t word = static_cast<uint32_t>(slots[i]) << (bitpos % 8);
+      for (char* p = array + bitpos / 8; word != 0; p++, word >>= 8) {
+        *p |= static_cast<char>(word & 0xff);
+      }
+    }
+    PutFixed32(dst, seed);
+    PutFixed32(dst, static_cast<uint32_t>(m));
+    dst->push_back(static_cast<char>(f));
+  }
+
+  bool KeyMayMatch(const Slice& key, const Slice& xor_filter) const override {
+    const size_t len = xor_filter.size();
+    if (len < kTrailerSize) return false;
+
+    const char* array = xor_filter.data();
+    const char* trailer = array + len - kTrailerSize;
+    const uint32_t seed = DecodeFixed32(trailer);
+    const size_t m = DecodeFixed32(trailer + 4);
+    const size_t f = static_cast<unsigned char>(trailer[8]);
+    if (f < 1 || f > 16 || len != (3 * m * f + 7) / 8 + kTrailerSize) {
+      // Reserved for potentially new encodings.  Consider it a match.
+      return true;
+    }
+    if (m == 0) return false;
+
+    const uint64_t h = Mix(XorHash(key), seed);
+    uint32_t fingerprint = Fingerprint(h, f);
+    fingerprint ^= ReadSlot(array, Slot(h, 0, m), f);
+    fingerprint ^= ReadSlot(array, Slot(h, 1, m), f);
+    fingerprint ^= ReadSlot(array, Slot(h, 2, m), f);
+    return fingerprint == 0;
+  }
+
+ private:
+  static const size_t kTrailerSize = 9;
+
+  static uint32_t XorHash(const Slice& key) {
+    return Hash(key.data(), key.size(), 0x7a3f1c95);
+  }
+
+  // Derive a 64-bit hash for an attempt from the key's hash.  This is a
+  // bijection (the finalizer of MurmurHash3), so distinct key hashes never
+  // collide here.
+  static uint64_t Mix(uint32_t key_hash, uint32_t seed) {
+    uint64_t h = (static_cast<uint64_t>(seed) << 32) | key_hash;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+  }
+
+  static uint32_t Fingerprint(uint64_t h, size_t f) {
+    return static_cast<uint32_t>(h ^ (h >> 32)) & ((1u << f) - 1);
+  }
+
+  // Return the slot of the hash in segment "segment" (0, 1 or 2).
+  static size_t Slot(uint64_t h, int segment, size_t m) {
+    const int shift = 21 * segment;
+    const uint64_t rotated =
+        shift == 0 ? h : (h << shift) | (h >> (64 - shift));
+    // Map the low 32 bits uniformly onto [0, m) without a division.
+    const uint64_t r = static_cast<uint32_t>(rotated);
+    return segment * m + static_cast<size_t>((r * m) >> 32);
+  }
+
+  static uint32_t ReadSlot(const char* array, size_t i, size_t f) {
+    // A slot spans at most three bytes.  Reading past the end of the slot
+    // array lands in the trailer, which is never shorter than two bytes.
+    const size_t bitpos = i * f;
+    const unsigned char* p =
+        reinterpret_cast<const unsigned char*>(array) + bitpos / 8;
+    const uint32_t word = p[0] | (p[1] << 8) | (p[2] << 16);
+    return (word >> (bitpos % 8)) & ((1u << f) - 1);
+  }
+
+  // Try to fill *slots so that every hash's three slots xor to its
+  // fingerprint.  Returns false if the hashes cannot be peeled with this
+  // seed.
+  static bool Assign(const std::vector<uint32_t>& hashes, uint32_t seed,
+                     size_t m, size_t f, std::vector<uint16_t>* slots) {
+    // Peel: repeatedly take a slot hit by a single remaining key and
+    // remove that key.  For each slot, track the number of keys hitting
+    // it and the xor of their hashes, which is the hash of the last key
+    // once the count drops to one.
+    std::vector<uint32_t> count(3 * m, 0);
+    std::vector<uint64_t> xor_mask(3 * m, 0);
+    for (size_t i = 0; i < hashes.size(); i++) {
+      const uint64_t h = Mix(hashes[i], seed);
+      for (int s = 0; s < 3; s++) {
+        const size_t slot = Slot(h, s, m);
+        count[slot]++;
+        xor_mask[slot] ^= h;
+      }
+    }
+
+    std::vector<size_t> queue;
+    for (size_t slot = 0; slot < count.size(); slot++) {
+      if (count[slot] == 1) queue.push_back(slot);
+    }
+    // Keys in the order they were peeled, and the slot each one owns.
+    std::vector<std::pair<uint64_t, size_t>> order;
+    order.reserve(hashes.size());
+    while (!queue.empty()) {
+      const size_t slot = queue.back();
+      queue.pop_back();
+      if (count[slot] != 1) continue;
+      const uint64_t h = xor_mask[slot];
+      order.emplace_back(h, slot);
+      for (int s = 0; s < 3; s++) {
+        const size_t other = Slot(h, s, m);
+        count[other]--;
+        xor_mask[other] ^= h;
+        if (count[other] == 1) queue.push_back(other);
+      }
+    }
+    if (order.size() != hashes.size()) {
+      return false;
+    }
+
+    // Assign in reverse peeling order: each key's owned slot is not used
+    // by any key assigned after it.
+    std::fill(slots->begin(), slots->end(), 0);
+    for (size_t i = order.size(); i-- > 0;) {
+      const uint64_t h = order[i].first;
+      const size_t owned = order[i].second;
+      uint32_t value = Fingerprint(h, f);
+      for (int s = 0; s < 3; s++) {
+        const size_t slot = Slot(h, s, m);
+        if (slot != owned) value ^= (*slots)[slot];
+      }
+      (*slots)[owned] = static_cast<uint16_t>(value);
+    }
+    return true;
+  }
+
+  size_t fingerprint_bits_;
+};
+
+}  // namespace
+
+const FilterPolicy* NewXorFilterPolicy(int bits_per_key) {
+  return new XorFilterPolicy(bits_per_key);
+}
+
+}  // namespace leveldb
@@ -0,0 +1,35 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The cases that xor filters share with bloom filters are in bloom_test.cc.
+
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "leveldb/filter_policy.h"
+#include "leveldb/slice.h"
+
+namespace leveldb {
+
+TEST(XorFilterPolicyTest, EmptyFilter) {
+  std::unique_ptr<const FilterPolicy> policy(NewXorFilterPolicy(9));
+  std::string filter;
+  policy->CreateFilter(nullptr, 0, &filter);
+  ASSERT_TRUE(!policy->KeyMayMatch("hello", filter));
+  ASSERT_TRUE(!policy->KeyMayMatch("world", filter));
+}
+
+TEST(XorFilterPolicyTest, DuplicateKeys) {
+  // Construction fails on repeated keys unless they are dropped first.
+  std::unique_ptr<const FilterPolicy> policy(NewXorFilterPolicy(9));
+  const Slice keys[] = {"hello", "hello", "world", "hello"};
+  std::string filter;
+  policy->CreateFilter(keys, 4, &filter);
+  ASSERT_TRUE(policy->KeyMayMatch("hello", filter));
+  ASSERT_TRUE(policy->KeyMayMatch("world", filter));
+  ASSERT_TRUE(!policy->KeyMayMatch("foo", filter));
+}
+
+}  // namespace leveldb